@@ -0,0 +1,204 @@
+# radare - LGPL - Copyright 2022 - bemodtwz
+#
+# Benchmark pdP over a generated corpus of pickles.
+#
+#   python3 bench.py                       # generate corpus, run, print table
+#   python3 bench.py -o baseline.json      # also save results
+#   python3 bench.py -c baseline.json      # compare against saved results
+#   python3 bench.py --scale 10 --huge     # bigger pickles, multi-GB payloads
+#
+# Everything is generated with the local `pickle` module from fixed seeds, so
+# the same arguments always produce the same corpus.
+import argparse
+import json
+import os
+import pickle
+import random
+import subprocess
+import sys
+import time
+
+COMMANDS = ["pdP", "pdPq", "pdPj"]
+PROTOCOLS = range(0, 6)
+
+
+class Call:
+    # pickles as `func(*args)`, every instance is a REDUCE
+    def __init__(self, func, args):
+        self.func = func
+        self.args = args
+
+    def __reduce__(self):
+        return (self.func, self.args)
+
+
+def flat_list(scale, rnd):
+    return [rnd.randint(-2**31, 2**31) for _ in range(100000 * scale)]
+
+
+def deep_nesting(scale, rnd):
+    depth = 500 * scale
+    obj = []
+    for i in range(depth):
+        obj = [i, obj] if i % 2 else {"k%d" % i: obj}
+    return obj
+
+
+def memo_heavy(scale, rnd):
+    shared = [["shared%d" % i, i] for i in range(100)]
+    return [[shared[rnd.randrange(100)] for _ in range(10)] for _ in range(2000 * scale)]
+
+
+def reduce_heavy(scale, rnd):
+    # every reduce gets the same growing list, so add_splits has to walk it
+    shared = []
+    ret = []
+    for i in range(2000 * scale):
+        shared.append(i)
+        ret.append(Call(print, (shared,)))
+    return ret
+
+
+def big_bytes(size):
+    def gen(scale, rnd):
+        # random bytes in 1MiB chunks so generating GBs stays reasonable
+        chunk = rnd.randbytes(1 << 20)
+        return [chunk * max(1, (size * scale) >> 20)]
+    return gen
+
+
+def text_ints(scale, rnd):
+    # protocol 0 writes these as `INT`/`LONG` text opcodes, some too big for 64 bits
+    return [rnd.randint(0, 10**rnd.randint(1, 30)) for _ in range(20000 * scale)]
+
+
+# name: (generator, protocols)
+SHAPES = {
+    "flat_list": (flat_list, PROTOCOLS),
+    "deep_nesting": (deep_nesting, PROTOCOLS),
+    "memo_heavy": (memo_heavy, PROTOCOLS),
+    "reduce_heavy": (reduce_heavy, PROTOCOLS),
+    "bytes_64m": (big_bytes(64 << 20), PROTOCOLS),
+    "text_ints": (text_ints, [0]),
+}
+HUGE_SHAPES = {
+    "bytes_2g": (big_bytes(2 << 30), range(3, 6)),
+}
+
+
+def gen_corpus(path, scale, huge):
+    os.makedirs(path, exist_ok=True)
+    sys.setrecursionlimit(max(10000, 2000 * scale))
+    shapes = dict(SHAPES)
+    if huge:
+        shapes.update(HUGE_SHAPES)
+    files = []
+    for name, (gen, protocols) in shapes.items():
+        obj = None
+        for proto in protocols:
+            fname = os.path.join(path, "%s_s%d_p%d.pickle" % (name, scale, proto))
+            files.append(fname)
+            if os.path.exists(fname):
+                continue
+            if obj is None:
+                obj = gen(scale, random.Random(name))
+            with open(fname, "wb") as fp:
+                pickle.dump(obj, fp, protocol=proto)
+    return files
+
+
+def run_r2(r2, cmd, fname):
+    # returns (seconds, peak rss KiB, stdout)
+    start = time.monotonic()
+    proc = subprocess.Popen(
+        [r2, "-a", "pickle", "-e", "log.level=0", "-qqc", cmd, fname],
+        stdout=subprocess.PIPE, stderr=subprocess.DEVNULL
+    )
+    out = b""
+    while True:
+        chunk = proc.stdout.read(1 << 20)
+        if not chunk:
+            break
+        if cmd.endswith("sj"):
+            out += chunk
+    _, _, usage = os.wait4(proc.pid, 0)
+    secs = time.monotonic() - start
+    rss = usage.ru_maxrss
+    if sys.platform == "darwin":
+        rss //= 1024
+    return secs, rss, out
+
+
+def count_objects(r2, fname):
+    _, _, out = run_r2(r2, "pdPsj", fname)
+    try:
+        return json.loads(out)["objects"]
+    except (ValueError, KeyError):
+        return 0
+
+
+def bench(r2, files, runs):
+    results = {}
+    for fname in files:
+        size = os.path.getsize(fname)
+        objs = count_objects(r2, fname)
+        for cmd in COMMANDS:
+            secs, rss = min(run_r2(r2, cmd, fname)[:2] for _ in range(runs))
+            key = "%s %s" % (cmd, os.path.basename(fname))
+            results[key] = {
+                "bytes": size,
+                "objects": objs,
+                "seconds": round(secs, 4),
+                "mb_s": round(size / (1 << 20) / secs, 3) if secs else 0,
+                "objs_s": round(objs / secs) if secs else 0,
+                "rss_kb": rss,
+            }
+            print("%-40s %10d %8.3fs %10.2f MB/s %12d obj/s %10d KiB" % (
+                key, size, secs, results[key]["mb_s"], results[key]["objs_s"], rss
+            ))
+            sys.stdout.flush()
+    return results
+
+
+def compare(results, baseline, tolerance):
+    worse = 0
+    for key, res in results.items():
+        old = baseline.get(key)
+        if not old or not old["seconds"]:
+            continue
+        ratio = res["seconds"] / old["seconds"]
+        if ratio > 1 + tolerance:
+            worse += 1
+            print("SLOWER %s: %.3fs -> %.3fs (x%.2f)" % (key, old["seconds"], res["seconds"], ratio))
+        elif ratio < 1 - tolerance:
+            print("FASTER %s: %.3fs -> %.3fs (x%.2f)" % (key, old["seconds"], res["seconds"], ratio))
+    return worse
+
+
+def main():
+    ap = argparse.ArgumentParser(description="benchmark pdP over a generated pickle corpus")
+    ap.add_argument("--corpus", default="/tmp/pickle_bench", help="where to generate pickles")
+    ap.add_argument("--scale", type=int, default=1, help="multiply size of every shape")
+    ap.add_argument("--huge", action="store_true", help="also generate multi-GB payloads")
+    ap.add_argument("--runs", type=int, default=3, help="keep the best of N runs")
+    ap.add_argument("--r2", default="r2", help="radare2 binary")
+    ap.add_argument("--filter", default="", help="only run corpus files containing this")
+    ap.add_argument("-o", "--out", help="write results as JSON baseline")
+    ap.add_argument("-c", "--compare", help="compare with JSON baseline")
+    ap.add_argument("--tolerance", type=float, default=0.15, help="allowed slowdown for --compare")
+    args = ap.parse_args()
+
+    files = [f for f in gen_corpus(args.corpus, args.scale, args.huge) if args.filter in f]
+    results = bench(args.r2, files, args.runs)
+    if args.out:
+        with open(args.out, "w") as fp:
+            json.dump({"scale": args.scale, "results": results}, fp, indent=1, sort_keys=True)
+    if args.compare:
+        with open(args.compare) as fp:
+            baseline = json.load(fp)["results"]
+        if compare(results, baseline, args.tolerance):
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,598 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "diff.h"
+#include "plimits.h"
+
+#define DIFF_CALL 2 // step pushed a child, resume once it is done
+#define SUMMARY_STR 48 // longest string shown in a summary
+
+enum {
+	DS_START = 0,
+	DS_REDUCE_ARGS, DS_REDUCE_KWARGS, DS_REDUCE_DONE,
+	DS_ONE_DONE, // persid and readonly buffers
+	DS_LIST_PAIR, DS_LIST_MATCH,
+	DS_DICT,
+};
+
+static const char *kind_names[PD_KIND_COUNT] = {
+	[PD_CHANGED] = "changed",
+	[PD_ADDED] = "added",
+	[PD_REMOVED] = "removed",
+};
+
+static const char kind_marks[PD_KIND_COUNT] = {
+	[PD_CHANGED] = '~',
+	[PD_ADDED] = '+',
+	[PD_REMOVED] = '-',
+};
+
+PDiff *diff_new(void) {
+	PDiff *d = R_NEW0 (PDiff);
+	if (d && !(d->seen = ht_up_new0 ())) {
+		R_FREE (d);
+	}
+	return d;
+}
+
+static void frame_fini(PDiffFrame *f) {
+	free (f->ka);
+	free (f->kb);
+	free (f->used);
+	ht_up_free (f->left_a);
+	ht_up_free (f->left_b);
+}
+
+void diff_free(PDiff *d) {
+	if (d) {
+		ut64 i;
+		for (i = 0; i < d->nentries; i++) {
+			free (d->entries[i].path);
+			free (d->entries[i].path_b);
+		}
+		for (i = 0; i < d->nframes; i++) {
+			frame_fini (&d->frames[i]);
+		}
+		free (d->entries);
+		free (d->frames);
+		ht_up_free (d->seen);
+		free (d);
+	}
+}
+
+static inline bool path_add(RStrBuf *sb, const char *field, ut64 idx, ut64 sub) {
+	return (!field || r_strbuf_append (sb, field))
+		&& (idx == DIFF_NOIDX || r_strbuf_appendf (sb, "[%"PFMT64u"]", idx))
+		&& (sub == DIFF_NOIDX || r_strbuf_appendf (sb, "[%"PFMT64u"]", sub));
+}
+
+// path of the top frame, plus one more component when field or idx is set
+static char *diff_path(PDiff *d, bool side_b, const char *field, ut64 idx) {
+	RStrBuf *sb = r_strbuf_new ("");
+	bool ret = sb != NULL;
+	ut64 i;
+	for (i = 0; ret && i < d->nframes; i++) {
+		PDiffFrame *f = &d->frames[i];
+		ret = path_add (sb, f->field, side_b? f->ib: f->ia, f->sub);
+	}
+	if (ret && (field || idx != DIFF_NOIDX)) {
+		ret = path_add (sb, field, idx, DIFF_NOIDX);
+	}
+	if (!ret) {
+		r_strbuf_free (sb);
+		return NULL;
+	}
+	return r_strbuf_drain (sb);
+}
+
+// for an added or removed kid of the top frame, or the top frame itself when
+// kid is NULL
+static bool diff_add(PDiff *d, PDiffKind kind, PDiffKid *kid, PyObj *a, PyObj *b) {
+	d->count[kind]++;
+	if (d->nentries >= DIFF_KEEP) {
+		return true;
+	}
+	if (!py_grow ((void **)&d->entries, &d->entries_size, d->nentries, sizeof (PDiffEntry))) {
+		return false;
+	}
+	PDiffFrame *top = &d->frames[d->nframes - 1];
+	const char *field = kid? top->kfield: NULL;
+	ut64 idx = kid? kid->idx: DIFF_NOIDX;
+	PDiffEntry *e = &d->entries[d->nentries];
+	memset (e, 0, sizeof (*e));
+	e->kind = kind;
+	e->a = a;
+	e->b = b;
+	e->key = kid? kid->key: NULL;
+	e->path = diff_path (d, kind == PD_ADDED, field, idx);
+	if (!e->path) {
+		return false;
+	}
+	if (kind == PD_CHANGED) {
+		char *path_b = diff_path (d, true, field, idx);
+		if (!path_b) {
+			free (e->path);
+			return false;
+		}
+		if (strcmp (path_b, e->path)) {
+			e->path_b = path_b;
+		} else {
+			free (path_b);
+		}
+	}
+	d->nentries++;
+	return true;
+}
+
+static PDiffFrame *frame_push(PDiff *d, PyObj *a, PyObj *b, const char *field, ut64 ia, ut64 ib, ut64 sub) {
+	if (!limits_poll (d->lim, a? a->offset: 0)
+		|| !py_grow ((void **)&d->frames, &d->frames_size, d->nframes, sizeof (PDiffFrame))
+	) {
+		return NULL;
+	}
+	PDiffFrame *f = &d->frames[d->nframes++];
+	memset (f, 0, sizeof (*f));
+	f->a = a;
+	f->b = b;
+	f->field = field;
+	f->kfield = ".value";
+	f->ia = ia;
+	f->ib = ib;
+	f->sub = sub;
+	return f;
+}
+
+// push a pair of kids, must be the last thing a step does. May move frames
+static inline int kid_call(PDiff *d, int step, PDiffKid *ka, PDiffKid *kb, ut64 sub) {
+	PDiffFrame *f = &d->frames[d->nframes - 1];
+	f->step = step;
+	return frame_push (d, ka->obj, kb->obj, f->kfield, ka->idx, kb->idx, sub)? DIFF_CALL: false;
+}
+
+static inline int field_call(PDiff *d, int step, const char *field, PyObj *a, PyObj *b) {
+	d->frames[d->nframes - 1].step = step;
+	return frame_push (d, a, b, field, DIFF_NOIDX, DIFF_NOIDX, DIFF_NOIDX)? DIFF_CALL: false;
+}
+
+// list elements as pdPj indexes them, it skips a trailing split
+static PDiffKid *kids_list(RList *l, ut64 *n) {
+	*n = 0;
+	PDiffKid *kids = calloc (r_list_length (l) + 1, sizeof (PDiffKid));
+	if (kids) {
+		RListIter *iter;
+		PyObj *obj;
+		r_list_foreach (l, iter, obj) {
+			if (obj->type == PY_SPLIT && !r_list_iter_get_next (iter)) {
+				break;
+			}
+			kids[*n].obj = obj;
+			kids[*n].idx = *n;
+			(*n)++;
+		}
+	}
+	return kids;
+}
+
+// key, value pairs. A split takes up one pair index, like in pdPj
+static PDiffKid *kids_dict(RList *l, ut64 *n) {
+	*n = 0;
+	PDiffKid *kids = calloc (r_list_length (l) / 2 + 1, sizeof (PDiffKid));
+	if (kids) {
+		ut64 idx = 0;
+		RListIter *iter = r_list_head (l);
+		while (iter) {
+			PyObj *key = r_list_iter_get_data (iter);
+			RListIter *next = r_list_iter_get_next (iter);
+			if (key->type == PY_SPLIT) {
+				idx++;
+			} else if (next) {
+				kids[*n].key = key;
+				kids[*n].obj = r_list_iter_get_data (next);
+				kids[(*n)++].idx = idx++;
+				next = r_list_iter_get_next (next);
+			}
+			iter = next;
+		}
+	}
+	return kids;
+}
+
+static inline bool left_add(HtUP *ht, ut64 hash) {
+	size_t n = (size_t)ht_up_find (ht, hash, NULL);
+	return ht_up_update (ht, hash, (void *)(n + 1));
+}
+
+static inline bool left_has(HtUP *ht, ut64 hash) {
+	return ht_up_find (ht, hash, NULL) != NULL;
+}
+
+static inline void left_take(HtUP *ht, ut64 hash) {
+	size_t n = (size_t)ht_up_find (ht, hash, NULL);
+	if (n > 1) {
+		ht_up_update (ht, hash, (void *)(n - 1));
+	} else if (n) {
+		ht_up_delete (ht, hash);
+	}
+}
+
+// common head and tail are equal, a middle of the same length is compared
+// element by element, else elements are matched by hash
+static bool list_start(PDiffFrame *f) {
+	ut64 i = 0;
+	while (i < f->na && i < f->nb && f->ka[i].obj->hash == f->kb[i].obj->hash) {
+		i++;
+	}
+	f->i = f->j = i;
+	f->ea = f->na;
+	f->eb = f->nb;
+	while (f->ea > f->i && f->eb > f->j && f->ka[f->ea - 1].obj->hash == f->kb[f->eb - 1].obj->hash) {
+		f->ea--;
+		f->eb--;
+	}
+	if (f->ea - f->i == f->eb - f->j) {
+		f->step = DS_LIST_PAIR;
+		return true;
+	}
+	f->step = DS_LIST_MATCH;
+	if (!(f->left_a = ht_up_new0 ()) || !(f->left_b = ht_up_new0 ())) {
+		return false;
+	}
+	for (i = f->i; i < f->ea; i++) {
+		if (!left_add (f->left_a, f->ka[i].obj->hash)) {
+			return false;
+		}
+	}
+	for (i = f->j; i < f->eb; i++) {
+		if (!left_add (f->left_b, f->kb[i].obj->hash)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int list_pair(PDiff *d, PDiffFrame *f) {
+	while (f->i < f->ea) {
+		PDiffKid *ka = &f->ka[f->i++];
+		PDiffKid *kb = &f->kb[f->j++];
+		if (ka->obj->hash != kb->obj->hash) {
+			return kid_call (d, DS_LIST_PAIR, ka, kb, DIFF_NOIDX);
+		}
+	}
+	return true;
+}
+
+// an element only one side has is added or removed, two that neither side
+// has a match for are compared, moves show up as a removal and an addition
+static int list_match(PDiff *d, PDiffFrame *f) {
+	while (f->i < f->ea || f->j < f->eb) {
+		PDiffKid *ka = f->i < f->ea? &f->ka[f->i]: NULL;
+		PDiffKid *kb = f->j < f->eb? &f->kb[f->j]: NULL;
+		if (ka && kb && ka->obj->hash == kb->obj->hash) {
+			left_take (f->left_a, ka->obj->hash);
+			left_take (f->left_b, kb->obj->hash);
+			f->i++;
+			f->j++;
+		} else if (ka && kb && !left_has (f->left_b, ka->obj->hash) && !left_has (f->left_a, kb->obj->hash)) {
+			left_take (f->left_a, ka->obj->hash);
+			left_take (f->left_b, kb->obj->hash);
+			f->i++;
+			f->j++;
+			return kid_call (d, DS_LIST_MATCH, ka, kb, DIFF_NOIDX);
+		} else if (ka && (!kb || !left_has (f->left_b, ka->obj->hash))) {
+			left_take (f->left_a, ka->obj->hash);
+			f->i++;
+			if (!diff_add (d, PD_REMOVED, ka, ka->obj, NULL)) {
+				return false;
+			}
+		} else {
+			left_take (f->left_b, kb->obj->hash);
+			f->j++;
+			if (!diff_add (d, PD_ADDED, kb, NULL, kb->obj)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// pairs are matched by key, f->i walks a then f->j the leftovers of b
+static int dict_step(PDiff *d, PDiffFrame *f) {
+	if (!f->left_b) {
+		if (!(f->left_b = ht_up_new0 ()) || !(f->used = calloc (f->nb + 1, sizeof (bool)))) {
+			return false;
+		}
+		ut64 j;
+		for (j = f->nb; j > 0; j--) { // first of two equal keys wins
+			if (!ht_up_update (f->left_b, f->kb[j - 1].key->hash, (void *)(size_t)j)) {
+				return false;
+			}
+		}
+	}
+	while (f->i < f->na) {
+		PDiffKid *ka = &f->ka[f->i++];
+		size_t at = (size_t)ht_up_find (f->left_b, ka->key->hash, NULL);
+		if (!at || f->used[at - 1]) {
+			if (!diff_add (d, PD_REMOVED, ka, ka->obj, NULL)) {
+				return false;
+			}
+			continue;
+		}
+		f->used[at - 1] = true;
+		PDiffKid *kb = &f->kb[at - 1];
+		if (ka->obj->hash != kb->obj->hash) {
+			return kid_call (d, DS_DICT, ka, kb, 1);
+		}
+	}
+	for (; f->j < f->nb; f->j++) {
+		if (!f->used[f->j] && !diff_add (d, PD_ADDED, &f->kb[f->j], NULL, f->kb[f->j].obj)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int diff_start(PDiff *d, PDiffFrame *f) {
+	PyObj *a = f->a, *b = f->b;
+	if (a->refcnt) {
+		if (ht_up_find (d->seen, (ut64)(size_t)a, NULL)) {
+			return true; // shared, or a cycle
+		}
+		if (!ht_up_insert (d->seen, (ut64)(size_t)a, b)) {
+			return false;
+		}
+	}
+	if (a->hash == b->hash) {
+		return true;
+	}
+	if (a->type != b->type) {
+		return diff_add (d, PD_CHANGED, NULL, a, b);
+	}
+	switch (a->type) {
+	case PY_REDUCE:
+	case PY_INST:
+	case PY_NEWOBJ:
+		return field_call (d, DS_REDUCE_ARGS, ".value.glob", a->reduce.glob, b->reduce.glob);
+	case PY_PERSID:
+		return field_call (d, DS_ONE_DONE, ".value", a->py_pid, b->py_pid);
+	case PY_BUFFER_RO:
+		return field_call (d, DS_ONE_DONE, ".value", a->py_robuf, b->py_robuf);
+	case PY_FROZEN_SET:
+	case PY_SET:
+	case PY_LIST:
+	case PY_TUPLE:
+		f->ka = kids_list (a->py_iter, &f->na);
+		f->kb = kids_list (b->py_iter, &f->nb);
+		if (!f->ka || !f->kb || !list_start (f)) {
+			return false;
+		}
+		return f->step == DS_LIST_PAIR? list_pair (d, f): list_match (d, f);
+	case PY_DICT:
+		f->ka = kids_dict (a->py_iter, &f->na);
+		f->kb = kids_dict (b->py_iter, &f->nb);
+		if (!f->ka || !f->kb) {
+			return false;
+		}
+		return dict_step (d, f);
+	default:
+		// scalars, globals and PY_WHAT are compared as a whole
+		return diff_add (d, PD_CHANGED, NULL, a, b);
+	}
+}
+
+static int diff_step(PDiff *d, PDiffFrame *f) {
+	PyObj *a = f->a, *b = f->b;
+	switch (f->step) {
+	case DS_START:
+		return diff_start (d, f);
+	case DS_REDUCE_ARGS:
+		return field_call (d, DS_REDUCE_KWARGS, ".value.args", a->reduce.args, b->reduce.args);
+	case DS_REDUCE_KWARGS:
+		if (a->reduce.kwargs && b->reduce.kwargs) {
+			return field_call (d, DS_REDUCE_DONE, ".value.kwargs", a->reduce.kwargs, b->reduce.kwargs);
+		}
+		if (a->reduce.kwargs || b->reduce.kwargs) {
+			PDiffKind kind = a->reduce.kwargs? PD_REMOVED: PD_ADDED;
+			// reported as the kwargs itself
+			PDiffFrame *k = frame_push (d, a->reduce.kwargs, b->reduce.kwargs, ".value.kwargs", DIFF_NOIDX, DIFF_NOIDX, DIFF_NOIDX);
+			bool ret = k && diff_add (d, kind, NULL, a->reduce.kwargs, b->reduce.kwargs);
+			if (k) {
+				d->nframes--;
+			}
+			return ret;
+		}
+		return true;
+	case DS_LIST_PAIR:
+		return list_pair (d, f);
+	case DS_LIST_MATCH:
+		return list_match (d, f);
+	case DS_DICT:
+		return dict_step (d, f);
+	default:
+		return true;
+	}
+}
+
+// run frames until the one just pushed is done
+static bool diff_run(PDiff *d) {
+	ut64 base = d->nframes - 1;
+	while (d->nframes > base) {
+		PDiffFrame *f = &d->frames[d->nframes - 1];
+		int r = diff_step (d, f);
+		if (r == DIFF_CALL) {
+			continue;
+		}
+		frame_fini (&d->frames[d->nframes - 1]);
+		d->nframes--;
+		if (!r) {
+			while (d->nframes > base) {
+				frame_fini (&d->frames[--d->nframes]);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool diff_lists(PDiff *d, const char *field, ut64 idx, const char *kfield, RList *a, RList *b) {
+	PDiffFrame *f = frame_push (d, NULL, NULL, field, idx, idx, DIFF_NOIDX);
+	if (!f) {
+		return false;
+	}
+	f->kfield = kfield;
+	f->ka = kids_list (a, &f->na);
+	f->kb = kids_list (b, &f->nb);
+	if (!f->ka || !f->kb || !list_start (f)) {
+		frame_fini (f);
+		d->nframes--;
+		return false;
+	}
+	return diff_run (d);
+}
+
+// objects must be hashed already, see hash_state
+bool diff_states(PDiff *d, PMState *a, PMState *b) {
+	d->lim = &a->limits;
+	limits_phase (d->lim, "diff");
+	ut64 i = 0;
+	RListIter *ia = r_list_head (a->metastack);
+	RListIter *ib = r_list_head (b->metastack);
+	for (; ia && ib; ia = r_list_iter_get_next (ia), ib = r_list_iter_get_next (ib), i++) {
+		if (!diff_lists (d, "metastack", i, NULL, r_list_iter_get_data (ia), r_list_iter_get_data (ib))) {
+			return false;
+		}
+	}
+	return diff_lists (d, NULL, DIFF_NOIDX, ".stack", a->stack, b->stack)
+		&& diff_lists (d, NULL, DIFF_NOIDX, ".popstack", a->popstack, b->popstack);
+}
+
+static inline bool glob_summary(RStrBuf *sb, PyObj *g) {
+	if (g->type != PY_GLOB || g->py_glob.module->type != PY_STR || g->py_glob.name->type != PY_STR) {
+		return r_strbuf_append (sb, py_type_to_name (g->type));
+	}
+	return r_strbuf_appendf (sb, "%s.%s", g->py_glob.module->py_str, g->py_glob.name->py_str);
+}
+
+// type and a short value, `int 3`, `str "abc"`, `list len 2`, `reduce os.system`
+static char *obj_summary(PyObj *o) {
+	RStrBuf *sb = r_strbuf_new (py_type_to_name (o->type));
+	bool ret = sb != NULL;
+	if (!ret) {
+		return NULL;
+	}
+	switch (o->type) {
+	case PY_INT:
+		ret = r_strbuf_appendf (sb, " %d", o->py_int);
+		break;
+	case PY_FLOAT:
+		ret = r_strbuf_appendf (sb, " %g", o->py_float);
+		break;
+	case PY_BOOL:
+		ret = r_strbuf_append (sb, o->py_bool? " True": " False");
+		break;
+	case PY_EXT:
+		ret = r_strbuf_appendf (sb, " %"PFMT64u, o->py_extnum);
+		break;
+	case PY_STR: {
+		const char *s = r_str_get (o->py_str);
+		int len = strlen (s);
+		ret = r_strbuf_appendf (sb, " \"%.*s%s\"", R_MIN (len, SUMMARY_STR), s, len > SUMMARY_STR? "...": "");
+		break;
+	}
+	case PY_GLOB:
+		ret = r_strbuf_append (sb, " ") && glob_summary (sb, o);
+		break;
+	case PY_REDUCE:
+	case PY_INST:
+	case PY_NEWOBJ:
+		ret = r_strbuf_append (sb, " ") && glob_summary (sb, o->reduce.glob);
+		break;
+	case PY_FROZEN_SET:
+	case PY_SET:
+	case PY_LIST:
+	case PY_TUPLE:
+		ret = r_strbuf_appendf (sb, " len %d", r_list_length (o->py_iter));
+		break;
+	case PY_DICT:
+		ret = r_strbuf_appendf (sb, " len %d", r_list_length (o->py_iter) / 2);
+		break;
+	default:
+		break;
+	}
+	ret = ret && r_strbuf_appendf (sb, " (0x%"PFMT64x")", o->offset);
+	if (!ret) {
+		r_strbuf_free (sb);
+		return NULL;
+	}
+	return r_strbuf_drain (sb);
+}
+
+static inline bool summary_add(RStrBuf *sb, const char *pre, PyObj *o) {
+	char *s = obj_summary (o);
+	bool ret = s && r_strbuf_appendf (sb, "%s%s", pre, s);
+	free (s);
+	return ret;
+}
+
+// `## diff: C changed, A added, R removed`, then `~ path a -> b`, `+ path b`
+// or `- path a`, dict pairs as `key: value`
+bool diff_dump(RStrBuf *sb, PDiff *d) {
+	bool ret = r_strbuf_appendf (sb, "## diff: %"PFMT64u" changed, %"PFMT64u" added, %"PFMT64u" removed\n",
+		d->count[PD_CHANGED], d->count[PD_ADDED], d->count[PD_REMOVED]);
+	ut64 i;
+	for (i = 0; ret && i < d->nentries; i++) {
+		PDiffEntry *e = &d->entries[i];
+		ret = r_strbuf_appendf (sb, "%c %s", kind_marks[e->kind], e->path);
+		if (ret && e->path_b) {
+			ret = r_strbuf_appendf (sb, " (%s)", e->path_b);
+		}
+		if (ret && e->key) {
+			ret = summary_add (sb, " ", e->key) && r_strbuf_append (sb, ":");
+		}
+		if (ret && e->a) {
+			ret = summary_add (sb, " ", e->a);
+		}
+		if (ret && e->b) {
+			ret = summary_add (sb, e->a? " -> ": " ", e->b);
+		}
+		ret = ret && r_strbuf_append (sb, "\n");
+	}
+	ut64 total = d->count[PD_CHANGED] + d->count[PD_ADDED] + d->count[PD_REMOVED];
+	if (ret && total > d->nentries) {
+		ret = r_strbuf_appendf (sb, "## ... %"PFMT64u" more\n", total - d->nentries);
+	}
+	return ret;
+}
+
+static inline bool pj_obj_summary(PJ *pj, const char *k, PyObj *o) {
+	char *s = obj_summary (o);
+	bool ret = s && pj_ko (pj, k)
+		&& pj_kn (pj, "offset", o->offset)
+		&& pj_ks (pj, "type", py_type_to_name (o->type))
+		&& pj_ks (pj, "summary", s)
+		&& pj_end (pj);
+	free (s);
+	return ret;
+}
+
+// "changed", "added", "removed" counts, then "diffs": [{"op", "path",
+// "path_b", "key", "a", "b"}] with {"offset", "type", "summary"} objects
+bool diff_dump_json(PJ *pj, PDiff *d) {
+	bool ret = true;
+	int k;
+	for (k = 0; ret && k < PD_KIND_COUNT; k++) {
+		ret = pj_kn (pj, kind_names[k], d->count[k]) != NULL;
+	}
+	ret = ret && pj_ka (pj, "diffs");
+	ut64 i;
+	for (i = 0; ret && i < d->nentries; i++) {
+		PDiffEntry *e = &d->entries[i];
+		ret = pj_o (pj)
+			&& pj_ks (pj, "op", kind_names[e->kind])
+			&& pj_ks (pj, "path", e->path)
+			&& (!e->path_b || pj_ks (pj, "path_b", e->path_b))
+			&& (!e->key || pj_obj_summary (pj, "key", e->key))
+			&& (!e->a || pj_obj_summary (pj, "a", e->a))
+			&& (!e->b || pj_obj_summary (pj, "b", e->b))
+			&& pj_end (pj);
+	}
+	return ret && pj_end (pj);
+}
@@ -0,0 +1,63 @@
+#ifndef DIFF_PICKLE
+#define DIFF_PICKLE
+#include "pyobjutil.h"
+
+// pdPd, structural diff of two decoded pickles. Both are hashed in full mode
+// first (see hash.h), then walked side by side from the stacks down. Equal
+// subtree hashes end the walk there, so the cost follows what changed, not
+// the size of the pickles. Lists are matched by element hash, after trimming
+// the common head and tail, dicts by key hash. Paths are the ones pdPj uses
+// for prev_seen, with the dict pair index and 0 or 1 for key or value.
+#define DIFF_KEEP 4096 // entries kept for the report, the rest are only counted
+#define DIFF_NOIDX UT64_MAX
+
+typedef enum pickle_diff_kind {
+	PD_CHANGED = 0, PD_ADDED, PD_REMOVED,
+	PD_KIND_COUNT
+} PDiffKind;
+
+typedef struct pickle_diff_entry {
+	PDiffKind kind;
+	char *path; // in a, in b for an added one
+	char *path_b; // changed only, NULL when it is the same as path
+	PyObj *a, *b; // NULL on the side it is missing from
+	PyObj *key; // dict key of an added or removed pair, its value is a or b
+} PDiffEntry;
+
+// a child of a list or dict, idx is its index in pdPj's paths
+typedef struct pickle_diff_kid {
+	PyObj *key; // NULL for lists
+	PyObj *obj;
+	ut64 idx;
+} PDiffKid;
+
+typedef struct pickle_diff_frame {
+	PyObj *a, *b; // NULL for a top level list
+	const char *field; // path component, ".value" or "metastack", NULL for none
+	const char *kfield; // and the one of its kids
+	ut64 ia, ib; // index into the parent list, DIFF_NOIDX for none
+	ut64 sub; // 1 for a dict value, DIFF_NOIDX for none
+	ut32 step;
+	PDiffKid *ka, *kb;
+	ut64 na, nb;
+	ut64 i, j, ea, eb; // alignment cursors and ends
+	HtUP *left_a, *left_b; // hash -> count of the unaligned kids left
+	bool *used; // per kb, paired with a kid of a
+} PDiffFrame;
+
+typedef struct pickle_diff {
+	PDiffEntry *entries;
+	ut64 nentries, entries_size;
+	ut64 count[PD_KIND_COUNT];
+	PDiffFrame *frames;
+	ut64 nframes, frames_size;
+	HtUP *seen; // shared objects of a already compared
+	PLimits *lim;
+} PDiff;
+
+PDiff *diff_new(void);
+void diff_free(PDiff *d);
+bool diff_states(PDiff *d, PMState *a, PMState *b);
+bool diff_dump(RStrBuf *sb, PDiff *d);
+bool diff_dump_json(PJ *pj, PDiff *d);
+#endif
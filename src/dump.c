@@ -1,4 +1,9 @@
 #include "dump.h"
+#include "plimits.h"
+#include "skeleton.h"
+#include "rle.h"
+#include "tensor.h"
+#include "policy.h"
 
 #define PALCOLOR(x) nfo->pal && nfo->pal->x? nfo->pal->x: ""
 #define PCOLOR_SET(x) printer_append (nfo, PALCOLOR (x))
@@ -7,8 +12,6 @@
 
 #define PSTATE(nfo, x) ((PrState *)r_list_last (nfo->outstack))->x
 
-bool dump_obj_no_pre(PrintInfo *nfo, PyObj *obj);
-
 static inline RStrBuf *printer_getout(PrintInfo *nfo, bool create) {
 	PrState *ps = r_list_last (nfo->outstack);
 	r_return_val_if_fail (ps, NULL);
@@ -20,12 +23,26 @@ static inline RStrBuf *printer_getout(PrintInfo *nfo, bool create) {
 
 static inline void pstate_free(PrState *ps) {
 	if (ps) {
-		r_strbuf_free (ps->out);
+		if (!ps->shared) {
+			r_strbuf_free (ps->out);
+		}
 		free (ps);
 	}
 }
 
-static inline void pstate_drain(PrState *ps, bool freeit) {
+static inline void printer_emit(PrintInfo *nfo, const char *buf) {
+	nfo->out_len += strlen (buf);
+	if (nfo->discard) {
+		return;
+	}
+	if (nfo->sink) {
+		r_strbuf_append (nfo->sink, buf);
+	} else {
+		r_cons_print (buf);
+	}
+}
+
+static inline void pstate_drain(PrintInfo *nfo, PrState *ps, bool freeit) {
 	if (ps && ps->out) {
 		char *buf = NULL;
 		if (freeit) {
@@ -35,14 +52,14 @@ static inline void pstate_drain(PrState *ps, bool freeit) {
 		} else {
 			buf = r_strbuf_drain_nofree (ps->out);
 		}
-		r_cons_print (buf);
+		printer_emit (nfo, buf);
 		free (buf);
 	}
 }
 
 static inline void printer_drain(PrintInfo *nfo) {
 	PrState *ps = r_list_last (nfo->outstack);
-	pstate_drain (ps, false);
+	pstate_drain (nfo, ps, false);
 }
 
 static inline bool printer_append(PrintInfo *nfo, const char *str) {
@@ -81,6 +98,16 @@ static inline PrState *printer_push_state(PrintInfo *nfo, bool prepend) {
 	if (last) {
 		memcpy (ps, last, sizeof (*ps));
 		ps->out = NULL;
+		ps->shared = false;
+		// nothing else is written to `last` until this state is popped, so
+		// rather than appending our buffer to its buffer on pop write there
+		if (!prepend) {
+			if (!last->out) {
+				last->out = r_strbuf_new ("");
+			}
+			ps->out = last->out;
+			ps->shared = ps->out? true: false;
+		}
 	}
 	ps->prepend = prepend;
 	return ps;
@@ -92,8 +119,8 @@ static bool printer_pop_state(PrintInfo *nfo) {
 	r_return_val_if_fail (ps, false);
 	bool ret = true;
 	if (ps->prepend) {
-		pstate_drain (ps, true);
-	} else {
+		pstate_drain (nfo, ps, true);
+	} else if (!ps->shared) {
 		if (ps->out && r_strbuf_length (ps->out)) {
 			char *buf = r_strbuf_drain (ps->out);
 			ps->out = NULL;
@@ -128,14 +155,28 @@ static inline char *glob_varname(PyObj *obj) {
 	return r_str_newf ("g_x%" PFMT64x, obj->offset);
 }
 
+#define FLAG_PRE "pick."
+#define FLAG_SPACE "pickle"
+
+// user chosen name from a pick.* flag, if any. Objects can share an offset
+// (a GLOBAL and the INST calling it), the first one named owns the flag.
+static inline const char *flag_varname(PrintInfo *nfo, PyObj *obj) {
+	if (!nfo->names) {
+		return NULL;
+	}
+	bool found = false;
+	PyObj *first = ht_up_find (nfo->named, obj->offset, &found);
+	if (!found && ht_up_insert (nfo->named, obj->offset, obj)) {
+		first = obj;
+	}
+	return first == obj? ht_up_find (nfo->names, obj->offset, NULL): NULL;
+}
+
 static inline const char *obj_varname(PrintInfo *nfo, PyObj *obj) {
-	const char *pre = "pick.";
-	if (!obj->noflags && nfo->flags) {
-		RFlagItem *f = r_flag_get_at (nfo->flags,  obj->offset, false);
-		if (f && r_str_startswith (f->name, pre)) {
-			obj->varname = strdup (f->name + strlen (pre));
-			return obj->varname;
-		}
+	const char *name = obj->noflags || obj->varname? NULL: flag_varname (nfo, obj);
+	if (name) {
+		obj->varname = strdup (name);
+		return obj->varname;
 	}
 
 	if (!obj->varname) {
@@ -212,15 +253,6 @@ static inline const char *obj_varname(PrintInfo *nfo, PyObj *obj) {
 			break;
 		}
 	}
-
-	if (nfo->setflags && nfo->flags) {
-		char *n = r_str_newf ("%s%s", pre, obj->varname);
-		if (n) {
-			r_flag_set (nfo->flags, n, obj->offset, 1);
-			free (n);
-		}
-	}
-
 	return obj->varname;
 }
 
@@ -343,22 +375,6 @@ static inline bool dump_ext(PrintInfo *nfo, PyObj *obj) {
 		&& newline (nfo);
 }
 
-static inline bool dump_persid(PrintInfo *nfo, PyObj *obj) {
-	PREPRINT (nfo, obj);
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
-	}
-	ps->first = false;
-	ps->ret = false;
-	return  printer_appendf (nfo, "%spersistent_load%s(",
-		  PALCOLOR (var), PALCOLOR (reset))
-		&& dump_obj (nfo, obj->py_pid)
-		&& printer_appendf (nfo, ")")
-		&& printer_pop_state (nfo)
-		&& newline (nfo);
-}
-
 static inline bool dump_buf(PrintInfo *nfo, PyObj *obj) {
 	PREPRINT (nfo, obj);
 	return  printer_appendf (nfo, "%spickle_buffer_at%s(%s0x%"PFMT64x"%s)",
@@ -367,21 +383,6 @@ static inline bool dump_buf(PrintInfo *nfo, PyObj *obj) {
 		&& newline (nfo);
 }
 
-static inline bool dump_buf_ro(PrintInfo *nfo, PyObj *obj) {
-	PREPRINT (nfo, obj);
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
-	}
-	ps->first = false;
-	ps->ret = false;
-	return dump_obj (nfo, obj->py_robuf)
-	  && printer_appendf (nfo, ".%storeadonly%s()",
-		  PALCOLOR (var), PALCOLOR (reset))
-		&& printer_pop_state (nfo)
-		&& newline (nfo);
-}
-
 static inline bool dump_int(PrintInfo *nfo, PyObj *obj) {
 	PREPRINT (nfo, obj);
 	return printer_append (nfo, PALCOLOR (num))
@@ -411,90 +412,254 @@ static inline bool dump_none(PrintInfo *nfo, PyObj *obj) {
 	return ret;
 }
 
-static inline bool dump_reduce(PrintInfo *nfo, PyObj *obj) {
+static inline bool dump_tensor(PrintInfo *nfo, PyObj *obj, PTensor *t) {
 	PREPRINT (nfo, obj);
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
-	}
-	ps->first = false;
-	ps->ret = false;
-	PyObj *oldred = nfo->reduce;
-	nfo->reduce = obj;
+	RStrBuf sb;
+	r_strbuf_init (&sb);
+	bool ret = tensor_dump (&sb, t)
+		&& printer_append (nfo, r_strbuf_get (&sb))
+		&& newline (nfo);
+	r_strbuf_fini (&sb);
+	tensor_resolve (t, nfo->recurse);
+	return ret;
+}
 
-	// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
-	obj->reduce.glob->refcnt++;
-	bool ret = dump_obj (nfo, obj->reduce.glob);
-	if (obj->reduce.args->type != PY_TUPLE) {
-		ret = ret
-			&& printer_append (nfo, "(*")
-			&& dump_obj (nfo, obj->reduce.args)
-			&& printer_append (nfo, ")");
-	} else {
-		ret = ret && dump_obj (nfo, obj->reduce.args);
+// Dumpers of objects that contain other objects are small state machines
+// over a DumpFrame. They ask for a child with dump_call and are resumed, at
+// f->step, with the child's result in `rv`. dump_obj runs them all on a heap
+// allocated work stack, so nesting is only limited by memory.
+#define DUMP_CALL 2 // step returned after pushing a child
+
+enum {
+	DF_NONE = 0, // leaf, printed in place
+	DF_OBJ, DF_PERSID, DF_BUF_RO, DF_TUPLE, DF_REDUCE, DF_INST, DF_NEWOBJ,
+	DF_ITER, DF_ITER_LOOP, DF_DICT, DF_GLOB, DF_WHAT, DF_WHAT_LOOP, DF_OPER,
+	DF_COUNT
+};
+
+struct dump_frame {
+	ut8 kind;
+	ut8 step; // where to resume once the child returns
+	bool ret;
+	bool flag; // dump_obj: pushed a prepend state, iters: tabbed, dump_iter: continuing
+	bool onkey; // dicts and setitems
+	PyObj *obj;
+	PyObj *oldred; // reduce the parent was printing
+	PyOper *pop; // opers
+	const char *vn; // opers, varname of the PY_WHAT
+	RListIter *iter;
+	PSkel skel; // iters, elided elements in skeleton mode
+
+	// lists and tuples printed with runs compacted
+	bool rle;
+	bool concat; // printed a run, brackets are concatenated
+	ut8 seg; // SEG_*
+	ut8 run_kind;
+	ut32 seg_len; // elements since the bracket opened
+	ut64 run; // length of the run being printed
+	ut64 norun; // elements left before looking for a run again
+};
+
+enum { SEG_EMPTY = 0, SEG_OPEN, SEG_CLOSED }; // DumpFrame.seg
+
+typedef int (*DumpStep)(PrintInfo *nfo, DumpFrame *f, bool rv);
+
+// may move the stack, parent frame pointers are stale afterwards
+static inline DumpFrame *frame_push(PrintInfo *nfo, int kind, PyObj *obj) {
+	if (nfo->nframes == nfo->frames_size) {
+		ut32 size = nfo->frames_size? nfo->frames_size * 2: 64;
+		DumpFrame *frames = realloc (nfo->frames, size * sizeof (DumpFrame));
+		if (!frames) {
+			R_LOG_ERROR ("Failed to grow printer stack");
+			return NULL;
+		}
+		nfo->frames = frames;
+		nfo->frames_size = size;
+	}
+	DumpFrame *f = &nfo->frames[nfo->nframes++];
+	memset (f, 0, sizeof (*f));
+	f->kind = kind;
+	f->obj = obj;
+	return f;
+}
+
+// print `obj`, then resume `f` at `step`. Must be the last thing a step does
+static inline int dump_call(PrintInfo *nfo, DumpFrame *f, int step, PyObj *obj) {
+	f->step = step;
+	return frame_push (nfo, DF_OBJ, obj)? DUMP_CALL: false;
+}
+
+static int step_persid(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		PREPRINT (nfo, obj);
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
+		if (!printer_appendf (nfo, "%spersistent_load%s(", PALCOLOR (var), PALCOLOR (reset))) {
+			return false;
+		}
+		return dump_call (nfo, f, 1, obj->py_pid);
 	}
-	obj->reduce.resolved = nfo->recurse;
-	nfo->reduce = oldred;
-	obj->reduce.glob->refcnt--;
-	return printer_pop_state (nfo) && ret && newline (nfo);
+	return rv
+		&& printer_appendf (nfo, ")")
+		&& printer_pop_state (nfo)
+		&& newline (nfo);
 }
 
-static inline bool dump_inst(PrintInfo *nfo, PyObj *obj) {
-	r_return_val_if_fail (obj->reduce.args->type == PY_TUPLE, false);
-	// if there are args, it acts just like reduce
-	if (r_list_length (obj->reduce.args->py_iter)) {
-		return dump_reduce (nfo, obj);
+static int step_buf_ro(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		PREPRINT (nfo, obj);
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
+		return dump_call (nfo, f, 1, obj->py_robuf);
 	}
+	return rv
+		&& printer_appendf (nfo, ".%storeadonly%s()", PALCOLOR (var), PALCOLOR (reset))
+		&& printer_pop_state (nfo)
+		&& newline (nfo);
+}
 
-	PREPRINT (nfo, obj);
-	// no args? It's not so simple, see _instantiate in pickle.py
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
+static int step_tuple(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	if (!f->step) {
+		PREPRINT (nfo, f->obj);
+		f->step = 1;
+		return frame_push (nfo, DF_ITER_LOOP, f->obj)? DUMP_CALL: false;
 	}
-	ps->first = false;
-	ps->ret = false;
+	return rv && newline (nfo);
+}
 
-	// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
-	obj->reduce.glob->refcnt++;
-	bool ret = printer_append (nfo, "_instantiate(")
-		&& dump_obj (nfo, obj->reduce.glob)
-		&& printer_append (nfo, ")");
+static int step_reduce(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	switch (f->step) {
+	case 0: {
+		PREPRINT (nfo, obj);
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
+		f->oldred = nfo->reduce;
+		nfo->reduce = obj;
+
+		// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
+		obj->reduce.glob->refcnt++;
+		return dump_call (nfo, f, 1, obj->reduce.glob);
+	}
+	case 1:
+		f->ret = rv;
+		if (obj->reduce.args->type != PY_TUPLE) {
+			if (f->ret && printer_append (nfo, "(*")) {
+				return dump_call (nfo, f, 2, obj->reduce.args);
+			}
+			f->ret = false;
+		} else if (f->ret) {
+			return dump_call (nfo, f, 3, obj->reduce.args);
+		}
+		break;
+	case 2:
+		f->ret = rv && printer_append (nfo, ")");
+		break;
+	default:
+		f->ret = rv;
+		break;
+	}
 	obj->reduce.resolved = nfo->recurse;
+	nfo->reduce = f->oldred;
 	obj->reduce.glob->refcnt--;
-	return printer_pop_state (nfo) && ret && newline (nfo);
+	return printer_pop_state (nfo) && f->ret && newline (nfo);
 }
 
-static inline bool dump_newobj(PrintInfo *nfo, PyObj *obj) {
-	PREPRINT (nfo, obj);
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
-	}
-	ps->first = false;
-	ps->ret = false;
+static int step_inst(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		r_return_val_if_fail (obj->reduce.args->type == PY_TUPLE, false);
+		// if there are args, it acts just like reduce
+		if (r_list_length (obj->reduce.args->py_iter)) {
+			f->kind = DF_REDUCE;
+			return step_reduce (nfo, f, rv);
+		}
 
-	// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
-	obj->reduce.glob->refcnt++;
+		PREPRINT (nfo, obj);
+		// no args? It's not so simple, see _instantiate in pickle.py
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
 
+		// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
+		obj->reduce.glob->refcnt++;
+		if (printer_append (nfo, "_instantiate(")) {
+			return dump_call (nfo, f, 1, obj->reduce.glob);
+		}
+		f->ret = false;
+	} else {
+		f->ret = rv && printer_append (nfo, ")");
+	}
+	obj->reduce.resolved = nfo->recurse;
+	obj->reduce.glob->refcnt--;
+	return printer_pop_state (nfo) && f->ret && newline (nfo);
+}
+
+static int step_newobj(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
 	/* obj = cls.__new__(cls, *args, **kwargs) */
-	bool ret = dump_obj (nfo, obj->reduce.glob)
-		&& printer_append (nfo, ".__new__(")
-		&& dump_obj (nfo, obj->reduce.glob)
-		&& printer_append (nfo, ", *")
-		&& dump_obj (nfo, obj->reduce.args);
+	switch (f->step) {
+	case 0: {
+		PREPRINT (nfo, obj);
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
 
-	if (ret && obj->reduce.kwargs) {
-		ret = printer_append (nfo, ", **")
-			&& dump_obj (nfo, obj->reduce.kwargs);
+		// HACK: artificially inflate to ensure it gets a variable, do not return without fixing
+		obj->reduce.glob->refcnt++;
+		return dump_call (nfo, f, 1, obj->reduce.glob);
 	}
-	ret = ret && printer_append (nfo, ")");
+	case 1:
+		if (rv && printer_append (nfo, ".__new__(")) {
+			return dump_call (nfo, f, 2, obj->reduce.glob);
+		}
+		f->ret = false;
+		break;
+	case 2:
+		if (rv && printer_append (nfo, ", *")) {
+			return dump_call (nfo, f, 3, obj->reduce.args);
+		}
+		f->ret = false;
+		break;
+	case 3:
+		f->ret = rv;
+		if (f->ret && obj->reduce.kwargs) {
+			if (printer_append (nfo, ", **")) {
+				return dump_call (nfo, f, 4, obj->reduce.kwargs);
+			}
+			f->ret = false;
+		}
+		break;
+	default:
+		f->ret = rv;
+		break;
+	}
+	f->ret = f->ret && printer_append (nfo, ")");
 	obj->reduce.glob->refcnt--;
 	obj->reduce.resolved = nfo->recurse;
-	return printer_pop_state (nfo) && ret && newline (nfo);
+	return printer_pop_state (nfo) && f->ret && newline (nfo);
 }
 
-
 static inline bool print_tabs(PrintInfo *nfo) {
 	int i;
 	if (!printer_append (nfo, "\n")) {
@@ -546,276 +711,453 @@ static bool iter_multi_line(PrintInfo *nfo, RListIter *iter, int depth) {
 	return true;
 }
 
-static inline bool dump_iter_loop(PrintInfo *nfo, PyObj *obj_iter) {
-	char *start, *end;
-	bool ret = iter_get_wrap (obj_iter->type, &start, &end);
-	if (!ret || !printer_append (nfo, start)) {
+// skeleton mode, on a line of its own after the opening bracket
+static inline bool skel_start(PrintInfo *nfo, DumpFrame *f) {
+	PShape sh;
+	if (!nfo->skeleton || !shape_get (&sh, f->obj, nfo->skeleton)) {
 		return false;
 	}
+	f->skel = sh.skel;
+	f->flag = true;
+	PSTATE (nfo, tabs)++;
 
-	// recursees, so save and modify nfo state
-	PrState *ps = printer_push_state (nfo, false);
-	ps->first = false;
-	ps->ret = false;
+	RStrBuf sb;
+	r_strbuf_init (&sb);
+	f->ret = shape_dump (&sb, &sh)
+		&& print_tabs (nfo)
+		&& printer_appendf (nfo, "%s## %s%s", PALCOLOR (usercomment), r_strbuf_get (&sb), PALCOLOR (reset));
+	r_strbuf_fini (&sb);
+	return true;
+}
 
-	if (!obj_iter->iter_next) {
-		obj_iter->iter_next = r_list_head (obj_iter->py_iter);
+static inline bool skel_gap(PrintInfo *nfo, DumpFrame *f) {
+	PSkel *sk = &f->skel;
+	// calls in the gap are never printed, splits after them should not wait
+	RListIter *iter;
+	for (iter = sk->gap; iter && iter != sk->resume; iter = r_list_iter_get_next (iter)) {
+		PyObj *obj = r_list_iter_get_data (iter);
+		if (obj_has_reduce (obj)) {
+			obj->reduce.resolved = nfo->recurse;
+		}
 	}
+	f->obj->iter_next = sk->resume;
+	return print_tabs (nfo)
+		&& printer_appendf (nfo, "%s## ... %"PFMT64u" more%s", PALCOLOR (usercomment), sk->elided, PALCOLOR (reset));
+}
 
-	bool tabbed = false;
-	if (iter_multi_line (nfo, obj_iter->iter_next, 3)) {
-		tabbed = true;
+// close the brackets of the elements before a run, `, end` for 1 tuples
+static inline bool rle_close(PrintInfo *nfo, DumpFrame *f) {
+	char *start = "", *end = "";
+	iter_get_wrap (f->obj->type, &start, &end);
+	bool ret = true;
+	if (f->obj->type == PY_TUPLE && f->seg_len == 1) {
+		ret = printer_append (nfo, ",");
+	}
+	if (f->flag) {
+		PrState *ps = r_list_last (nfo->outstack);
+		ps->tabs--;
+		ret = ret && print_tabs (nfo);
 		ps->tabs++;
 	}
+	return ret && printer_append (nfo, end);
+}
 
-	if (!iter_split_stop (nfo, obj_iter)) {
-		while (obj_iter->iter_next) {
-			PyObj *obj = r_list_iter_get_data (obj_iter->iter_next);
-			if (tabbed) {
-				ret &= print_tabs (nfo);
+// `[0] * n`, `(0,) * n` or `[{...} for _ in range(n)]` instead of n elements
+static int rle_next(PrintInfo *nfo, DumpFrame *f) {
+	PyObj *obj_iter = f->obj;
+	RListIter *iter = obj_iter->iter_next;
+	PyObj *obj = r_list_iter_get_data (iter);
+	char *start = "", *end = "";
+	iter_get_wrap (obj_iter->type, &start, &end);
+
+	if (!f->norun) {
+		PRleKind kind;
+		RListIter *next;
+		ut64 n = rle_run (&nfo->rle, iter, obj_iter->type == PY_TUPLE, &kind, &next);
+		if (kind != RLE_NONE && n >= nfo->rle.min) {
+			if (f->seg == SEG_OPEN) {
+				f->ret &= rle_close (nfo, f);
 			}
-			obj_iter->iter_next = r_list_iter_get_next (obj_iter->iter_next);
-			ret &= dump_obj (nfo, obj);
-			if (!ret) {
-				break;
+			if (f->seg != SEG_EMPTY) {
+				f->ret &= printer_append (nfo, " + ") && printer_append (nfo, start);
 			}
-
-			if (iter_split_stop (nfo, obj_iter)) {
-				break;
+			if (kind == RLE_COMP) {
+				f->ret &= rle_inline (&nfo->rle, obj);
 			}
-			ret &= printer_append (nfo, ", ");
+			f->run = n;
+			f->run_kind = kind;
+			obj_iter->iter_next = next;
+			return dump_call (nfo, f, 2, obj);
 		}
+		f->norun = n;
 	}
+	f->norun--;
 
-	printer_pop_state (nfo);
-	if (tabbed) {
-		ret &= print_tabs (nfo);
+	if (f->seg == SEG_OPEN) {
+		f->ret &= printer_append (nfo, ", ");
+	} else if (f->seg == SEG_CLOSED) {
+		f->ret &= printer_append (nfo, " + ") && printer_append (nfo, start);
 	}
-	return ret && printer_append (nfo, end);
+	f->seg = SEG_OPEN;
+	f->seg_len++;
+	if (f->flag) {
+		f->ret &= print_tabs (nfo);
+	}
+	obj_iter->iter_next = r_list_iter_get_next (iter);
+	return dump_call (nfo, f, 1, obj);
 }
 
-static inline bool iter_ready_continue(PrintInfo *nfo, PyObj *obj) {
-	if (obj->varname && obj->iter_next) {
-		PyObj *o = r_list_iter_get_data (obj->iter_next);
-		if (o->type == PY_SPLIT && split_is_resolved (nfo, o)) {
-			return true;
-		}
+static inline bool rle_end(PrintInfo *nfo, DumpFrame *f) {
+	f->seg = SEG_CLOSED;
+	f->seg_len = 0;
+	f->concat = true;
+	if (f->run_kind == RLE_COMP) {
+		return printer_appendf (nfo, " for _ in range(%s%"PFMT64u"%s)]", PALCOLOR (num), f->run, PALCOLOR (reset));
 	}
-	return false;
+	return printer_appendf (nfo, "%s * %s%"PFMT64u"%s",
+		f->obj->type == PY_TUPLE? ",)": "]", PALCOLOR (num), f->run, PALCOLOR (reset));
 }
 
-static inline bool dump_dict(PrintInfo *nfo, PyObj *obj_iter) {
-	if (!printer_append (nfo, "{")) {
-		return false;
+// `(x,)` and `set((x,))` need the comma wherever they are printed, after a
+// run too. Reduce args are printed as the call's own brackets instead.
+static inline bool iter_one_comma(PrintInfo *nfo, DumpFrame *f) {
+	PyObj *obj_iter = f->obj;
+	if (f->concat) {
+		return obj_iter->type == PY_TUPLE && f->seg_len == 1;
 	}
-	// recursees, so save and modify nfo state
-	PrState *ps = printer_push_state (nfo, false);
-	ps->first = false;
-	ps->ret = false;
-
-	if (!obj_iter->iter_next) {
-		obj_iter->iter_next = r_list_head (obj_iter->py_iter);
+	if (r_list_length (obj_iter->py_iter) != 1) {
+		return false;
 	}
-
-	bool tabbed = false;
-	if (iter_multi_line (nfo, obj_iter->iter_next, 6)) {
-		tabbed = true;
-		ps->tabs++;
+	switch (obj_iter->type) {
+	case PY_TUPLE:
+		return !nfo->reduce || nfo->reduce->reduce.args != obj_iter;
+	case PY_SET:
+	case PY_FROZEN_SET:
+		return true;
+	default:
+		return false;
 	}
+}
 
-	bool onkey = true;
-	bool ret = true;
-	if (!iter_split_stop (nfo, obj_iter)) {
-		while (obj_iter->iter_next) {
-			PyObj *obj = r_list_iter_get_data (obj_iter->iter_next);
-			if (tabbed && onkey) {
-				ret &= print_tabs (nfo);
-			}
-
-			obj_iter->iter_next = r_list_iter_get_next (obj_iter->iter_next);
-			ret &= dump_obj (nfo, obj);
-			if (!ret) {
-				break;
-			}
+static int step_iter_loop(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj_iter = f->obj;
+	char *start = "", *end = "";
+	switch (f->step) {
+	case 0: {
+		f->ret = iter_get_wrap (obj_iter->type, &start, &end);
+		if (!f->ret || !printer_append (nfo, start)) {
+			return false;
+		}
 
-			if (iter_split_stop (nfo, obj_iter)) {
-				break;
-			}
+		// recursees, so save and modify nfo state
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
 
-			if (onkey) {
-				ret &= printer_append (nfo, ": ");
-			} else {
-				ret &= printer_append (nfo, ", ");
+		if (!obj_iter->iter_next) {
+			obj_iter->iter_next = r_list_head (obj_iter->py_iter);
+		}
+		if (skel_start (nfo, f)) {
+			if (!f->ret) {
+				goto done;
 			}
-			onkey = !onkey;
+		} else if (iter_multi_line (nfo, obj_iter->iter_next, 3)) {
+			f->flag = true;
+			ps->tabs++;
 		}
+		f->rle = nfo->rle.min && !f->skel.gap
+			&& (obj_iter->type == PY_LIST || obj_iter->type == PY_TUPLE);
+		if (iter_split_stop (nfo, obj_iter)) {
+			goto done;
+		}
+		break;
+	}
+	default:
+		f->ret &= rv;
+		if (f->step == 2) {
+			f->ret = f->ret && rle_end (nfo, f);
+		}
+		if (!f->ret || iter_split_stop (nfo, obj_iter)) {
+			goto done;
+		}
+		if (!f->rle) {
+			f->ret &= printer_append (nfo, ", ");
+		}
+		break;
+	}
+	if (obj_iter->iter_next == f->skel.gap && f->skel.gap) {
+		f->ret &= skel_gap (nfo, f);
+	}
+	if (obj_iter->iter_next && f->rle) {
+		return rle_next (nfo, f);
+	}
+	if (obj_iter->iter_next) {
+		PyObj *obj = r_list_iter_get_data (obj_iter->iter_next);
+		if (f->flag) {
+			f->ret &= print_tabs (nfo);
+		}
+		obj_iter->iter_next = r_list_iter_get_next (obj_iter->iter_next);
+		return dump_call (nfo, f, 1, obj);
 	}
-	printer_pop_state (nfo);
 
-	if (tabbed) {
-		ret &= print_tabs (nfo);
+done:
+	if (iter_one_comma (nfo, f)) {
+		f->ret &= printer_append (nfo, ",");
+	}
+	printer_pop_state (nfo);
+	if (f->seg == SEG_CLOSED) {
+		return f->ret; // ended with a run
 	}
-	return ret && printer_append (nfo, "}");
+	if (f->flag) {
+		f->ret &= print_tabs (nfo);
+	}
+	iter_get_wrap (obj_iter->type, &start, &end);
+	return f->ret && printer_append (nfo, end);
 }
 
-static inline bool dump_iter(PrintInfo *nfo, PyObj *obj) {
-	PrState *ps = NULL;
-	bool ret = true;
-	if (iter_ready_continue (nfo, obj)) {
-		// partially printed, we have to finish it
-		ps = r_list_last (nfo->outstack);
-		if (ps->ret) {
-			ps->first = false;
+static inline bool iter_ready_continue(PrintInfo *nfo, PyObj *obj) {
+	if (obj->varname && obj->iter_next) {
+		PyObj *o = r_list_iter_get_data (obj->iter_next);
+		if (o->type == PY_SPLIT && split_is_resolved (nfo, o)) {
+			return true;
 		}
+	}
+	return false;
+}
 
-		if (!ret || !printer_push_state (nfo, true)) {
+static int step_dict(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj_iter = f->obj;
+	switch (f->step) {
+	case 0: {
+		if (!printer_append (nfo, "{")) {
 			return false;
 		}
+		// recursees, so save and modify nfo state
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
 
-		ret = PCOLORSTR (obj->varname, var);
-
-		switch (obj->type) {
-		case PY_LIST:
-			ret &= printer_appendf (nfo, ".extend(");
-			break;
-		case PY_SET:
-		case PY_FROZEN_SET:
-			ret &= printer_append (nfo, ".update(");
-			break;
-		case PY_DICT:
-			ret &= printer_append (nfo, " |= ");
-			break;
-		default:
-			r_warn_if_reached ();
-			ret = false;
+		if (!obj_iter->iter_next) {
+			obj_iter->iter_next = r_list_head (obj_iter->py_iter);
 		}
-	} else {
-		PREPRINT (nfo, obj);
+		f->onkey = true;
+		f->ret = true;
+		if (skel_start (nfo, f)) {
+			if (!f->ret) {
+				goto done;
+			}
+		} else if (iter_multi_line (nfo, obj_iter->iter_next, 6)) {
+			f->flag = true;
+			ps->tabs++;
+		}
+		if (iter_split_stop (nfo, obj_iter)) {
+			goto done;
+		}
+		break;
 	}
-	if (ret) {
-		if (obj->type == PY_DICT) {
-			ret = dump_dict (nfo, obj);
+	default:
+		f->ret &= rv;
+		if (!f->ret || iter_split_stop (nfo, obj_iter)) {
+			goto done;
+		}
+		if (f->onkey) {
+			f->ret &= printer_append (nfo, ": ");
 		} else {
-			ret = dump_iter_loop (nfo, obj);
+			f->ret &= printer_append (nfo, ", ");
+		}
+		f->onkey = !f->onkey;
+		break;
+	}
+	if (obj_iter->iter_next == f->skel.gap && f->skel.gap) {
+		f->ret &= skel_gap (nfo, f);
+	}
+	if (obj_iter->iter_next) {
+		PyObj *obj = r_list_iter_get_data (obj_iter->iter_next);
+		if (f->flag && f->onkey) {
+			f->ret &= print_tabs (nfo);
 		}
+		obj_iter->iter_next = r_list_iter_get_next (obj_iter->iter_next);
+		return dump_call (nfo, f, 1, obj);
 	}
 
-	if (ps) {
+done:
+	printer_pop_state (nfo);
+	if (f->flag) {
+		f->ret &= print_tabs (nfo);
+	}
+	return f->ret && printer_append (nfo, "}");
+}
+
+static int step_iter(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		f->ret = true;
+		if (iter_ready_continue (nfo, obj)) {
+			// partially printed, we have to finish it
+			PrState *ps = r_list_last (nfo->outstack);
+			if (ps->ret) {
+				ps->first = false;
+			}
+			if (!printer_push_state (nfo, true)) {
+				return false;
+			}
+			f->flag = true;
+
+			f->ret = PCOLORSTR (obj->varname, var);
+			switch (obj->type) {
+			case PY_LIST:
+				f->ret &= printer_appendf (nfo, ".extend(");
+				break;
+			case PY_SET:
+			case PY_FROZEN_SET:
+				f->ret &= printer_append (nfo, ".update(");
+				break;
+			case PY_DICT:
+				f->ret &= printer_append (nfo, " |= ");
+				break;
+			default:
+				r_warn_if_reached ();
+				f->ret = false;
+			}
+		} else {
+			PREPRINT (nfo, obj);
+		}
+		if (f->ret) {
+			f->step = 1;
+			return frame_push (nfo, obj->type == PY_DICT? DF_DICT: DF_ITER_LOOP, obj)? DUMP_CALL: false;
+		}
+	} else {
+		f->ret = rv;
+	}
+
+	if (f->flag) {
 		if (obj->type != PY_DICT) {
-			ret = ret && printer_append (nfo, ")");
+			f->ret = f->ret && printer_append (nfo, ")");
 		}
-		ret = ret && newline (nfo);
-		ret = ret && printer_pop_state (nfo);
+		f->ret = f->ret && newline (nfo);
+		f->ret = f->ret && printer_pop_state (nfo);
 		PREPRINT (nfo, obj);
 	} else {
-		ret &= newline (nfo);
+		f->ret &= newline (nfo);
 	}
-	return ret;
+	return f->ret;
 }
 
-
-static inline bool dump_glob(PrintInfo *nfo, PyObj *obj) {
-	PREPRINT (nfo, obj);
-	bool ret =  printer_append (nfo, "_find_class(" /*)*/);
-	PrState *ps = printer_push_state (nfo, false);
-	if (!ps) {
-		return false;
+static int step_glob(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	switch (f->step) {
+	case 0: {
+		PREPRINT (nfo, obj);
+		f->ret = printer_append (nfo, "_find_class(" /*)*/);
+		PrState *ps = printer_push_state (nfo, false);
+		if (!ps) {
+			return false;
+		}
+		ps->first = false;
+		ps->ret = false;
+		return dump_call (nfo, f, 1, obj->py_glob.module);
 	}
-	ps->first = false;
-	ps->ret = false;
-	ret &= dump_obj (nfo, obj->py_glob.module);
-	ret &= printer_append (nfo, ", ");
-	ret &= dump_obj (nfo, obj->py_glob.name);
-
-	ret &= printer_appendf (nfo, /*(*/", %sproto%s=%s%d%s)",
+	case 1:
+		f->ret &= rv;
+		f->ret &= printer_append (nfo, ", ");
+		return dump_call (nfo, f, 2, obj->py_glob.name);
+	}
+	f->ret &= rv;
+	f->ret &= printer_appendf (nfo, /*(*/", %sproto%s=%s%d%s)",
 		PALCOLOR (var), PALCOLOR (reset), // proto name format
 		PALCOLOR (var), obj->py_glob.proto, PALCOLOR (reset) // proto value
 	);
 
 	printer_pop_state (nfo);
-	ret &= printer_append (nfo, ")");
-	ret &= newline (nfo);
-	return ret;
-}
-
-static inline bool dump_oper_init(PrintInfo *nfo, PyOper *pop, const char *vn) {
-	return
-		PCOLORSTR (vn, var)
-		&& printer_append (nfo, " = ")
-		&& dump_obj (nfo, pop->obj)
-		&& printer_append (nfo, "\n");
-}
-
-static inline bool dump_oper_build(PrintInfo *nfo, PyOper *pop, const char *vn) {
-	PyObj *args = r_list_last (pop->stack);
-	return args
-		&& PCOLORSTR (vn, var)
-		&& printer_appendf (nfo, ".__setstate__(")
-		&& dump_obj (nfo, args) && printer_append (nfo, ")\n");
-}
-
-
-static inline bool dump_oper_meth(PrintInfo *nfo, PyObj *obj, const char *meth, const char *vn) {
-	return obj
-		&& PCOLORSTR (vn, var)
-		&& printer_appendf (nfo, ".%s(", meth)
-		&& dump_obj (nfo, obj)
-		&& printer_append (nfo, ")\n");
+	f->ret &= printer_append (nfo, ")");
+	f->ret &= newline (nfo);
+	return f->ret;
 }
 
-static inline bool dump_oper_meth_s(PrintInfo *nfo, PyOper *pop, const char *meth, const char *vn) {
-	PyObj *obj;
-	RListIter *iter;
-	r_list_foreach (pop->stack, iter, obj) {
-		if (!dump_oper_meth (nfo, obj, meth, vn)) {
-			return false;
-		}
+// start of `vn.meth(obj)`, the step resumed after obj finishes the line
+static inline int oper_meth(PrintInfo *nfo, DumpFrame *f, PyObj *obj, const char *meth) {
+	if (obj && PCOLORSTR (f->vn, var) && printer_appendf (nfo, ".%s(", meth)) {
+		return dump_call (nfo, f, 1, obj);
 	}
-	return true;
+	return false;
 }
 
-static inline bool dump_oper_setitems(PrintInfo *nfo, PyOper *pop, const char *vn) {
-	r_return_val_if_fail (!(r_list_length (pop->stack) % 2), false);
-	bool iskey = true;
+static int step_oper(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyOper *pop = f->pop;
+	const char *vn = f->vn;
 	PyObj *obj;
-	RListIter *iter;
-	r_list_foreach (pop->stack, iter, obj) {
-		if (iskey) { // start
-			if (!PCOLORSTR (vn, var) || !printer_append (nfo, "[")) {
-				return false;
+	switch (pop->op) {
+	case OP_FAKE_INIT:
+		if (!f->step) {
+			if (PCOLORSTR (vn, var) && printer_append (nfo, " = ")) {
+				return dump_call (nfo, f, 1, pop->obj);
 			}
-		} else if (!printer_append (nfo, "] = ")) {// middle
 			return false;
 		}
-
-		// key/value
-		if (!dump_obj (nfo, obj)) {
-			return false;
-		}
-
-		if (!iskey && !printer_append (nfo, "\n")) { // end
+		return rv && printer_append (nfo, "\n");
+	case OP_BUILD:
+		if (!f->step) {
+			PyObj *args = r_list_last (pop->stack);
+			if (args && PCOLORSTR (vn, var) && printer_appendf (nfo, ".__setstate__(")) {
+				return dump_call (nfo, f, 1, args);
+			}
 			return false;
 		}
-		iskey = !iskey;
-	}
-	return true;
-}
-
-static inline bool dump_oper(PrintInfo *nfo, PyOper *pop, const char *vn) {
-	switch (pop->op) {
-	case OP_FAKE_INIT:
-		return dump_oper_init (nfo, pop, vn);
-	case OP_BUILD:
-		return dump_oper_build (nfo, pop, vn);
+		return rv && printer_append (nfo, ")\n");
 	case OP_APPEND:
-		return dump_oper_meth (nfo, r_list_last (pop->stack), "append", vn);
+		if (!f->step) {
+			return oper_meth (nfo, f, r_list_last (pop->stack), "append");
+		}
+		return rv && printer_append (nfo, ")\n");
 	case OP_APPENDS:
-		return dump_oper_meth_s (nfo, pop, "append", vn);
 	case OP_ADDITEMS:
-		return dump_oper_meth_s (nfo, pop, "add", vn);
+		if (!f->step) {
+			f->iter = pop->stack? r_list_head (pop->stack): NULL;
+		} else if (!rv || !printer_append (nfo, ")\n")) {
+			return false;
+		}
+		if (!f->iter) {
+			return true;
+		}
+		obj = r_list_iter_get_data (f->iter);
+		f->iter = r_list_iter_get_next (f->iter);
+		return oper_meth (nfo, f, obj, pop->op == OP_APPENDS? "append": "add");
 	case OP_SETITEM:
 	case OP_SETITEMS:
-		return dump_oper_setitems (nfo, pop, vn);
+		if (!f->step) {
+			r_return_val_if_fail (!(r_list_length (pop->stack) % 2), false);
+			f->iter = pop->stack? r_list_head (pop->stack): NULL;
+			f->onkey = true;
+		} else {
+			if (!rv) {
+				return false;
+			}
+			if (!f->onkey && !printer_append (nfo, "\n")) { // end
+				return false;
+			}
+			f->onkey = !f->onkey;
+		}
+		if (!f->iter) {
+			return true;
+		}
+		if (f->onkey) { // start
+			if (!PCOLORSTR (vn, var) || !printer_append (nfo, "[")) {
+				return false;
+			}
+		} else if (!printer_append (nfo, "] = ")) {// middle
+			return false;
+		}
+
+		// key/value
+		obj = r_list_iter_get_data (f->iter);
+		f->iter = r_list_iter_get_next (f->iter);
+		return dump_call (nfo, f, 1, obj);
 	default:
 		R_LOG_ERROR ("Python dumper Can't handle `%s` (%02x) operator yet", py_op_to_name (pop->op), pop->op & 0xff);
 	}
@@ -837,14 +1179,15 @@ static inline bool what_completed(PrintInfo *nfo, PyObj *obj) {
 	return ret;
 }
 
-static inline int what_purge_intermediate(PrintInfo *nfo, PyObj *what) {
+// was an intermediate reduce popped? Then it has to be printed before we go on
+static inline bool what_purge_intermediate(PrintInfo *nfo, PyObj *what) {
 	RListIter *iter = what->iter_next;
 	RListIter *purge_to = NULL;
 	PyOper *pop;
 	r_list_foreach_prev (what->py_what, purge_to, pop) {
 		if (purge_to == iter) {
 			// hit start, nothing to purge, stop
-			return 1;
+			return false;
 		}
 		if (pop->op == OP_FAKE_SPLIT ) {
 			if (pop->obj->split == nfo->reduce || split_is_resolved (nfo, pop->obj)) {
@@ -852,80 +1195,95 @@ static inline int what_purge_intermediate(PrintInfo *nfo, PyObj *what) {
 			}
 		}
 	}
-	r_return_val_if_fail (purge_to, 1);
-
+	r_return_val_if_fail (purge_to, false);
+	return true;
+}
 
-	PSTATE (nfo, first) = true;
-	pop = r_list_iter_get_data (iter);
-	if (!dump_obj (nfo, pop->obj->split)) {
-		return -1;
+// print the next operator on `what`
+static inline int what_oper(PrintInfo *nfo, DumpFrame *f, PyObj *what) {
+	PyOper *pop = r_list_iter_get_data (what->iter_next);
+	what->iter_next = r_list_iter_get_next (what->iter_next);
+	f->step = 2;
+	DumpFrame *c = frame_push (nfo, DF_OPER, what);
+	if (!c) {
+		return false;
 	}
-	PSTATE (nfo, first) = false;
-	return 0; // continue
+	c->pop = pop;
+	c->vn = what->varname;
+	return DUMP_CALL;
 }
 
-// 1 stop
-static inline int what_split_stop(PrintInfo *nfo, PyObj *what) {
+static int step_what_loop(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *what = f->obj;
+	switch (f->step) {
+	case 0:
+		if (!what->iter_next) {
+			what->iter_next = r_list_head (what->py_iter);
+		}
+		break;
+	case 1: // intermediate reduce printed
+		if (!rv) {
+			return false;
+		}
+		PSTATE (nfo, first) = false;
+		what->iter_next = f->iter;
+		return what_oper (nfo, f, what);
+	default:
+		if (!rv) {
+			return false;
+		}
+		break;
+	}
+
 	if (!what->iter_next) { // end
-		return 1; // stop
+		return true;
 	}
 	PyOper *pop = r_list_iter_get_data (what->iter_next);
 	if (pop->op == OP_FAKE_SPLIT) { // not end, but we may have to wait
 		RListIter *next = r_list_iter_get_next (what->iter_next);
 		if (!next) {
-			return 1; // stop
+			return true;
 		}
 
 		if (!split_is_resolved (nfo, pop->obj)) {
 			if (nfo->reduce == pop->obj->split) {
-				return 1;
+				return true;
 			}
 			// unresolved split does not corespond to the current reduce being printed
 			// check if an intermediate reduce was popped
-			int ret = what_purge_intermediate (nfo, what);
-			if (ret) {
-				return ret;
+			if (!what_purge_intermediate (nfo, what)) {
+				return true;
 			}
+			PSTATE (nfo, first) = true;
+			f->iter = next;
+			return dump_call (nfo, f, 1, pop->obj->split);
 		}
 		what->iter_next = next;  // iter resolved, so we skip it
 	}
-	return 0; // continue
-}
-
-static inline bool what_loop(PrintInfo *nfo, PyObj *what) {
-	if (!what->iter_next) {
-		what->iter_next = r_list_head (what->py_iter);
-	}
-	for (;;) {
-		int ret = what_split_stop (nfo, what);
-		if (ret) {
-			return ret < 0? false: true;
-		}
-		PyOper *pop = r_list_iter_get_data (what->iter_next);
-		what->iter_next = r_list_iter_get_next (what->iter_next);
-		if (!dump_oper (nfo, pop, what->varname)) {
-			return false;
-		}
-	}
+	return what_oper (nfo, f, what);
 }
 
-static inline bool dump_what(PrintInfo *nfo, PyObj *what) {
+static int step_what(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *what = f->obj;
 	PrState *ps = r_list_last (nfo->outstack);
-	if (!what_completed (nfo, what)) {
-		// need to print some of `what`
-		if (!obj_varname (nfo, what)) { // populate what->varname
-			return false;
-		}
+	if (!f->step) {
+		if (!what_completed (nfo, what)) {
+			// need to print some of `what`
+			if (!obj_varname (nfo, what)) { // populate what->varname
+				return false;
+			}
 
-		ps = printer_push_state (nfo, ps->ret || !ps->first);
-		if (!ps) {
-			return false;
+			ps = printer_push_state (nfo, ps->ret || !ps->first);
+			if (!ps) {
+				return false;
+			}
+			ps->first = false;
+			ps->ret = false;
+			f->step = 1;
+			return frame_push (nfo, DF_WHAT_LOOP, what)? DUMP_CALL: false;
 		}
-		ps->first = false;
-		ps->ret = false;
-
-		bool ret = what_loop (nfo, what);
-		if (!printer_pop_state (nfo) || !ret) {
+	} else {
+		if (!printer_pop_state (nfo) || !rv) {
 			return false;
 		}
 		ps = r_list_last (nfo->outstack);
@@ -941,18 +1299,43 @@ static inline bool dump_what(PrintInfo *nfo, PyObj *what) {
 	return true;
 }
 
-bool dump_obj_no_pre(PrintInfo *nfo, PyObj *obj) {
+// frame kind for obj, DF_NONE for leaves
+static inline int dump_kind(PyObj *obj) {
+	switch (obj->type) {
+	case PY_PERSID:
+		return DF_PERSID;
+	case PY_BUFFER_RO:
+		return DF_BUF_RO;
+	case PY_TUPLE:
+		return DF_TUPLE;
+	case PY_REDUCE:
+		return DF_REDUCE;
+	case PY_INST:
+		return DF_INST;
+	case PY_NEWOBJ:
+		return DF_NEWOBJ;
+	case PY_LIST:
+	case PY_SET:
+	case PY_FROZEN_SET:
+	case PY_DICT:
+		return DF_ITER;
+	case PY_GLOB:
+		return DF_GLOB;
+	case PY_WHAT:
+		return DF_WHAT;
+	default:
+		return DF_NONE;
+	}
+}
+
+static inline bool dump_leaf(PrintInfo *nfo, PyObj *obj) {
 	switch (obj->type) {
 	case PY_BOOL:
 		return dump_bool (nfo, obj);
 	case PY_EXT:
 		return dump_ext (nfo, obj);
-	case PY_PERSID:
-		return dump_persid (nfo, obj);
 	case PY_BUFFER:
 		return dump_buf (nfo, obj);
-	case PY_BUFFER_RO:
-		return dump_buf_ro (nfo, obj);
 	case PY_INT:
 		return dump_int (nfo, obj);
 	case PY_STR:
@@ -961,52 +1344,107 @@ bool dump_obj_no_pre(PrintInfo *nfo, PyObj *obj) {
 		return dump_float (nfo, obj);
 	case PY_NONE:
 		return dump_none (nfo, obj);
-	case PY_TUPLE:
-		PREPRINT (nfo, obj);
-		return dump_iter_loop (nfo, obj) && newline (nfo);
-	case PY_REDUCE:
-		return dump_reduce (nfo, obj);
-	case PY_INST:
-		return dump_inst (nfo, obj);
-	case PY_NEWOBJ:
-		return dump_newobj (nfo, obj);
-	case PY_LIST:
-	case PY_SET:
-	case PY_FROZEN_SET:
-	case PY_DICT:
-		return dump_iter (nfo, obj);
-	case PY_GLOB:
-		return dump_glob (nfo, obj);
-	case PY_WHAT:
-		return dump_what (nfo, obj);
 	default:
 		R_LOG_ERROR ("Python dumper can't handle type `%s` yet", py_type_to_name(obj->type))
 		return false;
 	}
 }
 
-bool dump_obj(PrintInfo *nfo, PyObj *obj) {
-	PrState *ps = NULL;
-	if (!PSTATE (nfo, first) && obj->refcnt) {
-		ps = printer_push_state (nfo, true);
-		if (!ps) {
+// output includes what is still buffered in the current state
+static inline bool printer_enter(PrintInfo *nfo, PyObj *obj) {
+	PLimits *l = nfo->limits;
+	if (!l) {
+		return true;
+	}
+	if (l->max[PLIM_OUTPUT] && !l->stop) {
+		RStrBuf *out = printer_getout (nfo, false);
+		if (limits_over (l, PLIM_OUTPUT, nfo->out_len + (out? r_strbuf_length (out): 0))) {
+			return limits_hit (l, PLIM_OUTPUT, obj->offset);
+		}
+	}
+	return limits_enter (l, obj->offset);
+}
+
+static inline void printer_leave(PrintInfo *nfo) {
+	if (nfo->limits) {
+		limits_leave (nfo->limits);
+	}
+}
+
+static int step_obj(PrintInfo *nfo, DumpFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		if (!printer_enter (nfo, obj)) {
 			return false;
 		}
-		// prepends always start the line, never return
-		ps->first = true;
-		ps->ret = false;
-		ps->tabs = 0;
+		if (!PSTATE (nfo, first) && obj->refcnt && !rle_inlined (&nfo->rle, obj)) {
+			PrState *ps = printer_push_state (nfo, true);
+			if (!ps) {
+				printer_leave (nfo);
+				return false;
+			}
+			// prepends always start the line, never return
+			ps->first = true;
+			ps->ret = false;
+			ps->tabs = 0;
+			f->flag = true;
+		}
+		PTensor t;
+		int kind = dump_kind (obj);
+		if (kind != DF_NONE && tensor_get (&t, obj, &nfo->tensor)) {
+			rv = dump_tensor (nfo, obj, &t);
+		} else if (kind != DF_NONE) {
+			f->step = 1;
+			return frame_push (nfo, kind, obj)? DUMP_CALL: false;
+		} else {
+			rv = dump_leaf (nfo, obj);
+		}
 	}
 
-	bool ret = dump_obj_no_pre (nfo, obj);
-	if (ps) {
+	bool ret = rv;
+	if (f->flag) {
 		ret = ret
 			&& printer_pop_state (nfo)
 			&& PCOLORSTR (obj->varname, var);
 	}
+	printer_leave (nfo);
 	return ret;
 }
 
+static const DumpStep dump_steps[DF_COUNT] = {
+	[DF_OBJ] = step_obj,
+	[DF_PERSID] = step_persid,
+	[DF_BUF_RO] = step_buf_ro,
+	[DF_TUPLE] = step_tuple,
+	[DF_REDUCE] = step_reduce,
+	[DF_INST] = step_inst,
+	[DF_NEWOBJ] = step_newobj,
+	[DF_ITER] = step_iter,
+	[DF_ITER_LOOP] = step_iter_loop,
+	[DF_DICT] = step_dict,
+	[DF_GLOB] = step_glob,
+	[DF_WHAT] = step_what,
+	[DF_WHAT_LOOP] = step_what_loop,
+	[DF_OPER] = step_oper,
+};
+
+bool dump_obj(PrintInfo *nfo, PyObj *obj) {
+	ut32 base = nfo->nframes;
+	if (!frame_push (nfo, DF_OBJ, obj)) {
+		return false;
+	}
+	bool rv = true;
+	while (nfo->nframes > base) {
+		DumpFrame *f = &nfo->frames[nfo->nframes - 1];
+		int r = dump_steps[f->kind] (nfo, f, rv);
+		if (r != DUMP_CALL) {
+			rv = r? true: false;
+			nfo->nframes--;
+		}
+	}
+	return rv;
+}
+
 static inline bool dump_stack(PrintInfo *nfo, RList *stack, const char *n) {
 	int len = r_list_length (stack);
 	if (len == 0) {
@@ -1036,8 +1474,56 @@ static inline bool dump_stack(PrintInfo *nfo, RList *stack, const char *n) {
 	return true;
 }
 
+// a popped object handed to the stream thread while decoding goes on
+bool dump_popped(PrintInfo *nfo, PyObj *obj) {
+	printer_appendf (nfo, "%s## POP streamed, offset 0x%"PFMT64x"%s\n", PALCOLOR (usercomment), obj->offset, PALCOLOR (reset));
+	printer_drain (nfo);
+	PrState *ps = r_list_last (nfo->outstack);
+	r_return_val_if_fail (ps, false);
+	ps->first = true;
+	ps->ret = false;
+	bool ret = dump_obj (nfo, obj);
+	printer_drain (nfo);
+	return ret;
+}
+
+static inline void dump_begin(PMState *pvm, PrintInfo *nfo) {
+	nfo->limits = &pvm->limits;
+	nfo->tensor.buf = pvm->buf;
+	nfo->tensor.start = pvm->start;
+	nfo->tensor.size = pvm->buf_size;
+	nfo->tensor.zip = pvm->zip;
+	limits_phase (nfo->limits, "print");
+}
+
+// flushes what is left, then the incomplete warning, limits and policy
+static inline bool dump_end(PMState *pvm, PrintInfo *nfo, bool ret, bool warn) {
+	printer_drain (nfo); // partial output left behind on failure
+	printer_pop_state (nfo);
+	if (!ret || warn) {
+		printer_emit (nfo, "Raise Exception('INCOMPLETE!!! Pickle did not completely extract, check error log')\n");
+	}
+	if (pvm->limits.hit) {
+		RStrBuf sb;
+		r_strbuf_init (&sb);
+		limits_dump (&sb, &pvm->limits);
+		printer_emit (nfo, r_strbuf_get (&sb));
+		r_strbuf_fini (&sb);
+	}
+	if (pvm->policy) {
+		RStrBuf sb;
+		r_strbuf_init (&sb);
+		policy_dump (&sb, pvm->policy);
+		printer_emit (nfo, r_strbuf_get (&sb));
+		r_strbuf_fini (&sb);
+	}
+	nfo->limits = NULL;
+	return ret;
+}
+
 bool dump_machine(PMState *pvm, PrintInfo *nfo, bool warn) {
 	bool ret = true;
+	dump_begin (pvm, nfo);
 	if (nfo->stack) {
 		if (r_list_length (pvm->metastack)) {
 			RList *l;
@@ -1059,21 +1545,63 @@ bool dump_machine(PMState *pvm, PrintInfo *nfo, bool warn) {
 		if (r_list_length (pvm->stack) > 0) {
 			ret = ret && dump_stack (nfo, pvm->stack, "VM");
 		} else {
-			printf ("%s## stack is empty%s\n", PALCOLOR (usercomment), PALCOLOR (reset));
+			printer_appendf (nfo, "%s## stack is empty%s\n", PALCOLOR (usercomment), PALCOLOR (reset));
+			printer_drain (nfo);
 		}
 	}
 	if (ret && nfo->popstack && r_list_length (pvm->popstack)) {
 		ret = ret && dump_stack (nfo, pvm->popstack, "POP");
 	}
-	printer_pop_state (nfo);
-	if (!ret || warn) {
-		r_cons_print ("Raise Exception('INCOMPLETE!!! Pickle did not completely extract, check error log')\n");
+	return dump_end (pvm, nfo, ret, warn);
+}
+
+// pdPp, only `obj`, returned like the top of the stack
+bool dump_query(PMState *pvm, PrintInfo *nfo, PyObj *obj, const char *path, bool warn) {
+	dump_begin (pvm, nfo);
+	printer_appendf (nfo, "%s## %s%s\n", PALCOLOR (usercomment), path, PALCOLOR (reset));
+	printer_drain (nfo);
+	PrState *ps = r_list_last (nfo->outstack);
+	bool ret = false;
+	if (ps) {
+		ps->first = true;
+		ps->ret = true;
+		ret = dump_obj (nfo, obj);
 	}
-	return ret;
+	return dump_end (pvm, nfo, ret, warn);
+}
+
+static bool name_free(void *user, const ut64 k, const void *v) {
+	free ((void *)v);
+	return true;
+}
+
+static bool flag_name(RFlagItem *fi, void *user) {
+	char *dup = strdup (fi->name + strlen (FLAG_PRE));
+	if (!dup || !ht_up_insert (user, fi->offset, dup)) {
+		free (dup); // the first flag at an offset wins
+	}
+	return true;
+}
+
+// offset -> pick.* name, one pass over the flags instead of a lookup for
+// every object the printer names
+static HtUP *flag_names(RFlag *flags) {
+	HtUP *names = ht_up_new (NULL, NULL, NULL);
+	if (names) {
+		r_flag_foreach_prefix (flags, FLAG_PRE, -1, flag_name, names);
+	}
+	return names;
 }
 
 void print_info_clean(PrintInfo *nfo) {
+	if (nfo->names) {
+		ht_up_foreach (nfo->names, name_free, NULL);
+		ht_up_free (nfo->names);
+	}
+	ht_up_free (nfo->named);
 	r_list_free (nfo->outstack);
+	free (nfo->frames);
+	rle_fini (&nfo->rle);
 	memset (nfo, 0, sizeof (*nfo));
 }
 
@@ -1088,9 +1616,100 @@ bool print_info_init(PrintInfo *nfo, ut64 recurse, RCore *core) {
 			}
 		}
 	}
-	nfo->flags = core->flags;
+	if (core && core->flags) {
+		nfo->names = flag_names (core->flags);
+		nfo->named = ht_up_new (NULL, NULL, NULL);
+		if (!nfo->names || !nfo->named) {
+			return false;
+		}
+	}
+	nfo->skeleton = core? r_config_get_i (core->config, "pickle.skeleton"): 0;
+	nfo->rle.min = core? r_config_get_i (core->config, "pickle.rle"): 0;
+	nfo->tensor.on = core? r_config_get_b (core->config, "pickle.tensor"): false;
 	nfo->recurse = recurse;
 	nfo->outstack = r_list_newf ((RListFree) pstate_free);
 	printer_push_state (nfo, false); // init print state
 	return nfo->outstack? true: false;
 }
+
+static inline bool export_flag(RFlag *flags, PrintInfo *nfo, PyObj *obj) {
+	if (ht_up_find (nfo->names, obj->offset, NULL) || ht_up_find (nfo->named, obj->offset, NULL) != obj) {
+		return true; // one pick.* flag per offset, for the object that owns it
+	}
+	char *n = r_str_newf (FLAG_PRE"%s", obj->varname);
+	bool ret = n && r_flag_set (flags, n, obj->offset, 1);
+	free (n);
+	return ret;
+}
+
+static inline const char *glob_str(PMState *pvm, PyObj *s) {
+	return s && s->type == PY_STR && py_str_load (pvm, s) && s->py_str? s->py_str: "?";
+}
+
+// `os.system` for a GLOBAL, NULL for anything else
+char *dump_glob_name(PMState *pvm, PyObj *g) {
+	if (g && g->type == PY_GLOB) {
+		return r_str_newf ("%s.%s", glob_str (pvm, g->py_glob.module), glob_str (pvm, g->py_glob.name));
+	}
+	return NULL;
+}
+
+// the name the printer gives obj, or gave it already
+const char *dump_varname(PrintInfo *nfo, PyObj *obj) {
+	return obj_varname (nfo, obj);
+}
+
+// what a call or an import does, `ret_x2a = os.system(...)`
+static char *call_comment(PMState *pvm, PyObj *obj) {
+	PyObj *g = obj->type == PY_GLOB? obj: obj->reduce.glob;
+	RStrBuf *sb = r_strbuf_new (obj->varname);
+	if (!sb) {
+		return NULL;
+	}
+	if (obj->varname) {
+		r_strbuf_append (sb, " = ");
+	}
+	char *callee = dump_glob_name (pvm, g);
+	r_strbuf_append (sb, callee? callee: g && g->varname? g->varname: "?");
+	free (callee);
+	if (obj->type != PY_GLOB) {
+		r_strbuf_append (sb, "(...)");
+	}
+	return r_strbuf_drain (sb);
+}
+
+static inline bool export_comment(RAnal *anal, PMState *pvm, PyObj *obj) {
+	if (r_meta_get_string (anal, R_META_TYPE_COMMENT, obj->offset)) {
+		return true; // never overwrite the user's, or the last pdPf's
+	}
+	char *cc = call_comment (pvm, obj);
+	bool ret = cc && r_meta_set_string (anal, R_META_TYPE_COMMENT, obj->offset, cc);
+	free (cc);
+	return ret;
+}
+
+// pdPf, once printing is done: a pick.* flag, in the pickle flagspace, for
+// every object the printer named and a comment at every import and call. The
+// printer itself only reads the names flag_names took from RFlag up front.
+bool dump_flags(PrintInfo *nfo, PMState *pvm, RCore *core) {
+	r_return_val_if_fail (nfo && nfo->names && pvm && core && core->flags, false);
+	bool ret = r_flag_space_push (core->flags, FLAG_SPACE);
+	PyObj *obj;
+	for (obj = pvm->free_obj; ret && obj; obj = obj->next_free) {
+		if (obj->varname && !obj->noflags) {
+			ret = export_flag (core->flags, nfo, obj);
+		}
+		switch (obj->type) {
+		case PY_GLOB:
+		case PY_REDUCE:
+		case PY_INST:
+		case PY_NEWOBJ:
+			ret = ret && export_comment (core->anal, pvm, obj);
+			break;
+		default:
+			break;
+		}
+	}
+	r_flag_space_pop (core->flags);
+	return ret;
+}
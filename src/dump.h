@@ -1,33 +1,53 @@
 #ifndef DUMP_PICKLE
 #define DUMP_PICKLE
 #include "pyobjutil.h"
+#include "rle.h"
+#include "tensor.h"
 #include <stdbool.h>
 
 typedef struct print_state {
 	bool first, ret, prepend;
+	bool shared; // out belongs to the state below
 	int tabs;
 	RStrBuf *out; // where  script is stored
 } PrState;
 
+typedef struct dump_frame DumpFrame;
+
 typedef struct print_info {
 	bool stack, popstack, metastack; // input from user
 
 	PyObj *reduce;
 
-	RFlag *flags;
-	bool setflags;
+	HtUP *names; // offset -> pick.* name, taken from the flags up front
+	HtUP *named; // offset -> first PyObj named there, the one its flag is for
 
 	bool stack_start; // first on stack
 	RConsPrintablePalette *pal;
 
 	ut64 recurse;
 	bool verbose;
+	ut64 skeleton; // pickle.skeleton, see skeleton.h
+	PRle rle; // rle.min is pickle.rle
+	PTensorSrc tensor; // tensor.on is pickle.tensor
 
 	RList /*PrState* */*outstack;
+	RStrBuf *sink; // if set, output goes here instead of r_cons
+	bool discard; // only count out_len, for timing the printer
+	PLimits *limits; // set by dump_machine
+	ut64 out_len; // bytes emitted so far
+
+	DumpFrame *frames; // dump_obj work stack
+	ut32 nframes, frames_size;
 } PrintInfo;
 
 bool dump_obj(PrintInfo *nfo, PyObj *obj);
 bool dump_machine(PMState *pvm, PrintInfo *nfo, bool warn);
+bool dump_popped(PrintInfo *nfo, PyObj *obj);
+bool dump_query(PMState *pvm, PrintInfo *nfo, PyObj *obj, const char *path, bool warn);
 void print_info_clean(PrintInfo *nfo);
 bool print_info_init(PrintInfo *nfo, ut64 recurse, RCore *core);
+bool dump_flags(PrintInfo *nfo, PMState *pvm, RCore *core);
+char *dump_glob_name(PMState *pvm, PyObj *g);
+const char *dump_varname(PrintInfo *nfo, PyObj *obj);
 #endif
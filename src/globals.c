@@ -0,0 +1,242 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "globals.h"
+
+PGlobals *globals_new(void) {
+	PGlobals *g = R_NEW0 (PGlobals);
+	if (g) {
+		g->sparse = ht_up_new (NULL, NULL, NULL);
+		g->index = ht_pp_new0 ();
+		if (!g->sparse || !g->index) {
+			globals_free (g);
+			return NULL;
+		}
+	}
+	return g;
+}
+
+void globals_free(PGlobals *g) {
+	if (g) {
+		ut64 i;
+		for (i = 0; i < g->count; i++) {
+			free (g->globs[i].module);
+			free (g->globs[i].name);
+			free (g->globs[i].calls);
+		}
+		for (i = 0; i < g->ntexts; i++) {
+			free (g->texts[i]);
+		}
+		free (g->globs);
+		free (g->texts);
+		free (g->stack);
+		free (g->marks);
+		free (g->memo);
+		free (g->sparse_slots);
+		ht_up_free (g->sparse);
+		ht_pp_free (g->index);
+		free (g);
+	}
+}
+
+bool globals_push(PGlobals *g, PGSlot s) {
+	if (!py_grow ((void **)&g->stack, &g->stack_size, g->depth, sizeof (PGSlot))) {
+		return false;
+	}
+	g->stack[g->depth++] = s;
+	return true;
+}
+
+// never pops a mark, POP does that itself when the stack is empty
+bool globals_pop(PGlobals *g, PGSlot *s) {
+	if (!g->depth || (g->nmarks && g->marks[g->nmarks - 1] == g->depth)) {
+		return false;
+	}
+	*s = g->stack[--g->depth];
+	return true;
+}
+
+bool globals_mark(PGlobals *g) {
+	if (!py_grow ((void **)&g->marks, &g->marks_size, g->nmarks, sizeof (ut64))) {
+		return false;
+	}
+	g->marks[g->nmarks++] = g->depth;
+	return true;
+}
+
+// first is the slot right after the mark, GS_OTHER if there is none
+bool globals_pop_mark(PGlobals *g, PGSlot *first) {
+	if (!g->nmarks) {
+		return false;
+	}
+	ut64 at = g->marks[--g->nmarks];
+	*first = at < g->depth? g->stack[at]: GS_NEW (GS_OTHER, 0);
+	g->depth = at;
+	return true;
+}
+
+// MEMOIZE and most writers number memo entries 0, 1, 2..., those index an
+// array instead of going through a hash table
+static inline bool memo_dense(PGlobals *g, ut64 id) {
+	if (id < g->memo_size) {
+		return true;
+	}
+	if (id > g->memo_size * 2 + 1024) {
+		return false;
+	}
+	ut64 n = R_MAX (g->memo_size * 2, id + 1024);
+	PGSlot *tmp = n < ST32_MAX / sizeof (PGSlot)? realloc (g->memo, n * sizeof (PGSlot)): NULL;
+	if (!tmp) {
+		return false;
+	}
+	memset (tmp + g->memo_size, 0xff, (n - g->memo_size) * sizeof (PGSlot));
+	g->memo = tmp;
+	g->memo_size = n;
+	return true;
+}
+
+bool globals_memo_put(PGlobals *g, ut64 id) {
+	if (!g->depth) {
+		return false;
+	}
+	PGSlot top = g->stack[g->depth - 1];
+	if (memo_dense (g, id)) {
+		g->memo_len += g->memo[id] == GS_UNSET;
+		g->memo[id] = top;
+		return true;
+	}
+	size_t at = (size_t)ht_up_find (g->sparse, id, NULL);
+	if (at) {
+		g->sparse_slots[at - 1] = top;
+		return true;
+	}
+	if (!py_grow ((void **)&g->sparse_slots, &g->sparse_size, g->nsparse, sizeof (PGSlot))
+		|| !ht_up_insert (g->sparse, id, (void *)(size_t)(g->nsparse + 1))
+	) {
+		return false;
+	}
+	g->sparse_slots[g->nsparse++] = top;
+	g->memo_len++;
+	return true;
+}
+
+bool globals_memo_get(PGlobals *g, ut64 id) {
+	if (id < g->memo_size) {
+		return g->memo[id] != GS_UNSET && globals_push (g, g->memo[id]);
+	}
+	size_t at = (size_t)ht_up_find (g->sparse, id, NULL);
+	return at && globals_push (g, g->sparse_slots[at - 1]);
+}
+
+// protocol 0 string, takes str
+bool globals_text(PGlobals *g, char *str) {
+	if (!str || !py_grow ((void **)&g->texts, &g->texts_size, g->ntexts, sizeof (char *))) {
+		free (str);
+		return false;
+	}
+	g->texts[g->ntexts] = str;
+	return globals_push (g, GS_NEW (GS_TEXT, g->ntexts++));
+}
+
+// pushes the global, every import of the same one shares its entry
+bool globals_import(PGlobals *g, const char *module, const char *name, ut64 offset) {
+	char *key = r_str_newf ("%s\n%s", module, name);
+	if (!key) {
+		return false;
+	}
+	size_t at = (size_t)ht_pp_find (g->index, key, NULL);
+	if (!at) {
+		PGlob *gl = py_grow ((void **)&g->globs, &g->size, g->count, sizeof (PGlob))? &g->globs[g->count]: NULL;
+		if (gl) {
+			memset (gl, 0, sizeof (*gl));
+			gl->module = strdup (module);
+			gl->name = strdup (name);
+			gl->offset = offset;
+		}
+		if (!gl || !gl->module || !gl->name || !ht_pp_insert (g->index, key, (void *)(size_t)(g->count + 1))) {
+			if (gl) {
+				free (gl->module);
+				free (gl->name);
+			}
+			free (key);
+			return false;
+		}
+		at = ++g->count;
+	}
+	free (key);
+	g->globs[at - 1].imports++;
+	return globals_push (g, GS_NEW (GS_GLOBAL, at - 1));
+}
+
+// records the call when callable came from a global, ret is what the call
+// pushes
+bool globals_call(PGlobals *g, PGSlot callable, ut64 offset, char op, PGSlot *ret) {
+	ut64 kind = GS_KIND (callable);
+	*ret = GS_NEW (GS_OTHER, 0);
+	if (kind != GS_GLOBAL && kind != GS_CALL) {
+		return true;
+	}
+	PGlob *gl = &g->globs[GS_VAL (callable)];
+	if (!py_grow ((void **)&gl->calls, &gl->calls_size, gl->ncalls, sizeof (PGlobCall))) {
+		return false;
+	}
+	PGlobCall *c = &gl->calls[gl->ncalls++];
+	c->offset = offset;
+	c->op = op;
+	c->result = kind == GS_CALL;
+	*ret = GS_NEW (GS_CALL, GS_VAL (callable));
+	return true;
+}
+
+static inline char *glob_name(PGlob *gl) {
+	char *name = r_str_newf ("%s.%s", gl->module, gl->name);
+	char *esc = name? r_str_escape_raw ((const ut8 *)name, strlen (name)): NULL;
+	free (name);
+	return esc;
+}
+
+// one line per global, `module.name @ offset` and its calls
+bool globals_dump(RStrBuf *sb, PGlobals *g) {
+	bool ret = r_strbuf_appendf (sb, "## globals %"PFMT64u"\n", g->count);
+	ut64 i, j;
+	for (i = 0; ret && i < g->count; i++) {
+		PGlob *gl = &g->globs[i];
+		char *name = glob_name (gl);
+		ret = name && r_strbuf_appendf (sb, "0x%08"PFMT64x" %s", gl->offset, name);
+		free (name);
+		if (ret && gl->imports > 1) {
+			ret = r_strbuf_appendf (sb, " (imported %"PFMT64u" times)", gl->imports);
+		}
+		for (j = 0; ret && j < gl->ncalls; j++) {
+			PGlobCall *c = &gl->calls[j];
+			ret = r_strbuf_appendf (sb, "%s0x%"PFMT64x" %s%s", j? ", ": " called ",
+				c->offset, py_opcode_to_name (c->op), c->result? " (result)": "");
+		}
+		ret = ret && r_strbuf_append (sb, "\n");
+	}
+	return ret;
+}
+
+// "globals": [{"module", "name", "offset", "imports", "calls": [{"offset", "op", "result"}]}]
+bool globals_dump_json(PJ *pj, PGlobals *g) {
+	bool ret = pj_ka (pj, "globals");
+	ut64 i, j;
+	for (i = 0; ret && i < g->count; i++) {
+		PGlob *gl = &g->globs[i];
+		ret = pj_o (pj)
+			&& pj_ks (pj, "module", gl->module)
+			&& pj_ks (pj, "name", gl->name)
+			&& pj_kn (pj, "offset", gl->offset)
+			&& pj_kn (pj, "imports", gl->imports)
+			&& pj_ka (pj, "calls");
+		for (j = 0; ret && j < gl->ncalls; j++) {
+			PGlobCall *c = &gl->calls[j];
+			ret = pj_o (pj)
+				&& pj_kn (pj, "offset", c->offset)
+				&& pj_ks (pj, "op", py_opcode_to_name (c->op))
+				&& pj_kb (pj, "result", c->result)
+				&& pj_end (pj);
+		}
+		ret = ret && pj_end (pj) && pj_end (pj);
+	}
+	return ret && pj_end (pj);
+}
@@ -0,0 +1,68 @@
+#ifndef GLOBALS_PICKLE
+#define GLOBALS_PICKLE
+#include "pyobjutil.h"
+
+// pdPg, only what a security scan needs: which globals the pickle imports
+// and where they get called. The stack holds PGSlot's instead of PyObj's,
+// nothing is built for containers and nothing is printed until the end.
+typedef ut64 PGSlot; // GS_* kind in the top bits, the rest depends on it
+#define GS_SHIFT 60
+#define GS_KIND(s) ((s) >> GS_SHIFT)
+#define GS_VAL(s) ((s) & ((1ULL << GS_SHIFT) - 1))
+#define GS_NEW(k, v) (((ut64)(k) << GS_SHIFT) | GS_VAL (v))
+#define GS_UNSET UT64_MAX
+
+enum {
+	GS_OTHER = 0, // anything a global can't come from
+	GS_STR, // binary string, value is the offset of its opcode
+	GS_TEXT, // protocol 0 string, value indexes PGlobals.texts
+	GS_GLOBAL, // value indexes PGlobals.globs
+	GS_CALL, // result of calling a global (or a result), same value
+};
+
+typedef struct pickle_glob_call {
+	ut64 offset;
+	char op; // OP_REDUCE, OP_NEWOBJ, OP_NEWOBJ_EX, OP_OBJ, OP_INST or OP_BUILD
+	bool result; // what was called is something the global returned
+} PGlobCall;
+
+typedef struct pickle_glob {
+	char *module, *name;
+	ut64 offset; // first import
+	ut64 imports;
+	PGlobCall *calls;
+	ut64 ncalls, calls_size;
+} PGlob;
+
+struct pickle_globals {
+	PGSlot *stack;
+	ut64 depth, stack_size;
+	ut64 *marks; // stack depth at each MARK
+	ut64 nmarks, marks_size;
+	PGSlot *memo; // memo ids that are about dense, GS_UNSET if not set
+	ut64 memo_size;
+	HtUP *sparse; // other memo ids -> index + 1 into sparse_slots
+	PGSlot *sparse_slots;
+	ut64 nsparse, sparse_size;
+	ut64 memo_len; // ids set, MEMOIZE uses the next one
+	char **texts;
+	ut64 ntexts, texts_size;
+	HtPP *index; // "module\nname" -> index + 1 into globs
+	PGlob *globs;
+	ut64 count, size;
+};
+
+PGlobals *globals_new(void);
+void globals_free(PGlobals *g);
+bool globals_push(PGlobals *g, PGSlot s);
+bool globals_pop(PGlobals *g, PGSlot *s);
+bool globals_mark(PGlobals *g);
+bool globals_pop_mark(PGlobals *g, PGSlot *first);
+bool globals_memo_put(PGlobals *g, ut64 id);
+bool globals_memo_get(PGlobals *g, ut64 id);
+bool globals_text(PGlobals *g, char *str);
+bool globals_import(PGlobals *g, const char *module, const char *name, ut64 offset);
+bool globals_call(PGlobals *g, PGSlot callable, ut64 offset, char op, PGSlot *ret);
+bool globals_dump(RStrBuf *sb, PGlobals *g);
+bool globals_dump_json(PJ *pj, PGlobals *g);
+#endif
@@ -0,0 +1,356 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "hash.h"
+#include "plimits.h"
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+#define HASH_BACK 0x6261636b00000000ULL // cycle, or'd with the distance
+#define HASH_KWARGS 0x6b77617267730000ULL
+#define HASH_VISIT_ERR -1
+#define HASH_VISIT_DONE 0 // value known, nothing pushed
+#define HASH_VISIT_PUSHED 1
+
+static const char *mode_names[PH_MODE_COUNT] = {
+	[PH_TYPES] = "types",
+	[PH_GLOBALS] = "globals",
+	[PH_FULL] = "full",
+};
+
+bool hash_mode_parse(const char *str, PHashMode *mode) {
+	int i;
+	for (i = 0; i < PH_MODE_COUNT; i++) {
+		if (!strcmp (str, mode_names[i])) {
+			*mode = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *hash_mode_name(PHashMode mode) {
+	return mode < PH_MODE_COUNT? mode_names[mode]: "unknown";
+}
+
+// splitmix64 finalizer, a bijection so chained mixes never lose state
+static inline ut64 hash_fmix(ut64 v) {
+	v ^= v >> 30;
+	v *= 0xbf58476d1ce4e5b9ULL;
+	v ^= v >> 27;
+	v *= 0x94d049bb133111ebULL;
+	return v ^ (v >> 31);
+}
+
+static inline ut64 hash_mix(ut64 h, ut64 v) {
+	return hash_fmix (h ^ hash_fmix (v + HASH_SEED));
+}
+
+static inline ut64 hash_str(const char *s) {
+	ut64 h = 0xcbf29ce484222325ULL;
+	const ut8 *p;
+	for (p = (const ut8 *)s; *p; p++) {
+		h = (h ^ *p) * 0x100000001b3ULL;
+	}
+	return hash_mix (h, p - (const ut8 *)s);
+}
+
+PHash *hash_new(PHashMode mode) {
+	PHash *h = R_NEW0 (PHash);
+	if (h && !(h->shared = ht_up_new0 ())) {
+		R_FREE (h);
+	}
+	if (h) {
+		h->mode = mode;
+	}
+	return h;
+}
+
+void hash_free(PHash *h) {
+	if (h) {
+		ut64 i;
+		for (i = 0; i < h->nroots; i++) {
+			free (h->roots[i].path);
+		}
+		free (h->roots);
+		ht_up_free (h->shared);
+		free (h->open);
+		free (h->frames);
+		free (h);
+	}
+}
+
+// what an object adds before its children
+static inline ut64 hash_leaf(PHash *h, PyObj *obj) {
+	ut64 v = hash_mix (HASH_SEED, obj->type);
+	if (obj->type == PY_EXT && h->mode >= PH_GLOBALS) {
+		return hash_mix (v, obj->py_extnum); // stands for a registered global
+	}
+	if (h->mode < PH_FULL) {
+		return v;
+	}
+	switch (obj->type) {
+	case PY_INT:
+		return hash_mix (v, (ut64)(st64)obj->py_int);
+	case PY_BOOL:
+		return hash_mix (v, obj->py_bool);
+	case PY_BUFFER:
+		return hash_mix (v, obj->py_bufi);
+	case PY_FLOAT: {
+		ut64 bits;
+		memcpy (&bits, &obj->py_float, sizeof (bits));
+		return hash_mix (v, bits);
+	}
+	case PY_STR:
+		return obj->py_str? hash_mix (v, hash_str (obj->py_str)): v;
+	default:
+		return v;
+	}
+}
+
+// value of obj when it is known without walking it, else pushes its frame
+static int hash_visit(PHash *h, PyObj *obj, PLimits *lim, ut64 *v) {
+	ut64 node = 0;
+	if (obj->refcnt) {
+		node = (size_t)ht_up_find (h->shared, (ut64)(size_t)obj, NULL);
+		if (node) {
+			ut64 open = h->open[node - 1];
+			*v = open? hash_mix (HASH_BACK | (h->nframes - open), 0): obj->hash;
+			return HASH_VISIT_DONE;
+		}
+		if (!py_grow ((void **)&h->open, &h->open_size, h->nopen, sizeof (ut64))
+			|| !ht_up_insert (h->shared, (ut64)(size_t)obj, (void *)(size_t)(h->nopen + 1))
+		) {
+			return HASH_VISIT_ERR;
+		}
+		node = ++h->nopen;
+	}
+	if (!limits_poll (lim, obj->offset)
+		|| !py_grow ((void **)&h->frames, &h->frames_size, h->nframes, sizeof (PHashFrame))
+	) {
+		return HASH_VISIT_ERR;
+	}
+	PHashFrame *f = &h->frames[h->nframes++];
+	memset (f, 0, sizeof (*f));
+	f->obj = obj;
+	f->h = hash_leaf (h, obj);
+	f->node = node;
+	if (node) {
+		h->open[node - 1] = h->nframes;
+	}
+	h->objs++;
+	lim->prog.objs = h->objs;
+	return HASH_VISIT_PUSHED;
+}
+
+// a trailing split only marks where nothing happened yet, printers skip it too
+static inline PyObj *iter_next(PHashFrame *f, RList *l) {
+	f->iter = f->step++? r_list_iter_get_next (f->iter): (l? r_list_head (l): NULL);
+	if (!f->iter) {
+		return NULL;
+	}
+	PyObj *obj = r_list_iter_get_data (f->iter);
+	return obj->type == PY_SPLIT && !r_list_iter_get_next (f->iter)? NULL: obj;
+}
+
+static inline PyObj *what_next(PHashFrame *f) {
+	if (f->arg && (f->arg = r_list_iter_get_next (f->arg))) {
+		return r_list_iter_get_data (f->arg);
+	}
+	RList *what = f->obj->py_what;
+	while ((f->iter = f->step++? r_list_iter_get_next (f->iter): r_list_head (what))) {
+		PyOper *pop = r_list_iter_get_data (f->iter);
+		switch (pop->op) {
+		case OP_FAKE_SPLIT:
+			if (pop == r_list_last (what)) {
+				return NULL;
+			}
+			// fallthrough
+		case OP_FAKE_INIT:
+			f->h = hash_mix (f->h, pop->op);
+			if (pop->obj) {
+				return pop->obj;
+			}
+			break;
+		default:
+			f->h = hash_mix (f->h, (ut8)pop->op);
+			f->arg = pop->stack? r_list_head (pop->stack): NULL;
+			if (f->arg) {
+				return r_list_iter_get_data (f->arg);
+			}
+			break;
+		}
+	}
+	return NULL;
+}
+
+// next child of f->obj in order, NULL after the last one. Splits are leaves,
+// the reduce they point to is reached on its own
+static PyObj *hash_next(PHash *h, PHashFrame *f) {
+	PyObj *obj = f->obj;
+	switch (obj->type) {
+	case PY_REDUCE:
+	case PY_INST:
+	case PY_NEWOBJ:
+		switch (f->step++) {
+		case 0:
+			return obj->reduce.glob;
+		case 1:
+			return obj->reduce.args;
+		case 2:
+			if (obj->reduce.kwargs) {
+				f->h = hash_mix (f->h, HASH_KWARGS);
+				return obj->reduce.kwargs;
+			}
+		}
+		return NULL;
+	case PY_GLOB: {
+		PyObj *module = obj->py_glob.module;
+		PyObj *name = obj->py_glob.name;
+		if (!f->step && h->mode >= PH_GLOBALS && module->type == PY_STR && name->type == PY_STR) {
+			// by name, however the strings got there
+			f->h = hash_mix (hash_mix (f->h, hash_str (module->py_str)), hash_str (name->py_str));
+			f->step = 2;
+		}
+		switch (f->step++) {
+		case 0:
+			return module;
+		case 1:
+			return name;
+		}
+		return NULL;
+	}
+	case PY_PERSID:
+		return f->step++? NULL: obj->py_pid;
+	case PY_BUFFER_RO:
+		return f->step++? NULL: obj->py_robuf;
+	case PY_FROZEN_SET:
+	case PY_SET:
+	case PY_LIST:
+	case PY_TUPLE:
+	case PY_DICT:
+		return iter_next (f, obj->py_iter);
+	case PY_WHAT:
+		return what_next (f);
+	default:
+		return NULL;
+	}
+}
+
+// walks obj on the frame stack, not the C one, deep pickles nest far enough
+// to overflow it
+bool hash_obj(PHash *h, PyObj *obj, PLimits *lim, ut64 *out) {
+	ut64 base = h->nframes;
+	int r = hash_visit (h, obj, lim, out);
+	while (r != HASH_VISIT_ERR && h->nframes > base) {
+		PHashFrame *f = &h->frames[h->nframes - 1];
+		PyObj *kid = hash_next (h, f);
+		ut64 v;
+		if (kid) {
+			r = hash_visit (h, kid, lim, &v); // may move frames
+			if (r == HASH_VISIT_DONE) {
+				f = &h->frames[h->nframes - 1];
+				f->h = hash_mix (f->h, v);
+				f->n++;
+			}
+			continue;
+		}
+		v = f->obj->hash = hash_mix (f->h, f->n);
+		if (f->node) {
+			h->open[f->node - 1] = 0;
+		}
+		if (--h->nframes > base) {
+			f = &h->frames[h->nframes - 1];
+			f->h = hash_mix (f->h, v);
+			f->n++;
+		} else {
+			*out = v;
+		}
+	}
+	h->nframes = base;
+	return r != HASH_VISIT_ERR;
+}
+
+static bool hash_root(PHash *h, PLimits *lim, PyObj *obj, char *path) {
+	ut64 v;
+	if (!path || !hash_obj (h, obj, lim, &v)
+		|| !py_grow ((void **)&h->roots, &h->roots_size, h->nroots, sizeof (PHashRoot))
+	) {
+		free (path);
+		return false;
+	}
+	h->roots[h->nroots].path = path;
+	h->roots[h->nroots++].hash = v;
+	h->hash = hash_mix (h->hash, v);
+	return true;
+}
+
+// same paths and trailing split rule as the JSON printer
+static bool hash_list(PHash *h, PLimits *lim, const char *prefix, RList *l) {
+	h->hash = hash_mix (h->hash, hash_str (prefix));
+	ut32 i = 0;
+	RListIter *iter;
+	PyObj *obj;
+	r_list_foreach (l, iter, obj) {
+		if (obj->type == PY_SPLIT && !r_list_iter_get_next (iter)) {
+			break;
+		}
+		if (!hash_root (h, lim, obj, r_str_newf ("%s[%u]", prefix, i++))) {
+			return false;
+		}
+	}
+	h->hash = hash_mix (h->hash, i);
+	return true;
+}
+
+bool hash_state(PHash *h, PMState *pvm) {
+	PLimits *lim = &pvm->limits;
+	limits_phase (lim, "hash");
+	h->hash = hash_mix (HASH_SEED, h->mode);
+	bool ret = true;
+	int i = 0;
+	RList *l;
+	RListIter *iter;
+	r_list_foreach (pvm->metastack, iter, l) {
+		char *prefix = r_str_newf ("metastack[%d]", i++);
+		ret = prefix && hash_list (h, lim, prefix, l);
+		free (prefix);
+		if (!ret) {
+			return false;
+		}
+	}
+	return hash_list (h, lim, ".stack", pvm->stack)
+		&& hash_list (h, lim, ".popstack", pvm->popstack);
+}
+
+// `## hash <mode> <hash>, N objects`, then one `path hash` line per top level object
+bool hash_dump(RStrBuf *sb, PHash *h) {
+	bool ret = r_strbuf_appendf (sb, "## hash %s %016"PFMT64x", %"PFMT64u" objects\n", hash_mode_name (h->mode), h->hash, h->objs);
+	ut64 i;
+	for (i = 0; ret && i < h->nroots; i++) {
+		ret = r_strbuf_appendf (sb, "%s %016"PFMT64x"\n", h->roots[i].path, h->roots[i].hash);
+	}
+	return ret;
+}
+
+static inline bool pj_khash(PJ *pj, const char *k, ut64 hash) {
+	char *s = r_str_newf ("%016"PFMT64x, hash);
+	bool ret = s && pj_ks (pj, k, s);
+	free (s);
+	return ret;
+}
+
+// "mode", "hash", "objects", "roots": [{"path", "hash"}]. Hashes are hex
+// strings like tensor fnv1a, most JSON readers round 64 bit numbers
+bool hash_dump_json(PJ *pj, PHash *h) {
+	bool ret = pj_ks (pj, "mode", hash_mode_name (h->mode))
+		&& pj_khash (pj, "hash", h->hash)
+		&& pj_kn (pj, "objects", h->objs)
+		&& pj_ka (pj, "roots");
+	ut64 i;
+	for (i = 0; ret && i < h->nroots; i++) {
+		ret = pj_o (pj)
+			&& pj_ks (pj, "path", h->roots[i].path)
+			&& pj_khash (pj, "hash", h->roots[i].hash)
+			&& pj_end (pj);
+	}
+	return ret && pj_end (pj);
+}
@@ -0,0 +1,56 @@
+#ifndef HASH_PICKLE
+#define HASH_PICKLE
+#include "pyobjutil.h"
+
+// pdPh, structural hash of the decoded object graph. Each object hashes its
+// type, then its children in order, bottom up, so two pickles building the
+// same graph get the same hash whatever offsets, memo ids or opcodes (BINPUT
+// vs MEMOIZE, EMPTY_LIST + APPENDS vs LIST) they used. Objects reached twice
+// through the memo are walked once and hash like a copy would, an object
+// reached again while its own children are being walked (a cycle) hashes as
+// how many levels up it is. pickle.hash says how much of the values count.
+typedef enum pickle_hash_mode {
+	PH_TYPES = 0, // types and shape only
+	PH_GLOBALS, // and the module.name of globals and extension codes
+	PH_FULL, // and every literal
+	PH_MODE_COUNT
+} PHashMode;
+
+typedef struct pickle_hash_frame {
+	PyObj *obj;
+	ut64 h;
+	ut64 n; // children mixed in so far
+	ut64 node; // index + 1 into PHash.open, 0 when not shared
+	ut32 step;
+	RListIter *iter; // py_iter or py_what
+	RListIter *arg; // PyOper.stack of the oper at iter
+} PHashFrame;
+
+// a top level object, path as in pdPj's prev_seen
+typedef struct pickle_hash_root {
+	char *path;
+	ut64 hash;
+} PHashRoot;
+
+typedef struct pickle_hash {
+	PHashMode mode;
+	ut64 hash; // the whole pickle
+	ut64 objs; // objects hashed, shared ones once
+	PHashRoot *roots;
+	ut64 nroots, roots_size;
+	HtUP *shared; // PyObj * -> index + 1 into open, only objects with a refcnt
+	ut64 *open; // frame index + 1 while its children are walked, 0 once done
+	ut64 nopen, open_size;
+	PHashFrame *frames;
+	ut64 nframes, frames_size;
+} PHash;
+
+bool hash_mode_parse(const char *str, PHashMode *mode);
+const char *hash_mode_name(PHashMode mode);
+PHash *hash_new(PHashMode mode);
+void hash_free(PHash *h);
+bool hash_obj(PHash *h, PyObj *obj, PLimits *lim, ut64 *out);
+bool hash_state(PHash *h, PMState *pvm);
+bool hash_dump(RStrBuf *sb, PHash *h);
+bool hash_dump_json(PJ *pj, PHash *h);
+#endif
@@ -0,0 +1,366 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "index.h"
+
+// how an object hangs from its parent, each one a pdPj path component
+enum {
+	LK_STACK = 0, // .stack[i]
+	LK_POPSTACK, // .popstack[i]
+	LK_META, // metastack[i][j]
+	LK_ITEM, // .value[i]
+	LK_PAIR, // .value[i][j], j is 0 for the key, 1 for the value
+	LK_VALUE, // .value
+	LK_GLOB, LK_ARGS, LK_KWARGS, // .value.glob...
+	LK_MODULE, LK_NAME, // .value.module, .value.name
+	LK_OPARG, // .value[i].arg
+	LK_OPARGS, // .value[i].args[j]
+};
+
+typedef struct index_work {
+	PyObj *obj;
+	PIndexLink link;
+} IndexWork;
+
+typedef struct index_walk {
+	IndexWork *work;
+	ut64 n, size;
+} IndexWalk;
+
+PIndex *index_new(void) {
+	return R_NEW0 (PIndex);
+}
+
+void index_free(PIndex *ix) {
+	if (ix) {
+		free (ix->ops);
+		ht_up_free (ix->links);
+		free (ix->link);
+		free (ix);
+	}
+}
+
+// offsets only grow, so ops stays sorted
+bool index_op(PIndex *ix, ut64 offset, PyObj *obj, PIndexNote note, ut32 memo) {
+	if (!py_grow ((void **)&ix->ops, &ix->ops_size, ix->nops, sizeof (PIndexOp))) {
+		return false;
+	}
+	PIndexOp *op = &ix->ops[ix->nops++];
+	op->offset = offset;
+	op->obj = obj;
+	op->memo = memo;
+	op->note = note;
+	return true;
+}
+
+// the opcode `addr` is in, its size in `size`
+const PIndexOp *index_find(PIndex *ix, ut64 addr, ut64 *size) {
+	ut64 lo = 0, hi = ix->nops;
+	if (!hi || addr < ix->ops[0].offset || addr >= ix->end) {
+		return NULL;
+	}
+	while (hi - lo > 1) {
+		ut64 mid = lo + (hi - lo) / 2;
+		if (ix->ops[mid].offset <= addr) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	*size = (lo + 1 < ix->nops? ix->ops[lo + 1].offset: ix->end) - ix->ops[lo].offset;
+	return &ix->ops[lo];
+}
+
+// the object as the opcode left it, a dict that later got turned into a
+// PY_WHAT is still the dict, `.value[0].arg` of the PY_WHAT
+PyObj *index_obj(const PIndexOp *op) {
+	PyObj *obj = op->obj;
+	if (obj && obj->type == PY_WHAT && op->offset < obj->offset) {
+		PyOper *pop = r_list_first (obj->py_what);
+		if (pop && pop->op == OP_FAKE_INIT) {
+			return pop->obj;
+		}
+	}
+	return obj;
+}
+
+static inline bool walk_push(IndexWalk *w, PyObj *obj, PyObj *parent, ut32 kind, ut64 i, ut64 j) {
+	if (!obj) {
+		return true;
+	}
+	if (!py_grow ((void **)&w->work, &w->size, w->n, sizeof (IndexWork))) {
+		return false;
+	}
+	IndexWork *wk = &w->work[w->n++];
+	wk->obj = obj;
+	wk->link.parent = parent;
+	wk->link.kind = kind;
+	wk->link.i = i;
+	wk->link.j = j;
+	return true;
+}
+
+// children are pushed in order, then flipped so they pop in order
+static inline void walk_flip(IndexWalk *w, ut64 from) {
+	ut64 a = from, b = w->n;
+	while (b > a + 1) {
+		IndexWork tmp = w->work[a];
+		w->work[a++] = w->work[--b];
+		w->work[b] = tmp;
+	}
+}
+
+static bool walk_list(IndexWalk *w, PyObj *parent, RList *l, ut32 kind, ut64 i) {
+	RListIter *iter;
+	PyObj *o;
+	ut64 n = 0;
+	r_list_foreach (l, iter, o) {
+		// pdPj leaves out a trailing split
+		if (parent && o->type == PY_SPLIT && !r_list_iter_get_next (iter)) {
+			break;
+		}
+		bool ok = kind == LK_ITEM || kind == LK_STACK || kind == LK_POPSTACK
+			? walk_push (w, o, parent, kind, n, 0)
+			: walk_push (w, o, parent, kind, i, n);
+		if (!ok) {
+			return false;
+		}
+		n++;
+	}
+	return true;
+}
+
+static bool walk_dict(IndexWalk *w, PyObj *parent, RList *l) {
+	RListIter *iter;
+	PyObj *o;
+	ut64 n = 0;
+	r_list_foreach (l, iter, o) {
+		bool ok;
+		if (o->type == PY_SPLIT) {
+			if (!r_list_iter_get_next (iter)) {
+				break;
+			}
+			ok = walk_push (w, o, parent, LK_VALUE, 0, 0);
+			n += 2;
+		} else {
+			ok = walk_push (w, o, parent, LK_PAIR, n / 2, n % 2);
+			n++;
+		}
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool walk_what(IndexWalk *w, PyObj *obj) {
+	RListIter *iter;
+	PyOper *pop;
+	ut64 k = 0;
+	r_list_foreach (obj->py_what, iter, pop) {
+		bool ok;
+		if (pop->op == OP_FAKE_INIT || pop->op == OP_FAKE_SPLIT) {
+			if (pop->op == OP_FAKE_SPLIT && !r_list_iter_get_next (iter)) {
+				break;
+			}
+			ok = walk_push (w, pop->obj, obj, LK_OPARG, k, 0);
+		} else {
+			ok = walk_list (w, obj, pop->stack, LK_OPARGS, k);
+		}
+		if (!ok) {
+			return false;
+		}
+		k++;
+	}
+	return true;
+}
+
+static bool walk_kids(IndexWalk *w, PyObj *obj) {
+	switch (obj->type) {
+	case PY_REDUCE:
+	case PY_INST:
+	case PY_NEWOBJ:
+		return walk_push (w, obj->reduce.glob, obj, LK_GLOB, 0, 0)
+			&& walk_push (w, obj->reduce.args, obj, LK_ARGS, 0, 0)
+			&& walk_push (w, obj->reduce.kwargs, obj, LK_KWARGS, 0, 0);
+	case PY_GLOB:
+		return walk_push (w, obj->py_glob.module, obj, LK_MODULE, 0, 0)
+			&& walk_push (w, obj->py_glob.name, obj, LK_NAME, 0, 0);
+	case PY_PERSID:
+		return walk_push (w, obj->py_pid, obj, LK_VALUE, 0, 0);
+	case PY_SPLIT:
+		return walk_push (w, obj->split, obj, LK_VALUE, 0, 0);
+	case PY_BUFFER_RO:
+		return walk_push (w, obj->py_robuf, obj, LK_VALUE, 0, 0);
+	case PY_TUPLE:
+	case PY_LIST:
+	case PY_SET:
+	case PY_FROZEN_SET:
+		return walk_list (w, obj, obj->py_iter, LK_ITEM, 0);
+	case PY_DICT:
+		return walk_dict (w, obj, obj->py_iter);
+	case PY_WHAT:
+		return walk_what (w, obj);
+	default:
+		return true;
+	}
+}
+
+static bool walk_roots(IndexWalk *w, PMState *pvm) {
+	RListIter *iter;
+	RList *l;
+	ut64 i = 0;
+	r_list_foreach (pvm->metastack, iter, l) {
+		if (!walk_list (w, NULL, l, LK_META, i++)) {
+			return false;
+		}
+	}
+	return walk_list (w, NULL, pvm->stack, LK_STACK, 0)
+		&& walk_list (w, NULL, pvm->popstack, LK_POPSTACK, 0);
+}
+
+// links each object to where pdPj first prints it, a pre-order walk
+bool index_paths(PIndex *ix, PMState *pvm) {
+	if (ix->links) {
+		return true;
+	}
+	if (!(ix->links = ht_up_new (NULL, NULL, NULL))) {
+		return false;
+	}
+	IndexWalk w = {0};
+	bool ret = walk_roots (&w, pvm);
+	walk_flip (&w, 0);
+	while (ret && w.n) {
+		IndexWork wk = w.work[--w.n];
+		if (ht_up_find (ix->links, (ut64)(size_t)wk.obj, NULL)) {
+			continue;
+		}
+		ret = py_grow ((void **)&ix->link, &ix->links_size, ix->nlinks, sizeof (PIndexLink))
+			&& ht_up_insert (ix->links, (ut64)(size_t)wk.obj, (void *)(size_t)(ix->nlinks + 1));
+		if (ret) {
+			ix->link[ix->nlinks++] = wk.link;
+			ut64 from = w.n;
+			ret = walk_kids (&w, wk.obj);
+			walk_flip (&w, from);
+		}
+	}
+	free (w.work);
+	return ret;
+}
+
+static inline bool link_dump(RStrBuf *sb, PIndexLink *l) {
+	switch (l->kind) {
+	case LK_STACK:
+		return r_strbuf_appendf (sb, ".stack[%"PFMT64u"]", l->i);
+	case LK_POPSTACK:
+		return r_strbuf_appendf (sb, ".popstack[%"PFMT64u"]", l->i);
+	case LK_META:
+		return r_strbuf_appendf (sb, "metastack[%"PFMT64u"][%"PFMT64u"]", l->i, l->j);
+	case LK_ITEM:
+		return r_strbuf_appendf (sb, ".value[%"PFMT64u"]", l->i);
+	case LK_PAIR:
+		return r_strbuf_appendf (sb, ".value[%"PFMT64u"][%"PFMT64u"]", l->i, l->j);
+	case LK_VALUE:
+		return r_strbuf_append (sb, ".value");
+	case LK_GLOB:
+		return r_strbuf_append (sb, ".value.glob");
+	case LK_ARGS:
+		return r_strbuf_append (sb, ".value.args");
+	case LK_KWARGS:
+		return r_strbuf_append (sb, ".value.kwargs");
+	case LK_MODULE:
+		return r_strbuf_append (sb, ".value.module");
+	case LK_NAME:
+		return r_strbuf_append (sb, ".value.name");
+	case LK_OPARG:
+		return r_strbuf_appendf (sb, ".value[%"PFMT64u"].arg", l->i);
+	case LK_OPARGS:
+		return r_strbuf_appendf (sb, ".value[%"PFMT64u"].args[%"PFMT64u"]", l->i, l->j);
+	default:
+		return false;
+	}
+}
+
+// pdPj style path of obj, NULL when no root reaches it
+char *index_path(PIndex *ix, PyObj *obj) {
+	PIndexLink **chain = NULL;
+	ut64 n = 0, size = 0;
+	bool ret = ix->links? true: false;
+	while (ret && obj) {
+		bool found = false;
+		ut64 at = (ut64)(size_t)ht_up_find (ix->links, (ut64)(size_t)obj, &found);
+		if (!found || !at || !py_grow ((void **)&chain, &size, n, sizeof (PIndexLink *))) {
+			ret = false;
+			break;
+		}
+		chain[n++] = &ix->link[at - 1];
+		obj = ix->link[at - 1].parent;
+	}
+	RStrBuf *sb = ret? r_strbuf_new (""): NULL;
+	ret = sb? true: false;
+	while (ret && n) {
+		ret = link_dump (sb, chain[--n]);
+	}
+	free (chain);
+	if (!ret) {
+		r_strbuf_free (sb);
+		return NULL;
+	}
+	return r_strbuf_drain (sb);
+}
+
+// `memo[3] = lst_x2a`, `calls os.system -> ret_x40`, NULL when there is
+// nothing to say. Names are the ones pdP prints, a call that later turned
+// into a PY_WHAT goes by the PY_WHAT's name.
+char *index_note(PMState *pvm, PrintInfo *nfo, const PIndexOp *op) {
+	PyObj *obj = index_obj (op);
+	const char *name = op->obj? dump_varname (nfo, op->obj): "?";
+	char *callee = NULL;
+	char *ret = NULL;
+	switch (op->note) {
+	case PN_MARK:
+		return strdup ("mark");
+	case PN_POP_MARK:
+		return strdup ("pops to mark");
+	case PN_PUSH:
+		return r_str_newf ("pushes %s", name);
+	case PN_POP:
+		return r_str_newf ("pops %s", name);
+	case PN_MEMO_PUT:
+		return r_str_newf ("memo[%u] = %s", op->memo, name);
+	case PN_MEMO_GET:
+		return r_str_newf ("pushes memo[%u], %s", op->memo, name);
+	case PN_IMPORT:
+		callee = dump_glob_name (pvm, obj);
+		ret = r_str_newf ("imports %s", r_str_get_fail (callee, "?"));
+		break;
+	case PN_CALL:
+		switch (obj? obj->type: PY_NONE) {
+		case PY_REDUCE:
+		case PY_INST:
+		case PY_NEWOBJ:
+			callee = dump_glob_name (pvm, obj->reduce.glob);
+			if (!callee && obj->reduce.glob) {
+				callee = strdup (dump_varname (nfo, obj->reduce.glob));
+			}
+			break;
+		default:
+			break;
+		}
+		ret = r_str_newf ("calls %s -> %s", r_str_get_fail (callee, "?"), name);
+		break;
+	case PN_BUILD:
+		return r_str_newf ("builds %s", name);
+	case PN_APPEND:
+		return r_str_newf ("appends to %s", name);
+	case PN_SETITEM:
+		return r_str_newf ("sets items of %s", name);
+	case PN_ADDITEMS:
+		return r_str_newf ("adds to %s", name);
+	case PN_RETURN:
+		return r_str_newf ("returns %s", name);
+	default:
+		return NULL;
+	}
+	free (callee);
+	return ret;
+}
@@ -0,0 +1,62 @@
+#ifndef INDEX_PICKLE
+#define INDEX_PICKLE
+#include "pyobjutil.h"
+#include "dump.h"
+
+// pdPo, which object a byte of the pickle belongs to. While decoding, every
+// opcode records the object it left on top of the stack (the one it pushed,
+// built or memoized, the one it popped for POP), so a file offset maps to
+// its opcode by binary search and from there to the object. Paths are only
+// worked out on the first lookup, with one walk in pdPj's order that links
+// every object to where pdPj first prints it. Each opcode also keeps a note
+// of what it did, which pdPa renders into a comment at the opcode.
+
+// what an opcode did, see index_note
+typedef enum pickle_index_note {
+	PN_NONE = 0, // PROTO, FRAME
+	PN_MARK,
+	PN_PUSH,
+	PN_POP,
+	PN_POP_MARK,
+	PN_MEMO_PUT,
+	PN_MEMO_GET,
+	PN_IMPORT,
+	PN_CALL,
+	PN_BUILD,
+	PN_APPEND,
+	PN_SETITEM,
+	PN_ADDITEMS,
+	PN_RETURN, // STOP
+} PIndexNote;
+
+typedef struct pickle_index_op {
+	ut64 offset;
+	PyObj *obj; // NULL for opcodes that leave no object, like MARK or PROTO
+	ut32 memo; // memo index for PN_MEMO_*
+	ut8 note; // PIndexNote
+} PIndexOp;
+
+typedef struct pickle_index_link {
+	PyObj *parent; // NULL for the stacks
+	ut32 kind;
+	ut64 i, j;
+} PIndexLink;
+
+struct pickle_index {
+	PIndexOp *ops; // by offset
+	ut64 nops, ops_size;
+	ut64 end; // past the last opcode
+	HtUP *links; // PyObj * -> index + 1 into link, built by index_paths
+	PIndexLink *link;
+	ut64 nlinks, links_size;
+};
+
+PIndex *index_new(void);
+void index_free(PIndex *ix);
+bool index_op(PIndex *ix, ut64 offset, PyObj *obj, PIndexNote note, ut32 memo);
+const PIndexOp *index_find(PIndex *ix, ut64 addr, ut64 *size);
+bool index_paths(PIndex *ix, PMState *pvm);
+PyObj *index_obj(const PIndexOp *op);
+char *index_path(PIndex *ix, PyObj *obj);
+char *index_note(PMState *pvm, PrintInfo *nfo, const PIndexOp *op);
+#endif
@@ -0,0 +1,383 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "input.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+typedef enum {
+	STEP_MORE,
+	STEP_END,
+	STEP_ERR,
+} StepRet;
+
+struct pickle_input {
+	PInputKind kind;
+	ut8 *src; // compressed bytes, owned
+	ut64 src_size;
+	ut64 max; // pickle.limit.alloc, 0 for no limit
+	union { // only touched by the thread
+#ifdef HAVE_ZLIB
+		z_stream z;
+#endif
+#ifdef HAVE_BZIP2
+		bz_stream bz;
+#endif
+#ifdef HAVE_LZMA
+		lzma_stream xz;
+#endif
+		int none;
+	};
+	bool started; // stream initialized, needs an end
+	RThread *th;
+	// below is shared, under lock
+	RThreadLock *lock;
+	RThreadCond *cond;
+	ut8 *buf;
+	ut64 cap, avail;
+	RList *retired; // outgrown buffers the decoder may still be reading
+	bool done, failed, stop;
+};
+
+PInputKind input_sniff(const ut8 *buf, ut64 size) {
+	if (size >= 2 && buf[0] == 0x1f && buf[1] == 0x8b) {
+		return INPUT_GZIP;
+	}
+	if (size >= 2 && buf[0] == 0x78 && !(((buf[0] << 8) | buf[1]) % 31)) {
+		return INPUT_ZLIB;
+	}
+	if (size >= 10 && !memcmp (buf, "BZh", 3) && buf[3] >= '1' && buf[3] <= '9'
+		&& !memcmp (buf + 4, "\x31\x41\x59\x26\x53\x59", 6)
+	) {
+		return INPUT_BZIP2;
+	}
+	if (size >= 6 && !memcmp (buf, "\xfd" "7zXZ\x00", 6)) {
+		return INPUT_XZ;
+	}
+	// .lzma has no magic, check the header like liblzma does: default
+	// properties, a 2^n or 2^n + 2^(n-1) dictionary and a sane size
+	if (size >= 13 && buf[0] == 0x5d) {
+		ut32 dict = r_read_le32 (buf + 1);
+		ut64 len = r_read_le64 (buf + 5);
+		ut32 low = dict & -dict;
+		if (dict && (dict == low || dict == low * 3) && (len == UT64_MAX || len < (1ULL << 38))) {
+			return INPUT_LZMA;
+		}
+	}
+	return INPUT_RAW;
+}
+
+const char *input_name(PInputKind kind) {
+	switch (kind) {
+	case INPUT_GZIP:
+		return "gzip";
+	case INPUT_ZLIB:
+		return "zlib";
+	case INPUT_BZIP2:
+		return "bzip2";
+	case INPUT_XZ:
+		return "xz";
+	case INPUT_LZMA:
+		return "lzma";
+	default:
+		return "raw";
+	}
+}
+
+static bool input_begin(PInput *in) {
+	switch (in->kind) {
+#ifdef HAVE_ZLIB
+	case INPUT_GZIP:
+	case INPUT_ZLIB:
+		in->z.next_in = in->src;
+		in->z.avail_in = R_MIN (in->src_size, UT32_MAX);
+		return inflateInit2 (&in->z, 15 + 32) == Z_OK; // 32: zlib or gzip header
+#endif
+#ifdef HAVE_BZIP2
+	case INPUT_BZIP2:
+		in->bz.next_in = (char *)in->src;
+		in->bz.avail_in = R_MIN (in->src_size, UT32_MAX);
+		return BZ2_bzDecompressInit (&in->bz, 0, 0) == BZ_OK;
+#endif
+#ifdef HAVE_LZMA
+	case INPUT_XZ:
+	case INPUT_LZMA:
+		in->xz = (lzma_stream)LZMA_STREAM_INIT;
+		in->xz.next_in = in->src;
+		in->xz.avail_in = in->src_size;
+		return lzma_auto_decoder (&in->xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+#endif
+	default:
+		return false;
+	}
+}
+
+static void input_end(PInput *in) {
+	if (!in->started) {
+		return;
+	}
+	switch (in->kind) {
+#ifdef HAVE_ZLIB
+	case INPUT_GZIP:
+	case INPUT_ZLIB:
+		inflateEnd (&in->z);
+		break;
+#endif
+#ifdef HAVE_BZIP2
+	case INPUT_BZIP2:
+		BZ2_bzDecompressEnd (&in->bz);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case INPUT_XZ:
+	case INPUT_LZMA:
+		lzma_end (&in->xz);
+		break;
+#endif
+	default:
+		break;
+	}
+	in->started = false;
+}
+
+// decompress into out[0..len), concatenated gzip and bzip2 streams are
+// read as one (pigz, pbzip2)
+static StepRet input_step(PInput *in, ut8 *out, ut64 len, ut64 *got) {
+	*got = 0;
+	switch (in->kind) {
+#ifdef HAVE_ZLIB
+	case INPUT_GZIP:
+	case INPUT_ZLIB: {
+		in->z.next_out = out;
+		in->z.avail_out = len;
+		int r = inflate (&in->z, Z_NO_FLUSH);
+		*got = len - in->z.avail_out;
+		if (r == Z_STREAM_END) {
+			if (in->kind == INPUT_GZIP && in->z.avail_in && *in->z.next_in == 0x1f) {
+				return inflateReset (&in->z) == Z_OK? STEP_MORE: STEP_ERR;
+			}
+			return STEP_END;
+		}
+		return r == Z_OK? STEP_MORE: STEP_ERR; // Z_BUF_ERROR is truncated input
+	}
+#endif
+#ifdef HAVE_BZIP2
+	case INPUT_BZIP2: {
+		in->bz.next_out = (char *)out;
+		in->bz.avail_out = len;
+		int r = BZ2_bzDecompress (&in->bz);
+		*got = len - in->bz.avail_out;
+		if (r == BZ_STREAM_END) {
+			if (in->bz.avail_in >= 3 && !memcmp (in->bz.next_in, "BZh", 3)) {
+				char *next = in->bz.next_in;
+				unsigned int left = in->bz.avail_in;
+				BZ2_bzDecompressEnd (&in->bz);
+				memset (&in->bz, 0, sizeof (in->bz));
+				in->bz.next_in = next;
+				in->bz.avail_in = left;
+				return BZ2_bzDecompressInit (&in->bz, 0, 0) == BZ_OK? STEP_MORE: STEP_ERR;
+			}
+			return STEP_END;
+		}
+		if (r == BZ_OK && !in->bz.avail_in && *got < len) {
+			return STEP_ERR; // truncated
+		}
+		return r == BZ_OK? STEP_MORE: STEP_ERR;
+	}
+#endif
+#ifdef HAVE_LZMA
+	case INPUT_XZ:
+	case INPUT_LZMA: {
+		in->xz.next_out = out;
+		in->xz.avail_out = len;
+		lzma_ret r = lzma_code (&in->xz, LZMA_FINISH); // all input is there
+		*got = len - in->xz.avail_out;
+		if (r == LZMA_STREAM_END) {
+			return STEP_END;
+		}
+		return r == LZMA_OK? STEP_MORE: STEP_ERR;
+	}
+#endif
+	default:
+		return STEP_ERR;
+	}
+}
+
+// a bigger buffer, the old one is retired instead of freed since the
+// decoder may be reading it
+static bool input_grow(PInput *in, ut8 **buf, ut64 *cap, ut64 avail) {
+	ut64 ncap = *cap * 2;
+	if (in->max && ncap > in->max) {
+		ncap = in->max;
+	}
+	if (ncap <= *cap) {
+		R_LOG_ERROR ("Decompressed pickle is over pickle.limit.alloc (%"PFMT64u" bytes)", in->max);
+		return false;
+	}
+	ut8 *nbuf = malloc (ncap);
+	if (!nbuf) {
+		R_LOG_ERROR ("Failed to alloc %"PFMT64u" bytes for decompressed pickle", ncap);
+		return false;
+	}
+	memcpy (nbuf, *buf, avail);
+	r_th_lock_enter (in->lock);
+	bool ret = r_list_append (in->retired, in->buf)? true: false;
+	if (ret) {
+		in->buf = nbuf;
+		in->cap = ncap;
+	}
+	r_th_lock_leave (in->lock);
+	if (!ret) {
+		free (nbuf);
+		return false;
+	}
+	*buf = nbuf;
+	*cap = ncap;
+	return true;
+}
+
+static RThreadFunctionRet input_th(RThread *th) {
+	PInput *in = th->user;
+	ut8 *buf = in->buf;
+	ut64 cap = in->cap;
+	ut64 avail = 0;
+	StepRet r = STEP_MORE;
+	while (r == STEP_MORE) {
+		if (avail == cap && !input_grow (in, &buf, &cap, avail)) {
+			r = STEP_ERR;
+			break;
+		}
+		ut64 got;
+		r = input_step (in, buf + avail, R_MIN (cap - avail, INPUT_CHUNK), &got);
+		avail += got;
+		if (r == STEP_ERR) {
+			R_LOG_ERROR ("Bad or truncated %s data after %"PFMT64u" decompressed bytes", input_name (in->kind), avail);
+		}
+		r_th_lock_enter (in->lock);
+		in->avail = avail;
+		bool stop = in->stop;
+		if (r != STEP_MORE || stop) {
+			in->done = true;
+			in->failed = r == STEP_ERR;
+		}
+		r_th_cond_signal_all (in->cond);
+		r_th_lock_leave (in->lock);
+		if (stop) {
+			break;
+		}
+	}
+	if (r == STEP_ERR) {
+		r_th_lock_enter (in->lock);
+		in->done = in->failed = true;
+		r_th_cond_signal_all (in->cond);
+		r_th_lock_leave (in->lock);
+	}
+	input_end (in);
+	return R_TH_STOP;
+}
+
+// guess of the decompressed size, gzip trailer has it mod 2^32
+static inline ut64 input_cap(PInputKind kind, const ut8 *src, ut64 size, ut64 max) {
+	ut64 cap = 0;
+	if (kind == INPUT_GZIP && size >= 18) {
+		cap = r_read_le32 (src + size - 4);
+		cap = cap >= size? cap + 64: 0; // room for the end of stream
+	}
+	if (!cap) {
+		cap = R_MAX (size * 4, INPUT_CHUNK);
+	}
+	return max? R_MIN (cap, max): cap;
+}
+
+// takes src, which is freed with the input
+PInput *input_new(PInputKind kind, ut8 *src, ut64 size, ut64 max) {
+	PInput *in = R_NEW0 (PInput);
+	if (!in) {
+		free (src);
+		return NULL;
+	}
+	in->kind = kind;
+	in->src = src;
+	in->src_size = size;
+	in->max = max;
+	in->started = input_begin (in);
+	if (!in->started) {
+		R_LOG_ERROR ("Can't decompress %s pickle, pdP was built without support or the header is bad", input_name (kind));
+		input_free (in);
+		return NULL;
+	}
+	in->cap = input_cap (kind, src, size, max);
+	in->buf = malloc (in->cap);
+	in->retired = r_list_newf (free);
+	in->lock = r_th_lock_new (false);
+	in->cond = r_th_cond_new ();
+	if (!in->buf || !in->retired || !in->lock || !in->cond) {
+		input_free (in);
+		return NULL;
+	}
+	in->th = r_th_new (input_th, in, 0);
+	if (!in->th || !r_th_start (in->th)) {
+		R_LOG_ERROR ("Failed to start decompression thread");
+		input_free (in);
+		return NULL;
+	}
+	return in;
+}
+
+// Blocks until `need` bytes are decompressed or there is no more. Returns
+// true once the buffer is final. Earlier buffers are freed here, so pointers
+// from before the call are stale after it.
+bool input_wait(PInput *in, ut64 need, ut8 **buf, ut64 *avail) {
+	r_th_lock_enter (in->lock);
+	while (in->avail < need && !in->done) {
+		r_th_cond_wait (in->cond, in->lock);
+	}
+	r_list_purge (in->retired);
+	*buf = in->buf;
+	*avail = in->avail;
+	bool done = in->done;
+	r_th_lock_leave (in->lock);
+	return done;
+}
+
+// stops the decompression thread, if it is still running
+static void input_join(PInput *in) {
+	if (in->th) {
+		r_th_lock_enter (in->lock);
+		in->stop = true;
+		r_th_lock_leave (in->lock);
+		r_th_wait (in->th);
+		r_th_free (in->th);
+		in->th = NULL;
+	}
+}
+
+// stops the thread and hands over what was decompressed so far, false if
+// decompression failed
+bool input_finish(PInput *in, ut8 **buf, ut64 *size) {
+	input_join (in);
+	r_list_purge (in->retired);
+	*buf = in->buf;
+	*size = in->avail;
+	in->buf = NULL;
+	return !in->failed;
+}
+
+void input_free(PInput *in) {
+	if (in) {
+		input_join (in);
+		input_end (in);
+		r_list_free (in->retired);
+		r_th_lock_free (in->lock);
+		r_th_cond_free (in->cond);
+		free (in->buf);
+		free (in->src);
+		free (in);
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef INPUT_PICKLE
+#define INPUT_PICKLE
+#include "pyobjutil.h"
+
+// Compressed pickles (.pkl.gz, .pkl.bz2, .pkl.xz, joblib) are inflated by a
+// second thread into the decoder's buffer while the VM runs, instead of
+// going through a temp file. Each library is optional, see the Makefile.
+#define INPUT_CHUNK (1 << 20) // thread publishes output this often
+#define INPUT_AHEAD 16 // decoder waits when it gets closer than this to the end
+
+typedef enum pickle_input_kind {
+	INPUT_RAW = 0,
+	INPUT_GZIP, INPUT_ZLIB, // zlib
+	INPUT_BZIP2, // libbz2
+	INPUT_XZ, INPUT_LZMA, // liblzma, .xz and the older .lzma
+} PInputKind;
+
+PInputKind input_sniff(const ut8 *buf, ut64 size);
+const char *input_name(PInputKind kind);
+PInput *input_new(PInputKind kind, ut8 *src, ut64 size, ut64 max);
+bool input_wait(PInput *in, ut64 need, ut8 **buf, ut64 *avail);
+bool input_finish(PInput *in, ut8 **buf, ut64 *size);
+void input_free(PInput *in);
+#endif
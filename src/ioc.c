@@ -0,0 +1,365 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "ioc.h"
+
+#define TRIE_KEY(node, c) (((ut64)(node) << 8) | (c))
+#define MAX_NODES (1 << 24) // so TRIE_KEY and the target fit in one ut64, see edge_collect
+
+// index of the new node, 0 (the root) on failure
+static inline ut32 node_new(PIoc *a) {
+	if (a->nnodes >= MAX_NODES || !py_grow ((void **)&a->nodes, &a->nodes_size, a->nnodes, sizeof (PIocNode))) {
+		return 0;
+	}
+	memset (&a->nodes[a->nnodes], 0, sizeof (PIocNode));
+	return a->nnodes++;
+}
+
+// trie maps TRIE_KEY -> node + 1 while patterns are added
+static bool pattern_add(PIoc *a, HtUP *trie, char *pat) {
+	ut32 node = 0;
+	const ut8 *c;
+	for (c = (const ut8 *)pat; *c; c++) {
+		size_t kid = (size_t)ht_up_find (trie, TRIE_KEY (node, *c), NULL);
+		if (!kid) {
+			ut32 n = node_new (a);
+			if (!n || !ht_up_insert (trie, TRIE_KEY (node, *c), (void *)(size_t)(n + 1))) {
+				return false;
+			}
+			kid = n + 1;
+		}
+		node = kid - 1;
+	}
+	if (a->nodes[node].out) {
+		free (pat); // listed twice
+		return true;
+	}
+	if (!py_grow ((void **)&a->patterns, &a->patterns_size, a->npatterns, sizeof (char *))) {
+		return false;
+	}
+	a->patterns[a->npatterns++] = pat;
+	a->nodes[node].out = a->npatterns;
+	return true;
+}
+
+typedef struct edge_list {
+	ut64 *keys;
+	ut64 count;
+} EdgeList;
+
+static bool edge_collect(void *user, const ut64 k, const void *v) {
+	EdgeList *el = user;
+	el->keys[el->count++] = (k << 32) | ((size_t)v - 1); // node, byte, then target
+	return true;
+}
+
+static int edge_cmp(const void *a, const void *b) {
+	ut64 x = *(const ut64 *)a, y = *(const ut64 *)b;
+	return x < y? -1: x > y;
+}
+
+static inline ut32 edge_find(PIoc *a, ut32 s, ut8 c) {
+	PIocNode *n = &a->nodes[s];
+	PIocEdge *e = a->edges + n->edges;
+	ut32 lo = 0, hi = n->nedges;
+	while (lo < hi) {
+		ut32 mid = (lo + hi) / 2;
+		if (e[mid].c == c) {
+			return e[mid].to;
+		}
+		if (e[mid].c < c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return 0;
+}
+
+static inline ut32 ac_next(PIoc *a, ut32 s, ut8 c) {
+	while (s) {
+		ut32 t = edge_find (a, s, c);
+		if (t) {
+			return t;
+		}
+		s = a->nodes[s].fail;
+	}
+	return a->root[c];
+}
+
+// trie edges into sorted per node arrays, then fail and dict links breadth first
+static bool ioc_compile(PIoc *a, HtUP *trie) {
+	EdgeList el = { calloc (a->nnodes, sizeof (ut64)), 0 };
+	ut32 *queue = calloc (a->nnodes, sizeof (ut32));
+	a->edges = calloc (a->nnodes, sizeof (PIocEdge));
+	a->seen = calloc (a->npatterns + 1, sizeof (ut64));
+	bool ret = el.keys && queue && a->edges && a->seen;
+	if (ret) {
+		ht_up_foreach (trie, edge_collect, &el);
+		qsort (el.keys, el.count, sizeof (ut64), edge_cmp);
+		ut64 i;
+		for (i = 0; i < el.count; i++) {
+			ut32 from = el.keys[i] >> 40;
+			ut8 c = (el.keys[i] >> 32) & 0xff;
+			ut32 to = el.keys[i] & UT32_MAX;
+			if (!a->nodes[from].nedges) {
+				a->nodes[from].edges = i;
+			}
+			a->nodes[from].nedges++;
+			a->edges[i].c = c;
+			a->edges[i].to = to;
+			if (!from) {
+				a->root[c] = to;
+			}
+		}
+		ut64 head = 0, tail = 0;
+		queue[tail++] = 0;
+		while (head < tail) {
+			ut32 u = queue[head++];
+			PIocNode *n = &a->nodes[u];
+			for (i = 0; i < n->nedges; i++) {
+				PIocEdge *e = &a->edges[n->edges + i];
+				PIocNode *v = &a->nodes[e->to];
+				v->fail = u? ac_next (a, n->fail, e->c): 0;
+				PIocNode *f = &a->nodes[v->fail];
+				v->dict = f->out? v->fail: f->dict;
+				queue[tail++] = e->to;
+			}
+		}
+	}
+	free (el.keys);
+	free (queue);
+	return ret;
+}
+
+// one IOC per line, as is. Empty lines and lines starting with `#` are skipped
+PIoc *ioc_load(const char *path) {
+	char *data = r_file_slurp (path, NULL);
+	if (!data) {
+		R_LOG_ERROR ("Can't read pickle.ioc file %s", path);
+		return NULL;
+	}
+	PIoc *a = R_NEW0 (PIoc);
+	HtUP *trie = ht_up_new0 ();
+	bool ret = a && trie && (a->path = strdup (path)) && (a->by_slot = ht_up_new0 ());
+	if (ret) {
+		node_new (a);
+		ret = a->nnodes == 1;
+	}
+	char *line = data;
+	while (ret && line) {
+		char *nl = strchr (line, '\n');
+		if (nl) {
+			*nl = '\0';
+		}
+		size_t len = strlen (line);
+		if (len && line[len - 1] == '\r') {
+			line[--len] = '\0';
+		}
+		if (len && *line != '#') {
+			char *pat = strdup (line);
+			ret = pat && pattern_add (a, trie, pat);
+			if (!ret) {
+				free (pat);
+			}
+		}
+		line = nl? nl + 1: NULL;
+	}
+	free (data);
+	ret = ret && ioc_compile (a, trie);
+	ht_up_free (trie);
+	if (!ret) {
+		R_LOG_ERROR ("Failed to compile pickle.ioc file %s", path);
+		ioc_free (a);
+		return NULL;
+	}
+	if (!a->npatterns) {
+		R_LOG_WARN ("No IOC strings in %s", path);
+	}
+	return a;
+}
+
+void ioc_free(PIoc *a) {
+	if (a) {
+		ut64 i;
+		for (i = 0; i < a->npatterns; i++) {
+			free (a->patterns[i]);
+		}
+		free (a->patterns);
+		free (a->nodes);
+		free (a->edges);
+		free (a->seen);
+		free (a->hits);
+		free (a->open);
+		free (a->runs);
+		ht_up_free (a->by_slot);
+		free (a->path);
+		free (a);
+	}
+}
+
+// hits at depth and above become one run at depth, the object built from them
+void ioc_merge(PIoc *a, ut64 depth) {
+	ut64 first = UT64_MAX;
+	while (a->nruns && a->runs[a->nruns - 1].depth >= depth) {
+		first = a->runs[--a->nruns].first;
+	}
+	if (first != UT64_MAX) {
+		a->runs[a->nruns].depth = depth;
+		a->runs[a->nruns++].first = first;
+	}
+}
+
+static void ioc_take(PIoc *a, ut64 depth, ut64 call, char op) {
+	ut64 first = a->nopen;
+	while (a->nruns && a->runs[a->nruns - 1].depth >= depth) {
+		first = a->runs[--a->nruns].first;
+	}
+	ut64 i;
+	for (i = first; i < a->nopen; i++) {
+		PIocHit *h = &a->hits[a->open[i]];
+		h->open = false;
+		h->call = call;
+		h->op = op;
+	}
+	a->nopen = first;
+}
+
+// hits at depth and above are gone from the stack without being called
+void ioc_drop(PIoc *a, ut64 depth) {
+	ioc_take (a, depth, IOC_NONE, 0);
+}
+
+// hits at depth and above are the callable or args of this call
+void ioc_call(PIoc *a, ut64 depth, ut64 offset, char op) {
+	ioc_take (a, depth, offset, op);
+}
+
+static bool hit_open(PIoc *a, ut64 hit, ut64 depth) {
+	if (a->nruns && a->runs[a->nruns - 1].depth > depth) {
+		ioc_merge (a, depth);
+	}
+	if (!a->nruns || a->runs[a->nruns - 1].depth != depth) {
+		if (!py_grow ((void **)&a->runs, &a->runs_size, a->nruns, sizeof (PIocRun))) {
+			return false;
+		}
+		a->runs[a->nruns].depth = depth;
+		a->runs[a->nruns++].first = a->nopen;
+	}
+	if (!py_grow ((void **)&a->open, &a->open_size, a->nopen, sizeof (ut64))) {
+		return false;
+	}
+	a->open[a->nopen++] = hit;
+	a->hits[hit].open = true;
+	return true;
+}
+
+static bool hit_add(PIoc *a, ut64 offset, ut32 pattern, ut32 at, bool global, ut64 depth) {
+	a->count++;
+	if (a->nhits >= IOC_KEEP) {
+		return true;
+	}
+	if (!py_grow ((void **)&a->hits, &a->hits_size, a->nhits, sizeof (PIocHit))) {
+		return false;
+	}
+	PIocHit *h = &a->hits[a->nhits];
+	memset (h, 0, sizeof (*h));
+	h->offset = offset;
+	h->pattern = pattern;
+	h->at = at;
+	h->global = global;
+	h->call = IOC_NONE;
+	return hit_open (a, a->nhits++, depth);
+}
+
+// every IOC in data, each reported once, for the object at stack depth.
+// slot is the string's PGSlot, so memo gets of it can find its hits again
+bool ioc_scan(PIoc *a, const ut8 *data, ut64 len, ut64 offset, ut64 depth, bool global, ut64 slot) {
+	ut64 first = a->nhits;
+	ut64 i;
+	ut32 s = 0;
+	a->scan++;
+	for (i = 0; i < len; i++) {
+		s = ac_next (a, s, data[i]);
+		ut32 o = a->nodes[s].out? s: a->nodes[s].dict;
+		for (; o; o = a->nodes[o].dict) {
+			ut32 p = a->nodes[o].out - 1;
+			if (a->seen[p] == a->scan) {
+				continue;
+			}
+			a->seen[p] = a->scan;
+			ut64 at = i + 1 - strlen (a->patterns[p]);
+			if (!hit_add (a, offset, p, R_MIN (at, UT32_MAX), global, depth)) {
+				return false;
+			}
+		}
+	}
+	if (!global && a->nhits > first) {
+		ht_up_insert (a->by_slot, slot, (void *)(size_t)(first + 1));
+	}
+	return true;
+}
+
+// a memo get or DUP pushed the string in slot again, its hits that were
+// dropped without a call are back on the stack
+bool ioc_reopen(PIoc *a, ut64 slot, ut64 depth) {
+	size_t at = (size_t)ht_up_find (a->by_slot, slot, NULL);
+	ut64 i;
+	for (i = at? at - 1: a->nhits; i < a->nhits && a->hits[i].offset == a->hits[at - 1].offset; i++) {
+		PIocHit *h = &a->hits[i];
+		if (!h->global && !h->open && h->call == IOC_NONE && !hit_open (a, i, depth)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline char *pattern_esc(PIoc *a, ut32 p) {
+	return r_str_escape_raw ((const ut8 *)a->patterns[p], strlen (a->patterns[p]));
+}
+
+// `## ioc <path>: N hits`, then `offset kind "ioc" +at in <call> at offset`
+bool ioc_dump(RStrBuf *sb, PIoc *a) {
+	bool ret = r_strbuf_appendf (sb, "## ioc %s: %"PFMT64u" hits, %"PFMT64u" patterns\n", a->path, a->count, a->npatterns);
+	ut64 i;
+	for (i = 0; ret && i < a->nhits; i++) {
+		PIocHit *h = &a->hits[i];
+		char *pat = pattern_esc (a, h->pattern);
+		ret = pat && r_strbuf_appendf (sb, "0x%08"PFMT64x" %s \"%s\" +%u", h->offset, h->global? "global": "string", pat, h->at);
+		if (ret && h->call == IOC_NONE) {
+			ret = r_strbuf_append (sb, ", not called\n");
+		} else if (ret) {
+			ret = r_strbuf_appendf (sb, " in %s at 0x%"PFMT64x"\n", py_opcode_to_name (h->op), h->call);
+		}
+		free (pat);
+	}
+	if (ret && a->count > a->nhits) {
+		ret = r_strbuf_appendf (sb, "## ... %"PFMT64u" more\n", a->count - a->nhits);
+	}
+	return ret;
+}
+
+// {"path", "patterns", "count", "hits": [{"offset", "kind", "ioc", "at", "call": {"offset", "op"}}]}
+bool ioc_dump_json(PJ *pj, PIoc *a) {
+	bool ret = pj_o (pj)
+		&& pj_ks (pj, "path", a->path)
+		&& pj_kn (pj, "patterns", a->npatterns)
+		&& pj_kn (pj, "count", a->count)
+		&& pj_ka (pj, "hits");
+	ut64 i;
+	for (i = 0; ret && i < a->nhits; i++) {
+		PIocHit *h = &a->hits[i];
+		ret = pj_o (pj)
+			&& pj_kn (pj, "offset", h->offset)
+			&& pj_ks (pj, "kind", h->global? "global": "string")
+			&& pj_ks (pj, "ioc", a->patterns[h->pattern])
+			&& pj_kn (pj, "at", h->at);
+		if (ret && h->call != IOC_NONE) {
+			ret = pj_ko (pj, "call")
+				&& pj_kn (pj, "offset", h->call)
+				&& pj_ks (pj, "op", py_opcode_to_name (h->op))
+				&& pj_end (pj);
+		}
+		ret = ret && pj_end (pj);
+	}
+	return ret && pj_end (pj) && pj_end (pj);
+}
@@ -0,0 +1,71 @@
+#ifndef IOC_PICKLE
+#define IOC_PICKLE
+#include "pyobjutil.h"
+
+// pdPi, signature scan. The IOC strings in pickle.ioc are compiled into an
+// Aho-Corasick automaton once per run. String payloads are matched straight
+// from the pickle buffer as the globals VM (see globals.h) pushes them, and
+// the `module.name` of every global as it is imported. Each hit is then
+// followed through the stack until a call consumes it, that call is the
+// enclosing reduce. Nothing is rendered.
+#define IOC_KEEP 4096 // hits kept for the report, the rest are only counted
+#define IOC_NONE UT64_MAX // IocHit.call when nothing called it
+
+typedef struct pickle_ioc_node {
+	ut32 fail; // longest proper suffix that is also a node
+	ut32 out; // pattern index + 1 ending here, 0 for none
+	ut32 dict; // next node on the fail chain with an out, 0 for none
+	ut32 edges, nedges; // into PIoc.edges, sorted by byte
+} PIocNode;
+
+typedef struct pickle_ioc_edge {
+	ut8 c;
+	ut32 to;
+} PIocEdge;
+
+typedef struct pickle_ioc_hit {
+	ut64 offset; // opcode that pushed the string or imported the global
+	ut32 pattern; // index into PIoc.patterns
+	ut32 at; // where in the string or `module.name` it matched
+	bool global;
+	bool open; // still on the stack, no call consumed it yet
+	ut64 call; // offset of the call that consumed it, IOC_NONE if none did
+	char op; // and its opcode
+} PIocHit;
+
+// open hits from `first` up to the next run sit at stack depth `depth`
+typedef struct pickle_ioc_run {
+	ut64 depth;
+	ut64 first; // index into PIoc.open
+} PIocRun;
+
+struct pickle_ioc {
+	char *path;
+	char **patterns;
+	ut64 npatterns, patterns_size;
+	PIocNode *nodes; // nodes[0] is the root
+	ut64 nnodes, nodes_size;
+	PIocEdge *edges;
+	ut32 root[256]; // root transitions, dense since every scan goes through them
+	ut64 *seen; // per pattern, last scan it was reported in
+	ut64 scan;
+	PIocHit *hits;
+	ut64 nhits, hits_size;
+	ut64 count; // all hits, kept or not
+	ut64 *open; // hits still on the stack, ordered by depth
+	ut64 nopen, open_size;
+	PIocRun *runs;
+	ut64 nruns, runs_size;
+	HtUP *by_slot; // string slot -> index + 1 of its first hit, for memo gets
+};
+
+PIoc *ioc_load(const char *path);
+void ioc_free(PIoc *a);
+bool ioc_scan(PIoc *a, const ut8 *data, ut64 len, ut64 offset, ut64 depth, bool global, ut64 slot);
+void ioc_merge(PIoc *a, ut64 depth);
+void ioc_drop(PIoc *a, ut64 depth);
+void ioc_call(PIoc *a, ut64 depth, ut64 offset, char op);
+bool ioc_reopen(PIoc *a, ut64 slot, ut64 depth);
+bool ioc_dump(RStrBuf *sb, PIoc *a);
+bool ioc_dump_json(PJ *pj, PIoc *a);
+#endif
@@ -1,8 +1,11 @@
 /* radare - LGPL - Copyright 2022 - bemodtwz */
 #include <r_util.h>
 #include "json_dump.h"
-
-static bool py_obj(PJ *pj, PyObj *obj, RList *path);
+#include "stats.h"
+#include "plimits.h"
+#include "skeleton.h"
+#include "tensor.h"
+#include "policy.h"
 
 static bool inline path_push(RList *path, char *str) {
 	if (str && r_list_push (path, str)) {
@@ -38,163 +41,312 @@ static inline bool obj_add_path(PyObj *obj, RList *path) {
 	return false;
 }
 
-static inline bool pj_list(PJ *pj, RList *l, RList *path) {
-	ut32 i = 0;
+// Like the python printer every nested value is a resumable step over a
+// JsonFrame, run by json_walk on a heap allocated stack instead of the C one.
+#define JSON_CALL 2 // step pushed a child, resume with its result
+
+enum {
+	JF_OBJ = 0, JF_LIST, JF_KLIST, JF_GLOB, JF_REDUCE, JF_DICT, JF_OP_M, JF_OP_S, JF_WHAT,
+	JF_COUNT
+};
+
+typedef struct json_frame {
+	ut8 kind;
+	ut8 step; // where to resume once the child returns
+	bool ret;
+	ut32 i;
 	PyObj *obj;
+	PyOper *pop;
+	RList *list;
 	RListIter *iter;
-	if (pj_a (pj)) {
-		r_list_foreach (l, iter, obj) {
-			if (obj->type == PY_SPLIT && !r_list_iter_get_next (iter)) {
-				break;
-			}
-			if (
-				!path_push (path, r_str_newf ("[%u]", i++))
-				|| !py_obj (pj, obj, path)
-				|| !path_pop (path)
-			) {
-				return false;
-			}
+	const char *name;
+	PSkel skel; // lists and dicts, elided elements in skeleton mode
+} JsonFrame;
+
+typedef struct json_walk {
+	PJ *pj;
+	RList *path;
+	PLimits *lim;
+	ut64 skeleton; // pickle.skeleton, 0 for off
+	PTensorSrc tensor;
+	JsonFrame *frames;
+	ut32 nframes, frames_size;
+} JsonWalk;
+
+typedef int (*JsonStep)(JsonWalk *w, JsonFrame *f, bool rv);
+
+// may move the stack, parent frame pointers are stale afterwards
+static inline JsonFrame *json_push(JsonWalk *w, int kind, PyObj *obj) {
+	if (w->nframes == w->frames_size) {
+		ut32 size = w->frames_size? w->frames_size * 2: 64;
+		JsonFrame *frames = realloc (w->frames, size * sizeof (JsonFrame));
+		if (!frames) {
+			R_LOG_ERROR ("Failed to grow JSON printer stack");
+			return NULL;
 		}
-		return pj_end (pj)? true: false;
+		w->frames = frames;
+		w->frames_size = size;
 	}
-	return false;
+	JsonFrame *f = &w->frames[w->nframes++];
+	memset (f, 0, sizeof (*f));
+	f->kind = kind;
+	f->obj = obj;
+	return f;
 }
 
-static inline bool pj_klist(PJ *pj, char *name, RList *l, RList *path) {
-	if (
-		pj_k (pj, name)
-		&& path_push (path, r_str_newf (".%s", name))
-		&& pj_list (pj, l, path)
-		&& path_pop (path)
-	) {
-		return true;
-	}
-	return false;
+// push child of `kind`, `f` resumes at `step`. Must be the last thing a step does
+static inline JsonFrame *json_call(JsonWalk *w, JsonFrame *f, int step, int kind, PyObj *obj) {
+	f->step = step;
+	return json_push (w, kind, obj);
 }
 
-static inline bool py_glob(PJ *pj, PyObj *obj, RList *path) {
-	if (
-		pj_o (pj)
-
-		&& pj_k (pj, "proto")
-		&& pj_N (pj, obj->py_glob.proto)
+#define JCALL_OBJ(w, f, step, obj) (json_call (w, f, step, JF_OBJ, obj)? JSON_CALL: false)
 
-		&& path_push (path, strdup(".module"))
-		&& pj_k (pj, "module")
-		&& py_obj (pj, obj->py_glob.module, path)
-		&& path_pop (path)
+static inline JsonFrame *json_call_list(JsonWalk *w, JsonFrame *f, int step, int kind, RList *l) {
+	JsonFrame *c = json_call (w, f, step, kind, NULL);
+	if (c) {
+		c->list = l;
+	}
+	return c;
+}
 
-		&& path_push (path, strdup(".name"))
-		&& pj_k (pj, "name")
-		&& py_obj (pj, obj->py_glob.name, path)
-		&& path_pop (path)
+static int jstep_list(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	if (!f->step) {
+		if (!pj_a (pj)) {
+			return false;
+		}
+		f->iter = f->list? r_list_head (f->list): NULL;
+	} else {
+		if (!rv || !path_pop (w->path)) {
+			return false;
+		}
+		f->iter = r_list_iter_get_next (f->iter);
+		if (f->iter == f->skel.gap && f->iter) {
+			f->iter = f->skel.resume;
+			f->i += f->skel.elided;
+		}
+	}
+	if (f->iter) {
+		PyObj *obj = r_list_iter_get_data (f->iter);
+		if (!w->lim->stop && !(obj->type == PY_SPLIT && !r_list_iter_get_next (f->iter))) {
+			if (!path_push (w->path, r_str_newf ("[%u]", f->i++))) {
+				return false;
+			}
+			return JCALL_OBJ (w, f, 1, obj);
+		}
+	}
+	return pj_end (pj)? true: false;
+}
 
-		&& pj_end (pj)
-	) {
-		return true;
+static int jstep_klist(JsonWalk *w, JsonFrame *f, bool rv) {
+	if (!f->step) {
+		if (
+			pj_k (w->pj, f->name)
+			&& path_push (w->path, r_str_newf (".%s", f->name))
+		) {
+			return json_call_list (w, f, 1, JF_LIST, f->list)? JSON_CALL: false;
+		}
+		return false;
 	}
-	return false;
+	return rv && path_pop (w->path);
 }
 
-static inline bool py_reduce(PJ *pj, PyObj *obj, RList *path) {
-	bool ret = pj_o (pj)
-		&& path_push (path, strdup(".glob"))
-		&& pj_k (pj, "func")
-		&& py_obj (pj, obj->reduce.glob, path)
-		&& path_pop (path)
+static int jstep_glob(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	PyObj *obj = f->obj;
+	switch (f->step) {
+	case 0:
+		if (
+			pj_o (pj)
+
+			&& pj_k (pj, "proto")
+			&& pj_N (pj, obj->py_glob.proto)
 
-		&& path_push (path, strdup(".args"))
-		&& pj_k (pj, "args")
-		&& py_obj (pj, obj->reduce.args, path)
-		&& path_pop (path);
+			&& path_push (w->path, strdup(".module"))
+			&& pj_k (pj, "module")
+		) {
+			return JCALL_OBJ (w, f, 1, obj->py_glob.module);
+		}
+		return false;
+	case 1:
+		if (
+			rv
+			&& path_pop (w->path)
 
-	if (ret && obj->reduce.kwargs) {
-		ret = path_push (path, strdup(".kwargs"))
-		&& pj_k (pj, "kwargs")
-		&& py_obj (pj, obj->reduce.kwargs, path)
-		&& path_pop (path);
+			&& path_push (w->path, strdup(".name"))
+			&& pj_k (pj, "name")
+		) {
+			return JCALL_OBJ (w, f, 2, obj->py_glob.name);
+		}
+		return false;
 	}
-	return ret && pj_end (pj);
+	return rv
+		&& path_pop (w->path)
+		&& pj_end (pj);
 }
 
-static inline bool pj_py_dict(PJ *pj, RList *l, RList *path) {
-	PyObj *obj;
-	RListIter *iter;
-
-	if (pj_a (pj)) {
-		ut32 i = 0;
-		r_list_foreach (l, iter, obj) {
-			if (obj->type == PY_SPLIT) {
-				if (!r_list_iter_get_next (iter)) {
-					break;
-				}
-				if (!py_obj (pj, obj, path)) {
-					return false;
-				}
-				i += 2; // treat split as 2 things, to keep rest of logic correct
-				continue;
-			}
+static int jstep_reduce(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	PyObj *obj = f->obj;
+	switch (f->step) {
+	case 0:
+		if (
+			pj_o (pj)
+			&& path_push (w->path, strdup(".glob"))
+			&& pj_k (pj, "func")
+		) {
+			return JCALL_OBJ (w, f, 1, obj->reduce.glob);
+		}
+		return false;
+	case 1:
+		if (
+			rv
+			&& path_pop (w->path)
 
-			if (i % 2 == 0) { // outer index
-			  if (!path_push (path, r_str_newf ("[%d]", i / 2)) || !pj_a (pj)) {
-					return false;
-				}
-			}
-			if ( // inneer index
-				!path_push (path, r_str_newf ("[%d]", i % 2 == 0? 0: 1))
-				|| !py_obj (pj, obj, path)
-				|| !path_pop (path)
+			&& path_push (w->path, strdup(".args"))
+			&& pj_k (pj, "args")
+		) {
+			return JCALL_OBJ (w, f, 2, obj->reduce.args);
+		}
+		return false;
+	case 2:
+		if (!rv || !path_pop (w->path)) {
+			return false;
+		}
+		if (obj->reduce.kwargs) {
+			if (
+				path_push (w->path, strdup(".kwargs"))
+				&& pj_k (pj, "kwargs")
 			) {
-				return false;
+				return JCALL_OBJ (w, f, 3, obj->reduce.kwargs);
 			}
-			if (i % 2) {
-				if (!pj_end (pj) || !path_pop (path)) {
-					pj_end (pj);
-				}
+			return false;
+		}
+		break;
+	default:
+		if (!rv || !path_pop (w->path)) {
+			return false;
+		}
+		break;
+	}
+	return pj_end (pj)? true: false;
+}
+
+static int jstep_dict(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	switch (f->step) {
+	case 0:
+		if (!pj_a (pj)) {
+			return false;
+		}
+		f->iter = f->list? r_list_head (f->list): NULL;
+		break;
+	case 1: // split
+		if (!rv) {
+			return false;
+		}
+		f->i += 2; // treat split as 2 things, to keep rest of logic correct
+		f->iter = r_list_iter_get_next (f->iter);
+		break;
+	default:
+		if (!rv || !path_pop (w->path)) {
+			return false;
+		}
+		if (f->i % 2) {
+			if (!pj_end (pj) || !path_pop (w->path)) {
+				pj_end (pj);
 			}
-			i++;
 		}
-		return pj_end (pj)? true: false;
+		f->i++;
+		f->iter = r_list_iter_get_next (f->iter);
+		if (f->iter == f->skel.gap && f->iter) {
+			f->iter = f->skel.resume;
+			f->i += f->skel.elided * 2;
+		}
+		break;
 	}
-	return false;
+
+	if (!f->iter || (w->lim->stop && f->i % 2 == 0)) {
+		return pj_end (pj)? true: false; // only stop between pairs
+	}
+	PyObj *obj = r_list_iter_get_data (f->iter);
+	if (obj->type == PY_SPLIT) {
+		if (!r_list_iter_get_next (f->iter)) {
+			return pj_end (pj)? true: false;
+		}
+		return JCALL_OBJ (w, f, 1, obj);
+	}
+
+	if (f->i % 2 == 0) { // outer index
+		if (!path_push (w->path, r_str_newf ("[%d]", f->i / 2)) || !pj_a (pj)) {
+			return false;
+		}
+	}
+	// inneer index
+	if (!path_push (w->path, r_str_newf ("[%d]", f->i % 2 == 0? 0: 1))) {
+		return false;
+	}
+	return JCALL_OBJ (w, f, 2, obj);
 }
 
-static inline bool pj_pyop_m(PJ *pj, PyOper *pop, RList *path) {
-	if (
-		pj_o (pj)
-		&& pj_kn (pj, "offset", pop->offset)
-		&& pj_ks (pj, "Op", py_op_to_name (pop->op))
-		&& pj_klist (pj, "args", pop->stack, path)
-		&& pj_end (pj)
-	) {
-		return true;
+static int jstep_op_m(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	PyOper *pop = f->pop;
+	if (!f->step) {
+		if (
+			pj_o (pj)
+			&& pj_kn (pj, "offset", pop->offset)
+			&& pj_ks (pj, "Op", py_op_to_name (pop->op))
+		) {
+			JsonFrame *c = json_call_list (w, f, 1, JF_KLIST, pop->stack);
+			if (c) {
+				c->name = "args";
+				return JSON_CALL;
+			}
+		}
+		return false;
 	}
-	return false;
+	return rv && pj_end (pj);
 }
 
-static inline bool pj_pyop_s(PJ *pj, PyOper *pop, RList *path) {
-	if (!pj_o (pj)
-		|| !pj_kn (pj, "offset", pop->offset)
-		|| !pj_ks (pj, "Op", py_op_to_name (pop->op))
-		|| !pj_k (pj, "arg")
-		|| !path_push (path, strdup (".arg"))
-		|| !py_obj (pj, pop->obj, path)
-		|| !path_pop (path)
-		|| !pj_end (pj)
-	) {
+static int jstep_op_s(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	PyOper *pop = f->pop;
+	if (!f->step) {
+		if (!pj_o (pj)
+			|| !pj_kn (pj, "offset", pop->offset)
+			|| !pj_ks (pj, "Op", py_op_to_name (pop->op))
+			|| !pj_k (pj, "arg")
+			|| !path_push (w->path, strdup (".arg"))
+		) {
+			return false;
+		}
+		return JCALL_OBJ (w, f, 1, pop->obj);
+	}
+	if (!rv || !path_pop (w->path) || !pj_end (pj)) {
 		return false;
 	}
 	return true;
 }
 
-static inline bool pj_obj_what(PJ *pj, PyObj *obj, RList *path) {
-	if (!pj_a (pj)) {
-		return false;
+static int jstep_what(JsonWalk *w, JsonFrame *f, bool rv) {
+	PyObj *obj = f->obj;
+	if (!f->step) {
+		if (!pj_a (w->pj)) {
+			return false;
+		}
+		f->iter = r_list_head (obj->py_what);
+	} else {
+		if (!rv) {
+			return false;
+		}
+		f->iter = r_list_iter_get_next (f->iter);
 	}
 
-	PyOper *pop;
-	RListIter *iter;
-	r_list_foreach (obj->py_what, iter, pop) {
+	for (; f->iter && !w->lim->stop; f->iter = r_list_iter_get_next (f->iter)) {
+		PyOper *pop = r_list_iter_get_data (f->iter);
+		int kind = JF_OP_M;
 		switch (pop->op) {
 		case OP_FAKE_SPLIT:
 			if (pop == r_list_last (obj->py_what)) {
@@ -202,21 +354,42 @@ static inline bool pj_obj_what(PJ *pj, PyObj *obj, RList *path) {
 			}
 			// fallthrough
 		case OP_FAKE_INIT:
-			if (!pj_pyop_s (pj, pop, path)) {
-				return false;
-			}
+			kind = JF_OP_S;
 			break;
 		default:
-			if (!pj_pyop_m (pj, pop, path)) {
-				return false;
-			}
 			break;
 		}
+		JsonFrame *c = json_call (w, f, 1, kind, NULL);
+		if (!c) {
+			return false;
+		}
+		c->pop = pop;
+		return JSON_CALL;
 	}
-	return pj_end (pj)? true: false;
+	return pj_end (w->pj)? true: false;
 }
 
-static bool py_obj(PJ *pj, PyObj *obj, RList *path) {
+// keeps JSON valid when a limit is reached, object is replaced by a stub
+static inline bool py_obj_limit(PJ *pj, PyObj *obj, PLimits *lim) {
+	if (!lim->stop && limits_over (lim, PLIM_OUTPUT, r_strbuf_length (&pj->sb))) {
+		limits_hit (lim, PLIM_OUTPUT, obj->offset);
+	}
+#ifdef R_PRINT_JSON_DEPTH_LIMIT
+	// PJ itself can only nest so deep, each object takes up to 3 levels
+	if (!lim->stop && pj->level + 4 >= R_PRINT_JSON_DEPTH_LIMIT) {
+		limits_hit (lim, PLIM_DEPTH, obj->offset);
+	}
+#endif
+	return limits_enter (lim, obj->offset);
+}
+
+static int jstep_obj(JsonWalk *w, JsonFrame *f, bool rv) {
+	PJ *pj = w->pj;
+	PyObj *obj = f->obj;
+	if (f->step) {
+		f->ret = rv;
+		goto done;
+	}
 	if (
 		!pj_o (pj)
 		|| !pj_kn (pj, "offset", obj->offset)
@@ -224,83 +397,145 @@ static bool py_obj(PJ *pj, PyObj *obj, RList *path) {
 	) {
 		return false;
 	}
+	if (!py_obj_limit (pj, obj, w->lim)) {
+		return pj_ks (pj, "limit", limits_name (w->lim->stop)) && pj_end (pj);
+	}
 	if (obj->refcnt) {
 		if (obj->varname) {
+			limits_leave (w->lim);
 			return pj_ks (pj, "prev_seen", obj->varname) && pj_end (pj);
 		}
-		if (!obj_add_path (obj, path)) {
+		if (!obj_add_path (obj, w->path)) {
 			return false;
 		}
 	}
 
+	PTensor t;
+	if (tensor_get (&t, obj, &w->tensor)) {
+		limits_leave (w->lim);
+		return tensor_dump_json (pj, &t) && pj_end (pj);
+	}
+
+	PShape sh;
+	bool skel = w->skeleton && shape_get (&sh, obj, w->skeleton);
+	const PZipEntry *member = obj->type == PY_PERSID? zip_persid (w->tensor.zip, obj->py_pid): NULL;
 	if (
-		!pj_k (pj, "value")
-		|| !path_push (path, strdup(".value"))
+		(skel && !shape_dump_json (pj, &sh))
+		|| (member && !zip_entry_dump_json (pj, "member", member))
+		|| !pj_k (pj, "value")
+		|| !path_push (w->path, strdup(".value"))
 	) {
 		return false;
 	}
 	// just the value
-	bool ret = true;
+	f->ret = true;
 	switch (obj->type) {
 	case PY_EXT:
-		ret &= pj_N (pj, obj->py_extnum)? true: false;
+		f->ret &= pj_N (pj, obj->py_extnum)? true: false;
 		break;
 	case PY_BUFFER:
-		ret &= pj_N (pj, obj->py_bufi)? true: false;
+		f->ret &= pj_N (pj, obj->py_bufi)? true: false;
 		break;
 	case PY_INT:
-		ret &= pj_N (pj, obj->py_int)? true: false;
+		f->ret &= pj_N (pj, obj->py_int)? true: false;
 		break;
 	case PY_FLOAT:
-		ret &= pj_d (pj, obj->py_float)? true: false;
+		f->ret &= pj_d (pj, obj->py_float)? true: false;
 		break;
 	case PY_NONE:
-		ret &= pj_null (pj)? true: false;
+		f->ret &= pj_null (pj)? true: false;
 		break;
 	case PY_BOOL:
-		ret &= pj_b (pj, obj->py_bool)? true: false;
+		f->ret &= pj_b (pj, obj->py_bool)? true: false;
 		break;
 	case PY_GLOB:
-		ret &= py_glob (pj, obj, path);
-		break;
+		return json_call (w, f, 1, JF_GLOB, obj)? JSON_CALL: false;
 	case PY_PERSID:
-		ret &= py_obj (pj, obj->py_pid, path);
-		break;
+		return JCALL_OBJ (w, f, 1, obj->py_pid);
 	case PY_NEWOBJ:
 	case PY_INST:
 	case PY_REDUCE:
-		ret &= py_reduce (pj, obj, path);
-		break;
+		return json_call (w, f, 1, JF_REDUCE, obj)? JSON_CALL: false;
 	case PY_STR:
-		ret &= pj_s (pj, obj->py_str)? true: false;
+		f->ret &= pj_s (pj, obj->py_str)? true: false;
 		break;
 	case PY_SPLIT:
-		ret &= py_obj (pj, obj->split, path);
-		break;
+		return JCALL_OBJ (w, f, 1, obj->split);
 	case PY_BUFFER_RO:
-		ret &= py_obj (pj, obj->py_robuf, path);
-		break;
+		return JCALL_OBJ (w, f, 1, obj->py_robuf);
 	case PY_FROZEN_SET:
 	case PY_SET:
 	case PY_LIST:
 	case PY_TUPLE:
-		ret &= pj_list (pj, obj->py_iter, path);
-		break;
-	case PY_DICT:
-		ret &= pj_py_dict (pj, obj->py_iter, path);
-		break;
+	case PY_DICT: {
+		JsonFrame *c = json_call_list (w, f, 1, obj->type == PY_DICT? JF_DICT: JF_LIST, obj->py_iter);
+		if (c && skel) {
+			c->skel = sh.skel;
+		}
+		return c? JSON_CALL: false;
+	}
 	case PY_WHAT:
-		ret &= pj_obj_what (pj, obj, path);
-		break;
+		return json_call (w, f, 1, JF_WHAT, obj)? JSON_CALL: false;
 	default:
 		r_warn_if_reached ();
-		ret = false;
+		f->ret = false;
+	}
+
+done:
+	path_pop (w->path);
+	limits_leave (w->lim);
+	return f->ret && pj_end (pj)? true: false;
+}
+
+static const JsonStep json_steps[JF_COUNT] = {
+	[JF_OBJ] = jstep_obj,
+	[JF_LIST] = jstep_list,
+	[JF_KLIST] = jstep_klist,
+	[JF_GLOB] = jstep_glob,
+	[JF_REDUCE] = jstep_reduce,
+	[JF_DICT] = jstep_dict,
+	[JF_OP_M] = jstep_op_m,
+	[JF_OP_S] = jstep_op_s,
+	[JF_WHAT] = jstep_what,
+};
+
+// run frames until the one just pushed returns
+static bool json_run(JsonWalk *w) {
+	ut32 base = w->nframes - 1;
+	bool rv = true;
+	while (w->nframes > base) {
+		JsonFrame *f = &w->frames[w->nframes - 1];
+		int r = json_steps[f->kind] (w, f, rv);
+		if (r != JSON_CALL) {
+			rv = r? true: false;
+			w->nframes--;
+		}
 	}
-	path_pop (path);
-	return ret && pj_end (pj)? true: false;
+	return rv;
 }
 
-static bool json_dump_metastack(PJ *pj, RList *meta, RList *path) {
+static inline bool pj_list(JsonWalk *w, RList *l) {
+	JsonFrame *f = json_push (w, JF_LIST, NULL);
+	if (f) {
+		f->list = l;
+		return json_run (w);
+	}
+	return false;
+}
+
+static inline bool pj_klist(JsonWalk *w, const char *name, RList *l) {
+	JsonFrame *f = json_push (w, JF_KLIST, NULL);
+	if (f) {
+		f->list = l;
+		f->name = name;
+		return json_run (w);
+	}
+	return false;
+}
+
+static bool json_dump_metastack(JsonWalk *w, RList *meta) {
+	PJ *pj = w->pj;
+	RList *path = w->path;
 	if (!r_list_length (meta)) {
 		return true;
 	}
@@ -314,7 +549,7 @@ static bool json_dump_metastack(PJ *pj, RList *meta, RList *path) {
 		RListIter *iter;
 		r_list_foreach(meta, iter, l) {
 			ret = path_push (path, r_str_newf ("[%d]", i++))
-				&& pj_list (pj, l, path)
+				&& pj_list (w, l)
 				&& path_pop (path);
 			if (!ret) {
 				break;
@@ -324,21 +559,72 @@ static bool json_dump_metastack(PJ *pj, RList *meta, RList *path) {
 	return path_pop (path) && pj_end (pj) && ret;
 }
 
-bool json_dump_state(PJ *pj, PMState *pvm) {
+static inline void json_walk_init(JsonWalk *w, PJ *pj, PMState *pvm, ut64 skeleton, bool tensor) {
+	JsonWalk init = {
+		.pj = pj,
+		.path = r_list_newf (free),
+		.lim = &pvm->limits,
+		.skeleton = skeleton,
+		.tensor = { tensor, pvm->buf, pvm->start, pvm->buf_size, pvm->zip },
+	};
+	*w = init;
+	limits_phase (w->lim, "print");
+}
+
+// limit, policy and stats, then closes the initial object
+static inline bool json_dump_trailer(JsonWalk *w, PMState *pvm) {
+	PJ *pj = w->pj;
+	PLimits *lim = w->lim;
+	bool ret = true;
+	if (lim->hit) {
+		ret = pj_k (pj, "limit") && limits_dump_json (pj, lim);
+	}
+	if (ret && pvm->policy) {
+		ret = pj_k (pj, "policy") && policy_dump_json (pj, pvm->policy);
+	}
+	if (ret && pvm->stats) {
+		pvm->stats->time_print = r_time_now_mono () - pvm->stats->print_start;
+		ret = pj_k (pj, "stats") && stats_dump_phases_json (pj, pvm->stats);
+	}
+	return ret && pj_end (pj);
+}
+
+bool json_dump_state(PJ *pj, PMState *pvm, ut64 skeleton, bool tensor) {
 	r_return_val_if_fail (pj && pvm, false);
-	RList *path = r_list_newf (free);
+	JsonWalk w;
+	json_walk_init (&w, pj, pvm, skeleton, tensor);
 	bool ret = false;
-	if (path) {
+	if (w.path) {
 		ret = pj_o (pj) // open initial object
-			&& json_dump_metastack (pj, pvm->metastack, path)
-			&& pj_klist (pj, "stack", pvm->stack, path)
-			&& pj_klist (pj, "popstack", pvm->popstack, path)
-			&& pj_end (pj);
+			&& json_dump_metastack (&w, pvm->metastack)
+			&& pj_klist (&w, "stack", pvm->stack)
+			&& pj_klist (&w, "popstack", pvm->popstack)
+			&& json_dump_trailer (&w, pvm);
 
-		if (ret && r_list_length (path)) {
+		if (ret && r_list_length (w.path)) {
 			r_warn_if_reached ();
 		}
 	}
-	r_list_free (path);
+	r_list_free (w.path);
+	free (w.frames);
+	return ret;
+}
+
+// pdPp, only `obj`, prev_seen paths start at its `path`
+bool json_dump_query(PJ *pj, PMState *pvm, PyObj *obj, const char *path, ut64 skeleton, bool tensor) {
+	r_return_val_if_fail (pj && pvm && obj && path, false);
+	JsonWalk w;
+	json_walk_init (&w, pj, pvm, skeleton, tensor);
+	bool ret = w.path
+		&& pj_o (pj)
+		&& pj_ks (pj, "path", path)
+		&& pj_k (pj, "object")
+		&& path_push (w.path, strdup (path))
+		&& json_push (&w, JF_OBJ, obj)
+		&& json_run (&w)
+		&& path_pop (w.path)
+		&& json_dump_trailer (&w, pvm);
+	r_list_free (w.path);
+	free (w.frames);
 	return ret;
 }
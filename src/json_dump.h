@@ -3,5 +3,6 @@
 #include "dump.h"
 #include "pyobjutil.h"
 
-bool json_dump_state(PJ *pj, PMState *pvm);
+bool json_dump_state(PJ *pj, PMState *pvm, ut64 skeleton, bool tensor);
+bool json_dump_query(PJ *pj, PMState *pvm, PyObj *obj, const char *path, ut64 skeleton, bool tensor);
 #endif
@@ -2,8 +2,21 @@
 #include <r_core.h>
 #include <r_cons.h>
 #include <r_util.h>
+#include "pickle_dec.h"
 #include "json_dump.h"
 #include "pyobjutil.h"
+#include "stats.h"
+#include "plimits.h"
+#include "stream.h"
+#include "zip.h"
+#include "input.h"
+#include "globals.h"
+#include "policy.h"
+#include "ioc.h"
+#include "hash.h"
+#include "diff.h"
+#include "query.h"
+#include "index.h"
 
 #define TAB "\t"
 
@@ -12,7 +25,16 @@ static const char *help_msg[] = {
 	"pdP", "", "Decompile python pickle until STOP, eof or bad opcode",
 	"pdPj", "", "JSON output",
 	"pdPf", "", "Decompile and set pick.* flags from decompiled var names",
-	"pdPq", "", "Qucik flag, less accurate but faster results (No PY_SPLIT)",
+	"pdPq", "", "Quick flag, less accurate but faster results (No PY_SPLIT)",
+	"pdPs", "", "Statistics only: opcode histogram, object counts, timings (pdPsj for JSON)",
+	"pdPg", "", "Globals only: imported callables and where they get called (pdPgj for JSON)",
+	"pdPi", "", "Signature scan: pickle.ioc strings in strings and globals, with the call using them (pdPij for JSON)",
+	"pdPh", "", "Structural hash of the decoded objects, see pickle.hash (pdPhj for JSON)",
+	"pdPp", " <path>", "Only the object at path, like .stack[0][\"state_dict\"] (pdPpj for JSON)",
+	"pdPd", " <offset|file>", "Structural diff against the pickle at offset or in file (pdPdj for JSON)",
+	"pdPo", " [addr]", "Opcode and object the byte at addr belongs to, with its path (pdPoj for JSON)",
+	"pdPa", "", "Comment every opcode with what it does, for pd (pdPa- removes them)",
+	"pdP&", "", "Decompile in a background task, combines with the above (pdPj&)",
 	NULL
 };
 
@@ -79,6 +101,18 @@ static inline void empty_state(PMState *pvm) {
 	r_list_free (pvm->stack);
 	r_list_free (pvm->metastack);
 	r_list_free (pvm->popstack);
+	free (pvm->split_stack);
+	ht_up_free (pvm->split_leafs);
+	if (pvm->input) {
+		input_free (pvm->input); // buf is still the input's
+	} else {
+		free (pvm->buf);
+	}
+	zip_free (pvm->zip);
+	globals_free (pvm->globals);
+	policy_free (pvm->policy);
+	ioc_free (pvm->ioc);
+	index_free (pvm->index);
 	PyObj *obj = pvm->free_obj;
 	while (obj) {
 		PyObj *tmp = obj->next_free;
@@ -87,14 +121,82 @@ static inline void empty_state(PMState *pvm) {
 	}
 }
 
-static inline bool init_machine_state(RCore *c, PMState *pvm) {
+static inline ut64 get_buff(ut64 offset, RIO *io, ut8 **buf) {
+	// TODO: this probably only works if the pickle is the only thing in the file
+	*buf = NULL;
+	ut64 bsize = r_io_size (io);
+	if (!bsize) {
+		R_LOG_ERROR ("File size is 0");
+		return 0;
+	}
+	if (bsize > offset) {
+		bsize -= offset;
+		*buf = malloc (bsize);
+		if (*buf && r_io_read_at (io, offset, *buf, bsize)) {
+			return bsize;
+		}
+	}
+	return 0;
+}
+
+// torch checkpoints, decode the pickle member instead of the zip itself.
+// Stored members keep file offsets, inflated ones count from 0.
+static inline ut64 get_zip_buff(RCore *c, PMState *pvm) {
+	const char *member = r_config_get (c->config, "pickle.zip.member");
+	pvm->zip = zip_open (c->io, pvm->start, member);
+	if (!pvm->zip) {
+		return 0;
+	}
+	const PZipEntry *e = pvm->zip->pkl;
+	ut64 size = 0;
+	pvm->buf = zip_read (pvm->zip, c->io, e, &size);
+	if (pvm->buf) {
+		pvm->start = pvm->offset = e->method == ZIP_STORED? e->data: 0;
+		R_LOG_INFO ("Decompiling zip member `%s` (%"PFMT64u" bytes%s)", e->name, size,
+			e->method == ZIP_STORED? "": ", inflated, offsets are into the member");
+	}
+	return size;
+}
+
+// compressed pickles are decompressed while decoding, see input.h. Like
+// inflated zip members, offsets count from 0 in the decompressed bytes.
+static inline bool get_input(RCore *c, PMState *pvm) {
+	PInputKind kind = input_sniff (pvm->buf, pvm->buf_size);
+	if (kind == INPUT_RAW) {
+		return true;
+	}
+	R_LOG_INFO ("Decompressing %s pickle, offsets are into the decompressed bytes", input_name (kind));
+	ut64 max = r_config_get_i (c->config, "pickle.limit.alloc");
+	pvm->input = input_new (kind, pvm->buf, pvm->buf_size, max);
+	pvm->buf = NULL;
+	pvm->buf_size = 0;
+	pvm->start = pvm->offset = 0;
+	return pvm->input != NULL;
+}
+
+// decodes at `at`, or pvm->buf from 0 when the caller read a file into it
+static inline bool init_machine_state(RCore *c, PMState *pvm, ut64 at) {
 	if (strcmp(r_config_get (c->config, "asm.arch"), "pickle")) {
 		R_LOG_ERROR ("Arch must be set to picke, use `e asm.config = pickle`")
 		return false;
 	}
-	pvm->start = pvm->offset = c->offset;
+	pvm->start = pvm->offset = pvm->buf? 0: at;
 	pvm->end = UT64_MAX; // TODO: allow user to set an end
 	pvm->verbose = r_config_get_b (c->config, "anal.verbose");
+	if (pvm->buf) {
+		// already read
+	} else if (zip_is (c->io, pvm->offset)) {
+		pvm->buf_size = get_zip_buff (c, pvm);
+	} else {
+		pvm->buf_size = get_buff (pvm->offset, c->io, &pvm->buf);
+	}
+	if (!pvm->buf_size) {
+		R_LOG_ERROR ("Failed to alloc pickle buffer");
+		return false;
+	}
+	if (!pvm->zip && !get_input (c, pvm)) {
+		return false;
+	}
 
 	// allocs
 	pvm->stack = r_list_new ();
@@ -108,10 +210,17 @@ static inline bool init_machine_state(RCore *c, PMState *pvm) {
 	return true;
 }
 
+static inline void pvm_alloc(PMState *pvm, ut64 size) {
+	pvm->alloc_bytes += size;
+	stats_alloc (pvm->stats, size);
+}
+
 // PyObj stuff
 static inline PyObj *py_obj_new(PMState *pvm, PyType type) {
 	PyObj *obj = R_NEW0 (PyObj);
 	if (obj) {
+		pvm->objs++;
+		pvm_alloc (pvm, sizeof (PyObj));
 		// every new pyobj goes in single linked list, so it should only be
 		// free'd when pvm is emptied
 		obj->next_free = pvm->free_obj;
@@ -150,6 +259,7 @@ static inline PyObj *obj_stack_peek(RList *stack, bool dup) {
 static inline PyOper *py_oper_new(PMState *pvm, PyOp op, bool initlist) {
 	PyOper *pop = R_NEW0 (PyOper);
 	if (pop) {
+		pvm_alloc (pvm, sizeof (PyOper));
 		pop->offset = pvm->offset;
 		pop->op = op;
 		pop->stack = initlist? r_list_new (): NULL;
@@ -161,6 +271,21 @@ static inline PyOper *py_oper_new(PMState *pvm, PyOp op, bool initlist) {
 	return NULL;
 }
 
+// objects add_splits walks into
+static inline bool split_has_items(PyObj *obj) {
+	switch (obj->type) {
+	case PY_LIST:
+	case PY_FROZEN_SET:
+	case PY_SET:
+	case PY_DICT:
+	case PY_TUPLE: // attempting to modify will result in PY_WHAT, so only recurse
+	case PY_WHAT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 static inline bool py_what_new(PMState *pvm, PyObj *obj) {
 	// obj becomes a PY_WHAT, so ALL references must also.
 	// This means keeping same pointer, but replacing internals
@@ -169,13 +294,27 @@ static inline bool py_what_new(PMState *pvm, PyObj *obj) {
 	RList *l = r_list_newf ((RListFree)pyop_free);
 
 	if (pinit && pop && l && r_list_push (l, pop)) {
-		// pinit populated with original object info
+		// pinit populated with original object info, but stays in free list
+		PyObj *next_free = pinit->next_free;
 		memcpy (pinit, obj, sizeof (*pinit));
+		pinit->next_free = next_free;
 		pinit->refcnt = 0;
 
 		// pop references pinit
 		pop->obj = pinit;
 
+		// its items moved to pinit, and a leaf turning into a container
+		// invalidates what add_splits knows about any container holding
+		// it. Without a dup or memo it can only be on the stack.
+		if (pvm->split_leafs) {
+			if (split_has_items (obj)) {
+				ht_up_delete (pvm->split_leafs, (ut64)(size_t)obj);
+			} else if (obj->refcnt) {
+				ht_up_free (pvm->split_leafs);
+				pvm->split_leafs = NULL;
+			}
+		}
+
 		// obj becomes PY_WHAT, keeping references from original obj
 		obj->type = PY_WHAT;
 		obj->offset = pvm->offset;
@@ -243,39 +382,132 @@ static inline bool itter_add_split(PMState *pvm, RList *list, PyObj *split) {
 	return false;
 }
 
-static bool add_splits(PMState *pvm, PyObj *obj, PyObj *split);
-
-static inline bool split_iter_recures(PMState *pvm, RList *list, PyObj *split) {
-	RListIter *iter;
+// add_splits walks the whole object graph below a reduce's args, keep the
+// walk on the heap so deep nesting can't overflow the stack
+typedef struct split_frame {
 	PyObj *obj;
-	r_list_foreach (list, iter, obj) {
-		if (!add_splits (pvm, obj, split)) {
+	RListIter *iter; // next item, or next PyOper for PY_WHAT
+	RListIter *sub; // next arg of the current PyOper
+	RListIter *leaf; // items up to this one are leafs, kept in split_leafs
+	bool leafs; // no container seen yet, leaf can still move up
+} SplitFrame;
+
+static inline RListIter *list_head(RList *l) {
+	return l? r_list_head (l): NULL;
+}
+
+// mark obj as seen, containers get a frame so their items are visited next
+static inline bool split_visit(PMState *pvm, PyObj *obj, ut32 *n) {
+	if (!limits_poll (&pvm->limits, pvm->offset)) {
+		return false;
+	}
+	// skip previously seen (python allows `a.append(a)`)
+	if (obj->recurse == pvm->recurse) {
+		return true;
+	}
+	obj->recurse = pvm->recurse;
+	if (!split_has_items (obj)) {
+		return true;
+	}
+	if (!limits_enter (&pvm->limits, obj->offset)) {
+		return false;
+	}
+	if (*n == pvm->split_size) {
+		ut32 size = pvm->split_size? pvm->split_size * 2: 64;
+		SplitFrame *frames = realloc (pvm->split_stack, size * sizeof (SplitFrame));
+		if (!frames) {
+			limits_leave (&pvm->limits);
 			return false;
 		}
+		pvm_alloc (pvm, (size - pvm->split_size) * sizeof (SplitFrame));
+		pvm->split_stack = frames;
+		pvm->split_size = size;
+	}
+	SplitFrame *f = &pvm->split_stack[(*n)++];
+	f->obj = obj;
+	f->iter = list_head (obj->type == PY_WHAT? obj->py_what: obj->py_iter);
+	f->sub = NULL;
+	f->leaf = NULL;
+	f->leafs = obj->type != PY_WHAT;
+	if (f->leafs && pvm->split_leafs) {
+		// containers only grow at the end, leafs seen last time stay leafs
+		f->leaf = ht_up_find (pvm->split_leafs, (ut64)(size_t)obj, NULL);
+		if (f->leaf) {
+			f->iter = r_list_iter_get_next (f->leaf);
+		}
 	}
 	return true;
 }
 
-static inline bool split_what_recures(PMState *pvm, RList *list, PyObj *split) {
-	RListIter *iter;
-	PyOper *pop;
-	r_list_foreach (list, iter, pop) {
+// `it` held a leaf or a container, only a run of leafs from the start can be
+// skipped next time. A split at the end can still be replaced, so it isn't
+// part of the run until something follows it.
+static inline void split_leaf(SplitFrame *f, RListIter *it, PyObj *item) {
+	if (f->leafs) {
+		if (split_has_items (item)) {
+			f->leafs = false;
+		} else if (item->type != PY_SPLIT || r_list_iter_get_next (it)) {
+			f->leaf = it;
+		}
+	}
+}
+
+// remember how far f->obj is only leafs, so the next split skips them
+static inline bool split_leafs_save(PMState *pvm, SplitFrame *f) {
+	if (!f->leaf) {
+		return true;
+	}
+	if (!pvm->split_leafs) {
+		pvm->split_leafs = ht_up_new0 ();
+		if (!pvm->split_leafs) {
+			return false;
+		}
+	}
+	return ht_up_update (pvm->split_leafs, (ut64)(size_t)f->obj, f->leaf);
+}
+
+// next object directly inside f->obj, NULL when done
+static inline PyObj *split_next(SplitFrame *f) {
+	PyObj *ret = NULL;
+	if (f->obj->type != PY_WHAT) {
+		if (f->iter) {
+			ret = r_list_iter_get_data (f->iter);
+			f->iter = r_list_iter_get_next (f->iter);
+		}
+		return ret;
+	}
+	while (!ret && (f->sub || f->iter)) {
+		if (f->sub) {
+			ret = r_list_iter_get_data (f->sub);
+			f->sub = r_list_iter_get_next (f->sub);
+			continue;
+		}
+		PyOper *pop = r_list_iter_get_data (f->iter);
+		f->iter = r_list_iter_get_next (f->iter);
 		switch (pop->op) {
 		case OP_FAKE_SPLIT:
-			continue;
+			break;
 		case OP_FAKE_INIT:
-			if (!add_splits (pvm, pop->obj, split)) {
-				return false;
-			}
+			ret = pop->obj;
 			break;
 		default:
-			if (!split_iter_recures (pvm, pop->stack, split)) {
-				return false;
-			}
+			f->sub = list_head (pop->stack);
+			break;
 		}
 	}
+	return ret;
+}
 
-	pop = r_list_last (list);
+// everything inside obj has the split, now obj itself
+static inline bool split_done(PMState *pvm, PyObj *obj, PyObj *split) {
+	if (obj->type == PY_TUPLE) {
+		return true;
+	}
+	if (obj->type != PY_WHAT) {
+		return itter_add_split (pvm, obj->py_iter, split);
+	}
+	RList *list = obj->py_what;
+	PyOper *pop = r_list_last (list);
 	if (pop && pop->op == OP_FAKE_SPLIT) {
 		pyop_free (r_list_pop (list));
 	}
@@ -294,27 +526,27 @@ static bool add_splits(PMState *pvm, PyObj *obj, PyObj *split) {
 	if (pvm->nosplit) {
 		return true;
 	}
-	// skip previously seen (python allows `a.append(a)`)
-	if (obj->recurse == pvm->recurse) {
-		return true;
-	}
-	obj->recurse = pvm->recurse;
-
-	switch (obj->type) {
-	case PY_LIST:
-	case PY_FROZEN_SET:
-	case PY_SET:
-	case PY_DICT:
-	case PY_TUPLE: // attempting to modify will result in PY_WHAT, so only recurse
-		if (!split_iter_recures (pvm, obj->py_iter, split)) {
-			return false;
+	ut32 n = 0;
+	bool ret = split_visit (pvm, obj, &n);
+	while (ret && n) {
+		SplitFrame *f = &pvm->split_stack[n - 1];
+		RListIter *it = f->iter;
+		PyObj *next = split_next (f);
+		if (next) {
+			if (f->obj->type != PY_WHAT) {
+				split_leaf (f, it, next);
+			}
+			ret = split_visit (pvm, next, &n);
+			continue;
 		}
-		return obj->type == PY_TUPLE || itter_add_split (pvm, obj->py_iter, split);
-	case PY_WHAT:
-		return split_what_recures (pvm, obj->py_what, split);
-	default:
-		return true;
+		ret = split_leafs_save (pvm, f) && split_done (pvm, f->obj, split);
+		limits_leave (&pvm->limits);
+		n--;
+	}
+	for (; n; n--) { // failed, leave the frames still open
+		limits_leave (&pvm->limits);
 	}
+	return ret;
 }
 
 static inline bool split_reduce(PMState *pvm, PyObj *obj) {
@@ -323,7 +555,11 @@ static inline bool split_reduce(PMState *pvm, PyObj *obj) {
 		split->split = obj;
 		obj->refcnt++;
 		pvm->recurse++;
+		ut64 start = pvm->stats? r_time_now_mono (): 0;
 		bool ret = add_splits (pvm, obj->reduce.args, split);
+		if (pvm->stats) {
+			pvm->stats->time_split += r_time_now_mono () - start;
+		}
 		return ret;
 	}
 	return false;
@@ -377,6 +613,9 @@ static inline bool op_arg_str_to_num(RAnalOp *op, st64 *out, bool longg, int bas
 static inline bool memo_put(PMState *pvm, st64 loc) {
 	if (loc >= 0) {
 		PyObj *obj = obj_stack_peek (pvm->stack, true); // will inc refcnt
+		if (obj && obj->memo_id == UT64_MAX) {
+			obj->memo_id = loc;
+		}
 		if (ht_up_update (pvm->memo, loc, obj)) {
 			R_LOG_DEBUG ("\t[++] Memoid %d of %u is %p", loc, pvm->memo->count, obj);
 			return true;
@@ -422,7 +661,31 @@ static inline bool op_dup(PMState *pvm) {
 	return false;
 }
 
-static inline bool op_ext(PMState *pvm, RAnalOp *op) {
+// false when pickle.policy.stop ends decoding at this violation
+static inline bool policy_verdict(PMState *pvm, bool ok) {
+	if (ok || !pvm->policy->stop) {
+		return true;
+	}
+	return limits_hit (&pvm->limits, PLIM_POLICY, pvm->offset);
+}
+
+// extension codes name a global through copyreg, which one is up to the
+// unpickling process
+static inline char *ext_name(RAnalOp *op) {
+	return r_str_newf ("_inverted_registry[%"PFMT64d"]", op->val);
+}
+
+static inline bool policy_ext(PMState *pvm, RAnalOp *op, char code) {
+	char *name = ext_name (op);
+	bool ret = name && policy_verdict (pvm, policy_import (pvm->policy, "copyreg", name, pvm->offset, code));
+	free (name);
+	return ret;
+}
+
+static inline bool op_ext(PMState *pvm, RAnalOp *op, char code) {
+	if (pvm->policy && !policy_ext (pvm, op, code)) {
+		return false;
+	}
 	PyObj *obj = py_obj_new (pvm, PY_EXT);
 	if (obj && r_list_push (pvm->stack, obj)) {
 		obj->py_extnum = op->val;
@@ -480,6 +743,7 @@ static inline PyObj *py_iter_new(PMState *pvm, PyType type) {
 	if (obj) {
 		obj->py_iter = r_list_new ();
 		if (obj->py_iter) {
+			pvm_alloc (pvm, sizeof (RList));
 			return obj;
 		}
 	}
@@ -669,6 +933,16 @@ static inline char *op_str_arg(RAnalOp *op) {
 	return NULL;
 }
 
+// STRING keeps the quotes of its repr
+static inline char *op_str_unquote(char *str) {
+	size_t len = str? strlen (str): 0;
+	if (len >= 2 && (*str == '\'' || *str == '"') && str[len - 1] == *str) {
+		memmove (str, str + 1, len - 2);
+		str[len - 2] = '\0';
+	}
+	return str;
+}
+
 static inline bool op_none(PMState *pvm) {
 	PyObj *obj = py_obj_new (pvm, PY_NONE);
 	if (obj && r_list_push (pvm->stack, obj)) {
@@ -702,32 +976,45 @@ static inline bool op_float(PMState *pvm, RAnalOp *op, bool quoted) {
 	return false;
 }
 
-static inline char *get_big_str(RCore *c, RAnalOp *op) {
+// the whole pickle is already in pvm->buf, no need to go back to r_io
+static inline char *get_big_str(PMState *pvm, RAnalOp *op) {
 	if (op->ptr && op->ptrsize > 80 && op->ptrsize < ST32_MAX) {
-		char *str = NULL;
-		ut8 *buf = malloc (op->ptrsize);
-		if (buf && r_io_read_at (c->io, op->ptr, buf, op->ptrsize)) {
-			str = r_str_escape_raw (buf, op->ptrsize);
+		ut64 at = op->ptr - pvm->start;
+		if (op->ptr >= pvm->start && at < pvm->buf_size && op->ptrsize <= pvm->buf_size - at) {
+			return r_str_escape_raw (pvm->buf + at, op->ptrsize);
 		}
-		free (buf);
-		return str;
 	}
 	return op_str_arg (op);
 }
 
-static inline PyObj *py_obj_newstr(RCore *c, PMState *pvm, RAnalOp *op) {
+// a big binary string in lazy mode stays in buf, see py_str_load
+static inline bool str_lazy(PMState *pvm, RAnalOp *op) {
+	const ut8 *data;
+	ut64 len, at = pvm->offset - pvm->start;
+	return pvm->lazy && !pvm->input && op->ptrsize > 80
+		&& pvm->offset >= pvm->start && at < pvm->buf_size
+		&& py_str_raw (pvm->buf + at, pvm->buf_size - at, &data, &len)
+		&& data == pvm->buf + (op->ptr - pvm->start) && len == op->ptrsize;
+}
+
+static inline PyObj *py_obj_newstr(PMState *pvm, RAnalOp *op) {
 	PyObj *obj = py_obj_new (pvm, PY_STR);
+	if (obj && str_lazy (pvm, op)) {
+		obj->lazy = true;
+		return obj;
+	}
 	if (obj) {
-		obj->py_str = get_big_str (c, op);
+		obj->py_str = get_big_str (pvm, op);
 		if (obj->py_str) {
+			pvm_alloc (pvm, strlen (obj->py_str) + 1);
 			return obj;
 		}
 	}
 	return NULL;
 }
 
-static inline bool push_str(RCore *c, PMState *pvm, RAnalOp *op) {
-	PyObj *obj = py_obj_newstr (c, pvm, op);
+static inline bool push_str(PMState *pvm, RAnalOp *op) {
+	PyObj *obj = py_obj_newstr (pvm, op);
 	if (obj && r_list_push (pvm->stack, obj)) {
 		return true;
 	}
@@ -744,9 +1031,22 @@ static inline bool op_mark(PMState *pvm) {
 	return false;
 }
 
+static inline bool pop_obj(PMState *pvm, PyObj *obj) {
+	return stream_pop (pvm->stream, obj) || r_list_push (pvm->popstack, obj);
+}
+
 static inline bool op_pop_mark(PMState *pvm) {
 	if (pvm->metastack && r_list_length (pvm->metastack)) {
-		r_list_join (pvm->popstack, pvm->stack);
+		if (pvm->stream) {
+			PyObj *obj;
+			while ((obj = r_list_pop_head (pvm->stack))) {
+				if (!pop_obj (pvm, obj)) {
+					return false;
+				}
+			}
+		} else {
+			r_list_join (pvm->popstack, pvm->stack);
+		}
 		r_list_free (pvm->stack);
 		pvm->stack = r_list_pop (pvm->metastack);
 		return true;
@@ -757,7 +1057,7 @@ static inline bool op_pop_mark(PMState *pvm) {
 static inline bool op_pop(PMState *pvm) {
 	if (r_list_length (pvm->stack)) {
 		PyObj *obj = r_list_pop (pvm->stack);
-		return obj && r_list_push (pvm->popstack, obj);
+		return obj && pop_obj (pvm, obj);
 	}
 	return op_pop_mark (pvm);
 }
@@ -767,6 +1067,7 @@ static inline PyObj *str_to_pystr(PMState *pvm, const char *str) {
 	if (obj) {
 		obj->py_str = strdup (str);
 		if (obj->py_str) {
+			pvm_alloc (pvm, strlen (obj->py_str) + 1);
 			return obj;
 		}
 	}
@@ -775,9 +1076,9 @@ static inline PyObj *str_to_pystr(PMState *pvm, const char *str) {
 
 // last resort, just make it into a call to `int("strnum")`
 // TODO just make a new fake pyt obj to handle this case
-static inline bool push_int_type_str(RCore *c, PMState *pvm, RAnalOp *op, bool longg) {
+static inline bool push_int_type_str(PMState *pvm, RAnalOp *op, bool longg) {
 	// building from ground up
-	PyObj *obj_child = py_obj_newstr (c, pvm, op);
+	PyObj *obj_child = py_obj_newstr (pvm, op);
 	if (!obj_child) {
 		return false;
 	}
@@ -829,8 +1130,8 @@ static inline bool push_int_type_str(RCore *c, PMState *pvm, RAnalOp *op, bool l
 	return r_list_push (pvm->stack, obj_parent)? true: false;
 }
 
-static inline bool op_persid(RCore *c, PMState *pvm, RAnalOp *op) {
-	PyObj *obj = py_obj_newstr (c, pvm, op);
+static inline bool op_persid(PMState *pvm, RAnalOp *op) {
+	PyObj *obj = py_obj_newstr (pvm, op);
 	return make_persid (pvm, obj);
 }
 
@@ -850,7 +1151,7 @@ static inline bool split_module_str(PMState *pvm, RAnalOp *op, PyGlob *cl) {
 	return cl->name && cl->module? true: false;
 }
 
-static inline bool strnum_try_push(RCore *c, PMState *pvm, RAnalOp *op, bool longg) {
+static inline bool strnum_try_push(PMState *pvm, RAnalOp *op, bool longg) {
 	st64 val = 0;
 	if (op_arg_str_to_num (op, &val, longg, longg? 10: 0)) {
 		PyObj *obj = py_obj_new (pvm, PY_INT);
@@ -862,12 +1163,12 @@ static inline bool strnum_try_push(RCore *c, PMState *pvm, RAnalOp *op, bool lon
 	return false;
 }
 
-static inline bool op_long(RCore *c, PMState *pvm, RAnalOp *op) {
-	return strnum_try_push (c, pvm, op, true)
-		|| push_int_type_str (c, pvm, op, true);
+static inline bool op_long(PMState *pvm, RAnalOp *op) {
+	return strnum_try_push (pvm, op, true)
+		|| push_int_type_str (pvm, op, true);
 }
 
-static inline bool op_int(RCore *c, PMState *pvm, RAnalOp *op) {
+static inline bool op_int(PMState *pvm, RAnalOp *op) {
 	// this is subtitly a strange opcode...
 	//printf ("op->ptr: %s\n", op->ptr);
 	if (!strcmp ("\"01\"", op->mnemonic + 4)) {
@@ -877,8 +1178,8 @@ static inline bool op_int(RCore *c, PMState *pvm, RAnalOp *op) {
 		return op_newbool (pvm, false);
 	}
 
-	return strnum_try_push (c, pvm, op, false)
-		|| push_int_type_str (c, pvm, op, false);
+	return strnum_try_push (pvm, op, false)
+		|| push_int_type_str (pvm, op, false);
 }
 
 static inline PyObj *glob_obj(PMState *pvm, RAnalOp *op) {
@@ -889,8 +1190,36 @@ static inline PyObj *glob_obj(PMState *pvm, RAnalOp *op) {
 	return NULL;
 }
 
+// module or name of a global, "?" when it isn't a string
+static inline char *policy_str(PMState *pvm, PyObj *obj) {
+	if (obj->type != PY_STR) {
+		return strdup ("?");
+	}
+	return py_str_load (pvm, obj)? op_str_unquote (strdup (obj->py_str)): NULL;
+}
+
+static inline bool policy_glob(PMState *pvm, PyGlob *g, char code) {
+	char *module = policy_str (pvm, g->module);
+	char *name = policy_str (pvm, g->name);
+	bool ret = module && name && policy_verdict (pvm, policy_import (pvm->policy, module, name, pvm->offset, code));
+	free (module);
+	free (name);
+	return ret;
+}
+
+// globals were checked when imported, anything else is an indirect call
+static inline bool policy_callable(PMState *pvm, PyObj *callable, char code) {
+	if (!pvm->policy || callable->type == PY_GLOB || callable->type == PY_EXT) {
+		return true;
+	}
+	return policy_verdict (pvm, policy_call (pvm->policy, pvm->offset, code));
+}
+
 static inline bool op_global(PMState *pvm, RAnalOp *op) {
 	PyObj *obj = glob_obj (pvm, op);
+	if (obj && pvm->policy && !policy_glob (pvm, &obj->py_glob, OP_GLOBAL)) {
+		return false;
+	}
 	if (obj && r_list_push (pvm->stack, obj)) {
 		return true;
 	}
@@ -904,6 +1233,9 @@ static inline bool op_stack_global(PMState *pvm, RAnalOp *op) {
 			PyGlob *func = &obj->py_glob;
 			func->name = r_list_pop (pvm->stack);
 			func->module = r_list_pop (pvm->stack);
+			if (func->name && func->module && pvm->policy && !policy_glob (pvm, func, OP_STACK_GLOBAL)) {
+				return false;
+			}
 			if (func->name && func->module && r_list_push (pvm->stack, obj)) {
 				return true;
 			}
@@ -912,9 +1244,12 @@ static inline bool op_stack_global(PMState *pvm, RAnalOp *op) {
 	return false;
 }
 
-static inline bool insantiate(PMState *pvm, PyObj *klass, PyObj *args) {
+static inline bool insantiate(PMState *pvm, PyObj *klass, PyObj *args, char code) {
 	PyObj *obj = py_obj_new (pvm, PY_INST);
 	if (obj && args && klass) {
+		if (!policy_callable (pvm, klass, code)) {
+			return false;
+		}
 		obj->reduce.glob = klass;
 		obj->reduce.args = args;
 		if (r_list_push (pvm->stack, obj)) {
@@ -928,8 +1263,11 @@ static inline bool insantiate(PMState *pvm, PyObj *klass, PyObj *args) {
 static inline bool op_inst(PMState *pvm, RAnalOp *op) {
 	// like GLOBAL + TUPLE + REDUCE but stack is not set up wonky
 	PyObj *klass = glob_obj (pvm, op);
+	if (klass && pvm->policy && !policy_glob (pvm, &klass->py_glob, OP_INST)) {
+		return false;
+	}
 	PyObj *args = iter_to_mark (pvm, PY_TUPLE);
-	return insantiate (pvm, klass, args);
+	return insantiate (pvm, klass, args, OP_INST);
 }
 
 static inline bool op_newobj(PMState *pvm, RAnalOp *op, bool kw) {
@@ -946,6 +1284,9 @@ static inline bool op_newobj(PMState *pvm, RAnalOp *op, bool kw) {
 		}
 		obj->reduce.args = r_list_pop (pvm->stack);
 		obj->reduce.glob = r_list_pop (pvm->stack);
+		if (obj->reduce.glob && !policy_callable (pvm, obj->reduce.glob, kw? OP_NEWOBJ_EX: OP_NEWOBJ)) {
+			return false;
+		}
 		if (obj->reduce.args && obj->reduce.glob && r_list_push (pvm->stack, obj)) {
 			return true;
 		}
@@ -957,7 +1298,7 @@ static inline bool op_obj(PMState *pvm) {
 	// like TUPLE + REDUCE but stack is not set up wonky
 	PyObj *klass = r_list_pop_head (pvm->stack);
 	PyObj *args = iter_to_mark (pvm, PY_TUPLE);
-	return insantiate (pvm, klass, args);
+	return insantiate (pvm, klass, args, OP_OBJ);
 }
 
 static inline bool op_reduce(PMState *pvm, RAnalOp *op) {
@@ -966,6 +1307,9 @@ static inline bool op_reduce(PMState *pvm, RAnalOp *op) {
 		if (obj) {
 			obj->reduce.args = r_list_pop (pvm->stack);
 			obj->reduce.glob = r_list_pop (pvm->stack);
+			if (obj->reduce.glob && !policy_callable (pvm, obj->reduce.glob, OP_REDUCE)) {
+				return false;
+			}
 			if (obj->reduce.args && obj->reduce.glob && r_list_push (pvm->stack, obj)) {
 				return split_reduce (pvm, obj);
 			}
@@ -974,7 +1318,7 @@ static inline bool op_reduce(PMState *pvm, RAnalOp *op) {
 	return false;
 }
 
-static inline bool exec_op(RCore *c, PMState *pvm, RAnalOp *op, char code) {
+static inline bool exec_op(PMState *pvm, RAnalOp *op, char code) {
 	switch (code) {
 	// meta
 	case OP_PROTO:
@@ -1011,11 +1355,11 @@ static inline bool exec_op(RCore *c, PMState *pvm, RAnalOp *op, char code) {
 		return op_float (pvm, op, false);
 	// ints again but the bad ones, string encoded...
 	case OP_INT:
-		return op_int (c, pvm, op);
+		return op_int (pvm, op);
 	case OP_LONG: // same as int, but string arg *should* start with L
-		return op_long (c, pvm, op);
+		return op_long (pvm, op);
 	case OP_PERSID:
-		return op_persid (c, pvm, op);
+		return op_persid (pvm, op);
 	// strings TODO: distinguish between b'', u'', and ''
 	case OP_STRING:
 	case OP_UNICODE:
@@ -1028,7 +1372,7 @@ static inline bool exec_op(RCore *c, PMState *pvm, RAnalOp *op, char code) {
 	case OP_SHORT_BINBYTES:
 	case OP_SHORT_BINSTRING:
 	case OP_SHORT_BINUNICODE:
-		return push_str (c, pvm, op);
+		return push_str (pvm, op);
 	// class stuff
 	case OP_OBJ:
 		return op_obj (pvm);
@@ -1105,7 +1449,7 @@ static inline bool exec_op(RCore *c, PMState *pvm, RAnalOp *op, char code) {
 	case OP_EXT1:
 	case OP_EXT2:
 	case OP_EXT4:
-		return op_ext (pvm, op);
+		return op_ext (pvm, op, code);
 	case OP_BINPERSID:
 		return op_binpersid (pvm);
 	case OP_NEXT_BUFFER: // proto 5, C stuff
@@ -1121,119 +1465,1449 @@ static inline bool exec_op(RCore *c, PMState *pvm, RAnalOp *op, char code) {
 	return true;
 }
 
-static inline ut64 get_buff(ut64 offset, RIO *io, ut8 **buf) {
-	// TODO: this probably only works if the pickle is the only thing in the file
-	*buf = NULL;
-	ut64 bsize = r_io_size (io);
-	if (!bsize) {
-		R_LOG_ERROR ("File size is 0");
-		return 0;
+// module or name for STACK_GLOBAL, "?" when s is not a string
+static inline char *glob_slot_str(PMState *pvm, PGSlot s) {
+	PGlobals *g = pvm->globals;
+	if (GS_KIND (s) == GS_TEXT) {
+		return strdup (g->texts[GS_VAL (s)]);
 	}
-	if (bsize > offset) {
-		bsize -= offset;
-		*buf = malloc (bsize);
-		if (*buf && r_io_read_at (io, offset, *buf, bsize)) {
-			return bsize;
-		}
+	ut64 at = GS_VAL (s) - pvm->start;
+	const ut8 *data;
+	ut64 len;
+	if (GS_KIND (s) == GS_STR && at < pvm->buf_size
+		&& py_str_raw (pvm->buf + at, pvm->buf_size - at, &data, &len)
+	) {
+		return r_str_ndup ((const char *)data, R_MIN (len, UT16_MAX));
 	}
-	return 0;
+	return strdup ("?");
 }
 
-static inline bool run_pvm(RCore *c, PMState *pvm) {
-	ut8 *buf, *rbuf;
-	ut64 bsize = get_buff (pvm->offset, c->io, &buf);
-	if (!bsize) {
-		free (buf);
-		R_LOG_ERROR ("Failed to alloc pickle buffer");
+// pickle.policy, same checks as policy_glob and policy_callable
+static inline bool glob_import(PMState *pvm, const char *module, const char *name, char code) {
+	if (pvm->policy && !policy_verdict (pvm, policy_import (pvm->policy, module, name, pvm->offset, code))) {
 		return false;
 	}
-	rbuf = buf;
-	while (bsize > 0) {
-		if (pvm->break_on_stop && rbuf[0] == OP_STOP) {
-			R_LOG_DEBUG ("[0x%"PFMT64x"] OP(%02x): stop", pvm->offset, OP_STOP);
-			break;
-		}
-		RAnalOp op;
-		r_anal_op_init(&op);
-		if (r_anal_op (c->anal, &op, pvm->offset, rbuf, bsize, R_ARCH_OP_MASK_BASIC) <= 0) {
-			R_LOG_ERROR ("Failed to disassemble op at offset: 0x"PFMT64x, pvm->offset);
-			free (buf);
-			return false;
-		}
-		int size = op.size;
-		R_LOG_DEBUG ("[0x%"PFMT64x"] OP(%02x) len: %d: %s", pvm->offset, ((char)rbuf[0]) & 0xff, op.size, op.mnemonic);
-		bool exec = exec_op (c, pvm, &op, (char)rbuf[0]);
-		if (!exec) {
-			if (op.mnemonic) {
-				R_LOG_ERROR ("Failed to exec opcode '%s' at offset: 0x%" PFMT64x, op.mnemonic,pvm->offset);
-			} else {
-				R_LOG_ERROR ("Failed to exec unkown opcode 0x%02x at offset: 0x%" PFMT64x, rbuf[0], pvm->offset);
-			}
-			r_anal_op_fini (&op);
-			free (buf);
-			return false;
+	if (!globals_import (pvm->globals, module, name, pvm->offset)) {
+		return false;
+	}
+	if (pvm->ioc) {
+		char *full = r_str_newf ("%s.%s", module, name);
+		bool ret = full && ioc_scan (pvm->ioc, (const ut8 *)full, strlen (full), pvm->offset, pvm->globals->depth - 1, true, 0);
+		free (full);
+		return ret;
+	}
+	return true;
+}
+
+// pdPi, matches the string just pushed
+static inline bool glob_ioc_str(PMState *pvm) {
+	PGlobals *g = pvm->globals;
+	if (!pvm->ioc) {
+		return true;
+	}
+	PGSlot s = g->stack[g->depth - 1];
+	const ut8 *data;
+	ut64 len;
+	if (GS_KIND (s) == GS_TEXT) {
+		data = (const ut8 *)g->texts[GS_VAL (s)];
+		len = strlen (g->texts[GS_VAL (s)]);
+	} else {
+		ut64 at = GS_VAL (s) - pvm->start;
+		if (at >= pvm->buf_size || !py_str_raw (pvm->buf + at, pvm->buf_size - at, &data, &len)) {
+			return true;
 		}
-		r_anal_op_fini (&op);
+	}
+	return ioc_scan (pvm->ioc, data, len, pvm->offset, g->depth - 1, false, s);
+}
 
-		// adjust read loc for next loop
-		pvm->offset += size;
-		bsize -= size;
-		rbuf += size;
+// pdPi, the slot on top came back from the memo or DUP
+static inline bool glob_ioc_reopen(PMState *pvm) {
+	PGlobals *g = pvm->globals;
+	PGSlot s = g->stack[g->depth - 1];
+	if (pvm->ioc && (GS_KIND (s) == GS_STR || GS_KIND (s) == GS_TEXT)) {
+		return ioc_reopen (pvm->ioc, s, g->depth - 1);
 	}
-	empty_memo (pvm);
-	free (buf);
 	return true;
 }
 
-static inline bool dump_json(RCore *c, PMState *pvm) {
-	PJ *pj = r_core_pj_new (c);
-	if (pj && json_dump_state (pj, pvm)) {
-		r_cons_print (pj_string (pj));
-		pj_free (pj);
-		return true;
+// pdPi, what was just popped is gone
+static inline bool glob_ioc_drop(PMState *pvm) {
+	if (pvm->ioc) {
+		ioc_drop (pvm->ioc, pvm->globals->depth);
 	}
-	return false;
+	return true;
 }
 
-static int pickle_dec(void *user, const char *input) {
-	if (!input || strncmp ("pdP", input, 3)) {
-		return 0;
+// pdPi, what was just popped went into the object now on top
+static inline bool glob_ioc_into(PMState *pvm) {
+	PGlobals *g = pvm->globals;
+	if (pvm->ioc && g->depth) {
+		ioc_merge (pvm->ioc, g->depth - 1);
+	} else if (pvm->ioc) {
+		ioc_drop (pvm->ioc, 0);
 	}
-	input += 3;
-	RCore *c = (RCore *)user;
+	return true;
+}
 
-	if (strchr (input, '?')) {
-		r_core_cmd_help (c, help_msg);
-		return 1;
+static inline bool glob_global(PMState *pvm, RAnalOp *op, char code) {
+	char *str = op_str_arg (op);
+	char *name = str? strchr (str, ' '): NULL;
+	bool ret = false;
+	if (name) {
+		*name++ = '\0';
+		ret = glob_import (pvm, str, name, code);
 	}
+	free (str);
+	return ret;
+}
 
-	PMState state = {0};
-	if (strchr (input, 'q')) {
-		state.nosplit = true;
-	} else  {
-		state.nosplit = false;
+static inline bool glob_stack_global(PMState *pvm) {
+	PGlobals *g = pvm->globals;
+	PGSlot name, module;
+	if (!globals_pop (g, &name) || !globals_pop (g, &module)) {
+		return false;
 	}
-	if (init_machine_state (c, &state)) {
-		state.break_on_stop = true;
-		bool pvm_fin = run_pvm (c, &state);
-		if (strchr (input, 'j')) {
-			dump_json(c, &state);
-		} else {
-			PrintInfo nfo;
-			state.recurse++;
-			if (print_info_init (&nfo, state.recurse, c)) {
-				nfo.setflags = strchr (input, 'f');
-				if (!dump_machine( &state, &nfo, !pvm_fin)) {
-					R_LOG_ERROR ("Failed to dump pickle");
-				}
-			} else {
-				R_LOG_ERROR ("Failed to init pickle printer state");
-			}
-			print_info_clean (&nfo);
+	char *n = glob_slot_str (pvm, name);
+	char *m = glob_slot_str (pvm, module);
+	if (pvm->ioc) {
+		ioc_merge (pvm->ioc, g->depth); // the strings travel with the global
+	}
+	bool ret = n && m && glob_import (pvm, m, n, OP_STACK_GLOBAL);
+	free (n);
+	free (m);
+	return ret;
+}
+
+static inline bool glob_ext(PMState *pvm, RAnalOp *op, char code) {
+	char *name = ext_name (op);
+	bool ret = name && glob_import (pvm, "copyreg", name, code);
+	free (name);
+	return ret;
+}
+
+static inline bool glob_policy_call(PMState *pvm, PGSlot callable, char code) {
+	if (!pvm->policy || GS_KIND (callable) == GS_GLOBAL) {
+		return true;
+	}
+	return policy_verdict (pvm, policy_call (pvm->policy, pvm->offset, code));
+}
+
+// pops argc args and the callable below them, pushes the result
+static inline bool glob_call(PMState *pvm, int argc, char code) {
+	PGlobals *g = pvm->globals;
+	PGSlot s;
+	while (argc-- > 0) {
+		if (!globals_pop (g, &s)) {
+			return false;
 		}
 	}
-	empty_state (&state);
-	return 1;
+	if (!globals_pop (g, &s) || !glob_policy_call (pvm, s, code)) {
+		return false;
+	}
+	if (pvm->ioc) {
+		ioc_call (pvm->ioc, g->depth, pvm->offset, code);
+	}
+	return globals_call (g, s, pvm->offset, code, &s)
+		&& globals_push (g, s);
+}
+
+// INST and OBJ take their args up to a mark, INST imports the class itself
+static inline bool glob_call_mark(PMState *pvm, RAnalOp *op, char code) {
+	PGlobals *g = pvm->globals;
+	PGSlot klass;
+	if (!globals_pop_mark (g, &klass)) {
+		return false;
+	}
+	if (code == OP_INST && !(glob_global (pvm, op, code) && globals_pop (g, &klass))) {
+		return false;
+	}
+	if (pvm->ioc) {
+		ioc_call (pvm->ioc, g->depth, pvm->offset, code);
+	}
+	return glob_policy_call (pvm, klass, code)
+		&& globals_call (g, klass, pvm->offset, code, &klass)
+		&& globals_push (g, klass);
+}
+
+// BUILD calls __setstate__ on the object below the state
+static inline bool glob_build(PMState *pvm) {
+	PGlobals *g = pvm->globals;
+	PGSlot obj, ret;
+	if (!globals_pop (g, &obj) || !globals_pop (g, &obj) || !globals_push (g, obj)) {
+		return false;
+	}
+	if (pvm->ioc) {
+		ioc_call (pvm->ioc, g->depth, pvm->offset, OP_BUILD); // the state
+	}
+	return globals_call (g, obj, pvm->offset, OP_BUILD, &ret);
+}
+
+// pops n, pushes something no global comes from
+static inline bool glob_other(PMState *pvm, int n) {
+	PGlobals *g = pvm->globals;
+	PGSlot s;
+	while (n-- > 0) {
+		if (!globals_pop (g, &s)) {
+			return false;
+		}
+	}
+	if (pvm->ioc) {
+		ioc_merge (pvm->ioc, g->depth);
+	}
+	return globals_push (g, GS_NEW (GS_OTHER, 0));
+}
+
+// APPEND and SETITEM, pops n into the object below them
+static inline bool glob_drop(PMState *pvm, int n) {
+	PGSlot s;
+	while (n-- > 0) {
+		if (!globals_pop (pvm->globals, &s)) {
+			return false;
+		}
+	}
+	return glob_ioc_into (pvm);
+}
+
+// pdPg, same stack effects as exec_op but only globals and the strings they
+// may be built from are kept
+static inline bool exec_glob_op(PMState *pvm, RAnalOp *op, char code) {
+	PGlobals *g = pvm->globals;
+	PGSlot s;
+	st64 id;
+	switch (code) {
+	case OP_PROTO:
+		pvm->proto = op->val;
+		break;
+	case OP_FRAME:
+	case OP_STOP:
+	case OP_READONLY_BUFFER:
+		break;
+	case OP_MARK:
+		return globals_mark (g);
+	case OP_POP:
+		return (globals_pop (g, &s) || globals_pop_mark (g, &s)) && glob_ioc_drop (pvm);
+	case OP_POP_MARK:
+		return globals_pop_mark (g, &s) && glob_ioc_drop (pvm);
+	case OP_DUP:
+		return globals_pop (g, &s) && globals_push (g, s) && globals_push (g, s) && glob_ioc_reopen (pvm);
+	// strings, the ones STACK_GLOBAL can use are resolved when it does
+	case OP_BINUNICODE8:
+	case OP_BINBYTES8:
+	case OP_BYTEARRAY8:
+	case OP_BINSTRING:
+	case OP_BINUNICODE:
+	case OP_BINBYTES:
+	case OP_SHORT_BINBYTES:
+	case OP_SHORT_BINSTRING:
+	case OP_SHORT_BINUNICODE:
+		return globals_push (g, GS_NEW (GS_STR, pvm->offset)) && glob_ioc_str (pvm);
+	case OP_STRING:
+		return globals_text (g, op_str_unquote (op_str_arg (op))) && glob_ioc_str (pvm);
+	case OP_UNICODE:
+		return globals_text (g, op_str_arg (op)) && glob_ioc_str (pvm);
+	// everything else that pushes one object
+	case OP_NONE:
+	case OP_BININT:
+	case OP_BININT1:
+	case OP_BININT2:
+	case OP_LONG1:
+	case OP_LONG4:
+	case OP_INT:
+	case OP_LONG:
+	case OP_FLOAT:
+	case OP_BINFLOAT:
+	case OP_NEWTRUE:
+	case OP_NEWFALSE:
+	case OP_EMPTY_TUPLE:
+	case OP_EMPTY_LIST:
+	case OP_EMPTY_DICT:
+	case OP_EMPTY_SET:
+	case OP_PERSID:
+	case OP_NEXT_BUFFER:
+		return glob_other (pvm, 0);
+	case OP_BINPERSID:
+	case OP_TUPLE1:
+		return glob_other (pvm, 1);
+	case OP_TUPLE2:
+		return glob_other (pvm, 2);
+	case OP_TUPLE3:
+		return glob_other (pvm, 3);
+	case OP_TUPLE:
+	case OP_LIST:
+	case OP_DICT:
+	case OP_FROZENSET:
+		return globals_pop_mark (g, &s) && glob_other (pvm, 0);
+	case OP_APPEND:
+		return glob_drop (pvm, 1);
+	case OP_SETITEM:
+		return glob_drop (pvm, 2);
+	case OP_APPENDS:
+	case OP_SETITEMS:
+	case OP_ADDITEMS:
+		return globals_pop_mark (g, &s) && glob_ioc_into (pvm);
+	// memo
+	case OP_MEMOIZE:
+		return globals_memo_put (g, g->memo_len);
+	case OP_LONG_BINPUT:
+	case OP_BINPUT:
+		return globals_memo_put (g, op->val);
+	case OP_PUT:
+		return op_arg_str_to_num (op, &id, false, 10) && id >= 0 && globals_memo_put (g, id);
+	case OP_LONG_BINGET:
+	case OP_BINGET:
+		return globals_memo_get (g, op->val) && glob_ioc_reopen (pvm);
+	case OP_GET:
+		return op_arg_str_to_num (op, &id, false, 10) && id >= 0 && globals_memo_get (g, id) && glob_ioc_reopen (pvm);
+	// globals and calls
+	case OP_GLOBAL:
+		return glob_global (pvm, op, code);
+	case OP_STACK_GLOBAL:
+		return glob_stack_global (pvm);
+	case OP_EXT1:
+	case OP_EXT2:
+	case OP_EXT4:
+		return glob_ext (pvm, op, code);
+	case OP_REDUCE:
+	case OP_NEWOBJ:
+		return glob_call (pvm, 1, code);
+	case OP_NEWOBJ_EX:
+		return glob_call (pvm, 2, code);
+	case OP_INST:
+	case OP_OBJ:
+		return glob_call_mark (pvm, op, code);
+	case OP_BUILD:
+		return glob_build (pvm);
+	default:
+		if (op->type != R_ANAL_OP_TYPE_ILL) {
+			R_LOG_ERROR ("Can't handle op %02x '%s' yet", code & 0xff, op->mnemonic);
+		}
+		return false;
+	}
+	return true;
+}
+
+// waits for `need` more decompressed bytes past pvm->offset, the buffer may
+// move. False once nothing more is coming.
+static inline bool pvm_window(PMState *pvm, const ut8 **rbuf, ut64 *bsize, ut64 need) {
+	ut64 at = pvm->offset - pvm->start;
+	ut8 *buf;
+	ut64 avail;
+	bool final = input_wait (pvm->input, at + need, &buf, &avail);
+	pvm->buf = buf;
+	pvm->buf_size = avail;
+	pvm->limits.prog.end = pvm->start + avail;
+	*rbuf = buf + at;
+	*bsize = avail - at;
+	return !final;
+}
+
+// decompression is over, the printers get the whole buffer
+static inline void pvm_input_done(PMState *pvm) {
+	if (pvm->input) {
+		ut8 *buf;
+		ut64 size;
+		input_finish (pvm->input, &buf, &size);
+		input_free (pvm->input);
+		pvm->input = NULL;
+		pvm->buf = buf;
+		pvm->buf_size = size;
+	}
+}
+
+// the memo index a memo opcode works on, taken before the opcode runs
+static inline ut32 index_memo(PMState *pvm, RAnalOp *op, char code) {
+	st64 out = 0;
+	switch (code) {
+	case OP_MEMOIZE:
+		return pvm->memo? pvm->memo->count: 0;
+	case OP_PUT:
+	case OP_GET:
+		return op_arg_str_to_num (op, &out, false, 10)? (ut32)out: 0;
+	default:
+		return op->val;
+	}
+}
+
+// pdPo and pdPa, the object an opcode leaves on top of the stack, or the one
+// it popped, and what it did. `top` is the top before the opcode ran.
+static inline bool index_exec(PMState *pvm, char code, PyObj *top, ut64 size, ut32 memo) {
+	PyObj *obj = obj_stack_peek (pvm->stack, false);
+	PIndexNote note = PN_PUSH;
+	switch (code) {
+	case OP_PROTO:
+	case OP_FRAME:
+		obj = NULL;
+		note = PN_NONE;
+		break;
+	case OP_MARK:
+		note = PN_MARK;
+		break;
+	case OP_POP:
+		obj = top;
+		note = PN_POP;
+		break;
+	case OP_POP_MARK:
+		obj = top;
+		note = PN_POP_MARK;
+		break;
+	case OP_STOP:
+		obj = top;
+		note = PN_RETURN;
+		break;
+	case OP_MEMOIZE:
+	case OP_PUT:
+	case OP_BINPUT:
+	case OP_LONG_BINPUT:
+		note = PN_MEMO_PUT;
+		break;
+	case OP_GET:
+	case OP_BINGET:
+	case OP_LONG_BINGET:
+		note = PN_MEMO_GET;
+		break;
+	case OP_GLOBAL:
+	case OP_STACK_GLOBAL:
+		note = PN_IMPORT;
+		break;
+	case OP_REDUCE:
+	case OP_INST:
+	case OP_OBJ:
+	case OP_NEWOBJ:
+	case OP_NEWOBJ_EX:
+		note = PN_CALL;
+		break;
+	case OP_BUILD:
+		note = PN_BUILD;
+		break;
+	case OP_APPEND:
+	case OP_APPENDS:
+		note = PN_APPEND;
+		break;
+	case OP_SETITEM:
+	case OP_SETITEMS:
+		note = PN_SETITEM;
+		break;
+	case OP_ADDITEMS:
+		note = PN_ADDITEMS;
+		break;
+	default:
+		break;
+	}
+	pvm->index->end = pvm->offset + size;
+	return index_op (pvm->index, pvm->offset, obj, note, memo);
+}
+
+// touches neither RCore nor r_cons, safe to run from a background task
+static inline bool run_pvm(RAnal *anal, PMState *pvm) {
+	const ut8 *rbuf = pvm->buf;
+	ut64 bsize = pvm->buf_size;
+	bool more = pvm->input; // decompressed bytes still coming
+	pvm->limits.prog.start = pvm->start;
+	pvm->limits.prog.end = pvm->start + bsize;
+	while (true) {
+		if (more && bsize < INPUT_AHEAD) {
+			more = pvm_window (pvm, &rbuf, &bsize, INPUT_AHEAD);
+		}
+		if (!bsize) {
+			break;
+		}
+		PyObj *top = pvm->index? obj_stack_peek (pvm->stack, false): NULL;
+		if (pvm->break_on_stop && rbuf[0] == OP_STOP) {
+			R_LOG_DEBUG ("[0x%"PFMT64x"] OP(%02x): stop", pvm->offset, OP_STOP);
+			if (pvm->index && !index_exec (pvm, OP_STOP, top, 1, 0)) {
+				return false;
+			}
+			break;
+		}
+		RAnalOp op;
+		r_anal_op_init(&op);
+		int len = r_anal_op (anal, &op, pvm->offset, rbuf, bsize, R_ARCH_OP_MASK_BASIC);
+		if (more && (len <= 0 || op.size > bsize)) {
+			// op runs past what is decompressed so far
+			ut64 need = op.size > bsize? op.size: bsize + INPUT_CHUNK;
+			r_anal_op_fini (&op);
+			more = pvm_window (pvm, &rbuf, &bsize, need);
+			continue;
+		}
+		if (len <= 0) {
+			R_LOG_ERROR ("Failed to disassemble op at offset: 0x"PFMT64x, pvm->offset);
+			return false;
+		}
+		int size = op.size;
+		R_LOG_DEBUG ("[0x%"PFMT64x"] OP(%02x) len: %d: %s", pvm->offset, ((char)rbuf[0]) & 0xff, op.size, op.mnemonic);
+		ut32 memo = pvm->index? index_memo (pvm, &op, (char)rbuf[0]): 0;
+		bool exec = pvm->globals? exec_glob_op (pvm, &op, (char)rbuf[0]): exec_op (pvm, &op, (char)rbuf[0]);
+		if (!exec && pvm->limits.stop) {
+			// already logged, keep what we have
+			r_anal_op_fini (&op);
+			return false;
+		} else if (!exec) {
+			if (op.mnemonic) {
+				R_LOG_ERROR ("Failed to exec opcode '%s' at offset: 0x%" PFMT64x, op.mnemonic,pvm->offset);
+			} else {
+				R_LOG_ERROR ("Failed to exec unkown opcode 0x%02x at offset: 0x%" PFMT64x, rbuf[0], pvm->offset);
+			}
+			r_anal_op_fini (&op);
+			return false;
+		}
+		r_anal_op_fini (&op);
+		if (pvm->stats) {
+			stats_op (pvm->stats, pvm, (char)rbuf[0], size);
+		}
+		if (!limits_check_pvm (&pvm->limits, pvm)) {
+			return false;
+		}
+		if (pvm->index && !index_exec (pvm, (char)rbuf[0], top, size, memo)) {
+			return false;
+		}
+
+		stream_flush (pvm->stream);
+
+		// adjust read loc for next loop
+		pvm->offset += size;
+		bsize -= size;
+		rbuf += size;
+	}
+	empty_memo (pvm);
+	return true;
+}
+
+// output goes to `out` if set, r_cons otherwise
+static inline void pickle_print(RStrBuf *out, const char *str) {
+	if (out) {
+		r_strbuf_append (out, str);
+	} else {
+		r_cons_print (str);
+	}
+}
+
+// the whole state, or only `obj` for pdPp
+static inline bool dump_json(PJ *pj, PMState *pvm, PyObj *obj, const char *path, ut64 skeleton, bool tensor, RStrBuf *out) {
+	if (pvm->stats) {
+		pvm->stats->print_start = r_time_now_mono ();
+	}
+	bool ret = obj
+		? json_dump_query (pj, pvm, obj, path, skeleton, tensor)
+		: json_dump_state (pj, pvm, skeleton, tensor);
+	if (ret) {
+		pickle_print (out, pj_string (pj));
+		return true;
+	}
+	return false;
+}
+
+// pj is NULL for text output, printer times the python printer too
+static inline bool dump_stats(PJ *pj, PMState *pvm, bool printer, bool warn, RStrBuf *out) {
+	PStats *st = pvm->stats;
+	stats_objs (st, pvm);
+
+	if (printer) {
+		// run the printer with its output counted and dropped
+		PrintInfo nfo;
+		pvm->recurse++;
+		if (print_info_init (&nfo, pvm->recurse, NULL)) {
+			nfo.discard = true;
+			ut64 start = r_time_now_mono ();
+			dump_machine (pvm, &nfo, warn);
+			st->time_print = r_time_now_mono () - start;
+			st->print_len = nfo.out_len;
+			st->printed = true;
+		}
+		print_info_clean (&nfo);
+	}
+
+	bool ret = false;
+	if (!pj) {
+		RStrBuf *sb = r_strbuf_new ("");
+		if (sb && stats_dump (sb, st, pvm)) {
+			pickle_print (out, r_strbuf_get (sb));
+			ret = true;
+		}
+		r_strbuf_free (sb);
+		return ret;
+	}
+	if (stats_dump_json (pj, st, pvm)) {
+		pickle_print (out, pj_string (pj));
+		ret = true;
+	}
+	return ret;
+}
+
+// pdPg, or pdPi when pvm->ioc is set. pj is NULL for text output
+static inline bool dump_globals(PJ *pj, PMState *pvm, bool warn, RStrBuf *out) {
+	bool ret = false;
+	if (!pj) {
+		RStrBuf *sb = r_strbuf_new ("");
+		if (sb && (pvm->ioc? ioc_dump (sb, pvm->ioc): globals_dump (sb, pvm->globals))) {
+			if (warn) {
+				r_strbuf_appendf (sb, "## incomplete, decoding stopped at offset 0x%"PFMT64x"\n", pvm->offset);
+			}
+			limits_dump (sb, &pvm->limits);
+			if (pvm->policy) {
+				policy_dump (sb, pvm->policy);
+			}
+			pickle_print (out, r_strbuf_get (sb));
+			ret = true;
+		}
+		r_strbuf_free (sb);
+		return ret;
+	}
+	ret = pj_o (pj)
+		&& (pvm->ioc? pj_k (pj, "ioc") && ioc_dump_json (pj, pvm->ioc): globals_dump_json (pj, pvm->globals))
+		&& pj_kb (pj, "complete", !warn);
+	if (ret && pvm->limits.hit) {
+		ret = pj_k (pj, "limit") && limits_dump_json (pj, &pvm->limits);
+	}
+	if (ret && pvm->policy) {
+		ret = pj_k (pj, "policy") && policy_dump_json (pj, pvm->policy);
+	}
+	if (ret && pj_end (pj)) {
+		pickle_print (out, pj_string (pj));
+		return true;
+	}
+	return false;
+}
+
+// pdPh, pj is NULL for text output
+static inline bool dump_hash(PJ *pj, PMState *pvm, PHash *h, bool warn, RStrBuf *out) {
+	bool hashed = hash_state (h, pvm);
+	if (!hashed && !pvm->limits.stop) {
+		return false;
+	}
+	bool ret = false;
+	if (!pj) {
+		RStrBuf *sb = r_strbuf_new ("");
+		if (sb && (!hashed || hash_dump (sb, h))) {
+			if (warn) {
+				r_strbuf_appendf (sb, "## incomplete, decoding stopped at offset 0x%"PFMT64x"\n", pvm->offset);
+			}
+			limits_dump (sb, &pvm->limits);
+			if (pvm->policy) {
+				policy_dump (sb, pvm->policy);
+			}
+			pickle_print (out, r_strbuf_get (sb));
+			ret = true;
+		}
+		r_strbuf_free (sb);
+		return ret;
+	}
+	ret = pj_o (pj)
+		&& (!hashed || hash_dump_json (pj, h))
+		&& pj_kb (pj, "complete", !warn && hashed);
+	if (ret && pvm->limits.hit) {
+		ret = pj_k (pj, "limit") && limits_dump_json (pj, &pvm->limits);
+	}
+	if (ret && pvm->policy) {
+		ret = pj_k (pj, "policy") && policy_dump_json (pj, pvm->policy);
+	}
+	if (ret && pj_end (pj)) {
+		pickle_print (out, pj_string (pj));
+		return true;
+	}
+	return false;
+}
+
+// `\r` status line on stderr, only shows up for slow pickles
+static void progress_line(void *user, const PProgress *p) {
+	bool *shown = user;
+	ut64 total = p->end - p->start;
+	ut64 done = p->offset - p->start;
+	r_cons_eprintf ("\r[pdP] %s 0x%08"PFMT64x" %3d%%, %"PFMT64u" objects, %"PFMT64u"s ",
+		p->phase, p->offset, total? (int)(done * 100 / total): 0, p->objs, p->usec / 1000000);
+	*shown = true;
+}
+
+// the task pdP runs in, when that is not the main one (`pdP&` or `& pdP`)
+static inline RCoreTask *bg_task(RCore *c) {
+	RCoreTask *task = r_core_task_self (&c->tasks);
+	return task && task != c->tasks.main_task && task->cons_context? task: NULL;
+}
+
+// c->anal belongs to the main thread, a sleeping task decodes with its own
+static inline RAnal *bg_anal_new(void) {
+	RAnal *anal = r_anal_new ();
+	if (anal && !r_anal_use (anal, "pickle")) {
+		r_anal_free (anal);
+		return NULL;
+	}
+	return anal;
+}
+
+// one side of pdPd, at `at` unless pvm->buf already holds a file
+static bool diff_decode(RCore *c, PMState *pvm, ut64 at, bool *fin) {
+	pvm->nosplit = true; // splits mark when reduces ran, not what they built
+	if (!init_machine_state (c, pvm, at)) {
+		return false;
+	}
+	limits_init (&pvm->limits, c->config);
+	pvm->break_on_stop = true;
+	*fin = run_pvm (c->anal, pvm);
+	pvm_input_done (pvm);
+	return true;
+}
+
+static inline bool diff_side_json(PJ *pj, const char *k, PMState *pvm, const char *file, bool fin) {
+	return pj_ko (pj, k)
+		&& (!file || pj_ks (pj, "file", file))
+		&& pj_kn (pj, "offset", pvm->start)
+		&& pj_kb (pj, "complete", fin)
+		&& (!pvm->limits.hit || (pj_k (pj, "limit") && limits_dump_json (pj, &pvm->limits)))
+		&& pj_end (pj);
+}
+
+static inline void diff_side_dump(RStrBuf *sb, const char *name, PMState *pvm, bool fin) {
+	if (!fin) {
+		r_strbuf_appendf (sb, "## %s incomplete, decoding stopped at offset 0x%"PFMT64x"\n", name, pvm->offset);
+	}
+	limits_dump (sb, &pvm->limits);
+}
+
+// pdPd, `arg` is an offset in this file or the path of another one
+static bool pickle_diff(RCore *c, const char *flags, const char *arg, RStrBuf *out) {
+	if (R_STR_ISEMPTY (arg)) {
+		R_LOG_ERROR ("Usage: pdPd <offset|file>, diffs the pickle here against another one");
+		return false;
+	}
+	const char *file = r_file_exists (arg)? arg: NULL;
+	char *buf = NULL;
+	size_t size = 0;
+	if (file && !(buf = r_file_slurp (file, &size))) {
+		R_LOG_ERROR ("Can't read %s", file);
+		return false;
+	}
+	ut64 at = file? 0: r_num_math (c->num, arg);
+	PMState a = {0}, b = {0};
+	b.buf = (ut8 *)buf; // freed with b
+	b.buf_size = size;
+	bool fin_a = false, fin_b = false;
+	PHash *ha = hash_new (PH_FULL);
+	PHash *hb = hash_new (PH_FULL);
+	PDiff *d = diff_new ();
+	bool ret = false;
+	r_cons_break_push (NULL, NULL);
+	bool ok = ha && hb && d
+		&& diff_decode (c, &a, c->offset, &fin_a)
+		&& diff_decode (c, &b, at, &fin_b);
+	bool diffed = ok && hash_state (ha, &a) && hash_state (hb, &b) && diff_states (d, &a, &b);
+	r_cons_break_pop ();
+	if (ok && strchr (flags, 'j')) {
+		PJ *pj = r_core_pj_new (c);
+		ret = pj && pj_o (pj)
+			&& diff_side_json (pj, "a", &a, NULL, fin_a)
+			&& diff_side_json (pj, "b", &b, file, fin_b)
+			&& (!diffed || diff_dump_json (pj, d))
+			&& pj_kb (pj, "complete", fin_a && fin_b && diffed)
+			&& pj_end (pj);
+		if (ret) {
+			pickle_print (out, pj_string (pj));
+		}
+		pj_free (pj);
+	} else if (ok) {
+		RStrBuf *sb = r_strbuf_new ("");
+		if (sb && (!diffed || diff_dump (sb, d))) {
+			diff_side_dump (sb, "a", &a, fin_a);
+			diff_side_dump (sb, "b", &b, fin_b);
+			pickle_print (out, r_strbuf_get (sb));
+			ret = true;
+		}
+		r_strbuf_free (sb);
+	}
+	if (ok && !ret) {
+		R_LOG_ERROR ("Failed to diff pickles");
+	}
+	diff_free (d);
+	hash_free (ha);
+	hash_free (hb);
+	empty_state (&a);
+	empty_state (&b);
+	return ret;
+}
+
+// decompile at current offset, `input` takes the same flags as pdP, `arg` is
+// the path for pdPp
+static bool pickle_decode(RCore *c, const char *input, const char *arg, RStrBuf *out) {
+	PMState state = {0};
+	PStats stats = {0};
+	bool ret = false;
+	const char *query = strchr (input, 'p')? arg: NULL;
+	if (strchr (input, 'p') && R_STR_ISEMPTY (query)) {
+		R_LOG_ERROR ("Usage: pdPp <path>, e.g. pdPp .stack[0][\"state_dict\"]");
+		return false;
+	}
+	if (query && strpbrk (input, "sgih")) {
+		R_LOG_ERROR ("pdPp only combines with j, f, q and &");
+		return false;
+	}
+	state.lazy = query != NULL; // only the strings under the path get escaped
+	if (strchr (input, 'q')) {
+		state.nosplit = true;
+	} else  {
+		state.nosplit = false;
+	}
+	bool showstats = strchr (input, 's');
+	bool iocs = strchr (input, 'i');
+	bool globs = iocs || strchr (input, 'g');
+	PHash *hash = NULL;
+	if (strchr (input, 'h')) {
+		PHashMode mode;
+		const char *m = r_config_get (c->config, "pickle.hash");
+		if (!hash_mode_parse (m, &mode)) {
+			R_LOG_ERROR ("Unknown pickle.hash mode '%s', expected types, globals or full", m);
+			return false;
+		}
+		if (!(hash = hash_new (mode))) {
+			return false;
+		}
+	}
+	if (iocs) {
+		const char *path = r_config_get (c->config, "pickle.ioc");
+		if (R_STR_ISEMPTY (path)) {
+			R_LOG_ERROR ("pdPi needs the IOC strings file in pickle.ioc");
+		} else {
+			state.ioc = ioc_load (path);
+		}
+	}
+	if (globs || hash) {
+		showstats = false;
+		state.globals = globs && (!iocs || state.ioc)? globals_new (): NULL;
+	} else if (showstats || r_config_get_b (c->config, "pickle.stats")) {
+		stats_init (&stats);
+		state.stats = &stats;
+	}
+
+	// In a background task, decoding and printing happen with the task
+	// asleep so the prompt stays usable. Nothing in between may touch RCore
+	// or r_cons. pdPf sets its flags once the task is awake again.
+	RCoreTask *task = bg_task (c);
+	RAnal *anal = task? bg_anal_new (): c->anal;
+	if (!anal) {
+		task = NULL;
+		anal = c->anal;
+	}
+	RStrBuf *sink = out;
+	if (task && !out) {
+		sink = r_strbuf_new ("");
+		if (!sink) {
+			task = NULL;
+		}
+	}
+
+	// compiled once, before anything is decoded
+	const char *policy = r_config_get (c->config, "pickle.policy");
+	if (R_STR_ISNOTEMPTY (policy)) {
+		state.policy = policy_load (policy, r_config_get_b (c->config, "pickle.policy.stop"));
+	}
+
+	if ((!globs || state.globals) && (R_STR_ISEMPTY (policy) || state.policy) && init_machine_state (c, &state, c->offset)) {
+		limits_init (&state.limits, c->config);
+		// streaming prints to r_cons while decoding, so never from a task
+		bool json = strchr (input, 'j');
+		if (!task && !showstats && !globs && !hash && !json && !query && r_config_get_b (c->config, "pickle.stream")) {
+			state.stream = stream_new (c, &state, out);
+		}
+		bool progress = false;
+		if (task) {
+			state.limits.cancel = &task->cons_context->breaked;
+		} else if (!out && !state.stream && !json && !showstats && r_cons_is_tty () && r_config_get_b (c->config, "pickle.progress")) {
+			state.limits.progress = progress_line;
+			state.limits.progress_user = &progress;
+		}
+		state.break_on_stop = true;
+		ut64 start = r_time_now_mono ();
+		r_cons_break_push (NULL, NULL);
+		if (task) {
+			r_core_task_sleep_begin (task);
+		}
+		bool pvm_fin = run_pvm (anal, &state);
+		pvm_input_done (&state);
+		if (task) {
+			r_core_task_sleep_end (task);
+		}
+		ut64 streamed = 0; // counts against pickle.limit.output
+		if (state.stream) {
+			stream_finish (state.stream, &state);
+			streamed = state.stream->nfo.out_len;
+			stream_free (state.stream);
+			state.stream = NULL;
+		}
+		r_cons_break_pop ();
+		stats.time_pvm = r_time_now_mono () - start;
+
+		// everything the printers need from the core is gathered before sleeping
+		char *qpath = NULL;
+		PyObj *qobj = query? query_resolve (&state, query, &qpath): NULL;
+		if (qobj && !py_obj_load (&state, qobj)) {
+			R_LOG_ERROR ("Failed to load the strings of %s", qpath);
+			qobj = NULL;
+		}
+		PJ *pj = json? r_core_pj_new (c): NULL;
+		ut64 skeleton = r_config_get_i (c->config, "pickle.skeleton");
+		bool tensor = r_config_get_b (c->config, "pickle.tensor");
+		bool printer = r_config_get_b (c->config, "pickle.stats.printer");
+		PrintInfo nfo = {0};
+		bool nfo_ok = true;
+		bool setflags = false;
+		if (!showstats && !globs && !hash && !json) {
+			state.recurse++;
+			nfo_ok = print_info_init (&nfo, state.recurse, c);
+			setflags = strchr (input, 'f');
+			nfo.out_len = streamed;
+			if (out) {
+				nfo.pal = NULL;
+			}
+			nfo.sink = sink;
+		}
+
+		// fresh break state, ^C while decoding still prints what was decoded
+		r_cons_break_push (NULL, NULL);
+		if (task) {
+			r_core_task_sleep_begin (task);
+		}
+		if (json && !pj) {
+			R_LOG_ERROR ("Failed to init JSON output");
+		} else if (query && !qobj) {
+			// bad path, already logged
+		} else if (globs) {
+			ret = dump_globals (pj, &state, !pvm_fin, sink);
+		} else if (hash) {
+			ret = dump_hash (pj, &state, hash, !pvm_fin, sink);
+			if (!ret) {
+				R_LOG_ERROR ("Failed to hash pickle");
+			}
+		} else if (showstats) {
+			ret = dump_stats (pj, &state, printer, !pvm_fin, sink);
+			if (!ret) {
+				R_LOG_ERROR ("Failed to dump pickle stats");
+			}
+		} else if (json) {
+			ret = dump_json (pj, &state, qobj, qpath, skeleton, tensor, sink);
+		} else if (nfo_ok) {
+			stats.print_start = r_time_now_mono ();
+			ret = qobj
+				? dump_query (&state, &nfo, qobj, qpath, !pvm_fin)
+				: dump_machine (&state, &nfo, !pvm_fin);
+			if (!ret && !state.limits.stop) {
+				R_LOG_ERROR ("Failed to dump pickle");
+			}
+			if (state.stats) {
+				stats.time_print = r_time_now_mono () - stats.print_start;
+				RStrBuf *sb = r_strbuf_new ("");
+				if (sb) {
+					stats_dump_phases (sb, &stats);
+					pickle_print (sink, r_strbuf_get (sb));
+				}
+				r_strbuf_free (sb);
+			}
+		} else {
+			R_LOG_ERROR ("Failed to init pickle printer state");
+		}
+		if (task) {
+			r_core_task_sleep_end (task);
+		}
+		r_cons_break_pop ();
+		if (ret && setflags && !dump_flags (&nfo, &state, c)) {
+			R_LOG_ERROR ("Failed to set pick.* flags");
+		}
+		print_info_clean (&nfo);
+		pj_free (pj);
+		free (qpath);
+		if (progress) {
+			r_cons_eprintf ("\n");
+		}
+	}
+	empty_state (&state);
+	hash_free (hash);
+	if (sink != out) {
+		r_cons_print (r_strbuf_get (sink));
+		r_strbuf_free (sink);
+	}
+	if (anal != c->anal) {
+		r_anal_free (anal);
+	}
+	return ret;
+}
+
+// pdPo and pdPa keep the last pickle they decoded on each core, so moving
+// around in it is a binary search rather than a decode. An r_io write over
+// it drops it, and so does a change to the config the decode used. Once
+// another file is open, only the same pickle bytes keep it.
+typedef struct pickle_index_cache {
+	RCore *core;
+	RThreadLock *lock; // held while a command or the write hook uses it
+	REventCallbackHandle hook;
+	PMState pvm;
+	bool used; // pvm holds a decode
+	bool stale; // written to since
+	bool fin;
+
+	// what the decode came from, see index_cache_hit
+	int fd;
+	char *uri;
+	ut64 size; // r_io_size
+	ut64 hash; // index_cache_hash of the pickle
+	char *member; // pickle.zip.member, pvm.limits has pickle.limit.*
+} PIndexCache;
+
+#define INDEX_CACHE_HEAD 64 // bytes compared at the start of the pickle
+
+// RCore * -> PIndexCache *, for the cores the plugin is initialized on.
+// Those come and go on the main thread.
+static HtUP *index_caches = NULL;
+static RThreadLock *index_caches_lock = NULL;
+static ut32 index_cores = 0;
+
+static void index_cache_drop(PIndexCache *ic) {
+	if (ic->used) {
+		empty_state (&ic->pvm);
+	}
+	memset (&ic->pvm, 0, sizeof (ic->pvm));
+	ic->used = ic->stale = ic->fin = false;
+	R_FREE (ic->uri);
+	R_FREE (ic->member);
+}
+
+// FNV-1a
+static ut64 index_cache_hash(const ut8 *buf, ut64 len) {
+	ut64 h = 0xcbf29ce484222325ULL;
+	ut64 i;
+	for (i = 0; i < len; i++) {
+		h = (h ^ buf[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+// remember which file is open
+static void index_cache_file(PIndexCache *ic) {
+	RIO *io = ic->core->io;
+	free (ic->uri);
+	ic->uri = io->desc && io->desc->uri? strdup (io->desc->uri): NULL;
+	ic->fd = io->desc? io->desc->fd: -1;
+	ic->size = r_io_size (io);
+}
+
+static inline bool index_cache_same_file(PIndexCache *ic) {
+	RIO *io = ic->core->io;
+	return io->desc && io->desc->fd == ic->fd && ic->uri && io->desc->uri
+		&& !strcmp (io->desc->uri, ic->uri) && r_io_size (io) == ic->size;
+}
+
+// another file is open, is the pickle still there? Reads all of it, but
+// that is still much less work than decoding it again.
+static bool index_cache_same_bytes(PIndexCache *ic) {
+	PMState *pvm = &ic->pvm;
+	ut64 len = pvm->index->end - pvm->start;
+	ut8 *buf = len < ST32_MAX? malloc (len): NULL;
+	bool ret = buf && r_io_read_at (ic->core->io, pvm->start, buf, len)
+		&& index_cache_hash (buf, len) == ic->hash;
+	free (buf);
+	if (ret) {
+		index_cache_file (ic);
+	}
+	return ret;
+}
+
+static void index_cache_written(REvent *ev, int type, void *user, void *data) {
+	PIndexCache *ic = user;
+	REventIOWrite *iow = data;
+	r_th_lock_enter (ic->lock);
+	PMState *pvm = &ic->pvm;
+	if (ic->used && iow && iow->addr < pvm->index->end && iow->addr + iow->len > pvm->start) {
+		ic->stale = true;
+	}
+	r_th_lock_leave (ic->lock);
+}
+
+static void index_cache_free(PIndexCache *ic) {
+	if (ic) {
+		if (ic->core->io && ic->core->io->event) {
+			r_event_unhook (ic->core->io->event, ic->hook);
+		}
+		index_cache_drop (ic);
+		r_th_lock_free (ic->lock);
+		free (ic);
+	}
+}
+
+// c's cache, locked, NULL on failure. index_cache_leave when done.
+static PIndexCache *index_cache_enter(RCore *c) {
+	if (!index_caches_lock) {
+		return NULL;
+	}
+	r_th_lock_enter (index_caches_lock);
+	PIndexCache *ic = index_caches? ht_up_find (index_caches, (ut64)(size_t)c, NULL): NULL;
+	if (!ic && (index_caches || (index_caches = ht_up_new0 ())) && (ic = R_NEW0 (PIndexCache))) {
+		ic->core = c;
+		ic->lock = r_th_lock_new (false);
+		if (!ic->lock || !ht_up_insert (index_caches, (ut64)(size_t)c, ic)) {
+			r_th_lock_free (ic->lock);
+			R_FREE (ic);
+		} else if (c->io && c->io->event) {
+			ic->hook = r_event_hook (c->io->event, R_EVENT_IO_WRITE, index_cache_written, ic);
+		}
+	}
+	if (ic) {
+		// taken before the registry is released, so fini can't free it
+		r_th_lock_enter (ic->lock);
+	}
+	r_th_lock_leave (index_caches_lock);
+	return ic;
+}
+
+static void index_cache_leave(PIndexCache *ic) {
+	r_th_lock_leave (ic->lock);
+}
+
+// still the bytes and config that were decoded, and `addr` is one of them
+static bool index_cache_hit(PIndexCache *ic, ut64 addr) {
+	PMState *pvm = &ic->pvm;
+	RConfig *cfg = ic->core->config;
+	if (!ic->used || ic->stale || addr < pvm->start || addr >= pvm->index->end
+		|| strcmp (r_str_get (r_config_get (cfg, "pickle.zip.member")), r_str_get (ic->member))) {
+		return false;
+	}
+	PLimits limits;
+	limits_init (&limits, cfg);
+	if (memcmp (limits.max, pvm->limits.max, sizeof (limits.max))) {
+		return false;
+	}
+	if (!index_cache_same_file (ic)) {
+		return index_cache_same_bytes (ic);
+	}
+	ut8 head[INDEX_CACHE_HEAD];
+	ut64 len = R_MIN (sizeof (head), pvm->index->end - pvm->start);
+	return r_io_read_at (ic->core->io, pvm->start, head, len) && !memcmp (head, pvm->buf, len);
+}
+
+static bool index_cache_fill(PIndexCache *ic) {
+	RCore *c = ic->core;
+	index_cache_drop (ic);
+	PMState *pvm = &ic->pvm;
+	pvm->lazy = true; // strings are never printed
+	bool ret = init_machine_state (c, pvm, c->offset);
+	ic->used = ret;
+	if (ret && (pvm->input || (pvm->zip && pvm->zip->pkl->method != ZIP_STORED))) {
+		R_LOG_ERROR ("pdPo needs file offsets, this pickle is compressed");
+		ret = false;
+	}
+	ret = ret && (pvm->index = index_new ());
+	if (ret) {
+		limits_init (&pvm->limits, c->config);
+		pvm->break_on_stop = true;
+		r_cons_break_push (NULL, NULL);
+		ic->fin = run_pvm (c->anal, pvm);
+		r_cons_break_pop ();
+		pvm_input_done (pvm);
+		ret = index_paths (pvm->index, pvm);
+	}
+	if (ret) {
+		ic->hash = index_cache_hash (pvm->buf, pvm->index->end - pvm->start);
+		ic->member = strdup (r_str_get (r_config_get (c->config, "pickle.zip.member")));
+		index_cache_file (ic);
+	} else {
+		index_cache_drop (ic);
+	}
+	return ret;
+}
+
+// pdPo and pdPa, ic locked and holding the pickle at addr
+static PIndexCache *index_cache_get(RCore *c, ut64 addr) {
+	PIndexCache *ic = index_cache_enter (c);
+	if (!ic) {
+		R_LOG_ERROR ("Failed to set up the pdPo cache");
+		return NULL;
+	}
+	if (!index_cache_hit (ic, addr) && !index_cache_fill (ic)) {
+		index_cache_leave (ic);
+		return NULL;
+	}
+	return ic;
+}
+
+static inline bool index_dump_json(PJ *pj, PIndexCache *ic, ut64 addr, const PIndexOp *op, ut64 size, const char *name, PyObj *obj, const char *path) {
+	bool ret = pj_o (pj)
+		&& pj_kn (pj, "addr", addr)
+		&& pj_ko (pj, "op")
+		&& pj_kn (pj, "offset", op->offset)
+		&& pj_kn (pj, "size", size)
+		&& pj_ks (pj, "name", name)
+		&& pj_end (pj)
+		&& pj_k (pj, "object");
+	if (ret && obj) {
+		ret = pj_o (pj)
+			&& pj_kn (pj, "offset", obj->offset)
+			&& pj_ks (pj, "type", py_type_to_name (obj->type))
+			&& (path? pj_ks (pj, "path", path): pj_knull (pj, "path"))
+			&& pj_end (pj);
+	} else if (ret) {
+		ret = pj_null (pj);
+	}
+	return ret && pj_kb (pj, "complete", ic->fin) && pj_end (pj);
+}
+
+static inline void index_dump(RStrBuf *sb, PIndexCache *ic, ut64 addr, const PIndexOp *op, ut64 size, const char *name, PyObj *obj, const char *path) {
+	r_strbuf_appendf (sb, "0x%"PFMT64x": %s at 0x%"PFMT64x", %"PFMT64u" bytes", addr, name, op->offset, size);
+	if (obj) {
+		r_strbuf_appendf (sb, " -> %s from 0x%"PFMT64x", %s\n", py_type_to_name (obj->type), obj->offset,
+			path? path: "not reachable from the stacks");
+	} else {
+		r_strbuf_append (sb, ", no object\n");
+	}
+	if (!ic->fin) {
+		r_strbuf_appendf (sb, "## incomplete, decoding stopped at offset 0x%"PFMT64x"\n", ic->pvm.offset);
+	}
+}
+
+// pdPo, which opcode and object the byte at `arg` (here by default) is part
+// of. Decodes the pickle here unless the last one pdPo decoded still covers it.
+static bool pickle_offset(RCore *c, const char *flags, const char *arg, RStrBuf *out) {
+	ut64 addr = R_STR_ISEMPTY (arg)? c->offset: r_num_math (c->num, arg);
+	PIndexCache *ic = index_cache_get (c, addr);
+	if (!ic) {
+		return false;
+	}
+	PMState *pvm = &ic->pvm;
+	ut64 size = 0;
+	const PIndexOp *op = index_find (pvm->index, addr, &size);
+	if (!op) {
+		R_LOG_ERROR ("0x%"PFMT64x" is not in the pickle at 0x%"PFMT64x"-0x%"PFMT64x, addr, pvm->start, pvm->index->end);
+		index_cache_leave (ic);
+		return false;
+	}
+	const char *name = py_opcode_to_name ((char)pvm->buf[op->offset - pvm->start]);
+	PyObj *obj = index_obj (op);
+	char *path = obj? index_path (pvm->index, obj): NULL;
+	bool ret = false;
+	if (strchr (flags, 'j')) {
+		PJ *pj = r_core_pj_new (c);
+		ret = pj && index_dump_json (pj, ic, addr, op, size, name, obj, path);
+		if (ret) {
+			pickle_print (out, pj_string (pj));
+		}
+		pj_free (pj);
+	} else {
+		RStrBuf *sb = r_strbuf_new ("");
+		if (sb) {
+			index_dump (sb, ic, addr, op, size, name, obj, path);
+			pickle_print (out, r_strbuf_get (sb));
+			ret = true;
+		}
+		r_strbuf_free (sb);
+	}
+	free (path);
+	index_cache_leave (ic);
+	return ret;
+}
+
+// pdPa, a comment at every opcode of the pickle here saying what it did, from
+// the same decode pdPo keeps, so `pd` shows them without decoding again. An
+// existing comment is kept. pdPa- removes the ones pdPa would set.
+static bool pickle_annotate(RCore *c, const char *flags, RStrBuf *out) {
+	PIndexCache *ic = index_cache_get (c, c->offset);
+	if (!ic) {
+		return false;
+	}
+	PMState *pvm = &ic->pvm;
+	PIndex *ix = pvm->index;
+	bool del = strchr (flags, '-');
+	PrintInfo nfo;
+	pvm->recurse++;
+	bool ret = print_info_init (&nfo, pvm->recurse, c);
+	ut64 i, done = 0, kept = 0;
+	for (i = 0; ret && i < ix->nops; i++) {
+		const PIndexOp *op = &ix->ops[i];
+		char *note = index_note (pvm, &nfo, op);
+		const char *had = note? r_meta_get_string (c->anal, R_META_TYPE_COMMENT, op->offset): NULL;
+		if (!note) {
+			// nothing to say
+		} else if (del) {
+			if (had && !strcmp (had, note)) {
+				r_meta_del (c->anal, R_META_TYPE_COMMENT, op->offset, 1);
+				done++;
+			}
+		} else if (had) {
+			kept++;
+		} else {
+			ret = r_meta_set_string (c->anal, R_META_TYPE_COMMENT, op->offset, note);
+			done++;
+		}
+		free (note);
+	}
+	print_info_clean (&nfo);
+	if (!ret) {
+		R_LOG_ERROR ("Failed to annotate pickle");
+	} else if (strchr (flags, 'j')) {
+		PJ *pj = r_core_pj_new (c);
+		ret = pj && pj_o (pj)
+			&& pj_kn (pj, del? "removed": "annotated", done)
+			&& pj_kn (pj, "kept", kept)
+			&& pj_kb (pj, "complete", ic->fin)
+			&& pj_end (pj);
+		if (ret) {
+			pickle_print (out, pj_string (pj));
+		}
+		pj_free (pj);
+	} else {
+		char *msg = r_str_newf ("## %"PFMT64u" opcodes %s, %"PFMT64u" kept their comment\n%s",
+			done, del? "unannotated": "annotated", kept,
+			ic->fin? "": "## incomplete, only the opcodes decoded\n");
+		pickle_print (out, r_str_get (msg));
+		free (msg);
+	}
+	index_cache_leave (ic);
+	return ret;
+}
+
+// flags, then an argument after a space for the commands taking one
+static bool pickle_run(RCore *c, const char *input, RStrBuf *out) {
+	char *flags = strdup (input);
+	if (!flags) {
+		return false;
+	}
+	char *arg = strchr (flags, ' ');
+	if (arg) {
+		*arg++ = '\0';
+		r_str_trim (arg);
+	}
+	bool ret;
+	if (strchr (flags, 'd')) {
+		ret = pickle_diff (c, flags, arg, out);
+	} else if (strchr (flags, 'o')) {
+		ret = pickle_offset (c, flags, arg, out);
+	} else if (strchr (flags, 'a')) {
+		ret = pickle_annotate (c, flags, out);
+	} else {
+		ret = pickle_decode (c, flags, arg, out);
+	}
+	free (flags);
+	return ret;
+}
+
+R_API char *pickle_dec_str(RCore *c, const char *input) {
+	r_return_val_if_fail (c && input, NULL);
+	RStrBuf *sb = r_strbuf_new ("");
+	if (sb) {
+		pickle_run (c, input, sb);
+		return r_strbuf_drain (sb);
+	}
+	return NULL;
+}
+
+static void pickle_bg_done(void *user, char *out) {
+	char *cmd = user;
+	R_LOG_INFO ("Background `%s` is done, `&` lists tasks and `&= <id>` shows its output", cmd);
+	free (cmd);
+}
+
+// `pdP&`, runs `pdP @ offset` as an r2 task, same as `& pdP` but the offset
+// is pinned now and a message says when it is done
+static bool pickle_bg(RCore *c, const char *input) {
+	char *flags = strdup (input);
+	if (!flags) {
+		return false;
+	}
+	char *arg = strchr (flags, ' '); // pdPp and pdPd, may hold a '&' itself
+	if (arg) {
+		*arg++ = '\0';
+	}
+	r_str_replace_char (flags, '&', 0);
+	char *cmd = r_str_newf ("pdP%s%s%s @ 0x%"PFMT64x, flags, arg? " ": "", r_str_get (arg), c->offset);
+	free (flags);
+	RCoreTask *task = cmd? r_core_task_new (c, true, cmd, pickle_bg_done, cmd): NULL;
+	if (!task) {
+		R_LOG_ERROR ("Failed to start pdP task");
+		free (cmd);
+		return false;
+	}
+	// cmd is freed by pickle_bg_done, possibly before enqueue returns
+	R_LOG_INFO ("Starting `%s` as task %d", cmd, task->id);
+	r_core_task_enqueue (&c->tasks, task);
+	return true;
+}
+
+static int pickle_dec(void *user, const char *input) {
+	if (!input || strncmp ("pdP", input, 3)) {
+		return 0;
+	}
+	input += 3;
+	RCore *c = (RCore *)user;
+
+	size_t nflags = strcspn (input, " ");
+	if (memchr (input, '?', nflags)) {
+		r_core_cmd_help (c, help_msg);
+		return 1;
+	}
+	if (memchr (input, '&', nflags) && (memchr (input, 'o', nflags) || memchr (input, 'a', nflags))) {
+		R_LOG_ERROR ("pdPo and pdPa share the last decode, they have no background mode");
+		return 1;
+	}
+	if (memchr (input, '&', nflags)) {
+		pickle_bg (c, input);
+		return 1;
+	}
+	pickle_run (c, input, NULL);
+	return 1;
+}
+
+static int pickle_dec_init(void *user, const char *input) {
+	RCore *c = (RCore *)user;
+	if (c && c->config) {
+		r_config_lock (c->config, false);
+		r_config_set_b (c->config, "pickle.stats", false);
+		r_config_desc (c->config, "pickle.stats", "Append phase timings, allocations and peak RSS to pdP output");
+		r_config_set_b (c->config, "pickle.stats.printer", false);
+		r_config_desc (c->config, "pickle.stats.printer", "Have pdPs also run the python printer, discarding its output, to time it");
+		r_config_set_b (c->config, "pickle.progress", true);
+		r_config_desc (c->config, "pickle.progress", "Show decode/print progress on stderr for pickles that take a while (python output on a tty only)");
+		r_config_set_b (c->config, "pickle.stream", false);
+		r_config_desc (c->config, "pickle.stream", "Print popped objects that can't change anymore while still decoding (python output only)");
+		r_config_set_i (c->config, "pickle.rle", 16);
+		r_config_desc (c->config, "pickle.rle", "Print runs of at least N equal list or tuple elements as `[x] * N` (0 to print every element)");
+		r_config_set_i (c->config, "pickle.skeleton", 0);
+		r_config_desc (c->config, "pickle.skeleton", "Only print the first and last N elements of bigger containers, with counts (0 to print everything)");
+		r_config_set_b (c->config, "pickle.tensor", true);
+		r_config_desc (c->config, "pickle.tensor", "Print numpy arrays and torch tensors as a summary (dtype, shape, size, hash) instead of their data");
+		r_config_set (c->config, "pickle.zip.member", "data.pkl");
+		r_config_desc (c->config, "pickle.zip.member", "Zip member to decompile when pdP is run on a zip (torch .pt), matched against the end of the path");
+		r_config_set (c->config, "pickle.policy", "");
+		r_config_desc (c->config, "pickle.policy", "File of allow/deny rules for the globals a pickle imports, violations are reported after the output");
+		r_config_set_b (c->config, "pickle.policy.stop", true);
+		r_config_desc (c->config, "pickle.policy.stop", "Stop decoding at the first pickle.policy violation");
+		r_config_set (c->config, "pickle.ioc", "");
+		r_config_desc (c->config, "pickle.ioc", "File of IOC strings for pdPi, one per line");
+		r_config_set (c->config, "pickle.hash", "globals");
+		r_config_desc (c->config, "pickle.hash", "What pdPh hashes besides types and shape: types (nothing), globals (imported names) or full (every value)");
+		limits_config_init (c->config);
+		r_config_lock (c->config, true);
+	}
+	if (!index_cores++) {
+		index_caches_lock = r_th_lock_new (false);
+	}
+	return true;
+}
+
+static int pickle_dec_fini(void *user, const char *input) {
+	RCore *c = (RCore *)user;
+	if (!index_cores) {
+		return true;
+	}
+	if (index_caches_lock) {
+		r_th_lock_enter (index_caches_lock);
+		PIndexCache *ic = index_caches? ht_up_find (index_caches, (ut64)(size_t)c, NULL): NULL;
+		if (ic) {
+			ht_up_delete (index_caches, (ut64)(size_t)c);
+			// a pdPo still running on one of c's tasks has it locked
+			r_th_lock_enter (ic->lock);
+			r_th_lock_leave (ic->lock);
+			index_cache_free (ic);
+		}
+		r_th_lock_leave (index_caches_lock);
+	}
+	if (!--index_cores) {
+		ht_up_free (index_caches);
+		index_caches = NULL;
+		index_caches_lock = r_th_lock_free (index_caches_lock);
+	}
+	return true;
 }
 
 // PLUGIN Definition Info
@@ -1247,6 +2921,8 @@ RCorePlugin r_core_plugin_pickle_dec = {
 		.status = R_PLUGIN_STATUS_OK // ???
 	},
 	.call = pickle_dec,
+	.init = pickle_dec_init,
+	.fini = pickle_dec_fini,
 };
 
 #ifndef R2_PLUGIN_INCORE
@@ -0,0 +1,11 @@
+#ifndef PICKLE_DEC
+#define PICKLE_DEC
+#include <r_core.h>
+
+// Decompile the pickle at the current offset without touching r_cons.
+// `input` takes the same flags as the pdP command (ie: "j", "q", "sj").
+// Returned string must be freed.
+R_API char *pickle_dec_str(RCore *c, const char *input);
+
+extern RCorePlugin r_core_plugin_pickle_dec;
+#endif
@@ -0,0 +1,131 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include <r_config.h>
+#include <r_cons.h>
+#include "plimits.h"
+
+typedef struct limit_info {
+	const char *name;
+	const char *config;
+	const char *desc;
+} LimitInfo;
+
+static const LimitInfo limit_info[PLIM_COUNT] = {
+	[PLIM_OBJS] = { "objects", "pickle.limit.objs", "Stop decoding after this many objects (0 for no limit)" },
+	[PLIM_ALLOC] = { "alloc", "pickle.limit.alloc", "Stop decoding after allocating this many bytes (0 for no limit)" },
+	[PLIM_DEPTH] = { "depth", "pickle.limit.depth", "Max nesting of marks, containers and split analysis (0 for no limit)" },
+	[PLIM_OUTPUT] = { "output", "pickle.limit.output", "Stop printing after this many bytes of output (0 for no limit)" },
+	[PLIM_TIME] = { "time", "pickle.limit.time", "Stop decoding and printing after this many milliseconds (0 for no limit)" },
+	[PLIM_BREAK] = { "break", NULL, NULL },
+	[PLIM_POLICY] = { "policy", NULL, NULL },
+};
+
+const char *limits_name(PLimit what) {
+	if (what > PLIM_NONE && what < PLIM_COUNT) {
+		return limit_info[what].name;
+	}
+	return "none";
+}
+
+void limits_config_init(RConfig *cfg) {
+	int i;
+	for (i = PLIM_NONE + 1; i < PLIM_COUNT; i++) {
+		if (!limit_info[i].config) {
+			continue;
+		}
+		r_config_set_i (cfg, limit_info[i].config, 0);
+		r_config_desc (cfg, limit_info[i].config, limit_info[i].desc);
+	}
+}
+
+void limits_init(PLimits *l, RConfig *cfg) {
+	memset (l, 0, sizeof (*l));
+	int i;
+	for (i = PLIM_NONE + 1; i < PLIM_COUNT; i++) {
+		if (limit_info[i].config) {
+			l->max[i] = r_config_get_i (cfg, limit_info[i].config);
+		}
+	}
+	limits_phase (l, "decode");
+}
+
+// decoding and printing each get the full time budget, so a decoder that ran
+// out of time still gets its partial result printed
+void limits_phase(PLimits *l, const char *phase) {
+	l->stop = PLIM_NONE;
+	l->level = 0;
+	l->phase_start = l->progress_last = r_time_now_mono ();
+	l->prog.phase = phase;
+	if (l->max[PLIM_TIME]) {
+		l->deadline = l->phase_start + l->max[PLIM_TIME] * 1000;
+	}
+}
+
+bool limits_poll_slow(PLimits *l, ut64 offset) {
+	ut64 now = r_time_now_mono ();
+	if (l->deadline && now > l->deadline) {
+		return limits_hit (l, PLIM_TIME, offset);
+	}
+	if (l->cancel? *l->cancel: r_cons_is_breaked ()) {
+		return limits_hit (l, PLIM_BREAK, offset);
+	}
+	if (l->progress && now - l->progress_last >= LIMIT_PROGRESS_USEC) {
+		l->progress_last = now;
+		l->prog.offset = offset;
+		l->prog.usec = now - l->phase_start;
+		l->progress (l->progress_user, &l->prog);
+	}
+	return true;
+}
+
+bool limits_hit(PLimits *l, PLimit what, ut64 offset) {
+	l->stop = what;
+	if (!l->hit) {
+		l->hit = what;
+		l->hit_offset = offset;
+		if (what == PLIM_BREAK) {
+			R_LOG_WARN ("Interrupted at offset 0x%"PFMT64x", result is incomplete", offset);
+		} else if (what == PLIM_POLICY) {
+			R_LOG_WARN ("pickle.policy violation at offset 0x%"PFMT64x", result is incomplete", offset);
+		} else {
+			R_LOG_WARN ("Reached %s=%"PFMT64u" at offset 0x%"PFMT64x", result is incomplete",
+				limit_info[what].config, l->max[what], offset);
+		}
+	}
+	return false;
+}
+
+// called once per opcode
+bool limits_check_pvm(PLimits *l, PMState *pvm) {
+	if (limits_over (l, PLIM_OBJS, pvm->objs)) {
+		return limits_hit (l, PLIM_OBJS, pvm->offset);
+	}
+	if (limits_over (l, PLIM_ALLOC, pvm->alloc_bytes)) {
+		return limits_hit (l, PLIM_ALLOC, pvm->offset);
+	}
+	if (limits_over (l, PLIM_DEPTH, r_list_length (pvm->metastack))) {
+		return limits_hit (l, PLIM_DEPTH, pvm->offset);
+	}
+	l->prog.objs = pvm->objs;
+	return limits_poll (l, pvm->offset);
+}
+
+void limits_dump(RStrBuf *sb, PLimits *l) {
+	if (l->hit == PLIM_BREAK) {
+		r_strbuf_appendf (sb, "## interrupted at offset 0x%"PFMT64x"\n", l->hit_offset);
+	} else if (l->hit == PLIM_POLICY) {
+		r_strbuf_appendf (sb, "## stopped by pickle.policy at offset 0x%"PFMT64x"\n", l->hit_offset);
+	} else if (l->hit) {
+		r_strbuf_appendf (sb, "## stopped by %s=%"PFMT64u" at offset 0x%"PFMT64x"\n",
+			limit_info[l->hit].config, l->max[l->hit], l->hit_offset);
+	}
+}
+
+bool limits_dump_json(PJ *pj, PLimits *l) {
+	const char *config = limit_info[l->hit].config;
+	return pj_o (pj)
+		&& pj_ks (pj, "reason", limits_name (l->hit))
+		&& (!config || !l->max[l->hit] || (pj_ks (pj, "config", config) && pj_kn (pj, "max", l->max[l->hit])))
+		&& pj_kn (pj, "offset", l->hit_offset)
+		&& pj_end (pj);
+}
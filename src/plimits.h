@@ -0,0 +1,52 @@
+#ifndef PLIMITS_PICKLE
+#define PLIMITS_PICKLE
+#include "pyobjutil.h"
+
+#define LIMIT_TICKS 0x3ff // look at the clock, ^C and progress once every LIMIT_TICKS + 1 checks
+#define LIMIT_PROGRESS_USEC 500000 // quicker runs never report progress
+
+// stops the current phase and returns false, so callers can just
+// `return limits_hit (...)`. Only the first limit reached is reported.
+bool limits_hit(PLimits *l, PLimit what, ut64 offset);
+
+bool limits_poll_slow(PLimits *l, ut64 offset);
+
+// cheap enough to call for every opcode and every printed object
+static inline bool limits_poll(PLimits *l, ut64 offset) {
+	if (++l->tick & LIMIT_TICKS) {
+		return true;
+	}
+	return limits_poll_slow (l, offset);
+}
+
+static inline bool limits_over(PLimits *l, PLimit what, ut64 val) {
+	return l->max[what] && val > l->max[what];
+}
+
+// enter one level of nesting, pair with limits_leave
+static inline bool limits_enter(PLimits *l, ut64 offset) {
+	if (l->stop) {
+		return false;
+	}
+	if (limits_over (l, PLIM_DEPTH, l->level + 1)) {
+		return limits_hit (l, PLIM_DEPTH, offset);
+	}
+	if (!limits_poll (l, offset)) {
+		return false;
+	}
+	l->level++;
+	return true;
+}
+
+static inline void limits_leave(PLimits *l) {
+	l->level--;
+}
+
+void limits_init(PLimits *l, RConfig *cfg);
+void limits_phase(PLimits *l, const char *phase);
+bool limits_check_pvm(PLimits *l, PMState *pvm);
+const char *limits_name(PLimit what);
+void limits_dump(RStrBuf *sb, PLimits *l);
+bool limits_dump_json(PJ *pj, PLimits *l);
+void limits_config_init(RConfig *cfg);
+#endif
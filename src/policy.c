@@ -0,0 +1,280 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "policy.h"
+
+// index of the new node, 0 (the root) on failure
+static inline ut32 node_new(PPolicy *p) {
+	if (!py_grow ((void **)&p->nodes, &p->nodes_size, p->nnodes, sizeof (PPolicyNode))) {
+		return 0;
+	}
+	memset (&p->nodes[p->nnodes], 0, sizeof (PPolicyNode));
+	return p->nnodes++;
+}
+
+static inline ut32 node_child(PPolicy *p, ut32 at, const char *comp) {
+	if (!p->nodes[at].kids && !(p->nodes[at].kids = ht_pp_new0 ())) {
+		return 0;
+	}
+	size_t kid = (size_t)ht_pp_find (p->nodes[at].kids, comp, NULL);
+	if (kid) {
+		return kid - 1;
+	}
+	ut32 n = node_new (p);
+	if (n && !ht_pp_insert (p->nodes[at].kids, comp, (void *)(size_t)(n + 1))) {
+		p->nnodes--;
+		return 0;
+	}
+	return n;
+}
+
+// `a.b.*` walks or adds the nodes for a and b
+static bool rule_prefix(PPolicy *p, char *prefix, PRule r) {
+	ut32 at = 0;
+	char *comp = prefix;
+	while (comp) {
+		char *dot = strchr (comp, '.');
+		if (dot) {
+			*dot = '\0';
+		}
+		if (!*comp || !(at = node_child (p, at, comp))) {
+			return false;
+		}
+		comp = dot? dot + 1: NULL;
+	}
+	p->nodes[at].rule = r;
+	return true;
+}
+
+static bool rule_exact(PPolicy *p, const char *name, PRule r) {
+	size_t at = (size_t)ht_pp_find (p->exact, name, NULL);
+	if (at) {
+		p->rules[at - 1] = r;
+		return true;
+	}
+	if (!py_grow ((void **)&p->rules, &p->rules_size, p->nrules, sizeof (PRule))
+		|| !ht_pp_insert (p->exact, name, (void *)(size_t)(p->nrules + 1))
+	) {
+		return false;
+	}
+	p->rules[p->nrules++] = r;
+	return true;
+}
+
+static bool rule_add(PPolicy *p, const char *pat, PRule r) {
+	size_t len = strlen (pat);
+	if (!strcmp (pat, "*")) {
+		p->nodes[0].rule = r;
+		return true;
+	}
+	if (len > 2 && !strcmp (pat + len - 2, ".*")) {
+		char *prefix = r_str_ndup (pat, len - 2);
+		bool ret = prefix && !strchr (prefix, '*') && rule_prefix (p, prefix, r);
+		free (prefix);
+		return ret;
+	}
+	if (strchr (pat, '*') || !strchr (pat, '.') || *pat == '.' || pat[len - 1] == '.') {
+		return false;
+	}
+	return rule_exact (p, pat, r);
+}
+
+static inline bool verdict_parse(const char *str, PVerdict *v) {
+	if (!strcmp (str, "allow")) {
+		*v = PV_ALLOW;
+	} else if (!strcmp (str, "deny")) {
+		*v = PV_DENY;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool policy_line(PPolicy *p, char *line, ut32 num) {
+	char *hash = strchr (line, '#');
+	if (hash) {
+		*hash = '\0';
+	}
+	r_str_trim (line);
+	if (!*line) {
+		return true;
+	}
+	char *arg = line + strcspn (line, " \t");
+	if (*arg) {
+		*arg++ = '\0';
+		r_str_trim (arg);
+	}
+	if (!*arg || strchr (arg, ' ') || strchr (arg, '\t')) {
+		return false;
+	}
+	PRule r = { PV_NONE, num };
+	if (!strcmp (line, "default")) {
+		p->def.line = num;
+		return verdict_parse (arg, &p->def.verdict);
+	}
+	if (!strcmp (line, "indirect")) {
+		p->indirect.line = num;
+		return verdict_parse (arg, &p->indirect.verdict);
+	}
+	return verdict_parse (line, &r.verdict) && rule_add (p, arg, r);
+}
+
+PPolicy *policy_load(const char *path, bool stop) {
+	char *data = r_file_slurp (path, NULL);
+	if (!data) {
+		R_LOG_ERROR ("Can't read pickle.policy file %s", path);
+		return NULL;
+	}
+	PPolicy *p = R_NEW0 (PPolicy);
+	bool ret = p && (p->path = strdup (path)) && (p->exact = ht_pp_new0 ());
+	if (ret) {
+		node_new (p);
+		ret = p->nnodes == 1;
+	}
+	ut32 num = 0;
+	char *line = data;
+	while (ret && line) {
+		char *nl = strchr (line, '\n');
+		if (nl) {
+			*nl = '\0';
+		}
+		num++;
+		if (!policy_line (p, line, num)) {
+			R_LOG_ERROR ("%s:%u: bad policy rule, expected `allow|deny module.name`, `allow|deny prefix.*` or `default|indirect allow|deny`", path, num);
+			ret = false;
+		}
+		line = nl? nl + 1: NULL;
+	}
+	free (data);
+	if (!ret) {
+		policy_free (p);
+		return NULL;
+	}
+	if (!p->def.verdict) {
+		p->def.verdict = PV_ALLOW;
+	}
+	if (!p->indirect.verdict) {
+		p->indirect = p->def;
+	}
+	p->stop = stop;
+	return p;
+}
+
+void policy_free(PPolicy *p) {
+	if (p) {
+		ut64 i;
+		for (i = 0; i < p->nnodes; i++) {
+			ht_pp_free (p->nodes[i].kids);
+		}
+		for (i = 0; i < p->nviol; i++) {
+			free (p->viol[i].name);
+		}
+		ht_pp_free (p->exact);
+		free (p->nodes);
+		free (p->rules);
+		free (p->viol);
+		free (p->path);
+		free (p);
+	}
+}
+
+// exact name, else the longest `prefix.*`, else the default
+PRule policy_match(PPolicy *p, const char *module, const char *name) {
+	PRule r = p->nodes[0].rule.verdict? p->nodes[0].rule: p->def;
+	char *key = r_str_newf ("%s.%s", module, name);
+	if (!key) {
+		return r;
+	}
+	size_t at = (size_t)ht_pp_find (p->exact, key, NULL);
+	if (at) {
+		free (key);
+		return p->rules[at - 1];
+	}
+	ut32 node = 0;
+	char *comp = key;
+	char *dot;
+	while ((dot = strchr (comp, '.'))) {
+		*dot = '\0';
+		HtPP *kids = p->nodes[node].kids;
+		size_t kid = kids? (size_t)ht_pp_find (kids, comp, NULL): 0;
+		if (!kid) {
+			break;
+		}
+		node = kid - 1;
+		if (p->nodes[node].rule.verdict) {
+			r = p->nodes[node].rule;
+		}
+		comp = dot + 1;
+	}
+	free (key);
+	return r;
+}
+
+// always false, the violation is what the caller returns. Takes name
+static bool violation(PPolicy *p, ut64 offset, char op, char *name, PRule r) {
+	p->count++;
+	if (p->nviol < POLICY_KEEP && py_grow ((void **)&p->viol, &p->viol_size, p->nviol, sizeof (PViolation))) {
+		PViolation *v = &p->viol[p->nviol++];
+		v->offset = offset;
+		v->op = op;
+		v->name = name;
+		v->rule = r;
+	} else {
+		free (name);
+	}
+	return false;
+}
+
+// false when the global is denied
+bool policy_import(PPolicy *p, const char *module, const char *name, ut64 offset, char op) {
+	PRule r = policy_match (p, module, name);
+	if (r.verdict != PV_DENY) {
+		return true;
+	}
+	return violation (p, offset, op, r_str_newf ("%s.%s", module, name), r);
+}
+
+// calling something that isn't a global, false when `indirect` denies it
+bool policy_call(PPolicy *p, ut64 offset, char op) {
+	if (p->indirect.verdict != PV_DENY) {
+		return true;
+	}
+	return violation (p, offset, op, NULL, p->indirect);
+}
+
+// `## policy <path>: N violations`, then one line per kept violation
+bool policy_dump(RStrBuf *sb, PPolicy *p) {
+	bool ret = r_strbuf_appendf (sb, "## policy %s: %"PFMT64u" violations\n", p->path, p->count);
+	ut64 i;
+	for (i = 0; ret && i < p->nviol; i++) {
+		PViolation *v = &p->viol[i];
+		char *name = v->name? r_str_escape_raw ((const ut8 *)v->name, strlen (v->name)): strdup ("(indirect call)");
+		ret = name && r_strbuf_appendf (sb, "0x%08"PFMT64x" %s %s denied by ", v->offset, py_opcode_to_name (v->op), name);
+		ret = ret && (v->rule.line
+			? r_strbuf_appendf (sb, "line %u\n", v->rule.line)
+			: r_strbuf_append (sb, "default\n"));
+		free (name);
+	}
+	if (ret && p->count > p->nviol) {
+		ret = r_strbuf_appendf (sb, "## ... %"PFMT64u" more\n", p->count - p->nviol);
+	}
+	return ret;
+}
+
+// {"path", "count", "violations": [{"offset", "op", "name" or "indirect", "line"}]}
+bool policy_dump_json(PJ *pj, PPolicy *p) {
+	bool ret = pj_o (pj)
+		&& pj_ks (pj, "path", p->path)
+		&& pj_kn (pj, "count", p->count)
+		&& pj_ka (pj, "violations");
+	ut64 i;
+	for (i = 0; ret && i < p->nviol; i++) {
+		PViolation *v = &p->viol[i];
+		ret = pj_o (pj)
+			&& pj_kn (pj, "offset", v->offset)
+			&& pj_ks (pj, "op", py_opcode_to_name (v->op))
+			&& (v->name? pj_ks (pj, "name", v->name): pj_kb (pj, "indirect", true))
+			&& pj_kn (pj, "line", v->rule.line)
+			&& pj_end (pj);
+	}
+	return ret && pj_end (pj) && pj_end (pj);
+}
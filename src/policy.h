@@ -0,0 +1,61 @@
+#ifndef POLICY_PICKLE
+#define POLICY_PICKLE
+#include "pyobjutil.h"
+
+// pickle.policy, a file saying which globals a pickle may import. It is
+// compiled once per run: exact names go in a hash table, `prefix.*` rules in
+// a trie over the dotted components. One rule per line, `#` comments:
+//
+//   default deny                # when no rule matches, allow if not given
+//   indirect deny               # calling what a call returned, same as default if not given
+//   allow collections.OrderedDict
+//   allow torch._utils.*
+//   deny torch._utils._rebuild_qtensor
+//
+// An exact name beats any prefix, a longer prefix beats a shorter one and
+// the last of two identical rules wins.
+#define POLICY_KEEP 256 // violations kept for the report, the rest are only counted
+
+typedef enum pickle_verdict {
+	PV_NONE = 0, PV_ALLOW, PV_DENY
+} PVerdict;
+
+typedef struct pickle_rule {
+	PVerdict verdict;
+	ut32 line; // in the policy file, 0 when not given
+} PRule;
+
+typedef struct pickle_violation {
+	ut64 offset;
+	char op; // OP_GLOBAL, OP_STACK_GLOBAL, OP_INST, OP_EXT or a call for indirect ones
+	char *name; // module.name, NULL for an indirect call
+	PRule rule;
+} PViolation;
+
+typedef struct pickle_policy_node {
+	HtPP *kids; // component -> index + 1 into PPolicy.nodes, NULL for a leaf
+	PRule rule; // `prefix.*` ending at this node
+} PPolicyNode;
+
+struct pickle_policy {
+	char *path;
+	HtPP *exact; // "module.name" -> index + 1 into rules
+	PRule *rules;
+	ut64 nrules, rules_size;
+	PPolicyNode *nodes; // nodes[0] is the root
+	ut64 nnodes, nodes_size;
+	PRule def, indirect;
+	bool stop; // pickle.policy.stop, first violation ends decoding
+	PViolation *viol;
+	ut64 nviol, viol_size; // kept, at most POLICY_KEEP
+	ut64 count; // all of them
+};
+
+PPolicy *policy_load(const char *path, bool stop);
+void policy_free(PPolicy *p);
+PRule policy_match(PPolicy *p, const char *module, const char *name);
+bool policy_import(PPolicy *p, const char *module, const char *name, ut64 offset, char op);
+bool policy_call(PPolicy *p, ut64 offset, char op);
+bool policy_dump(RStrBuf *sb, PPolicy *p);
+bool policy_dump_json(PJ *pj, PPolicy *p);
+#endif
@@ -96,3 +96,400 @@ bool pytype_has_depth(PyType t) {
 		return true;
 	}
 }
+
+const char *py_opcode_to_name(char code) {
+	switch (code) {
+	case OP_MARK:
+		return "mark";
+	case OP_STOP:
+		return "stop";
+	case OP_POP:
+		return "pop";
+	case OP_POP_MARK:
+		return "pop_mark";
+	case OP_DUP:
+		return "dup";
+	case OP_FLOAT:
+		return "float";
+	case OP_INT:
+		return "int";
+	case OP_BININT:
+		return "binint";
+	case OP_BININT1:
+		return "binint1";
+	case OP_LONG:
+		return "long";
+	case OP_BININT2:
+		return "binint2";
+	case OP_NONE:
+		return "none";
+	case OP_PERSID:
+		return "persid";
+	case OP_BINPERSID:
+		return "binpersid";
+	case OP_REDUCE:
+		return "reduce";
+	case OP_STRING:
+		return "string";
+	case OP_BINSTRING:
+		return "binstring";
+	case OP_SHORT_BINSTRING:
+		return "short_binstring";
+	case OP_UNICODE:
+		return "unicode";
+	case OP_BINUNICODE:
+		return "binunicode";
+	case OP_APPEND:
+		return "append";
+	case OP_BUILD:
+		return "build";
+	case OP_GLOBAL:
+		return "global";
+	case OP_DICT:
+		return "dict";
+	case OP_EMPTY_DICT:
+		return "empty_dict";
+	case OP_APPENDS:
+		return "appends";
+	case OP_GET:
+		return "get";
+	case OP_BINGET:
+		return "binget";
+	case OP_INST:
+		return "inst";
+	case OP_LONG_BINGET:
+		return "long_binget";
+	case OP_LIST:
+		return "list";
+	case OP_EMPTY_LIST:
+		return "empty_list";
+	case OP_OBJ:
+		return "obj";
+	case OP_PUT:
+		return "put";
+	case OP_BINPUT:
+		return "binput";
+	case OP_LONG_BINPUT:
+		return "long_binput";
+	case OP_SETITEM:
+		return "setitem";
+	case OP_TUPLE:
+		return "tuple";
+	case OP_EMPTY_TUPLE:
+		return "empty_tuple";
+	case OP_SETITEMS:
+		return "setitems";
+	case OP_BINFLOAT:
+		return "binfloat";
+	case OP_PROTO:
+		return "proto";
+	case OP_NEWOBJ:
+		return "newobj";
+	case OP_EXT1:
+		return "ext1";
+	case OP_EXT2:
+		return "ext2";
+	case OP_EXT4:
+		return "ext4";
+	case OP_TUPLE1:
+		return "tuple1";
+	case OP_TUPLE2:
+		return "tuple2";
+	case OP_TUPLE3:
+		return "tuple3";
+	case OP_NEWTRUE:
+		return "newtrue";
+	case OP_NEWFALSE:
+		return "newfalse";
+	case OP_LONG1:
+		return "long1";
+	case OP_LONG4:
+		return "long4";
+	case OP_BINBYTES:
+		return "binbytes";
+	case OP_SHORT_BINBYTES:
+		return "short_binbytes";
+	case OP_SHORT_BINUNICODE:
+		return "short_binunicode";
+	case OP_BINUNICODE8:
+		return "binunicode8";
+	case OP_BINBYTES8:
+		return "binbytes8";
+	case OP_EMPTY_SET:
+		return "empty_set";
+	case OP_ADDITEMS:
+		return "additems";
+	case OP_FROZENSET:
+		return "frozenset";
+	case OP_NEWOBJ_EX:
+		return "newobj_ex";
+	case OP_STACK_GLOBAL:
+		return "stack_global";
+	case OP_MEMOIZE:
+		return "memoize";
+	case OP_FRAME:
+		return "frame";
+	case OP_BYTEARRAY8:
+		return "bytearray8";
+	case OP_NEXT_BUFFER:
+		return "next_buffer";
+	case OP_READONLY_BUFFER:
+		return "readonly_buffer";
+	default:
+		return "invalid";
+	}
+}
+
+PyOpClass py_opcode_class(char code) {
+	switch (code) {
+	case OP_PROTO:
+	case OP_FRAME:
+	case OP_STOP:
+		return OPC_META;
+	case OP_MARK:
+	case OP_POP:
+	case OP_POP_MARK:
+	case OP_DUP:
+		return OPC_STACK;
+	case OP_PUT:
+	case OP_BINPUT:
+	case OP_LONG_BINPUT:
+	case OP_MEMOIZE:
+	case OP_GET:
+	case OP_BINGET:
+	case OP_LONG_BINGET:
+		return OPC_MEMO;
+	case OP_INT:
+	case OP_BININT:
+	case OP_BININT1:
+	case OP_BININT2:
+	case OP_LONG:
+	case OP_LONG1:
+	case OP_LONG4:
+	case OP_FLOAT:
+	case OP_BINFLOAT:
+	case OP_NEWTRUE:
+	case OP_NEWFALSE:
+	case OP_NONE:
+		return OPC_NUM;
+	case OP_STRING:
+	case OP_BINSTRING:
+	case OP_SHORT_BINSTRING:
+	case OP_UNICODE:
+	case OP_BINUNICODE:
+	case OP_SHORT_BINUNICODE:
+	case OP_BINUNICODE8:
+	case OP_BINBYTES:
+	case OP_SHORT_BINBYTES:
+	case OP_BINBYTES8:
+	case OP_BYTEARRAY8:
+		return OPC_STR;
+	case OP_TUPLE:
+	case OP_EMPTY_TUPLE:
+	case OP_TUPLE1:
+	case OP_TUPLE2:
+	case OP_TUPLE3:
+	case OP_LIST:
+	case OP_EMPTY_LIST:
+	case OP_APPEND:
+	case OP_APPENDS:
+	case OP_DICT:
+	case OP_EMPTY_DICT:
+	case OP_SETITEM:
+	case OP_SETITEMS:
+	case OP_EMPTY_SET:
+	case OP_ADDITEMS:
+	case OP_FROZENSET:
+		return OPC_ITER;
+	case OP_GLOBAL:
+	case OP_STACK_GLOBAL:
+	case OP_REDUCE:
+	case OP_BUILD:
+	case OP_INST:
+	case OP_OBJ:
+	case OP_NEWOBJ:
+	case OP_NEWOBJ_EX:
+	case OP_EXT1:
+	case OP_EXT2:
+	case OP_EXT4:
+	case OP_PERSID:
+	case OP_BINPERSID:
+		return OPC_CALL;
+	case OP_NEXT_BUFFER:
+	case OP_READONLY_BUFFER:
+		return OPC_BUFFER;
+	default:
+		return OPC_UNKOWN;
+	}
+}
+
+const char *py_opclass_to_name(PyOpClass c) {
+	switch (c) {
+	case OPC_META:
+		return "meta";
+	case OPC_STACK:
+		return "stack";
+	case OPC_MEMO:
+		return "memo";
+	case OPC_NUM:
+		return "number";
+	case OPC_STR:
+		return "string";
+	case OPC_ITER:
+		return "iter";
+	case OPC_CALL:
+		return "call";
+	case OPC_BUFFER:
+		return "buffer";
+	case OPC_UNKOWN:
+	default:
+		return "unkown";
+	}
+}
+
+// raw bytes of the binary string opcode at buf, false for the text ones of
+// protocol 0 or when the length runs past size
+bool py_str_raw(const ut8 *buf, ut64 size, const ut8 **data, ut64 *len) {
+	if (!size) {
+		return false;
+	}
+	ut64 left = size - 1;
+	ut64 n;
+	int lsize;
+	switch (*buf) {
+	case OP_SHORT_BINBYTES:
+	case OP_SHORT_BINSTRING:
+	case (ut8)OP_SHORT_BINUNICODE:
+		lsize = 1;
+		break;
+	case OP_BINBYTES:
+	case OP_BINSTRING:
+	case OP_BINUNICODE:
+		lsize = 4;
+		break;
+	case (ut8)OP_BINBYTES8:
+	case (ut8)OP_BINUNICODE8:
+	case (ut8)OP_BYTEARRAY8:
+		lsize = 8;
+		break;
+	default:
+		return false;
+	}
+	if (left < lsize) {
+		return false;
+	}
+	const ut8 *p = buf + 1;
+	n = lsize == 1? *p: lsize == 4? r_read_le32 (p): r_read_le64 (p);
+	left -= lsize;
+	if (n > left) {
+		return false;
+	}
+	*data = p + lsize;
+	*len = n;
+	return true;
+}
+
+// escapes a lazy PY_STR from its opcode, as the decoder would have
+bool py_str_load(PMState *pvm, PyObj *obj) {
+	if (!obj->lazy) {
+		return true;
+	}
+	ut64 at = obj->offset - pvm->start;
+	const ut8 *data;
+	ut64 len;
+	if (obj->offset < pvm->start || at >= pvm->buf_size
+		|| !py_str_raw (pvm->buf + at, pvm->buf_size - at, &data, &len)
+		|| !(obj->py_str = r_str_escape_raw (data, len))) {
+		return false;
+	}
+	obj->lazy = false;
+	pvm->alloc_bytes += strlen (obj->py_str) + 1;
+	return true;
+}
+
+static inline bool load_push(PyObj ***stack, ut64 *size, ut64 *n, PyObj *obj) {
+	if (!obj) {
+		return true;
+	}
+	if (!py_grow ((void **)stack, size, *n, sizeof (PyObj *))) {
+		return false;
+	}
+	(*stack)[(*n)++] = obj;
+	return true;
+}
+
+static inline bool load_push_list(PyObj ***stack, ut64 *size, ut64 *n, RList *l) {
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (l, iter, o) {
+		if (!load_push (stack, size, n, o)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// loads every lazy string `obj` reaches, before printing only that part
+bool py_obj_load(PMState *pvm, PyObj *obj) {
+	PyObj **stack = NULL;
+	ut64 size = 0, n = 0;
+	ut64 token = ++pvm->recurse;
+	bool ret = load_push (&stack, &size, &n, obj);
+	while (ret && n) {
+		obj = stack[--n];
+		if (obj->recurse == token) {
+			continue;
+		}
+		obj->recurse = token;
+		switch (obj->type) {
+		case PY_STR:
+			ret = py_str_load (pvm, obj);
+			break;
+		case PY_REDUCE:
+		case PY_INST:
+		case PY_NEWOBJ:
+			ret = load_push (&stack, &size, &n, obj->reduce.glob)
+				&& load_push (&stack, &size, &n, obj->reduce.args)
+				&& load_push (&stack, &size, &n, obj->reduce.kwargs);
+			break;
+		case PY_GLOB:
+			ret = load_push (&stack, &size, &n, obj->py_glob.module)
+				&& load_push (&stack, &size, &n, obj->py_glob.name);
+			break;
+		case PY_PERSID:
+			ret = load_push (&stack, &size, &n, obj->py_pid);
+			break;
+		case PY_SPLIT:
+			ret = load_push (&stack, &size, &n, obj->split);
+			break;
+		case PY_BUFFER_RO:
+			ret = load_push (&stack, &size, &n, obj->py_robuf);
+			break;
+		case PY_TUPLE:
+		case PY_LIST:
+		case PY_DICT:
+		case PY_SET:
+		case PY_FROZEN_SET:
+			ret = load_push_list (&stack, &size, &n, obj->py_iter);
+			break;
+		case PY_WHAT: {
+			RListIter *iter;
+			PyOper *pop;
+			r_list_foreach (obj->py_what, iter, pop) {
+				bool one = pop->op == OP_FAKE_INIT || pop->op == OP_FAKE_SPLIT;
+				ret = one
+					? load_push (&stack, &size, &n, pop->obj)
+					: load_push_list (&stack, &size, &n, pop->stack);
+				if (!ret) {
+					break;
+				}
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	free (stack);
+	return ret;
+}
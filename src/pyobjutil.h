@@ -86,6 +86,20 @@ typedef enum opcode {
 	OP_FAKE_INIT, OP_FAKE_SPLIT,
 } PyOp;
 
+// coarse grouping of opcodes, used for statistics
+typedef enum opcode_class {
+	OPC_META, // proto, frame, stop
+	OPC_STACK, // mark, pop, dup...
+	OPC_MEMO,
+	OPC_NUM, // ints, floats, bools and none
+	OPC_STR, // strings and bytes
+	OPC_ITER, // building and modifying tuples, lists, dicts and sets
+	OPC_CALL, // globals, reduce, build, obj creation, persid and ext
+	OPC_BUFFER,
+	OPC_UNKOWN,
+	OPC_COUNT // number of classes, not a class
+} PyOpClass;
+
 typedef enum python_type {
 	PY_NOT_RIGHT = 0, // initial invalid type
 	PY_SPLIT, // meta, used to split items into before and after reduce
@@ -97,8 +111,55 @@ typedef enum python_type {
 	// Note: PY_DICT is treated just like a list, but it's only appended to in
 	// pairs. No overwrites happen, to preserve data that might of been lost
 } PyType;
+#define PY_TYPE_COUNT (PY_FROZEN_SET + 1)
 
 typedef struct python_object PyObj;
+typedef struct pickle_stats PStats;
+typedef struct pickle_stream PStream;
+typedef struct pickle_zip PZip;
+typedef struct pickle_input PInput;
+typedef struct pickle_globals PGlobals;
+typedef struct pickle_policy PPolicy;
+typedef struct pickle_ioc PIoc;
+typedef struct pickle_index PIndex;
+
+// resource limits, see plimits.h
+typedef enum pickle_limit {
+	PLIM_NONE = 0,
+	PLIM_OBJS, PLIM_ALLOC, PLIM_DEPTH, PLIM_OUTPUT, PLIM_TIME,
+	PLIM_BREAK, // user hit ^C, not configurable
+	PLIM_POLICY, // pickle.policy violation with pickle.policy.stop set
+	PLIM_COUNT
+} PLimit;
+
+typedef struct pickle_progress {
+	const char *phase; // "decode" or "print"
+	ut64 start, end; // pickle buffer
+	ut64 offset; // current opcode or object being printed
+	ut64 objs; // PyObj's created so far
+	ut64 usec; // since the phase started
+} PProgress;
+
+typedef void (*PProgressCb)(void *user, const PProgress *p);
+
+typedef struct pickle_limits {
+	ut64 max[PLIM_COUNT]; // indexed by PLimit, 0 means no limit
+	ut64 deadline; // r_time_now_mono () value, 0 for none
+	ut32 tick; // clock is only read every so often
+	ut64 level; // current nesting, shared by split analysis and printers
+	PLimit stop; // limit that stopped the current phase (decoding or printing)
+	PLimit hit; // first limit reached, reported to the user
+	ut64 hit_offset;
+
+	// called every LIMIT_PROGRESS_USEC or so, NULL for none
+	PProgressCb progress;
+	void *progress_user;
+	PProgress prog;
+	ut64 phase_start, progress_last;
+	// checked instead of r_cons_is_breaked when set, r_cons belongs to the
+	// main thread while a background task decodes
+	const volatile bool *cancel;
+} PLimits;
 
 typedef struct pickle_machine_state {
 	RList *stack, *metastack, *popstack;
@@ -106,11 +167,28 @@ typedef struct pickle_machine_state {
 	ut64 recurse;
 	bool break_on_stop;
 	bool nosplit;
+	bool lazy; // leave big binary strings in buf until something reads them
 	ut64 start, offset, end;
 	bool verbose;
 	int proto;
 	PyObj *free_obj; // single linked free list
 	ut64 buffernum; // count next buffers as you encouter them
+	PStats *stats; // NULL unless collecting statistics
+	PStream *stream; // NULL unless popped objects are printed while decoding
+	PLimits limits;
+	ut64 objs; // PyObj's created
+	ut64 alloc_bytes; // approximate bytes allocated by decoder
+	struct split_frame *split_stack; // add_splits work stack
+	ut32 split_size;
+	HtUP *split_leafs; // container -> iter of its last item add_splits found to be a leaf
+	ut8 *buf; // pickle bytes from start on, decoding never touches r_io
+	ut64 buf_size;
+	PZip *zip; // NULL unless the pickle is a member of a zip, see zip.h
+	PInput *input; // NULL unless the pickle is compressed, owns buf while decoding, see input.h
+	PGlobals *globals; // pdPg, replaces stack and memo, see globals.h
+	PPolicy *policy; // NULL unless pickle.policy is set, see policy.h
+	PIoc *ioc; // pdPi, NULL otherwise, see ioc.h
+	PIndex *index; // pdPo, NULL otherwise, see index.h
 } PMState;
 
 typedef struct python_glob {
@@ -139,12 +217,14 @@ struct python_operator {
 
 struct python_object {
 	bool noflags; // don't use flags for this object
+	bool lazy; // PY_STR still in the pickle buffer, py_str is NULL until py_str_load
 	int refcnt; // number of times obj is duplicated
 	PyType type;
 	ut64 offset;
-	ut64 memo_id;
+	ut64 memo_id; // first memo slot it was put in, UT64_MAX for none
 	ut64 recurse; // token to prevent infinit recursion
 	char *varname; // used by printer
+	ut64 hash; // structural hash, set by hash_obj
 	RListIter *iter_next;
 	union {
 		bool py_bool;
@@ -168,5 +248,30 @@ struct python_object {
 
 const char *py_type_to_name(PyType t);
 const char *py_op_to_name(PyOp t);
+const char *py_opcode_to_name(char code);
+PyOpClass py_opcode_class(char code);
+const char *py_opclass_to_name(PyOpClass c);
 bool pytype_has_depth(PyType t);
+bool py_str_raw(const ut8 *buf, ut64 size, const ut8 **data, ut64 *len);
+bool py_str_load(PMState *pvm, PyObj *obj);
+bool py_obj_load(PMState *pvm, PyObj *obj);
+
+// doubles *arr until it holds one more, for the plain arrays of globals.h,
+// policy.h and ioc.h
+static inline bool py_grow(void **arr, ut64 *size, ut64 used, size_t elem) {
+	if (used < *size) {
+		return true;
+	}
+	ut64 n = *size? *size * 2: 64;
+	if (n > ST32_MAX / elem) {
+		return false;
+	}
+	void *tmp = realloc (*arr, n * elem);
+	if (!tmp) {
+		return false;
+	}
+	*arr = tmp;
+	*size = n;
+	return true;
+}
 #endif
@@ -0,0 +1,461 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "query.h"
+
+typedef enum {
+	QT_END = 0,
+	QT_FIELD, // .name, or name at the start
+	QT_INDEX, // [n]
+	QT_KEY, // ["str"] or ['str']
+	QT_BAD,
+} QTokKind;
+
+typedef struct query_tok {
+	QTokKind kind;
+	const char *at; // where it starts, for errors
+	const char *name; // QT_FIELD, not terminated
+	size_t len;
+	st64 num; // QT_INDEX
+	char *key; // QT_KEY
+} QTok;
+
+// where the path points, a PyObj or one of the lists between them
+typedef enum {
+	QA_ROOT = 0, // nothing yet
+	QA_LIST, // .stack, .popstack or metastack[i]
+	QA_META, // metastack
+	QA_OBJ,
+	QA_VALUE, // obj.value
+	QA_PAIR, // obj.value[i] of a dict
+	QA_OPER, // obj.value[i] of a PY_WHAT
+	QA_ARGS, // obj.value[i].args
+} QAt;
+
+typedef struct query_cursor {
+	QAt at;
+	PyObj *obj;
+	RList *list;
+	PyObj *pair[2];
+	PyOper *pop;
+	RStrBuf *path;
+	PMState *pvm;
+} QCursor;
+
+static const char *query_next(const char *s, QTok *t, bool first) {
+	memset (t, 0, sizeof (*t));
+	t->at = s;
+	if (!*s) {
+		t->kind = QT_END;
+		return s;
+	}
+	if (*s == '.' || (first && isalpha ((ut8)*s))) {
+		s += *s == '.';
+		t->name = s;
+		while (isalnum ((ut8)*s) || *s == '_') {
+			s++;
+		}
+		t->len = s - t->name;
+		t->kind = t->len? QT_FIELD: QT_BAD;
+		return s;
+	}
+	if (*s != '[') {
+		t->kind = QT_BAD;
+		return s;
+	}
+	s++;
+	if (*s == '"' || *s == '\'') {
+		char quote = *s++;
+		RStrBuf *sb = r_strbuf_new ("");
+		while (sb && *s && *s != quote) {
+			if (*s == '\\' && s[1]) {
+				s++;
+			}
+			r_strbuf_append_n (sb, s++, 1);
+		}
+		t->key = sb? r_strbuf_drain (sb): NULL;
+		if (!t->key || *s != quote || s[1] != ']') {
+			R_FREE (t->key);
+			t->kind = QT_BAD;
+			return s;
+		}
+		t->kind = QT_KEY;
+		return s + 2;
+	}
+	char *end = NULL;
+	t->num = strtoll (s, &end, 0);
+	if (end == s || *end != ']') {
+		t->kind = QT_BAD;
+		return s;
+	}
+	t->kind = QT_INDEX;
+	return end + 1;
+}
+
+static inline bool field_is(QTok *t, const char *name) {
+	return t->len == strlen (name) && !strncmp (t->name, name, t->len);
+}
+
+// negative counts from the end, like Python
+static inline bool list_index(RList *l, st64 n, ut64 *out) {
+	st64 len = r_list_length (l);
+	if (n < 0) {
+		n += len;
+	}
+	if (n < 0 || n >= len) {
+		return false;
+	}
+	*out = n;
+	return true;
+}
+
+static inline bool is_seq(PyType t) {
+	switch (t) {
+	case PY_TUPLE:
+	case PY_LIST:
+	case PY_SET:
+	case PY_FROZEN_SET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// a lazy key is loaded to compare it, see py_str_load
+static inline bool key_match(PMState *pvm, PyObj *k, QTok *t) {
+	if (t->kind == QT_KEY) {
+		return k->type == PY_STR && py_str_load (pvm, k) && k->py_str && !strcmp (k->py_str, t->key);
+	}
+	return k->type == PY_INT && k->py_int == t->num;
+}
+
+// pair `n` of a dict's items, a split takes one pair index like in pdPj
+static bool dict_pair(RList *items, ut64 n, PyObj **pair) {
+	RListIter *iter;
+	PyObj *o;
+	ut64 p = 0;
+	int half = 0;
+	r_list_foreach (items, iter, o) {
+		if (o->type == PY_SPLIT) {
+			p++;
+			continue;
+		}
+		pair[half++] = o;
+		if (half == 2) {
+			if (p == n) {
+				return true;
+			}
+			half = 0;
+			p++;
+		}
+	}
+	return false;
+}
+
+static PyObj *dict_split(RList *items) {
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (items, iter, o) {
+		if (o->type == PY_SPLIT && r_list_iter_get_next (iter)) {
+			return o;
+		}
+	}
+	return NULL;
+}
+
+// value for the key in t, the last one set wins as in Python
+static PyObj *dict_lookup(PMState *pvm, RList *items, QTok *t, ut64 *pair) {
+	RListIter *iter;
+	PyObj *o, *key = NULL, *ret = NULL;
+	ut64 p = 0;
+	r_list_foreach (items, iter, o) {
+		if (o->type == PY_SPLIT) {
+			p++;
+		} else if (!key) {
+			key = o;
+		} else {
+			if (key_match (pvm, key, t)) {
+				ret = o;
+				*pair = p;
+			}
+			key = NULL;
+			p++;
+		}
+	}
+	return ret;
+}
+
+// the key in the dict a PY_WHAT started as, or in its SETITEM(S)
+static PyObj *what_lookup(PMState *pvm, PyObj *what, QTok *t, RStrBuf *path) {
+	RListIter *iter;
+	PyOper *pop;
+	PyObj *ret = NULL;
+	ut64 k = 0, p;
+	r_list_foreach (what->py_what, iter, pop) {
+		if (pop->op == OP_FAKE_INIT && pop->obj && pop->obj->type == PY_DICT) {
+			PyObj *v = dict_lookup (pvm, pop->obj->py_iter, t, &p);
+			if (v) {
+				ret = v;
+				r_strbuf_setf (path, "[%"PFMT64u"].arg.value[%"PFMT64u"][1]", k, p);
+			}
+		} else if (pop->op == OP_SETITEM || pop->op == OP_SETITEMS) {
+			RListIter *it;
+			PyObj *o, *key = NULL;
+			ut64 j = 0;
+			r_list_foreach (pop->stack, it, o) {
+				if (j++ % 2 == 0) {
+					key = o;
+				} else if (key_match (pvm, key, t)) {
+					ret = o;
+					r_strbuf_setf (path, "[%"PFMT64u"].args[%"PFMT64u"]", k, j - 1);
+				}
+			}
+		}
+		k++;
+	}
+	return ret;
+}
+
+static inline bool cursor_obj(QCursor *c, PyObj *obj) {
+	c->at = QA_OBJ;
+	c->obj = obj;
+	return obj? true: false;
+}
+
+// obj[key], Python subscripts straight after an object, `pre` is what the
+// path still needs before the index
+static const char *step_subscript(QCursor *c, QTok *t, const char *pre) {
+	PyObj *obj = c->obj;
+	ut64 n;
+	if (is_seq (obj->type)) {
+		if (t->kind != QT_INDEX) {
+			return "only dicts take a string key";
+		}
+		if (!list_index (obj->py_iter, t->num, &n)) {
+			return "index out of range";
+		}
+		r_strbuf_appendf (c->path, "%s[%"PFMT64u"]", pre, n);
+		return cursor_obj (c, r_list_get_n (obj->py_iter, n))? NULL: "missing item";
+	}
+	if (obj->type == PY_DICT) {
+		PyObj *v = dict_lookup (c->pvm, obj->py_iter, t, &n);
+		if (!v) {
+			return "key not found";
+		}
+		r_strbuf_appendf (c->path, "%s[%"PFMT64u"][1]", pre, n);
+		return cursor_obj (c, v)? NULL: "missing item";
+	}
+	if (obj->type == PY_WHAT) {
+		RStrBuf sub;
+		r_strbuf_init (&sub);
+		PyObj *v = what_lookup (c->pvm, obj, t, &sub);
+		if (v) {
+			r_strbuf_appendf (c->path, "%s%s", pre, r_strbuf_get (&sub));
+		}
+		r_strbuf_fini (&sub);
+		return cursor_obj (c, v)? NULL: "key not found";
+	}
+	return "not a list, tuple, set or dict";
+}
+
+// obj.value, the objects that wrap a single one go straight to it
+static const char *step_value(QCursor *c) {
+	PyObj *obj = c->obj;
+	r_strbuf_append (c->path, ".value");
+	switch (obj->type) {
+	case PY_PERSID:
+		return cursor_obj (c, obj->py_pid)? NULL: "missing value";
+	case PY_SPLIT:
+		return cursor_obj (c, obj->split)? NULL: "missing value";
+	case PY_BUFFER_RO:
+		return cursor_obj (c, obj->py_robuf)? NULL: "missing value";
+	case PY_REDUCE:
+	case PY_INST:
+	case PY_NEWOBJ:
+	case PY_GLOB:
+	case PY_WHAT:
+	case PY_DICT:
+		c->at = QA_VALUE;
+		return NULL;
+	default:
+		if (is_seq (obj->type)) {
+			c->at = QA_VALUE;
+			return NULL;
+		}
+		return "has no objects in it";
+	}
+}
+
+static inline const char *field_obj(QCursor *c, QTok *t, PyObj *obj) {
+	r_strbuf_appendf (c->path, ".%.*s", (int)t->len, t->name);
+	return cursor_obj (c, obj)? NULL: "not set";
+}
+
+static const char *step_field(QCursor *c, QTok *t, PMState *pvm) {
+	PyObj *obj = c->obj;
+	switch (c->at) {
+	case QA_ROOT:
+		c->at = QA_LIST;
+		if (field_is (t, "stack")) {
+			c->list = pvm->stack;
+		} else if (field_is (t, "popstack")) {
+			c->list = pvm->popstack;
+		} else if (field_is (t, "metastack")) {
+			c->at = QA_META;
+			c->list = pvm->metastack;
+			r_strbuf_append (c->path, "metastack"); // pdPj has no dot there
+			return NULL;
+		} else {
+			return "expected stack, popstack or metastack";
+		}
+		r_strbuf_appendf (c->path, ".%.*s", (int)t->len, t->name);
+		return NULL;
+	case QA_OBJ:
+		return field_is (t, "value")? step_value (c): "expected .value or a subscript";
+	case QA_VALUE:
+		switch (obj->type) {
+		case PY_REDUCE:
+		case PY_INST:
+		case PY_NEWOBJ:
+			if (field_is (t, "glob")) {
+				return field_obj (c, t, obj->reduce.glob);
+			}
+			if (field_is (t, "args")) {
+				return field_obj (c, t, obj->reduce.args);
+			}
+			if (field_is (t, "kwargs")) {
+				return field_obj (c, t, obj->reduce.kwargs);
+			}
+			return "expected .glob, .args or .kwargs";
+		case PY_GLOB:
+			if (field_is (t, "module")) {
+				return field_obj (c, t, obj->py_glob.module);
+			}
+			if (field_is (t, "name")) {
+				return field_obj (c, t, obj->py_glob.name);
+			}
+			return "expected .module or .name";
+		case PY_DICT:
+			// pdPj names what a split in a dict holds `.value.value`, no
+			// index and no step for the split, so that is the first one's
+			if (field_is (t, "value")) {
+				PyObj *split = dict_split (obj->py_iter);
+				return field_obj (c, t, split? split->split: NULL);
+			}
+			return "expected an index";
+		default:
+			return "expected an index";
+		}
+	case QA_OPER:
+		if (c->pop->op == OP_FAKE_INIT || c->pop->op == OP_FAKE_SPLIT) {
+			return field_is (t, "arg")? field_obj (c, t, c->pop->obj): "expected .arg";
+		}
+		if (field_is (t, "args")) {
+			r_strbuf_append (c->path, ".args");
+			c->at = QA_ARGS;
+			c->list = c->pop->stack;
+			return NULL;
+		}
+		return "expected .args";
+	default:
+		return "unexpected field";
+	}
+}
+
+static const char *step_index(QCursor *c, QTok *t) {
+	PyObj *obj = c->obj;
+	ut64 n;
+	if (c->at == QA_OBJ) {
+		return step_subscript (c, t, ".value");
+	}
+	if (t->kind == QT_KEY) {
+		if (c->at == QA_VALUE && (obj->type == PY_DICT || obj->type == PY_WHAT)) {
+			return step_subscript (c, t, ""); // obj.value["k"], same as obj["k"]
+		}
+		return "string keys only go after a dict";
+	}
+	switch (c->at) {
+	case QA_LIST:
+	case QA_ARGS:
+		if (!list_index (c->list, t->num, &n)) {
+			return "index out of range";
+		}
+		r_strbuf_appendf (c->path, "[%"PFMT64u"]", n);
+		return cursor_obj (c, r_list_get_n (c->list, n))? NULL: "missing item";
+	case QA_META:
+		if (!list_index (c->list, t->num, &n)) {
+			return "index out of range";
+		}
+		r_strbuf_appendf (c->path, "[%"PFMT64u"]", n);
+		c->at = QA_LIST;
+		c->list = r_list_get_n (c->list, n);
+		return NULL;
+	case QA_PAIR:
+		if (t->num != 0 && t->num != 1) {
+			return "a dict item is [0] for the key, [1] for the value";
+		}
+		r_strbuf_appendf (c->path, "[%d]", (int)t->num);
+		return cursor_obj (c, c->pair[t->num])? NULL: "missing item";
+	case QA_VALUE:
+		if (t->num < 0) {
+			return "index out of range";
+		}
+		r_strbuf_appendf (c->path, "[%"PFMT64d"]", t->num);
+		if (obj->type == PY_DICT) {
+			if (!dict_pair (obj->py_iter, t->num, c->pair)) {
+				return "index out of range";
+			}
+			c->at = QA_PAIR;
+			return NULL;
+		}
+		if (obj->type == PY_WHAT) {
+			c->pop = r_list_get_n (obj->py_what, t->num);
+			c->at = QA_OPER;
+			return c->pop? NULL: "index out of range";
+		}
+		if (is_seq (obj->type)) {
+			return cursor_obj (c, r_list_get_n (obj->py_iter, t->num))? NULL: "index out of range";
+		}
+		return "expected a field";
+	default:
+		return "unexpected index";
+	}
+}
+
+PyObj *query_resolve(PMState *pvm, const char *query, char **path) {
+	r_return_val_if_fail (pvm && query && path, NULL);
+	QCursor c = { .at = QA_ROOT, .path = r_strbuf_new (""), .pvm = pvm };
+	if (!c.path) {
+		return NULL;
+	}
+	const char *s = query, *err = NULL;
+	QTok t;
+	bool first = true;
+	while (!err) {
+		s = query_next (s, &t, first);
+		first = false;
+		if (t.kind == QT_END) {
+			break;
+		}
+		if (t.kind == QT_BAD) {
+			err = "bad syntax";
+		} else if (t.kind == QT_FIELD) {
+			err = step_field (&c, &t, pvm);
+		} else if (c.at == QA_ROOT) {
+			err = "expected stack, popstack or metastack";
+		} else {
+			err = step_index (&c, &t);
+		}
+		free (t.key);
+	}
+	if (!err && c.at != QA_OBJ && c.at != QA_VALUE) {
+		err = "does not end at an object";
+		t.at = query;
+	}
+	if (err) {
+		R_LOG_ERROR ("Bad pickle path at '%s': %s", t.at, err);
+		r_strbuf_free (c.path);
+		return NULL;
+	}
+	*path = r_strbuf_drain (c.path);
+	return *path? c.obj: NULL;
+}
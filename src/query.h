@@ -0,0 +1,13 @@
+#ifndef QUERY_PICKLE
+#define QUERY_PICKLE
+#include "pyobjutil.h"
+
+// pdPp, a path into the decoded objects, so only that subtree gets printed.
+// Paths are the ones pdPj uses for prev_seen (`.stack[0].value[1][1]`), plus
+// Python style subscripts right after an object: `.stack[0]["state_dict"]`
+// looks the key up in a dict, or in what SETITEM(S) did to an unknown object,
+// `[3]` takes an item of a list or tuple, or the int key 3 of a dict. Once
+// resolved the path is given back the long way, as pdPj would print it, with
+// `[n]` picking the n-th operation of a PY_WHAT, which pdPj leaves out.
+PyObj *query_resolve(PMState *pvm, const char *query, char **path);
+#endif
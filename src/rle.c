@@ -0,0 +1,175 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "rle.h"
+
+bool rle_inlined(PRle *r, PyObj *obj) {
+	return r->inlined && ht_up_find (r->inlined, (ut64)(size_t)obj, NULL);
+}
+
+// Nothing but its container refers to obj, so it is fine to print it once
+// for the whole run. The memo counts as a reference only when something got
+// the object back out of it. Whatever a run already inlined counts as
+// private too.
+static inline bool rle_private(PRle *r, PyObj *obj) {
+	return !obj->varname
+		&& (!obj->refcnt || (obj->refcnt == 1 && obj->memo_id != UT64_MAX) || rle_inlined (r, obj));
+}
+
+static inline bool cmp_push(PRle *r, PyObj *obj) {
+	if (r->ncmp == r->cmp_size) {
+		ut32 size = r->cmp_size? r->cmp_size * 2: 64;
+		PyObj **cmp = realloc (r->cmp, size * sizeof (PyObj *));
+		if (!cmp) {
+			return false;
+		}
+		r->cmp = cmp;
+		r->cmp_size = size;
+	}
+	r->cmp[r->ncmp++] = obj;
+	return true;
+}
+
+static inline bool iter_push(PRle *r, RList *a, RList *b) {
+	if (r_list_length (a) != r_list_length (b)) {
+		return false;
+	}
+	RListIter *ia = r_list_head (a);
+	RListIter *ib = r_list_head (b);
+	for (; ia && ib; ia = r_list_iter_get_next (ia), ib = r_list_iter_get_next (ib)) {
+		if (!cmp_push (r, r_list_iter_get_data (ia)) || !cmp_push (r, r_list_iter_get_data (ib))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// a and b would print the same. *mutable is set if anything in them that
+// is not shared is a list, dict or set
+static bool rle_equal(PRle *r, PyObj *a, PyObj *b, bool *mutable) {
+	r->ncmp = 0;
+	bool ret = cmp_push (r, a) && cmp_push (r, b);
+	while (ret && r->ncmp) {
+		b = r->cmp[--r->ncmp];
+		a = r->cmp[--r->ncmp];
+		if (a == b) {
+			continue; // printed as the same variable both times
+		}
+		if (a->type != b->type || !rle_private (r, a) || !rle_private (r, b)) {
+			ret = false;
+			break;
+		}
+		switch (a->type) {
+		case PY_INT:
+			ret = a->py_int == b->py_int;
+			break;
+		case PY_FLOAT:
+			ret = !memcmp (&a->py_float, &b->py_float, sizeof (a->py_float));
+			break;
+		case PY_BOOL:
+			ret = a->py_bool == b->py_bool;
+			break;
+		case PY_NONE:
+			break;
+		case PY_STR:
+			ret = !strcmp (a->py_str, b->py_str);
+			break;
+		case PY_LIST:
+		case PY_DICT:
+		case PY_SET:
+			*mutable = true;
+			// fallthrough
+		case PY_TUPLE:
+		case PY_FROZEN_SET:
+			ret = iter_push (r, a->py_iter, b->py_iter);
+			break;
+		default:
+			ret = false;
+			break;
+		}
+	}
+	return ret;
+}
+
+// Length of the run of equal elements starting at iter, *next is the
+// element after it. *kind is RLE_NONE if the run can't be compacted, tuples
+// only get RLE_MUL runs.
+ut64 rle_run(PRle *r, RListIter *iter, bool tuple, PRleKind *kind, RListIter **next) {
+	PyObj *first = r_list_iter_get_data (iter);
+	ut64 n = 1;
+	*kind = RLE_NONE;
+	iter = r_list_iter_get_next (iter);
+	if (iter && first->type != PY_SPLIT) {
+		if (r_list_iter_get_data (iter) == first) {
+			// one object over and over, `* n` keeps them the same object
+			while (iter && r_list_iter_get_data (iter) == first) {
+				n++;
+				iter = r_list_iter_get_next (iter);
+			}
+			*kind = RLE_MUL;
+		} else {
+			bool mutable = false;
+			while (iter) {
+				PyObj *obj = r_list_iter_get_data (iter);
+				if (obj == first || !rle_equal (r, first, obj, &mutable)) {
+					break;
+				}
+				n++;
+				iter = r_list_iter_get_next (iter);
+			}
+			if (n > 1 && !(tuple && mutable)) {
+				*kind = mutable? RLE_COMP: RLE_MUL;
+			}
+		}
+	}
+	*next = iter;
+	return n;
+}
+
+// x is printed once for a whole `[x for _ in range(n)]`, so whatever only
+// x refers to has to be printed in place rather than as a variable. The
+// objects are only added to r->inlined, the decoded graph stays as it is.
+bool rle_inline(PRle *r, PyObj *x) {
+	if (!r->inlined && !(r->inlined = ht_up_new0 ())) {
+		return false;
+	}
+	r->ncmp = 0;
+	bool ret = cmp_push (r, x);
+	while (ret && r->ncmp) {
+		PyObj *obj = r->cmp[--r->ncmp];
+		if (rle_inlined (r, obj) || !rle_private (r, obj)) {
+			continue;
+		}
+		if (!ht_up_insert (r->inlined, (ut64)(size_t)obj, obj)) {
+			ret = false;
+			break;
+		}
+		switch (obj->type) {
+		case PY_TUPLE:
+		case PY_LIST:
+		case PY_DICT:
+		case PY_SET:
+		case PY_FROZEN_SET: {
+			RListIter *iter;
+			PyObj *o;
+			r_list_foreach (obj->py_iter, iter, o) {
+				if (!cmp_push (r, o)) {
+					ret = false;
+					break;
+				}
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	return ret;
+}
+
+void rle_fini(PRle *r) {
+	free (r->cmp);
+	r->cmp = NULL;
+	r->ncmp = r->cmp_size = 0;
+	ht_up_free (r->inlined);
+	r->inlined = NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef RLE_PICKLE
+#define RLE_PICKLE
+#include "pyobjutil.h"
+
+// Runs of equal list or tuple elements are printed as `[x] * n` or
+// `[x for _ in range(n)]` instead of one element at a time, pickle.rle sets
+// the shortest run worth it.
+typedef enum rle_kind {
+	RLE_NONE = 0,
+	RLE_MUL, // `[x] * n`, one object n times, or equal immutable values
+	RLE_COMP, // `[x for _ in range(n)]`, equal but separate mutable objects
+} PRleKind;
+
+typedef struct pickle_rle {
+	ut64 min; // shortest run to compact, 0 for off
+	PyObj **cmp; // rle_equal and rle_inline work stack
+	ut32 ncmp, cmp_size;
+	HtUP *inlined; // PyObj * set, printed in place even if referenced elsewhere
+} PRle;
+
+ut64 rle_run(PRle *r, RListIter *iter, bool tuple, PRleKind *kind, RListIter **next);
+bool rle_inline(PRle *r, PyObj *x);
+bool rle_inlined(PRle *r, PyObj *obj);
+void rle_fini(PRle *r);
+#endif
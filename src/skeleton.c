@@ -0,0 +1,104 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "skeleton.h"
+
+// Count the elements of obj by type. True if obj should be elided, that is,
+// it has more than 2 * keep elements and no splits. A split means the
+// container is printed in parts around a call, so it is printed in full.
+bool shape_get(PShape *sh, PyObj *obj, ut64 keep) {
+	memset (sh, 0, sizeof (*sh));
+	sh->type = obj->type;
+	switch (obj->type) {
+	case PY_TUPLE:
+	case PY_LIST:
+	case PY_DICT:
+	case PY_SET:
+	case PY_FROZEN_SET:
+		break;
+	default:
+		return false;
+	}
+	ut64 step = obj->type == PY_DICT? 2: 1;
+	ut64 n = r_list_length (obj->py_iter);
+	if (!keep || n / step <= keep * 2) {
+		return false;
+	}
+	sh->len = n / step;
+
+	ut64 i = 0;
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (obj->py_iter, iter, o) {
+		if (o->type == PY_SPLIT || o->type >= PY_TYPE_COUNT) {
+			return false;
+		}
+		if (step == 2 && i % 2 == 0) {
+			sh->keys[o->type]++;
+		} else {
+			sh->vals[o->type]++;
+		}
+		if (i == keep * step) {
+			sh->skel.gap = iter;
+		} else if (i == (sh->len - keep) * step) {
+			sh->skel.resume = iter;
+		}
+		i++;
+	}
+	sh->skel.elided = sh->len - keep * 2;
+	return sh->skel.gap && sh->skel.resume;
+}
+
+static inline bool hist_dump(RStrBuf *sb, ut64 *hist) {
+	int i;
+	bool first = true;
+	for (i = PY_NOT_RIGHT + 1; i < PY_TYPE_COUNT; i++) {
+		if (hist[i]) {
+			if (!r_strbuf_appendf (sb, "%s%s %"PFMT64u, first? "": ", ", py_type_to_name (i), hist[i])) {
+				return false;
+			}
+			first = false;
+		}
+	}
+	return true;
+}
+
+// `1200000 items: PY_FLOAT 1200000`, dicts get `keys: ..., values: ...`
+bool shape_dump(RStrBuf *sb, PShape *sh) {
+	if (!r_strbuf_appendf (sb, "%"PFMT64u" items", sh->len)) {
+		return false;
+	}
+	if (sh->type == PY_DICT) {
+		return r_strbuf_append (sb, ", keys: ")
+			&& hist_dump (sb, sh->keys)
+			&& r_strbuf_append (sb, ", values: ")
+			&& hist_dump (sb, sh->vals);
+	}
+	return r_strbuf_append (sb, ": ") && hist_dump (sb, sh->vals);
+}
+
+static inline bool hist_dump_json(PJ *pj, const char *name, ut64 *hist) {
+	int i;
+	bool ret = pj_ko (pj, name)? true: false;
+	for (i = PY_NOT_RIGHT + 1; ret && i < PY_TYPE_COUNT; i++) {
+		if (hist[i]) {
+			ret = pj_kn (pj, py_type_to_name (i), hist[i])? true: false;
+		}
+	}
+	return ret && pj_end (pj);
+}
+
+// `value` of an elided object holds the first and last K elements, the gap
+// is between value[at - 1] and value[at]
+bool shape_dump_json(PJ *pj, PShape *sh) {
+	bool ret = pj_ko (pj, "skeleton")
+		&& pj_kn (pj, "len", sh->len)
+		&& pj_kn (pj, "elided", sh->skel.elided)
+		&& pj_kn (pj, "at", (sh->len - sh->skel.elided) / 2);
+	if (ret && sh->type == PY_DICT) {
+		ret = hist_dump_json (pj, "keys", sh->keys)
+			&& hist_dump_json (pj, "values", sh->vals);
+	} else if (ret) {
+		ret = hist_dump_json (pj, "types", sh->vals);
+	}
+	return ret && pj_end (pj);
+}
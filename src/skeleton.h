@@ -0,0 +1,27 @@
+#ifndef SKELETON_PICKLE
+#define SKELETON_PICKLE
+#include "pyobjutil.h"
+
+// Skeleton mode, pickle.skeleton=K. Containers with more than 2 * K elements
+// (pairs for dicts) only get their first and last K printed, along with a
+// count and a histogram of element types. The printers never visit the
+// elements in between, so output size and print time depend on K instead
+// of the size of the data.
+typedef struct pickle_skel {
+	RListIter *gap; // first elided element, NULL if nothing is elided
+	RListIter *resume; // first element after the gap
+	ut64 elided; // elements, pairs for dicts
+} PSkel;
+
+typedef struct pickle_shape {
+	PyType type;
+	ut64 len; // elements, pairs for dicts
+	ut64 keys[PY_TYPE_COUNT]; // dicts only
+	ut64 vals[PY_TYPE_COUNT];
+	PSkel skel;
+} PShape;
+
+bool shape_get(PShape *sh, PyObj *obj, ut64 keep);
+bool shape_dump(RStrBuf *sb, PShape *sh);
+bool shape_dump_json(PJ *pj, PShape *sh);
+#endif
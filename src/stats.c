@@ -0,0 +1,272 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "stats.h"
+
+// current resident set size in KiB, 0 without /proc
+static ut64 cur_rss(void) {
+	ut64 size = 0, resident = 0;
+	FILE *f = fopen ("/proc/self/statm", "r");
+	if (f) {
+		if (fscanf (f, "%"PFMT64u" %"PFMT64u, &size, &resident) != 2) {
+			resident = 0;
+		}
+		fclose (f);
+	}
+	long page = sysconf (_SC_PAGESIZE);
+	return page > 0? resident * (ut64)page / 1024: 0;
+}
+
+// process lifetime high-water mark of the resident set size in KiB
+ut64 stats_peak_rss(void) {
+	struct rusage ru;
+	if (getrusage (RUSAGE_SELF, &ru)) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return ru.ru_maxrss / 1024; // bytes on OSX
+#else
+	return ru.ru_maxrss;
+#endif
+}
+
+void stats_init(PStats *st) {
+	memset (st, 0, sizeof (*st));
+	st->rss_start = cur_rss ();
+}
+
+// how much the resident set grew since stats_init, negative if it shrank
+st64 stats_rss_delta(PStats *st) {
+	return st->rss_start? (st64)cur_rss () - (st64)st->rss_start: 0;
+}
+
+void stats_op(PStats *st, PMState *pvm, char code, int size) {
+	ut8 i = (ut8)code;
+	st->op_count[i]++;
+	st->op_bytes[i] += size;
+	st->ops++;
+	st->bytes += size;
+
+	ut64 depth = r_list_length (pvm->stack);
+	if (depth > st->max_stack) {
+		st->max_stack = depth;
+	}
+	depth = r_list_length (pvm->metastack);
+	if (depth > st->max_mark) {
+		st->max_mark = depth;
+	}
+	if (pvm->memo) {
+		st->memo_size = pvm->memo->count;
+	}
+}
+
+// keep top list sorted, biggest first
+static inline void top_add(StatsItem *top, PyObj *obj, ut64 size) {
+	if (size <= top[STATS_TOP - 1].size) {
+		return;
+	}
+	int i = STATS_TOP - 1;
+	while (i > 0 && top[i - 1].size < size) {
+		top[i] = top[i - 1];
+		i--;
+	}
+	top[i].offset = obj->offset;
+	top[i].size = size;
+	top[i].type = obj->type;
+}
+
+void stats_objs(PStats *st, PMState *pvm) {
+	PyObj *obj;
+	for (obj = pvm->free_obj; obj; obj = obj->next_free) {
+		if (obj->type < PY_TYPE_COUNT) {
+			st->type_count[obj->type]++;
+		}
+		st->objs++;
+		switch (obj->type) {
+		case PY_STR:
+			if (obj->py_str) {
+				top_add (st->strs, obj, strlen (obj->py_str));
+			}
+			break;
+		case PY_TUPLE:
+		case PY_LIST:
+		case PY_DICT:
+		case PY_SET:
+		case PY_FROZEN_SET:
+			top_add (st->iters, obj, r_list_length (obj->py_iter));
+			break;
+		case PY_WHAT:
+			top_add (st->iters, obj, r_list_length (obj->py_what));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static inline void class_totals(PStats *st, ut64 *count, ut64 *bytes) {
+	int i;
+	for (i = 0; i < 256; i++) {
+		PyOpClass c = py_opcode_class ((char)i);
+		count[c] += st->op_count[i];
+		bytes[c] += st->op_bytes[i];
+	}
+}
+
+static inline void dump_top(RStrBuf *sb, StatsItem *top, const char *name) {
+	int i;
+	r_strbuf_appendf (sb, "## largest %s\n", name);
+	for (i = 0; i < STATS_TOP && top[i].size; i++) {
+		r_strbuf_appendf (sb, "0x%08"PFMT64x" %-16s %10"PFMT64u"\n", top[i].offset, py_type_to_name (top[i].type), top[i].size);
+	}
+}
+
+bool stats_dump(RStrBuf *sb, PStats *st, PMState *pvm) {
+	int i;
+	r_strbuf_appendf (sb, "## pickle 0x%"PFMT64x"-0x%"PFMT64x", %"PFMT64u" bytes, %"PFMT64u" ops\n",
+		pvm->start, pvm->offset, st->bytes, st->ops);
+	r_strbuf_appendf (sb, "## time: run_pvm %"PFMT64u"us (split %"PFMT64u"us)", st->time_pvm, st->time_split);
+	if (st->printed) {
+		r_strbuf_appendf (sb, ", printer %"PFMT64u"us (%"PFMT64u" bytes out)\n", st->time_print, st->print_len);
+	} else {
+		r_strbuf_append (sb, ", printer not run (pickle.stats.printer)\n");
+	}
+	r_strbuf_appendf (sb, "## objects %"PFMT64u", memo %"PFMT64u", max stack %"PFMT64u", max mark depth %"PFMT64u"\n",
+		st->objs, st->memo_size, st->max_stack, st->max_mark);
+	r_strbuf_appendf (sb, "## allocs %"PFMT64u" (%"PFMT64u" bytes), rss %+"PFMT64d"KiB, process peak rss %"PFMT64u"KiB\n",
+		st->allocs, st->alloc_bytes, stats_rss_delta (st), stats_peak_rss ());
+
+	ut64 count[OPC_COUNT] = {0};
+	ut64 bytes[OPC_COUNT] = {0};
+	class_totals (st, count, bytes);
+	r_strbuf_appendf (sb, "## opcode classes\n");
+	for (i = 0; i < OPC_COUNT; i++) {
+		if (count[i]) {
+			r_strbuf_appendf (sb, "%-16s %10"PFMT64u" %12"PFMT64u"\n", py_opclass_to_name (i), count[i], bytes[i]);
+		}
+	}
+
+	r_strbuf_appendf (sb, "## opcodes\n");
+	for (i = 0; i < 256; i++) {
+		if (st->op_count[i]) {
+			r_strbuf_appendf (sb, "%-16s %10"PFMT64u" %12"PFMT64u"\n", py_opcode_to_name ((char)i), st->op_count[i], st->op_bytes[i]);
+		}
+	}
+
+	r_strbuf_appendf (sb, "## object types\n");
+	for (i = PY_NOT_RIGHT + 1; i < PY_TYPE_COUNT; i++) {
+		if (st->type_count[i]) {
+			r_strbuf_appendf (sb, "%-16s %10"PFMT64u"\n", py_type_to_name (i), st->type_count[i]);
+		}
+	}
+
+	dump_top (sb, st->strs, "strings");
+	dump_top (sb, st->iters, "iters");
+	return true;
+}
+
+static inline bool pj_top(PJ *pj, const char *name, StatsItem *top) {
+	int i;
+	if (!pj_ka (pj, name)) {
+		return false;
+	}
+	for (i = 0; i < STATS_TOP && top[i].size; i++) {
+		if (
+			!pj_o (pj)
+			|| !pj_kn (pj, "offset", top[i].offset)
+			|| !pj_ks (pj, "type", py_type_to_name (top[i].type))
+			|| !pj_kn (pj, "size", top[i].size)
+			|| !pj_end (pj)
+		) {
+			return false;
+		}
+	}
+	return pj_end (pj)? true: false;
+}
+
+static inline bool pj_count(PJ *pj, const char *name, ut64 count, ut64 bytes) {
+	return pj_ko (pj, name)
+		&& pj_kn (pj, "count", count)
+		&& pj_kn (pj, "bytes", bytes)
+		&& pj_end (pj);
+}
+
+bool stats_dump_json(PJ *pj, PStats *st, PMState *pvm) {
+	int i;
+	bool ret = pj_o (pj)
+		&& pj_kn (pj, "start", pvm->start)
+		&& pj_kn (pj, "end", pvm->offset)
+		&& pj_kn (pj, "bytes", st->bytes)
+		&& pj_kn (pj, "ops", st->ops)
+
+		&& pj_ko (pj, "time")
+		&& pj_kn (pj, "run_pvm", st->time_pvm)
+		&& pj_kn (pj, "split", st->time_split)
+		&& (!st->printed || pj_kn (pj, "printer", st->time_print))
+		&& pj_end (pj)
+		&& (!st->printed || pj_kn (pj, "print_len", st->print_len))
+
+		&& pj_kn (pj, "objects", st->objs)
+		&& pj_kn (pj, "memo", st->memo_size)
+		&& pj_kn (pj, "max_stack", st->max_stack)
+		&& pj_kn (pj, "max_mark", st->max_mark)
+		&& pj_kn (pj, "allocs", st->allocs)
+		&& pj_kn (pj, "alloc_bytes", st->alloc_bytes)
+		&& pj_kN (pj, "rss_delta", stats_rss_delta (st))
+		&& pj_kn (pj, "process_peak_rss", stats_peak_rss ());
+
+	if (ret) {
+		ut64 count[OPC_COUNT] = {0};
+		ut64 bytes[OPC_COUNT] = {0};
+		class_totals (st, count, bytes);
+		ret = pj_ko (pj, "classes");
+		for (i = 0; ret && i < OPC_COUNT; i++) {
+			if (count[i]) {
+				ret = pj_count (pj, py_opclass_to_name (i), count[i], bytes[i]);
+			}
+		}
+		ret = ret && pj_end (pj);
+	}
+
+	ret = ret && pj_ko (pj, "opcodes");
+	for (i = 0; ret && i < 256; i++) {
+		if (st->op_count[i]) {
+			ret = pj_count (pj, py_opcode_to_name ((char)i), st->op_count[i], st->op_bytes[i]);
+		}
+	}
+	ret = ret && pj_end (pj);
+
+	ret = ret && pj_ko (pj, "types");
+	for (i = PY_NOT_RIGHT + 1; ret && i < PY_TYPE_COUNT; i++) {
+		if (st->type_count[i]) {
+			ret = pj_kn (pj, py_type_to_name (i), st->type_count[i]);
+		}
+	}
+	ret = ret && pj_end (pj);
+
+	return ret
+		&& pj_top (pj, "strings", st->strs)
+		&& pj_top (pj, "iters", st->iters)
+		&& pj_end (pj);
+}
+
+// short summary, appended to normal pdP output when pickle.stats is set
+void stats_dump_phases(RStrBuf *sb, PStats *st) {
+	r_strbuf_appendf (sb, "## pickle.stats: run_pvm %"PFMT64u"us (add_splits %"PFMT64u"us), printer %"PFMT64u"us, "
+		"allocs %"PFMT64u" (%"PFMT64u" bytes), rss %+"PFMT64d"KiB, process peak rss %"PFMT64u"KiB\n",
+		st->time_pvm, st->time_split, st->time_print,
+		st->allocs, st->alloc_bytes, stats_rss_delta (st), stats_peak_rss ());
+}
+
+bool stats_dump_phases_json(PJ *pj, PStats *st) {
+	return pj_o (pj)
+		&& pj_kn (pj, "run_pvm", st->time_pvm)
+		&& pj_kn (pj, "add_splits", st->time_split)
+		&& pj_kn (pj, "printer", st->time_print)
+		&& pj_kn (pj, "allocs", st->allocs)
+		&& pj_kn (pj, "alloc_bytes", st->alloc_bytes)
+		&& pj_kN (pj, "rss_delta", stats_rss_delta (st))
+		&& pj_kn (pj, "process_peak_rss", stats_peak_rss ())
+		&& pj_end (pj);
+}
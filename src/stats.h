@@ -0,0 +1,55 @@
+#ifndef STATS_PICKLE
+#define STATS_PICKLE
+#include "pyobjutil.h"
+
+#define STATS_TOP 5 // how many of the largest strings/iters to remember
+
+typedef struct stats_item {
+	ut64 offset;
+	ut64 size; // string length or number of elements
+	PyType type;
+} StatsItem;
+
+struct pickle_stats {
+	ut64 op_count[256]; // indexed by opcode byte
+	ut64 op_bytes[256];
+	ut64 ops, bytes;
+
+	// micro seconds
+	ut64 time_pvm;
+	ut64 time_split; // part of time_pvm
+	ut64 time_print;
+	ut64 print_start;
+	ut64 print_len; // size of python output
+	bool printed; // pdPs only runs the printer with pickle.stats.printer
+
+	// decoder allocations
+	ut64 allocs, alloc_bytes;
+	ut64 rss_start; // RSS in KiB when stats started, 0 if unknown
+
+	ut64 type_count[PY_TYPE_COUNT];
+	ut64 objs;
+	ut64 memo_size;
+	ut64 max_stack, max_mark;
+
+	StatsItem strs[STATS_TOP];
+	StatsItem iters[STATS_TOP];
+};
+
+static inline void stats_alloc(PStats *st, ut64 size) {
+	if (st) {
+		st->allocs++;
+		st->alloc_bytes += size;
+	}
+}
+
+void stats_init(PStats *st);
+st64 stats_rss_delta(PStats *st);
+ut64 stats_peak_rss(void);
+void stats_op(PStats *st, PMState *pvm, char code, int size);
+void stats_objs(PStats *st, PMState *pvm);
+bool stats_dump(RStrBuf *sb, PStats *st, PMState *pvm);
+bool stats_dump_json(PJ *pj, PStats *st, PMState *pvm);
+void stats_dump_phases(RStrBuf *sb, PStats *st);
+bool stats_dump_phases_json(PJ *pj, PStats *st);
+#endif
@@ -0,0 +1,250 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_core.h>
+#include <r_cons.h>
+#include <r_th.h>
+#include "stream.h"
+#include "tensor.h"
+
+static inline void walk_push(RList *walk, PyObj *obj) {
+	if (obj) {
+		r_list_push (walk, obj);
+	}
+}
+
+static inline void walk_push_list(RList *walk, RList *l) {
+	RListIter *iter;
+	PyObj *obj;
+	r_list_foreach (l, iter, obj) {
+		walk_push (walk, obj);
+	}
+}
+
+// numpy payloads are hashed from the pickle bytes, which compressed input
+// only has once decompression is over
+static inline bool stream_numpy(PyObj *obj) {
+	PTensorSrc src = { .on = true };
+	PTensor t;
+	return tensor_get (&t, obj, &src) && t.kind == TENSOR_NUMPY;
+}
+
+// Objects only end up in two places through the memo, DUP or a split, all
+// of which bump refcnt. So if nothing below obj has a refcnt, obj was just
+// popped from the only place that could reach it, and the VM can't touch it
+// again. Without the pickle bytes numpy arrays are left for the end too.
+static bool stream_final(RList *walk, PyObj *obj, bool nobuf) {
+	bool ret = true;
+	walk_push (walk, obj);
+	while (ret && (obj = r_list_pop (walk))) {
+		if (obj->refcnt) {
+			ret = false;
+			break;
+		}
+		switch (obj->type) {
+		case PY_NOT_RIGHT:
+		case PY_SPLIT: // points back at a reduce that lives elsewhere
+			ret = false;
+			break;
+		case PY_WHAT: {
+			if (nobuf && stream_numpy (obj)) {
+				ret = false;
+				break;
+			}
+			RListIter *iter;
+			PyOper *pop;
+			r_list_foreach (obj->py_what, iter, pop) {
+				if (pop->op == OP_FAKE_SPLIT) {
+					ret = false;
+					break;
+				}
+				if (pop->op == OP_FAKE_INIT) {
+					walk_push (walk, pop->obj);
+				} else {
+					walk_push_list (walk, pop->stack);
+				}
+			}
+			break;
+		}
+		case PY_REDUCE:
+		case PY_INST:
+		case PY_NEWOBJ:
+			walk_push (walk, obj->reduce.glob);
+			walk_push (walk, obj->reduce.args);
+			walk_push (walk, obj->reduce.kwargs);
+			break;
+		case PY_PERSID:
+			walk_push (walk, obj->py_pid);
+			break;
+		case PY_BUFFER_RO:
+			walk_push (walk, obj->py_robuf);
+			break;
+		case PY_GLOB:
+			walk_push (walk, obj->py_glob.module);
+			walk_push (walk, obj->py_glob.name);
+			break;
+		case PY_TUPLE:
+		case PY_LIST:
+		case PY_DICT:
+		case PY_SET:
+		case PY_FROZEN_SET:
+			walk_push_list (walk, obj->py_iter);
+			break;
+		default:
+			break;
+		}
+	}
+	r_list_purge (walk);
+	return ret;
+}
+
+static RThreadFunctionRet stream_th(RThread *th) {
+	PStream *st = th->user;
+	RStrBuf *buf = r_strbuf_new ("");
+	r_th_lock_enter (st->lock);
+	while (buf && !st->failed) {
+		PyObj *obj = r_list_pop_head (st->todo);
+		if (!obj) {
+			if (st->done) {
+				break;
+			}
+			r_th_cond_wait (st->cond, st->lock);
+			continue;
+		}
+		r_th_lock_leave (st->lock);
+
+		st->nfo.sink = buf;
+		bool ok = dump_popped (&st->nfo, obj);
+
+		r_th_lock_enter (st->lock);
+		r_strbuf_append (st->ready, r_strbuf_get (buf));
+		r_strbuf_set (buf, "");
+		st->pending = true;
+		if (!ok) {
+			st->failed = true;
+		}
+	}
+	if (!buf) {
+		st->failed = true;
+	}
+	r_th_lock_leave (st->lock);
+	r_strbuf_free (buf);
+	return R_TH_STOP;
+}
+
+PStream *stream_new(RCore *core, PMState *pvm, RStrBuf *out) {
+	PStream *st = R_NEW0 (PStream);
+	if (!st) {
+		return NULL;
+	}
+	st->out = out;
+	st->todo = r_list_new ();
+	st->walk = r_list_new ();
+	st->ready = r_strbuf_new ("");
+	st->lock = r_th_lock_new (false);
+	st->cond = r_th_cond_new ();
+	limits_init (&st->limits, core->config);
+	limits_phase (&st->limits, "print");
+
+	// its own recurse token, the decoder's split analysis never reaches
+	// streamed objects
+	bool ok = st->todo && st->walk && st->ready && st->lock && st->cond
+		&& print_info_init (&st->nfo, UT64_MAX, core);
+	if (ok) {
+		if (out) {
+			st->nfo.pal = NULL;
+		}
+		st->nfo.limits = &st->limits;
+		st->nobuf = st->nfo.tensor.on && !pvm->buf;
+		// NULL while compressed input is still decompressing
+		st->nfo.tensor.buf = pvm->buf;
+		st->nfo.tensor.start = pvm->start;
+		st->nfo.tensor.size = pvm->buf_size;
+		st->nfo.tensor.zip = pvm->zip;
+		st->th = r_th_new (stream_th, st, 0);
+		ok = st->th && r_th_start (st->th);
+	}
+	if (!ok) {
+		R_LOG_ERROR ("Failed to start pickle stream, popped objects are printed at the end");
+		stream_free (st);
+		return NULL;
+	}
+	return st;
+}
+
+// takes obj if it can be printed right away, false leaves it to the caller
+bool stream_pop(PStream *st, PyObj *obj) {
+	if (!st || st->failed || !stream_final (st->walk, obj, st->nobuf)) {
+		return false;
+	}
+	r_th_lock_enter (st->lock);
+	bool ret = !st->failed && r_list_append (st->todo, obj);
+	r_th_cond_signal (st->cond);
+	r_th_lock_leave (st->lock);
+	if (ret) {
+		st->count++;
+	}
+	return ret;
+}
+
+static void stream_pass(PStream *st) {
+	RStrBuf *ready = r_strbuf_new ("");
+	if (!ready) {
+		return;
+	}
+	r_th_lock_enter (st->lock);
+	RStrBuf *tmp = st->ready;
+	st->ready = ready;
+	st->pending = false;
+	r_th_lock_leave (st->lock);
+	if (st->out) {
+		r_strbuf_append (st->out, r_strbuf_get (tmp));
+	} else {
+		r_cons_print (r_strbuf_get (tmp));
+		r_cons_flush ();
+	}
+	r_strbuf_free (tmp);
+}
+
+// pass on whatever the stream thread printed so far, cheap enough for the
+// decoder to call after every opcode
+void stream_flush(PStream *st) {
+	if (!st || ++st->tick & STREAM_TICKS || !st->pending) {
+		return;
+	}
+	ut64 now = r_time_now_mono ();
+	if (now - st->flushed >= STREAM_FLUSH_USEC) {
+		st->flushed = now;
+		stream_pass (st);
+	}
+}
+
+// wait for the stream thread, what it did not get to goes back on popstack
+void stream_finish(PStream *st, PMState *pvm) {
+	r_th_lock_enter (st->lock);
+	st->done = true;
+	r_th_cond_signal (st->cond);
+	r_th_lock_leave (st->lock);
+	r_th_wait (st->th);
+	stream_pass (st);
+
+	PyObj *obj;
+	while ((obj = r_list_pop_head (st->todo))) {
+		r_list_push (pvm->popstack, obj);
+	}
+	if (st->limits.hit && !pvm->limits.hit) {
+		pvm->limits.hit = st->limits.hit;
+		pvm->limits.hit_offset = st->limits.hit_offset;
+	}
+}
+
+void stream_free(PStream *st) {
+	if (st) {
+		r_th_free (st->th);
+		r_th_cond_free (st->cond);
+		r_th_lock_free (st->lock);
+		r_list_free (st->todo);
+		r_list_free (st->walk);
+		r_strbuf_free (st->ready);
+		print_info_clean (&st->nfo);
+		free (st);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef STREAM_PICKLE
+#define STREAM_PICKLE
+#include "dump.h"
+#include "plimits.h"
+
+#define STREAM_TICKS 0xff // stream_flush only looks for output every STREAM_TICKS + 1 calls
+#define STREAM_FLUSH_USEC 50000 // and passes it on at most this often
+
+// A popped object nothing else can reach (never memoized, DUP'ed or split)
+// can't change anymore, so it is printed by a second thread while the VM
+// keeps decoding. Only used for python output, when pickle.stream is set.
+struct pickle_stream {
+	RThread *th;
+	RThreadLock *lock;
+	RThreadCond *cond;
+	RList /*PyObj**/*todo; // waiting for the stream thread
+	RStrBuf *ready; // printed, not passed on yet
+	volatile bool pending; // ready is not empty, read without the lock
+	bool done; // no more objects coming
+	volatile bool failed; // printer stopped, later pops stay on popstack
+
+	// only touched by the stream thread
+	PrintInfo nfo;
+	PLimits limits;
+
+	// only touched by the decoder
+	RList /*PyObj**/*walk; // stream_pop work stack
+	bool nobuf; // pickle.tensor without the pickle bytes, see stream_final
+	RStrBuf *out; // where ready goes, r_cons (flushed) if NULL
+	ut32 tick;
+	ut64 flushed; // r_time_now_mono () of the last flush
+	ut64 count; // objects streamed
+};
+
+PStream *stream_new(RCore *core, PMState *pvm, RStrBuf *out);
+bool stream_pop(PStream *st, PyObj *obj);
+void stream_flush(PStream *st);
+void stream_finish(PStream *st, PMState *pvm);
+void stream_free(PStream *st);
+#endif
@@ -0,0 +1,344 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_util.h>
+#include "tensor.h"
+
+static inline PyObj *tuple_at(PyObj *tup, ut32 i) {
+	return tup && tup->type == PY_TUPLE? r_list_get_n (tup->py_iter, i): NULL;
+}
+
+static inline ut32 tuple_len(PyObj *tup) {
+	return tup && tup->type == PY_TUPLE? r_list_length (tup->py_iter): 0;
+}
+
+static inline const char *str_of(PyObj *obj) {
+	return obj && obj->type == PY_STR? obj->py_str: NULL;
+}
+
+static inline bool str_is(PyObj *obj, const char *str) {
+	return obj && obj->type == PY_STR && !strcmp (obj->py_str, str);
+}
+
+static inline bool glob_is(PyObj *glob, const char *module, const char *name) {
+	return glob && glob->type == PY_GLOB
+		&& str_is (glob->py_glob.module, module)
+		&& str_is (glob->py_glob.name, name);
+}
+
+static inline bool red_is(PyObj *red, const char *module, const char *name) {
+	return red && red->type == PY_REDUCE && glob_is (red->reduce.glob, module, name);
+}
+
+// all dims are non negative ints
+static inline bool dims_ok(PyObj *tup) {
+	if (!tup || tup->type != PY_TUPLE) {
+		return false;
+	}
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (tup->py_iter, iter, o) {
+		if (o->type != PY_INT || o->py_int < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// the PY_REDUCE a PY_WHAT started as, if all that happened to it since is
+// a single BUILD. *state gets the BUILD argument.
+static inline PyObj *what_built(PyObj *what, PyObj **state) {
+	if (!what || what->type != PY_WHAT || r_list_length (what->py_what) != 2) {
+		return NULL;
+	}
+	PyOper *init = r_list_get_n (what->py_what, 0);
+	PyOper *build = r_list_get_n (what->py_what, 1);
+	if (init->op != OP_FAKE_INIT || build->op != OP_BUILD || r_list_length (build->stack) != 1) {
+		return NULL;
+	}
+	*state = r_list_get_n (build->stack, 0);
+	return init->obj && init->obj->type == PY_REDUCE? init->obj: NULL;
+}
+
+// raw bytes of the string opcode that pushed obj
+static inline bool str_raw(PTensorSrc *src, PyObj *obj, const ut8 **data, ut64 *len) {
+	if (!src->buf || obj->offset < src->start || obj->offset - src->start >= src->size) {
+		return false;
+	}
+	ut64 at = obj->offset - src->start;
+	return py_str_raw (src->buf + at, src->size - at, data, len);
+}
+
+static inline ut64 numpy_itemsize(const char *code) {
+	// only kinds whose number is the item size
+	if (!code || !*code || !strchr ("biufcmM", *code)) {
+		return 0;
+	}
+	char *end = NULL;
+	ut64 size = strtoull (code + 1, &end, 10);
+	return end && !*end? size: 0;
+}
+
+static bool numpy_get(PTensor *t, PyObj *obj, PTensorSrc *src) {
+	PyObj *state = NULL;
+	PyObj *red = what_built (obj, &state);
+	if (!red
+		|| !(red_is (red, "numpy.core.multiarray", "_reconstruct") || red_is (red, "numpy._core.multiarray", "_reconstruct"))
+		|| tuple_len (state) != 5
+	) {
+		return false;
+	}
+	// (version, shape, dtype, is_fortran, data)
+	PyObj *shape = tuple_at (state, 1);
+	PyObj *fortran = tuple_at (state, 3);
+	PyObj *data = tuple_at (state, 4);
+	PyObj *dstate = NULL;
+	PyObj *dred = what_built (tuple_at (state, 2), &dstate);
+	if (!dims_ok (shape) || fortran->type != PY_BOOL
+		|| !red_is (dred, "numpy", "dtype")
+		|| !str_of (tuple_at (dred->reduce.args, 0))
+	) {
+		return false;
+	}
+	t->kind = TENSOR_NUMPY;
+	t->shape = shape;
+	t->fortran = fortran->py_bool;
+	t->dtype = tuple_at (dred->reduce.args, 0)->py_str;
+	t->itemsize = numpy_itemsize (t->dtype);
+	const char *order = str_of (tuple_at (dstate, 1));
+	t->order = order && strlen (order) == 1? *order: 0;
+	t->red[0] = red;
+	t->red[1] = dred;
+
+	// bytes, or _codecs.encode (str, "latin1") below protocol 3
+	if (red_is (data, "_codecs", "encode") && str_is (tuple_at (data->reduce.args, 1), "latin1")) {
+		t->red[2] = data;
+		t->latin1 = true;
+		data = tuple_at (data->reduce.args, 0);
+	}
+	if (data && data->type == PY_STR && !str_raw (src, data, &t->data, &t->data_len)) {
+		t->data = NULL;
+	}
+	return true;
+}
+
+static const struct {
+	const char *storage, *dtype;
+	ut64 itemsize;
+} torch_types[] = {
+	{ "FloatStorage", "float32", 4 },
+	{ "DoubleStorage", "float64", 8 },
+	{ "HalfStorage", "float16", 2 },
+	{ "BFloat16Storage", "bfloat16", 2 },
+	{ "LongStorage", "int64", 8 },
+	{ "IntStorage", "int32", 4 },
+	{ "ShortStorage", "int16", 2 },
+	{ "CharStorage", "int8", 1 },
+	{ "ByteStorage", "uint8", 1 },
+	{ "BoolStorage", "bool", 1 },
+	{ "ComplexFloatStorage", "complex64", 8 },
+	{ "ComplexDoubleStorage", "complex128", 16 },
+	{ "UntypedStorage", "uint8", 1 },
+};
+
+static bool torch_get(PTensor *t, PyObj *obj, PTensorSrc *src) {
+	if (!red_is (obj, "torch._utils", "_rebuild_tensor_v2")
+		&& !red_is (obj, "torch._utils", "_rebuild_tensor_v3")
+	) {
+		return false;
+	}
+	// (storage, storage_offset, size, stride, requires_grad, backward_hooks, ...)
+	PyObj *args = obj->reduce.args;
+	PyObj *storage = tuple_at (args, 0);
+	PyObj *offset = tuple_at (args, 1);
+	PyObj *grad = tuple_at (args, 4);
+	if (tuple_len (args) < 5 || storage->type != PY_PERSID
+		|| offset->type != PY_INT || offset->py_int < 0
+		|| !dims_ok (tuple_at (args, 2)) || !dims_ok (tuple_at (args, 3))
+		|| grad->type != PY_BOOL
+	) {
+		return false;
+	}
+	// BINPERSID ("storage", storage_type, key, location, numel)
+	PyObj *pid = storage->py_pid;
+	PyObj *type = tuple_at (pid, 1);
+	PyObj *numel = tuple_at (pid, 4);
+	if (tuple_len (pid) != 5 || !str_is (tuple_at (pid, 0), "storage")
+		|| type->type != PY_GLOB || !str_of (type->py_glob.name)
+		|| !str_of (tuple_at (pid, 2)) || !str_of (tuple_at (pid, 3))
+		|| numel->type != PY_INT || numel->py_int < 0
+	) {
+		return false;
+	}
+	t->kind = TENSOR_TORCH;
+	t->shape = tuple_at (args, 2);
+	t->stride = tuple_at (args, 3);
+	t->offset = offset->py_int;
+	t->grad = grad->py_bool;
+	t->key = tuple_at (pid, 2);
+	t->location = tuple_at (pid, 3);
+	t->numel = numel->py_int;
+	t->member = zip_storage (src->zip, t->key->py_str);
+	t->dtype = type->py_glob.name->py_str;
+	int i;
+	for (i = 0; i < R_ARRAY_SIZE (torch_types); i++) {
+		if (!strcmp (t->dtype, torch_types[i].storage)) {
+			t->dtype = torch_types[i].dtype;
+			t->itemsize = torch_types[i].itemsize;
+			break;
+		}
+	}
+	t->red[0] = obj;
+	PyObj *hooks = tuple_at (args, 5);
+	t->red[1] = hooks && hooks->type == PY_REDUCE? hooks: NULL;
+	return true;
+}
+
+// Is obj a numpy array or a torch tensor? Cheap unless it is one.
+bool tensor_get(PTensor *t, PyObj *obj, PTensorSrc *src) {
+	if (!src->on || (obj->type != PY_WHAT && obj->type != PY_REDUCE)) {
+		return false;
+	}
+	memset (t, 0, sizeof (*t));
+	return obj->type == PY_WHAT? numpy_get (t, obj, src): torch_get (t, obj, src);
+}
+
+// product of the dims times the item size, 0 if unknown or it overflows
+static inline ut64 dims_nbytes(PTensor *t) {
+	ut64 n = t->itemsize;
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (t->shape->py_iter, iter, o) {
+		if (o->py_int && n > UT64_MAX / o->py_int) {
+			return 0;
+		}
+		n *= o->py_int;
+	}
+	return n;
+}
+
+// FNV-1a over the payload, *nbytes is its size. Below protocol 3 numpy bytes are pickled as a
+// latin1 str, so utf-8 is decoded back into the original bytes.
+static bool tensor_hash(PTensor *t, ut64 *hash, ut64 *nbytes) {
+	ut64 h = 0xcbf29ce484222325ULL;
+	ut64 i, n = 0;
+	const ut8 *p = t->data;
+	for (i = 0; i < t->data_len; i++, n++) {
+		ut8 c = p[i];
+		if (t->latin1 && c >= 0x80) {
+			if ((c & 0xfe) != 0xc2 || i + 1 >= t->data_len) {
+				return false; // not latin1
+			}
+			c = ((c & 3) << 6) | (p[++i] & 0x3f);
+		}
+		h = (h ^ c) * 0x100000001b3ULL;
+	}
+	*hash = h;
+	*nbytes = n;
+	return true;
+}
+
+static inline bool dims_dump(RStrBuf *sb, PyObj *tup) {
+	bool ret = r_strbuf_append (sb, "(");
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (tup->py_iter, iter, o) {
+		ret = ret && r_strbuf_appendf (sb, "%s%d", iter == r_list_head (tup->py_iter)? "": ", ", o->py_int);
+	}
+	if (r_list_length (tup->py_iter) == 1) {
+		ret = ret && r_strbuf_append (sb, ",");
+	}
+	return ret && r_strbuf_append (sb, ")");
+}
+
+// `tensor_summary(kind="numpy", dtype="<f8", shape=(2, 3), ...)`
+bool tensor_dump(RStrBuf *sb, PTensor *t) {
+	bool ret;
+	if (t->kind == TENSOR_NUMPY) {
+		char order[2] = { t->order, 0 };
+		ret = r_strbuf_appendf (sb, "tensor_summary(kind=\"numpy\", dtype=\"%s%s\", shape=", order, t->dtype)
+			&& dims_dump (sb, t->shape)
+			&& r_strbuf_appendf (sb, ", fortran=%s", t->fortran? "True": "False");
+	} else {
+		ret = r_strbuf_appendf (sb, "tensor_summary(kind=\"torch\", dtype=\"%s\", shape=", t->dtype)
+			&& dims_dump (sb, t->shape)
+			&& r_strbuf_append (sb, ", stride=")
+			&& dims_dump (sb, t->stride)
+			&& r_strbuf_appendf (sb, ", offset=%"PFMT64u", storage=(\"%s\", \"%s\", %"PFMT64u"), requires_grad=%s",
+				t->offset, t->key->py_str, t->location->py_str, t->numel, t->grad? "True": "False");
+	}
+	ut64 hash, nbytes;
+	bool hashed = t->data && tensor_hash (t, &hash, &nbytes);
+	if (!hashed) {
+		nbytes = dims_nbytes (t);
+	}
+	if (ret && nbytes) {
+		ret = r_strbuf_appendf (sb, ", nbytes=%"PFMT64u, nbytes);
+	}
+	if (ret && hashed) {
+		ret = r_strbuf_appendf (sb, ", fnv1a=\"%016"PFMT64x"\"", hash);
+	}
+	if (ret && t->member) {
+		ret = r_strbuf_appendf (sb, ", member=\"%s\", member_size=%"PFMT64u, t->member->name, t->member->size);
+		if (ret && t->member->method == ZIP_STORED && t->member->data != UT64_MAX) {
+			ret = r_strbuf_appendf (sb, ", member_at=0x%"PFMT64x, t->member->data);
+		}
+	}
+	return ret && r_strbuf_append (sb, ")");
+}
+
+static inline bool dims_dump_json(PJ *pj, const char *name, PyObj *tup) {
+	bool ret = pj_ka (pj, name)? true: false;
+	RListIter *iter;
+	PyObj *o;
+	r_list_foreach (tup->py_iter, iter, o) {
+		ret = ret && pj_n (pj, o->py_int);
+	}
+	return ret && pj_end (pj);
+}
+
+// `tensor` object in place of `value`
+bool tensor_dump_json(PJ *pj, PTensor *t) {
+	bool ret = pj_ko (pj, "tensor")
+		&& pj_ks (pj, "kind", t->kind == TENSOR_NUMPY? "numpy": "torch")
+		&& pj_ks (pj, "dtype", t->dtype)
+		&& dims_dump_json (pj, "shape", t->shape);
+	if (ret && t->kind == TENSOR_NUMPY) {
+		char order[2] = { t->order, 0 };
+		if (t->order) {
+			ret = pj_ks (pj, "order", order)? true: false;
+		}
+		ret = ret && pj_kb (pj, "fortran", t->fortran);
+	} else if (ret) {
+		ret = dims_dump_json (pj, "stride", t->stride)
+			&& pj_kn (pj, "offset", t->offset)
+			&& pj_ks (pj, "storage", t->key->py_str)
+			&& pj_ks (pj, "location", t->location->py_str)
+			&& pj_kn (pj, "numel", t->numel)
+			&& pj_kb (pj, "requires_grad", t->grad);
+		if (ret && t->member) {
+			ret = zip_entry_dump_json (pj, "member", t->member);
+		}
+	}
+	ut64 hash, nbytes;
+	bool hashed = t->data && tensor_hash (t, &hash, &nbytes);
+	if (!hashed) {
+		nbytes = dims_nbytes (t);
+	}
+	if (ret && nbytes) {
+		ret = pj_kn (pj, "nbytes", nbytes)? true: false;
+	}
+	if (ret && hashed) {
+		char *h = r_str_newf ("%016"PFMT64x, hash);
+		ret = h && pj_ks (pj, "fnv1a", h);
+		free (h);
+	}
+	return ret && pj_end (pj);
+}
+
+// the payload is never printed, neither are the calls that build the tensor.
+// Mark them done so splits pointing at them don't hold up their containers.
+void tensor_resolve(PTensor *t, ut64 recurse) {
+	int i;
+	for (i = 0; i < R_ARRAY_SIZE (t->red) && t->red[i]; i++) {
+		t->red[i]->reduce.resolved = recurse;
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef TENSOR_PICKLE
+#define TENSOR_PICKLE
+#include "pyobjutil.h"
+#include "zip.h"
+
+// numpy arrays and torch tensors are printed as a one line summary, dtype,
+// shape, strides, storage and size, instead of their raw payload. Turned off
+// with pickle.tensor=false.
+typedef enum tensor_kind {
+	TENSOR_NONE = 0,
+	TENSOR_NUMPY, // numpy.core.multiarray._reconstruct + BUILD
+	TENSOR_TORCH, // torch._utils._rebuild_tensor_v2 over a BINPERSID storage
+} PTensorKind;
+
+// where the printers find the pickle bytes, see PMState.buf
+typedef struct pickle_tensor_src {
+	bool on; // pickle.tensor
+	const ut8 *buf;
+	ut64 start, size;
+	PZip *zip; // resolves torch storage keys to zip members, NULL if no zip
+} PTensorSrc;
+
+typedef struct pickle_tensor {
+	PTensorKind kind;
+	char order; // numpy byte order, '<', '>', '|' or '=', 0 if unknown
+	const char *dtype; // numpy dtype code ("f8") or torch dtype ("float32")
+	ut64 itemsize; // 0 if unknown
+	PyObj *shape, *stride; // tuples of PY_INT, stride is NULL for numpy
+	bool fortran; // numpy
+	ut64 offset; // torch storage offset, in elements
+	PyObj *key, *location; // torch storage
+	const PZipEntry *member; // where the storage is, NULL if unknown
+	ut64 numel; // torch storage elements
+	bool grad; // torch requires_grad
+	const ut8 *data; // numpy payload, NULL if not in the pickle bytes
+	ut64 data_len; // raw bytes at data
+	bool latin1; // data is utf-8 that _codecs.encode turns back into bytes
+	PyObj *red[3]; // reduces that make up the tensor, NULL terminated
+} PTensor;
+
+bool tensor_get(PTensor *t, PyObj *obj, PTensorSrc *src);
+bool tensor_dump(RStrBuf *sb, PTensor *t);
+bool tensor_dump_json(PJ *pj, PTensor *t);
+void tensor_resolve(PTensor *t, ut64 recurse);
+#endif
@@ -1,6 +1,12 @@
 # radare - LGPL - Copyright 2022 - bemodtwz
 import r2pipe
+import json
 import os
+import pickle
+import pickletools
+import re
+import sys
+import tempfile
 
 tests = [
     {
@@ -548,10 +554,13 @@ tests = [
     }
 ]
 
-def assemble_in_cache(r2, asm):
+def asm_cmd(asm):
     s = asm.replace("\n", ";").replace("    ", "").replace('"', '\\"')
     if s[0] == ';': s = s[1:]
-    r2.cmd('"wa %s"' % s)
+    return s
+
+def assemble_in_cache(r2, asm):
+    r2.cmd('"wa %s"' % asm_cmd(asm))
 
 def test_to_file(asm):
     asm_fname = "/tmp/failed_pickle.asm"
@@ -560,10 +569,118 @@ def test_to_file(asm):
         fp.write(asm)
     os.system("rasm2 -Ba pickle -f %s > %s" % (asm_fname, bin_fname))
 
+# Values for the round trip test: each is pickled, decompiled with pdP, the
+# output is run and has to give back an equal value. Mostly runs of equal
+# elements, which pdP prints as `[x] * n` or `[x for _ in range(n)]`.
+_shared = [1, 2]
+roundtrip_values = {
+    "zeros": [0] * 100,
+    "mixed": [1, 2] + [0] * 40 + [3] + [None] * 20 + [True] * 17,
+    "floats": [0.5] * 50 + [1.5],
+    "strs": ["ab"] * 30,
+    "dicts": [{"a": 1, "b": [1, 2]} for _ in range(40)],
+    "lists": [[] for _ in range(30)],
+    "aliased": [_shared] * 20,
+    "nested": [[[0] * 20 for _ in range(20)]],
+    "tuples": ((0,) * 20, (1,) + (2,) * 20, (3,) * 17 + (4, 5), ((1, 2),) * 20),
+    "one_tuples": [([1],) for _ in range(20)] + [(1,)] * 20 + [(([2],),)],
+    "short": [0] * 15,
+}
+
+def roundtrip_ok(name, value, got):
+    if got != value:
+        return False
+    if name == "aliased": # `* n` has to keep them the same object
+        return all(i is got[0] for i in got)
+    if name in ("dicts", "lists"): # and comprehensions separate objects
+        return len(set(map(id, got))) == len(got)
+    if name == "one_tuples":
+        return len(set(map(id, got[:20]))) == 20
+    return True
+
+def roundtrip(r2):
+    failed = 0
+    for name, value in roundtrip_values.items():
+        for proto in range(pickle.HIGHEST_PROTOCOL + 1):
+            for optimize in (False, True):
+                data = pickle.dumps(value, protocol=proto)
+                if optimize:
+                    data = pickletools.optimize(data)
+                r2.cmd("r %d" % len(data))
+                r2.cmd("wx %s" % data.hex())
+                src = r2.cmd("pdP")
+                what = "%s proto %d%s" % (name, proto, " optimized" if optimize else "")
+                try:
+                    env = {}
+                    # pdP ends with a `return`, so run it as a function body
+                    exec("def decompiled():\n" + "".join("\t%s\n" % l for l in src.splitlines()), env)
+                    ok = roundtrip_ok(name, value, env["decompiled"]())
+                except Exception as e:
+                    print("FAILED round trip: %s, %s" % (what, e))
+                    ok = None
+                if ok == False:
+                    print("FAILED round trip: %s" % what)
+                if not ok:
+                    print(src)
+                    failed += 1
+    if not failed:
+        print("PASSED round trip")
+    return failed
+
+# pdPo keeps its last decode. Two pickles of the same size and with the same
+# first 80 bytes, opened one after the other, must each get their own.
+def offset_reopen(r2):
+    pickles = {
+        "binint1": pickle.dumps(["x" * 80, 1, 2, 3, 4], protocol=2),
+        "binput": pickle.dumps(["x" * 80, [1], 2], protocol=2),
+    }
+    failed = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, data in pickles.items():
+            path = os.path.join(tmp, name + ".pickle")
+            with open(path, "wb") as fp:
+                fp.write(data)
+            r2.cmd("o-*")
+            r2.cmd("o %s" % path)
+            got = json.loads(r2.cmd("pdPoj 95") or "{}").get("op", {}).get("name")
+            if got != name:
+                print("FAILED offset reopen: %s got %s" % (name, got))
+                failed += 1
+        r2.cmd("o-*")
+        r2.cmd("o malloc://512")
+    if not failed:
+        print("PASSED offset reopen")
+    return failed
+
+def export_golden(r2, path):
+    # write name.pickle, name.json and name.py for the native runner in tests/
+    os.makedirs(path, exist_ok=True)
+    seen = set()
+    for i in tests:
+        name = re.sub(r"[^a-zA-Z0-9_]", "_", i["name"])
+        while name in seen:
+            name += "_"
+        seen.add(name)
+        data = bytes.fromhex(r2.cmd('"pa %s"' % asm_cmd(i["asm"])).strip())
+        r2.cmd("wx %s" % data.hex())
+        with open(os.path.join(path, name + ".pickle"), "wb") as fp:
+            fp.write(data)
+        with open(os.path.join(path, name + ".json"), "w") as fp:
+            fp.write(i["ret"])
+        with open(os.path.join(path, name + ".py"), "w") as fp:
+            fp.write(r2.cmd("pdP"))
+
 r2 = r2pipe.open("-")
 r2.cmd("e asm.arch = pickle")
 r2.cmd("e asm.bits = 8")
 #r2.cmd("e log.level = 5")
+if len(sys.argv) == 3 and sys.argv[1] == "--golden":
+    export_golden(r2, sys.argv[2])
+    sys.exit(0)
+if len(sys.argv) == 2 and sys.argv[1] == "--roundtrip":
+    sys.exit(1 if roundtrip(r2) else 0)
+if len(sys.argv) == 2 and sys.argv[1] == "--offset":
+    sys.exit(1 if offset_reopen(r2) else 0)
 for i in tests:
     assemble_in_cache(r2, i["asm"])
     x = r2.cmd("pdPmj")
@@ -577,3 +694,5 @@ for i in tests:
         print(repr(i["ret"]))
         test_to_file(i["asm"])
         break;
+roundtrip(r2)
+offset_reopen(r2)
@@ -0,0 +1,144 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+// libFuzzer/AFL entry point over the decoder and both printers.
+//
+// Besides crashes, an input fails (abort) when decoding or printing it costs
+// more than a linear budget relative to its size: wall clock time, bytes
+// allocated by the decoder and bytes of output. Build with `make fuzz`, or
+// with -DPICKLE_FUZZ_MAIN to get a plain binary that replays files given on
+// the command line (`make fuzz-regress` replays tests/fuzz_corpus).
+#include <r_core.h>
+#include "../pickle_dec.h"
+
+// budget = BASE + PER_BYTE * input size, override with -D
+#ifndef FUZZ_TIME_BASE
+#define FUZZ_TIME_BASE 100000 // usec
+#endif
+#ifndef FUZZ_TIME_PER_BYTE
+#define FUZZ_TIME_PER_BYTE 10 // sanitizers included, a clean build is ~1us per byte
+#endif
+#ifndef FUZZ_ALLOC_BASE
+#define FUZZ_ALLOC_BASE (1 << 20)
+#endif
+#ifndef FUZZ_ALLOC_PER_BYTE
+#define FUZZ_ALLOC_PER_BYTE 1024
+#endif
+#ifndef FUZZ_OUT_BASE
+#define FUZZ_OUT_BASE (1 << 20)
+#endif
+#ifndef FUZZ_OUT_PER_BYTE
+#define FUZZ_OUT_PER_BYTE 256
+#endif
+
+#define BUDGET(what, size) (FUZZ_##what##_BASE + (ut64)FUZZ_##what##_PER_BYTE * (size))
+
+static RCore *core = NULL;
+
+static ut64 json_num(const RJson *json, const char *key) {
+	const RJson *j = json? r_json_get (json, key): NULL;
+	return j && j->type == R_JSON_INTEGER? j->num.u_value: 0;
+}
+
+static void over_budget(const char *what, ut64 got, ut64 budget, size_t size) {
+	fprintf (stderr, "pickle_fuzz: %s %"PFMT64u" over budget %"PFMT64u" for %"PFMT64u" byte input\n",
+		what, got, budget, (ut64)size);
+	abort ();
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+	r_log_set_quiet (true);
+	core = r_core_new ();
+	if (!core) {
+		return 1;
+	}
+	r_config_set (core->config, "asm.arch", "pickle");
+	r_config_set_i (core->config, "asm.bits", 8);
+	r_config_set_b (core->config, "scr.color", false);
+	if (r_core_plugin_pickle_dec.init) {
+		r_core_plugin_pickle_dec.init (core, NULL);
+	}
+	r_config_set_b (core->config, "pickle.stats.printer", true);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const ut8 *data, size_t size) {
+	if (!core || !size || size > ST32_MAX) {
+		return 0;
+	}
+	r_io_close_all (core->io);
+	char *uri = r_str_newf ("malloc://%"PFMT64u, (ut64)size);
+	bool ok = uri
+		&& r_io_open_at (core->io, uri, R_PERM_RW, 0644, 0)
+		&& r_io_write_at (core->io, 0, data, size);
+	free (uri);
+	if (!ok) {
+		return 0;
+	}
+	r_core_seek (core, 0, true);
+
+	// decode + python printer, timed by the decoder itself
+	char *stats = pickle_dec_str (core, "sj");
+	RJson *json = stats? r_json_parse (stats): NULL;
+	if (json) {
+		const RJson *time = r_json_get (json, "time");
+		ut64 usec = json_num (time, "run_pvm") + json_num (time, "printer");
+		if (usec > BUDGET (TIME, size)) {
+			over_budget ("decode time (usec)", usec, BUDGET (TIME, size), size);
+		}
+		ut64 alloc = json_num (json, "alloc_bytes");
+		if (alloc > BUDGET (ALLOC, size)) {
+			over_budget ("allocation (bytes)", alloc, BUDGET (ALLOC, size), size);
+		}
+		ut64 len = json_num (json, "print_len");
+		if (len > BUDGET (OUT, size)) {
+			over_budget ("python output (bytes)", len, BUDGET (OUT, size), size);
+		}
+	}
+	r_json_free (json);
+	free (stats);
+
+	// decode + json printer
+	ut64 start = r_time_now_mono ();
+	char *out = pickle_dec_str (core, "j");
+	ut64 usec = r_time_now_mono () - start;
+	ut64 len = out? strlen (out): 0;
+	free (out);
+	if (usec > BUDGET (TIME, size)) {
+		over_budget ("json time (usec)", usec, BUDGET (TIME, size), size);
+	}
+	if (len > BUDGET (OUT, size)) {
+		over_budget ("json output (bytes)", len, BUDGET (OUT, size), size);
+	}
+
+	// globals only scan
+	start = r_time_now_mono ();
+	out = pickle_dec_str (core, "gj");
+	usec = r_time_now_mono () - start;
+	free (out);
+	if (usec > BUDGET (TIME, size)) {
+		over_budget ("globals time (usec)", usec, BUDGET (TIME, size), size);
+	}
+	return 0;
+}
+
+#ifdef PICKLE_FUZZ_MAIN
+int main(int argc, char **argv) {
+	if (LLVMFuzzerInitialize (&argc, &argv)) {
+		return 1;
+	}
+	int i;
+	for (i = 1; i < argc; i++) {
+		size_t size;
+		char *data = r_file_slurp (argv[i], &size);
+		if (!data) {
+			R_LOG_ERROR ("Failed to read %s", argv[i]);
+			return 1;
+		}
+		printf ("%s\n", argv[i]);
+		fflush (stdout);
+		LLVMFuzzerTestOneInput ((ut8 *)data, size);
+		free (data);
+	}
+	r_core_free (core);
+	return 0;
+}
+#endif
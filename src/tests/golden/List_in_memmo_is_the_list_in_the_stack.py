@@ -0,0 +1,6 @@
+## VM stack start, len 1
+## VM[0] TOP
+return [42]
+## POP stack start, len 1
+## POP[0] TOP
+lst_x2 = [42]
@@ -0,0 +1,13 @@
+## VM stack start, len 2
+## VM[1] 
+int_2_x7 = 2
+## VM[0] TOP
+return 4
+## POP stack start, len 4
+## POP[3] 
+int_1_x3 = 1
+## POP[2] 
+## POP[1] 
+int_3_xb = 3
+## POP[0] TOP
+int_4_xf = 4
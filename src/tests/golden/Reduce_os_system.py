@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_system_x2 = _find_class("os", "system", proto=2))
+return g_system_x2("whoami")
@@ -0,0 +1,3 @@
+## VM stack start, len 1
+## VM[0] TOP
+return [42, True]
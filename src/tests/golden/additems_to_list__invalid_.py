@@ -0,0 +1,7 @@
+## VM stack start, len 1
+## VM[0] TOP
+what_xa = []
+what_xa.add(1)
+what_xa.add(2)
+what_xa.add(3)
+return what_xa
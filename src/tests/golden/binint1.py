@@ -0,0 +1,5 @@
+## VM stack start, len 2
+## VM[1] 
+int_42_x2 = 42
+## VM[0] TOP
+return 43
@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+dict_x2 = {"key": dict_x2}
+return {"key": dict_x2}
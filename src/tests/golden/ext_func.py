@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+ext_x2a_x0 = _inverted_registry.get(42)
+return ext_x2a_x0()
@@ -0,0 +1,7 @@
+## VM stack start, len 1
+## VM[0] TOP
+return frozenset((
+	1, 
+	2, 
+	3
+))
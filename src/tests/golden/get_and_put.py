@@ -0,0 +1,7 @@
+## VM stack start, len 3
+## VM[2] 
+int_0_x0 = 0
+## VM[1] 
+int_42_x3 = 42
+## VM[0] TOP
+return (int_0_x0, int_42_x3)
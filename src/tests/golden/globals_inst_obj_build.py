@@ -0,0 +1,9 @@
+## VM stack start, len 2
+## VM[1] 
+g_system_x7 = _find_class("os", "system", proto=0))
+inst_x7 = g_system_x7("'id'")
+## VM[0] TOP
+g_popen_x13 = _find_class("os", "popen", proto=0))
+what_x25 = g_popen_x13("'ls'")
+what_x25.__setstate__({})
+return what_x25
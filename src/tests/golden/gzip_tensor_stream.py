@@ -0,0 +1,34 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_xe = "arr"
+what_xac = tensor_summary(kind="numpy", dtype="<f4", shape=(2, 2), fortran=False, nbytes=16, fnv1a="8faa0a18faf0fb98")
+str_xad = "same"
+str_xb6 = "u8"
+what_xfd = tensor_summary(kind="numpy", dtype="|u1", shape=(3,), fortran=True, nbytes=3, fnv1a="e71fa2190541574b")
+str_xfe = "w"
+ret_x18e = tensor_summary(kind="torch", dtype="float32", shape=(2, 3), stride=(3, 1), offset=0, storage=("0", "cpu", 6), requires_grad=False, nbytes=24)
+str_x190 = "view"
+ret_x1b8 = tensor_summary(kind="torch", dtype="float32", shape=(3,), stride=(1,), offset=3, storage=("0", "cpu", 6), requires_grad=False, nbytes=12)
+str_x1ba = "p"
+str_x102 = "torch._utils"
+str_x1c0 = "_rebuild_parameter"
+g_x1d5 = _find_class(str_x102, str_x1c0, proto=4))
+ret_x20a = tensor_summary(kind="torch", dtype="float16", shape=(2,), stride=(1,), offset=0, storage=("1", "cpu", 2), requires_grad=True, nbytes=4)
+str_x16b = "collections"
+str_x179 = "OrderedDict"
+g_OrderedDict_x187 = _find_class(str_x16b, str_x179, proto=4))
+ret_x210 = g_OrderedDict_x187()
+tup_x212 = (
+	ret_x20a, 
+	True, 
+	ret_x210
+)
+ret_x214 = g_x1d5tup_x212
+return {
+	str_xe: what_xac, 
+	str_xad: what_xac, 
+	str_xb6: what_xfd, 
+	str_xfe: ret_x18e, 
+	str_x190: ret_x1b8, 
+	str_x1ba: ret_x214
+}
@@ -0,0 +1,11 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_xc = "two"
+lst_x6 = [1, str_xc]
+str_x1c = "k"
+dict_x19 = {str_x1c: lst_x6}
+return [
+	lst_x6, 
+	lst_x6, 
+	dict_x19
+]
@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_int_x9 = _find_class("builtins", "int", proto=4))
+return g_int_x9("ff", 16)
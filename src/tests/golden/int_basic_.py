@@ -0,0 +1,12 @@
+## VM stack start, len 5
+## VM[4] 
+true_x0 = True
+## VM[3] 
+false_x4 = False
+## VM[2] 
+g_int_x8 = _find_class("builtins", "int", proto=-1))
+ret_x8 = g_int_x8("4444444444444444444444444444444444444444444444444444444", 0)
+## VM[1] 
+int_66_x41 = 66
+## VM[0] TOP
+return 1
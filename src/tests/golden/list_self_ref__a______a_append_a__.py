@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+lst_x2 = [lst_x2]
+return [lst_x2]
@@ -0,0 +1,12 @@
+## VM stack start, len 3
+## VM[2] 
+int_1_x2 = 1
+## VM[1] 
+int_2_x5 = 2
+## VM[0] TOP
+return 3
+## POP stack start, len 3
+## POP[2] 
+int_3_x8 = 3
+## POP[1] 
+## POP[0] TOP
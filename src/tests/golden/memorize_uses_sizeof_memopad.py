@@ -0,0 +1,8 @@
+## VM stack start, len 1
+## VM[0] TOP
+return 42
+## POP stack start, len 2
+## POP[1] 
+int_1_x2 = 1
+## POP[0] TOP
+int_42_x7 = 42
@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_print_x0 = _find_class("builtins", "print", proto=0))
+return g_print_x0(pickle_buffer_at(0x0))
@@ -0,0 +1,19 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_x12 = "a"
+str_x22 = "b"
+str_x26 = "c"
+str_x2a = "d"
+dict_x1f = {str_x22: str_x26, str_x2a: lst_x1d}
+lst_x1d = [dict_x1f]
+lst_x16 = [
+	0, 
+	1, 
+	lst_x1d
+]
+dict_x10 = {str_x12: lst_x16}
+return [
+	0, 
+	dict_x10, 
+	1
+]
@@ -0,0 +1,10 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_x2 = "builtins"
+str_xd = "getattr"
+g_getattr_x17 = _find_class(str_x2, str_xd, proto=4))
+ret_x2f = g_getattr_x17(_find_class("os", "system", proto=4)), "system")
+return ret_x2f("id")
+## policy policy.policy: 2 violations
+0x00000025 stack_global os.system denied by line 2
+0x00000035 reduce (indirect call) denied by line 3
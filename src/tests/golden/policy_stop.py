@@ -0,0 +1,9 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_x2 = "builtins"
+str_xd = "getattr"
+return _find_class(str_x2, str_xd, proto=4))
+Raise Exception('INCOMPLETE!!! Pickle did not completely extract, check error log')
+## stopped by pickle.policy at offset 0x25
+## policy policy.policy: 1 violations
+0x00000025 stack_global os.system denied by line 2
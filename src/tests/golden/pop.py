@@ -0,0 +1,4 @@
+## stack is empty
+## POP stack start, len 1
+## POP[0] TOP
+int_42_x2 = 42
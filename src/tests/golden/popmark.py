@@ -0,0 +1,10 @@
+## stack is empty
+## POP stack start, len 4
+## POP[3] 
+int_42_x3 = 42
+## POP[2] 
+int_43_x5 = 43
+## POP[1] 
+int_44_x7 = 44
+## POP[0] TOP
+int_45_x9 = 45
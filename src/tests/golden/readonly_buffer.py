@@ -0,0 +1,3 @@
+## VM stack start, len 1
+## VM[0] TOP
+return pickle_buffer_at(0x0).toreadonly()
@@ -0,0 +1,25 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_x6 = "m"
+lst_xe = [
+	1, 
+	2
+] + [0] * 20 + [
+	3
+] + [None] * 16
+str_x51 = "d"
+str_x60 = "a"
+lst_x59 = [{str_x60: 1} for _ in range(16)]
+str_xe4 = "t"
+tup_x10f = (
+	1,
+) + (2,) * 16
+str_x112 = "al"
+lst_x11f = [5]
+lst_x11b = [lst_x11f] * 16
+return {
+	str_x6: lst_xe, 
+	str_x51: lst_x59, 
+	str_xe4: tup_x10f, 
+	str_x112: lst_x11b
+}
@@ -0,0 +1,8 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_session_x2 = _find_class("requests.sessions", "session", proto=2))
+what_x4c = g_session_x2.__new__(g_session_x2, *())
+what_x4c["test_key"] = True
+what_x4c["test_key2"] = True
+what_x4c["test_key3"] = True
+return what_x4c
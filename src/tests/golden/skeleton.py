@@ -0,0 +1,49 @@
+## VM stack start, len 1
+## VM[0] TOP
+str_xe = "floats"
+lst_x17 = [
+	## 50 items: PY_FLOAT 50
+	0.000000, 
+	1.000000, 
+	## ... 46 more
+	48.000000, 
+	49.000000
+]
+str_x1dd = "ints"
+lst_x1e4 = [
+	0, 
+	1, 
+	2
+]
+str_x1ee = "names"
+str_x1f9 = "k0"
+str_x200 = "k1"
+str_x223 = "k6"
+str_x22a = "k7"
+dict_x1f6 = {
+	## 8 items, keys: PY_STR 8, values: PY_INT 8
+	str_x1f9: 0, 
+	str_x200: 1, 
+	## ... 4 more
+	str_x223: 6, 
+	str_x22a: 7
+}
+str_x232 = "tup"
+str_x239 = "a"
+str_x23d = "b"
+str_x245 = "d"
+str_x249 = "e"
+tup_x24d = (
+	## 5 items: PY_STR 5
+	str_x239, 
+	str_x23d, 
+	## ... 1 more
+	str_x245, 
+	str_x249
+)
+return {
+	str_xe: lst_x17, 
+	str_x1dd: lst_x1e4, 
+	str_x1ee: dict_x1f6, 
+	str_x232: tup_x24d
+}
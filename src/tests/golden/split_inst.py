@@ -0,0 +1,8 @@
+## VM stack start, len 2
+## VM[1] 
+g_print_x3 = _find_class("builtins", "print", proto=0))
+lst_x1 = []
+inst_x3 = g_print_x3(lst_x1)
+## VM[0] TOP
+lst_x1.extend([42])
+return lst_x1
@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_session_x1c = _find_class("requests.sessions", "session", proto=0))
+return g_session_x1c.__new__(g_session_x1c, *(), **{})
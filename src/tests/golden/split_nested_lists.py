@@ -0,0 +1,10 @@
+## VM stack start, len 3
+## VM[2] 
+lst_x1 = []
+lst_x0 = [lst_x1]
+## VM[1] 
+g_print_x5 = _find_class("builtins", "print", proto=0))
+ret_x18 = g_print_x5(lst_x0)
+## VM[0] TOP
+lst_x1.extend([42])
+return lst_x1
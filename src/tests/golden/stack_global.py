@@ -0,0 +1,4 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_os_xe = _find_class("system", "os", proto=4))
+return g_os_xe("whoami")
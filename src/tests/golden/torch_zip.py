@@ -0,0 +1,19 @@
+## VM stack start, len 1
+## VM[0] TOP
+g_OrderedDict_x30 = _find_class("collections", "OrderedDict", proto=2))
+str_x50 = "w"
+ret_xd3 = tensor_summary(kind="torch", dtype="float32", shape=(2, 3), stride=(3, 1), offset=0, storage=("0", "cpu", 6), requires_grad=False, nbytes=24, member="archive/data/0", member_size=24, member_at=0x1b5)
+str_xd6 = "b"
+g_xde = _find_class("torch._utils", "_rebuild_parameter", proto=2))
+ret_x142 = tensor_summary(kind="torch", dtype="float16", shape=(2,), stride=(1,), offset=0, storage=("1", "cpu", 2), requires_grad=True, nbytes=4, member="archive/data/1", member_size=4, member_at=0x1f9)
+ret_x149 = g_OrderedDict_x30()
+tup_x14c = (
+	ret_x142, 
+	True, 
+	ret_x149
+)
+ret_x14f = g_xdetup_x14c
+what_x152 = g_OrderedDict_x30()
+what_x152[str_x50] = ret_xd3
+what_x152[str_xd6] = ret_x14f
+return what_x152
@@ -0,0 +1,535 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+// Native test and perf-regression runner. Links the decoder directly, no
+// r2pipe and no r2 process per test. Cases are split over forked worker
+// processes, each with its own RCore, since r_cons is global state.
+//
+// A case is `name.pickle` in the golden directory, with optional `name.json`
+// (expected pdPj output), `name.py` (expected pdP output), `name.globals`
+// (expected pdPgj output), `name.ioc` (expected pdPij output), `name.hash`
+// (expected pdPhj output), `name.diff` (expected pdPdj output against
+// `name.other`, mapped right after the case's pickle), `name.query` (a pdPp
+// path on the first line, the expected pdPpj output after it) and
+// `name.offset` (an address, then the expected pdPoj output). Cases with none
+// of them are only timed. An optional `name.cfg` holds `key=value` lines, r2
+// config set for that case only; cases run from inside the golden directory,
+// so relative paths in it are relative to that. Per-case time budgets, in
+// micro seconds, are read from `budgets.txt` in the same directory, one
+// `name usec` per line.
+#include <r_core.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "../pickle_dec.h"
+
+#define DEFAULT_BUDGET 50000 // usec
+#define BUDGET_SLACK 4 // -u writes budgets as SLACK * measured time
+
+typedef struct test_case {
+	char *name;
+	ut8 *buf;
+	size_t len;
+	char *json; // expected, NULL to skip
+	char *py;
+	char *globals;
+	char *ioc;
+	char *hash;
+	char *diff;
+	char *query; // path, then a newline and the expected output
+	char *offset; // address, then a newline and the expected output
+	ut8 *other; // the b side of diff
+	size_t other_len;
+	char *cfg; // NULL for defaults
+	ut64 budget;
+
+	// results
+	ut64 usec; // best of all runs
+	char *err;
+	bool done; // reported back by its worker
+} TestCase;
+
+typedef struct test_run {
+	TestCase *cases;
+	int count;
+	int runs;
+	bool verbose;
+} TestRun;
+
+typedef struct worker {
+	pid_t pid;
+	int fd; // read end of the pipe it reports results on
+} Worker;
+
+// a result on the pipe, followed by errlen bytes of error message
+typedef struct case_result {
+	ut64 index, usec, errlen;
+} CaseResult;
+
+static char *slurp_ext(const char *dir, const char *name, const char *ext, size_t *len) {
+	char *path = r_str_newf ("%s/%s.%s", dir, name, ext);
+	char *ret = NULL;
+	if (path && r_file_exists (path)) {
+		ret = r_file_slurp (path, len);
+	}
+	free (path);
+	return ret;
+}
+
+static void load_budgets(TestRun *run, const char *dir) {
+	int i;
+	char *data = slurp_ext (dir, "budgets", "txt", NULL);
+	if (!data) {
+		return;
+	}
+	char *line = data;
+	while (line && *line) {
+		char *next = strchr (line, '\n');
+		if (next) {
+			*next++ = '\0';
+		}
+		char *sp = strchr (line, ' ');
+		if (*line != '#' && sp) {
+			*sp = '\0';
+			for (i = 0; i < run->count; i++) {
+				if (!strcmp (run->cases[i].name, line)) {
+					run->cases[i].budget = strtoull (sp + 1, NULL, 10);
+					break;
+				}
+			}
+		}
+		line = next;
+	}
+	free (data);
+}
+
+static bool save_budgets(TestRun *run, const char *dir) {
+	RStrBuf *sb = r_strbuf_new ("# name usec, generated by `pickle_test -u`\n");
+	int i;
+	for (i = 0; sb && i < run->count; i++) {
+		ut64 usec = R_MAX (run->cases[i].usec * BUDGET_SLACK, 1000);
+		r_strbuf_appendf (sb, "%s %"PFMT64u"\n", run->cases[i].name, usec);
+	}
+	char *path = r_str_newf ("%s/budgets.txt", dir);
+	bool ret = sb && path && r_file_dump (path, (ut8 *)r_strbuf_get (sb), r_strbuf_length (sb), false);
+	free (path);
+	r_strbuf_free (sb);
+	return ret;
+}
+
+static int case_cmp(const void *a, const void *b) {
+	return strcmp (((const TestCase *)a)->name, ((const TestCase *)b)->name);
+}
+
+static bool load_cases(TestRun *run, const char *dir) {
+	RList *files = r_sys_dir (dir);
+	if (!files) {
+		R_LOG_ERROR ("Can't open golden directory %s", dir);
+		return false;
+	}
+	run->cases = R_NEWS0 (TestCase, r_list_length (files));
+	RListIter *iter;
+	char *file;
+	r_list_foreach (files, iter, file) {
+		if (!run->cases || !r_str_endswith (file, ".pickle")) {
+			continue;
+		}
+		TestCase *tc = &run->cases[run->count];
+		tc->name = r_str_ndup (file, strlen (file) - strlen (".pickle"));
+		tc->buf = (ut8 *)slurp_ext (dir, tc->name, "pickle", &tc->len);
+		if (!tc->buf) {
+			R_LOG_ERROR ("Failed to read %s", file);
+			free (tc->name);
+			continue;
+		}
+		tc->json = slurp_ext (dir, tc->name, "json", NULL);
+		tc->py = slurp_ext (dir, tc->name, "py", NULL);
+		tc->globals = slurp_ext (dir, tc->name, "globals", NULL);
+		tc->ioc = slurp_ext (dir, tc->name, "ioc", NULL);
+		tc->hash = slurp_ext (dir, tc->name, "hash", NULL);
+		tc->diff = slurp_ext (dir, tc->name, "diff", NULL);
+		tc->query = slurp_ext (dir, tc->name, "query", NULL);
+		tc->offset = slurp_ext (dir, tc->name, "offset", NULL);
+		tc->other = tc->diff? (ut8 *)slurp_ext (dir, tc->name, "other", &tc->other_len): NULL;
+		tc->cfg = slurp_ext (dir, tc->name, "cfg", NULL);
+		run->count++;
+	}
+	r_list_free (files);
+	if (run->cases) {
+		qsort (run->cases, run->count, sizeof (TestCase), case_cmp);
+	}
+	return run->cases? true: false;
+}
+
+static void free_cases(TestRun *run) {
+	int i;
+	for (i = 0; i < run->count; i++) {
+		TestCase *tc = &run->cases[i];
+		free (tc->name);
+		free (tc->buf);
+		free (tc->json);
+		free (tc->py);
+		free (tc->globals);
+		free (tc->ioc);
+		free (tc->hash);
+		free (tc->diff);
+		free (tc->query);
+		free (tc->offset);
+		free (tc->other);
+		free (tc->cfg);
+		free (tc->err);
+	}
+	free (run->cases);
+}
+
+// map the pickle at address 0 of a fresh malloc:// file, the diff one after it
+static bool case_load(RCore *core, TestCase *tc) {
+	r_io_close_all (core->io);
+	char *uri = r_str_newf ("malloc://%"PFMT64u, (ut64)(tc->len + tc->other_len));
+	bool ret = uri
+		&& r_io_open_at (core->io, uri, R_PERM_RW, 0644, 0)
+		&& r_io_write_at (core->io, 0, tc->buf, tc->len)
+		&& (!tc->other || r_io_write_at (core->io, tc->len, tc->other, tc->other_len));
+	free (uri);
+	r_core_seek (core, 0, true);
+	return ret;
+}
+
+static inline char *mismatch(const char *what, const char *got, const char *expect, bool verbose) {
+	if (verbose) {
+		return r_str_newf ("%s mismatch\n== got ==\n%s\n== should be ==\n%s", what, got, expect);
+	}
+	return r_str_newf ("%s mismatch", what);
+}
+
+// apply the case's `key=value` lines, returns what to restore afterwards
+static RList *case_config(RCore *core, const char *cfg) {
+	RList *old = r_list_newf (free);
+	char *dup = old? strdup (cfg): NULL;
+	RList *lines = dup? r_str_split_list (dup, "\n", 0): NULL;
+	RListIter *iter;
+	char *line;
+	r_list_foreach (lines, iter, line) {
+		char *eq = strchr (line, '=');
+		if (!eq || *line == '#') {
+			continue;
+		}
+		char *key = r_str_ndup (line, eq - line);
+		if (key) {
+			r_list_append (old, r_str_newf ("%s=%s", key, r_str_get (r_config_get (core->config, key))));
+			r_config_set (core->config, key, eq + 1);
+			free (key);
+		}
+	}
+	r_list_free (lines);
+	free (dup);
+	return old;
+}
+
+static void case_config_restore(RCore *core, RList *old) {
+	RListIter *iter;
+	char *kv;
+	r_list_foreach (old, iter, kv) {
+		char *eq = strchr (kv, '=');
+		*eq = '\0';
+		r_config_set (core->config, kv, eq + 1);
+	}
+	r_list_free (old);
+}
+
+static void case_run(RCore *core, TestCase *tc, int runs, bool verbose) {
+	if (!case_load (core, tc)) {
+		tc->err = strdup ("failed to load pickle");
+		return;
+	}
+	RList *cfg = tc->cfg? case_config (core, tc->cfg): NULL;
+	int i;
+	tc->usec = UT64_MAX;
+	for (i = 0; i < runs; i++) {
+		ut64 start = r_time_now_mono ();
+		char *json = pickle_dec_str (core, "j");
+		char *py = pickle_dec_str (core, "");
+		ut64 usec = r_time_now_mono () - start;
+		tc->usec = R_MIN (tc->usec, usec);
+
+		// outputs only change with the decoder, checking the first run is enough
+		if (!i && tc->json && strcmp (tc->json, r_str_get (json))) {
+			tc->err = mismatch ("json", r_str_get (json), tc->json, verbose);
+		} else if (!i && tc->py && strcmp (tc->py, r_str_get (py))) {
+			tc->err = mismatch ("python", r_str_get (py), tc->py, verbose);
+		}
+		free (json);
+		free (py);
+	}
+	if (!tc->err && tc->globals) {
+		char *globs = pickle_dec_str (core, "gj");
+		if (strcmp (tc->globals, r_str_get (globs))) {
+			tc->err = mismatch ("globals", r_str_get (globs), tc->globals, verbose);
+		}
+		free (globs);
+	}
+	if (!tc->err && tc->ioc) {
+		char *iocs = pickle_dec_str (core, "ij");
+		if (strcmp (tc->ioc, r_str_get (iocs))) {
+			tc->err = mismatch ("ioc", r_str_get (iocs), tc->ioc, verbose);
+		}
+		free (iocs);
+	}
+	if (!tc->err && tc->hash) {
+		char *hash = pickle_dec_str (core, "hj");
+		if (strcmp (tc->hash, r_str_get (hash))) {
+			tc->err = mismatch ("hash", r_str_get (hash), tc->hash, verbose);
+		}
+		free (hash);
+	}
+	if (!tc->err && tc->diff) {
+		char *cmd = r_str_newf ("dj %"PFMT64u, (ut64)tc->len);
+		char *diff = cmd? pickle_dec_str (core, cmd): NULL;
+		if (strcmp (tc->diff, r_str_get (diff))) {
+			tc->err = mismatch ("diff", r_str_get (diff), tc->diff, verbose);
+		}
+		free (diff);
+		free (cmd);
+	}
+	char *expect = tc->query? strchr (tc->query, '\n'): NULL;
+	if (!tc->err && expect) {
+		char *cmd = r_str_newf ("pj %.*s", (int)(expect - tc->query), tc->query);
+		char *got = cmd? pickle_dec_str (core, cmd): NULL;
+		if (strcmp (expect + 1, r_str_get (got))) {
+			tc->err = mismatch ("query", r_str_get (got), expect + 1, verbose);
+		}
+		free (got);
+		free (cmd);
+	}
+	expect = tc->offset? strchr (tc->offset, '\n'): NULL;
+	if (!tc->err && expect) {
+		char *cmd = r_str_newf ("oj %.*s", (int)(expect - tc->offset), tc->offset);
+		char *got = cmd? pickle_dec_str (core, cmd): NULL;
+		if (strcmp (expect + 1, r_str_get (got))) {
+			tc->err = mismatch ("offset", r_str_get (got), expect + 1, verbose);
+		}
+		free (got);
+		free (cmd);
+	}
+	case_config_restore (core, cfg);
+	if (!tc->err && tc->usec > tc->budget) {
+		tc->err = r_str_newf ("over budget, %"PFMT64u"us > %"PFMT64u"us", tc->usec, tc->budget);
+	}
+}
+
+static RCore *core_new(void) {
+	RCore *core = r_core_new ();
+	if (core) {
+		r_config_set (core->config, "asm.arch", "pickle");
+		r_config_set_i (core->config, "asm.bits", 8);
+		r_config_set_b (core->config, "scr.color", false);
+		if (r_core_plugin_pickle_dec.init) {
+			r_core_plugin_pickle_dec.init (core, NULL);
+		}
+	}
+	return core;
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+	const ut8 *p = buf;
+	while (len) {
+		ssize_t n = write (fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len) {
+	ut8 *p = buf;
+	while (len) {
+		ssize_t n = read (fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// in the worker process, runs cases first, first + step... and writes each
+// result to fd
+static void worker_run(TestRun *run, int first, int step, int fd) {
+	RCore *core = core_new ();
+	int i;
+	for (i = first; core && i < run->count; i += step) {
+		TestCase *tc = &run->cases[i];
+		case_run (core, tc, run->runs, run->verbose);
+		CaseResult res = { i, tc->usec, tc->err? strlen (tc->err): 0 };
+		if (!write_all (fd, &res, sizeof (res)) || !write_all (fd, tc->err, res.errlen)) {
+			break;
+		}
+	}
+	r_core_free (core);
+}
+
+static void worker_collect(TestRun *run, Worker *w) {
+	CaseResult res;
+	while (read_all (w->fd, &res, sizeof (res)) && res.index < (ut64)run->count) {
+		TestCase *tc = &run->cases[res.index];
+		char *err = res.errlen? malloc (res.errlen + 1): NULL;
+		if (res.errlen && (!err || !read_all (w->fd, err, res.errlen))) {
+			free (err);
+			break;
+		}
+		if (err) {
+			err[res.errlen] = '\0';
+		}
+		tc->usec = res.usec;
+		tc->err = err;
+		tc->done = true;
+	}
+	close (w->fd);
+}
+
+// one process per worker, a crashing case only loses the cases of its worker
+static bool run_parallel(TestRun *run, int nworkers) {
+	Worker *workers = R_NEWS0 (Worker, nworkers);
+	if (!workers) {
+		return false;
+	}
+	fflush (stdout);
+	fflush (stderr);
+	bool ret = true;
+	int i, started = 0;
+	for (i = 0; i < nworkers; i++) {
+		int fds[2];
+		if (pipe (fds)) {
+			ret = false;
+			break;
+		}
+		pid_t pid = fork ();
+		if (pid < 0) {
+			close (fds[0]);
+			close (fds[1]);
+			ret = false;
+			break;
+		}
+		if (!pid) {
+			close (fds[0]);
+			worker_run (run, i, nworkers, fds[1]);
+			close (fds[1]);
+			_exit (0);
+		}
+		close (fds[1]);
+		workers[i].pid = pid;
+		workers[i].fd = fds[0];
+		started++;
+	}
+	for (i = 0; i < started; i++) {
+		worker_collect (run, &workers[i]);
+		int status = 0;
+		waitpid (workers[i].pid, &status, 0);
+		int j;
+		for (j = i; ret && j < run->count; j += nworkers) {
+			TestCase *tc = &run->cases[j];
+			if (!tc->done) {
+				tc->err = WIFSIGNALED (status)
+					? r_str_newf ("not run, worker died of signal %d", WTERMSIG (status))
+					: strdup ("not run, worker stopped early");
+			}
+		}
+	}
+	free (workers);
+	return ret;
+}
+
+static int report(TestRun *run) {
+	int i, failed = 0;
+	ut64 total = 0;
+	for (i = 0; i < run->count; i++) {
+		TestCase *tc = &run->cases[i];
+		total += tc->usec;
+		if (tc->err) {
+			failed++;
+			printf ("FAILED %-32s %10"PFMT64u"us: %s\n", tc->name, tc->usec, tc->err);
+		} else if (run->verbose) {
+			printf ("PASSED %-32s %10"PFMT64u"us / %"PFMT64u"us\n", tc->name, tc->usec, tc->budget);
+		}
+	}
+	printf ("%d passed, %d failed, %"PFMT64u"us decoding\n", run->count - failed, failed, total);
+	return failed;
+}
+
+static void usage(const char *argv0) {
+	printf ("Usage: %s [-j workers] [-r runs] [-b usec] [-u] [-v] [golden_dir]\n"
+		" -j  worker processes, default is one per cpu\n"
+		" -r  decode every case N times, keep the best time (default 1)\n"
+		" -b  default time budget for cases missing from budgets.txt (default %d)\n"
+		" -u  rewrite budgets.txt from measured times\n"
+		" -v  show passing cases and full output on mismatch\n", argv0, DEFAULT_BUDGET);
+}
+
+int main(int argc, char **argv) {
+	TestRun run = {0};
+	int nworkers = (int)sysconf (_SC_NPROCESSORS_ONLN);
+	ut64 budget = DEFAULT_BUDGET;
+	bool update = false;
+	run.runs = 1;
+
+	int c;
+	while ((c = getopt (argc, argv, "j:r:b:uvh")) != -1) {
+		switch (c) {
+		case 'j':
+			nworkers = atoi (optarg);
+			break;
+		case 'r':
+			run.runs = atoi (optarg);
+			break;
+		case 'b':
+			budget = strtoull (optarg, NULL, 10);
+			break;
+		case 'u':
+			update = true;
+			break;
+		case 'v':
+			run.verbose = true;
+			break;
+		default:
+			usage (argv[0]);
+			return c == 'h'? 0: 1;
+		}
+	}
+	const char *dir = optind < argc? argv[optind]: "tests/golden";
+	if (chdir (dir)) {
+		R_LOG_ERROR ("Can't open golden directory %s", dir);
+		return 1;
+	}
+	dir = ".";
+	nworkers = R_MAX (nworkers, 1);
+	run.runs = R_MAX (run.runs, 1);
+
+	if (!load_cases (&run, dir)) {
+		return 1;
+	}
+	int i;
+	for (i = 0; i < run.count; i++) {
+		run.cases[i].budget = update? UT64_MAX: budget;
+	}
+	if (!update) {
+		load_budgets (&run, dir);
+	}
+	int ret = 1;
+	if (run_parallel (&run, R_MIN (nworkers, R_MAX (run.count, 1)))) {
+		ret = report (&run)? 1: 0;
+		if (update && !save_budgets (&run, dir)) {
+			R_LOG_ERROR ("Failed to write budgets");
+			ret = 1;
+		}
+	}
+	free_cases (&run);
+	return ret;
+}
@@ -0,0 +1,261 @@
+/* radare - LGPL - Copyright 2022 - bemodtwz */
+#include <r_core.h>
+#include "zip.h"
+
+#define ZIP_EOCD_LEN 22
+#define ZIP_EOCD64_LEN 56
+#define ZIP_LOCATOR_LEN 20
+#define ZIP_CDIR_LEN 46
+#define ZIP_LOCAL_LEN 30
+#define ZIP_COMMENT_MAX 0xffff
+
+bool zip_is(RIO *io, ut64 at) {
+	ut8 sig[4];
+	return r_io_size (io) > at + ZIP_LOCAL_LEN
+		&& r_io_read_at (io, at, sig, sizeof (sig))
+		&& !memcmp (sig, "PK\x03\x04", 4);
+}
+
+static inline ut8 *zip_io_read(RIO *io, ut64 at, ut64 len) {
+	if (len >= ST32_MAX || at + len > r_io_size (io)) {
+		return NULL;
+	}
+	ut8 *buf = malloc (len? len: 1);
+	if (buf && !r_io_read_at (io, at, buf, len)) {
+		R_FREE (buf);
+	}
+	return buf;
+}
+
+// end of central directory, zip64 when any of its fields overflowed
+static bool zip_eocd(PZip *z, RIO *io, ut64 *cd_off, ut64 *cd_size, ut64 *count) {
+	ut64 size = r_io_size (io);
+	ut64 tail = R_MIN (size - z->base, ZIP_EOCD_LEN + ZIP_COMMENT_MAX);
+	ut8 *buf = zip_io_read (io, size - tail, tail);
+	if (!buf) {
+		return false;
+	}
+	st64 i;
+	for (i = tail - ZIP_EOCD_LEN; i >= 0 && memcmp (buf + i, "PK\x05\x06", 4); i--) {
+		// search backwards, the comment could hold a signature too
+	}
+	bool ret = false;
+	if (i >= 0) {
+		ut8 *e = buf + i;
+		*count = r_read_le16 (e + 10);
+		*cd_size = r_read_le32 (e + 12);
+		*cd_off = r_read_le32 (e + 16);
+		ret = true;
+		if ((*count == 0xffff || *cd_size == UT32_MAX || *cd_off == UT32_MAX) && i >= ZIP_LOCATOR_LEN) {
+			ut8 *loc = e - ZIP_LOCATOR_LEN;
+			ut8 *e64 = NULL;
+			ret = !memcmp (loc, "PK\x06\x07", 4)
+				&& (e64 = zip_io_read (io, z->base + r_read_le64 (loc + 8), ZIP_EOCD64_LEN))
+				&& !memcmp (e64, "PK\x06\x06", 4);
+			if (ret) {
+				*count = r_read_le64 (e64 + 32);
+				*cd_size = r_read_le64 (e64 + 40);
+				*cd_off = r_read_le64 (e64 + 48);
+			}
+			free (e64);
+		}
+	}
+	free (buf);
+	return ret;
+}
+
+// zip64 extra field, holds whichever of the sizes and offset overflowed
+static void zip_extra64(PZipEntry *e, const ut8 *x, ut64 len) {
+	while (len >= 4) {
+		ut16 id = r_read_le16 (x);
+		ut16 n = r_read_le16 (x + 2);
+		if (n > len - 4) {
+			return;
+		}
+		if (id == 1) {
+			const ut8 *p = x + 4;
+			const ut8 *end = p + n;
+			if (e->size == UT32_MAX && p + 8 <= end) {
+				e->size = r_read_le64 (p);
+				p += 8;
+			}
+			if (e->csize == UT32_MAX && p + 8 <= end) {
+				e->csize = r_read_le64 (p);
+				p += 8;
+			}
+			if (e->hdr == UT32_MAX && p + 8 <= end) {
+				e->hdr = r_read_le64 (p);
+			}
+			return;
+		}
+		x += 4 + n;
+		len -= 4 + n;
+	}
+}
+
+// member data starts after the local header, whose extra field is not the
+// one from the central directory (torch pads it to align the data)
+static inline ut64 zip_data_at(PZip *z, RIO *io, PZipEntry *e) {
+	ut8 hdr[ZIP_LOCAL_LEN];
+	ut64 at = z->base + e->hdr;
+	if (at + ZIP_LOCAL_LEN > r_io_size (io) || !r_io_read_at (io, at, hdr, sizeof (hdr))
+		|| memcmp (hdr, "PK\x03\x04", 4)
+	) {
+		return UT64_MAX;
+	}
+	at += ZIP_LOCAL_LEN + r_read_le16 (hdr + 26) + r_read_le16 (hdr + 28);
+	return at + e->csize <= r_io_size (io)? at: UT64_MAX;
+}
+
+static bool zip_cdir(PZip *z, RIO *io, ut64 cd_off, ut64 cd_size, ut64 count) {
+	ut8 *buf = zip_io_read (io, z->base + cd_off, cd_size);
+	if (!buf || count > cd_size / ZIP_CDIR_LEN) {
+		free (buf);
+		return false;
+	}
+	z->entries = R_NEWS0 (PZipEntry, count? count: 1);
+	ut8 *p = buf;
+	ut64 left = cd_size;
+	while (z->entries && z->count < count && left >= ZIP_CDIR_LEN && !memcmp (p, "PK\x01\x02", 4)) {
+		ut64 nlen = r_read_le16 (p + 28);
+		ut64 xlen = r_read_le16 (p + 30);
+		ut64 clen = r_read_le16 (p + 32);
+		ut64 len = ZIP_CDIR_LEN + nlen + xlen + clen;
+		if (len > left) {
+			break;
+		}
+		PZipEntry *e = &z->entries[z->count];
+		e->method = r_read_le16 (p + 10);
+		e->csize = r_read_le32 (p + 20);
+		e->size = r_read_le32 (p + 24);
+		e->hdr = r_read_le32 (p + 42);
+		e->name = r_str_ndup ((const char *)p + ZIP_CDIR_LEN, nlen);
+		if (!e->name) {
+			break;
+		}
+		zip_extra64 (e, p + ZIP_CDIR_LEN + nlen, xlen);
+		e->data = zip_data_at (z, io, e);
+		z->count++;
+		p += len;
+		left -= len;
+	}
+	free (buf);
+	return z->entries && z->count == count;
+}
+
+static inline bool name_is(const char *name, const char *member) {
+	size_t n = strlen (name);
+	size_t m = strlen (member);
+	return n >= m && !strcmp (name + n - m, member) && (n == m || name[n - m - 1] == '/');
+}
+
+// first entry named `member` (`data.pkl` matches `archive/data.pkl`)
+PZip *zip_open(RIO *io, ut64 at, const char *member) {
+	PZip *z = R_NEW0 (PZip);
+	if (!z) {
+		return NULL;
+	}
+	z->base = at;
+	ut64 cd_off, cd_size, count;
+	if (!zip_eocd (z, io, &cd_off, &cd_size, &count) || !zip_cdir (z, io, cd_off, cd_size, count)) {
+		R_LOG_ERROR ("Bad zip central directory at 0x%"PFMT64x, at);
+		zip_free (z);
+		return NULL;
+	}
+	ut32 i;
+	for (i = 0; i < z->count && !z->pkl; i++) {
+		if (name_is (z->entries[i].name, member)) {
+			z->pkl = &z->entries[i];
+		}
+	}
+	if (!z->pkl) {
+		R_LOG_ERROR ("No `%s` in zip, set pickle.zip.member", member);
+		zip_free (z);
+		return NULL;
+	}
+	z->dir = r_str_ndup (z->pkl->name, strlen (z->pkl->name) - strlen (member));
+	if (!z->dir) {
+		zip_free (z);
+		return NULL;
+	}
+	return z;
+}
+
+// member contents, inflated if need be
+ut8 *zip_read(PZip *z, RIO *io, const PZipEntry *e, ut64 *size) {
+	if (e->data == UT64_MAX) {
+		R_LOG_ERROR ("Bad local header for zip member `%s`", e->name);
+		return NULL;
+	}
+	ut8 *cbuf = zip_io_read (io, e->data, e->csize);
+	if (!cbuf || e->method == ZIP_STORED) {
+		*size = cbuf? e->csize: 0;
+		return cbuf;
+	}
+	ut8 *buf = NULL;
+	int len = 0;
+	if (e->method == ZIP_DEFLATE) {
+		buf = r_inflate_raw (cbuf, e->csize, NULL, &len);
+	} else {
+		R_LOG_ERROR ("Zip member `%s` uses unsupported compression method %d", e->name, e->method);
+	}
+	free (cbuf);
+	if (buf && len != e->size) {
+		R_LOG_WARN ("Zip member `%s` inflated to %d bytes, central directory says %"PFMT64u, e->name, len, e->size);
+	}
+	*size = buf? len: 0;
+	return buf;
+}
+
+// `<dir>/data/<key>`, where torch keeps a storage
+const PZipEntry *zip_storage(PZip *z, const char *key) {
+	if (!z) {
+		return NULL;
+	}
+	char *name = r_str_newf ("%sdata/%s", z->dir, key);
+	const PZipEntry *ret = NULL;
+	ut32 i;
+	for (i = 0; name && i < z->count && !ret; i++) {
+		if (!strcmp (z->entries[i].name, name)) {
+			ret = &z->entries[i];
+		}
+	}
+	free (name);
+	return ret;
+}
+
+// pid is the tuple of a torch BINPERSID, ("storage", type, key, location, numel)
+const PZipEntry *zip_persid(PZip *z, PyObj *pid) {
+	if (!z || pid->type != PY_TUPLE || r_list_length (pid->py_iter) != 5) {
+		return NULL;
+	}
+	PyObj *tag = r_list_get_n (pid->py_iter, 0);
+	PyObj *key = r_list_get_n (pid->py_iter, 2);
+	if (tag->type != PY_STR || strcmp (tag->py_str, "storage") || key->type != PY_STR) {
+		return NULL;
+	}
+	return zip_storage (z, key->py_str);
+}
+
+// {"name", "size", "offset"}, offset only for stored members
+bool zip_entry_dump_json(PJ *pj, const char *name, const PZipEntry *e) {
+	bool ret = pj_ko (pj, name)
+		&& pj_ks (pj, "name", e->name)
+		&& pj_kn (pj, "size", e->size);
+	if (ret && e->method == ZIP_STORED && e->data != UT64_MAX) {
+		ret = pj_kn (pj, "offset", e->data)? true: false;
+	}
+	return ret && pj_end (pj);
+}
+
+void zip_free(PZip *z) {
+	if (z) {
+		ut32 i;
+		for (i = 0; i < z->count; i++) {
+			free (z->entries[i].name);
+		}
+		free (z->entries);
+		free (z->dir);
+		free (z);
+	}
+}
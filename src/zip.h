@@ -0,0 +1,35 @@
+#ifndef ZIP_PICKLE
+#define ZIP_PICKLE
+#include "pyobjutil.h"
+
+// Torch checkpoints (.pt, .pth) are zip archives. The pickle is
+// `<dir>/data.pkl` and tensor storages are `<dir>/data/<key>`. Only the
+// central directory, the local headers and the pickle member are read,
+// nothing is extracted to disk.
+#define ZIP_STORED 0
+#define ZIP_DEFLATE 8
+
+typedef struct pickle_zip_entry {
+	char *name;
+	ut16 method; // ZIP_STORED or ZIP_DEFLATE, others can't be read
+	ut64 size, csize; // uncompressed and compressed
+	ut64 hdr; // file offset of the local header
+	ut64 data; // file offset of the member data, UT64_MAX if unknown
+} PZipEntry;
+
+struct pickle_zip {
+	ut64 base; // file offset of the archive
+	PZipEntry *entries;
+	ut32 count;
+	const PZipEntry *pkl; // member being decompiled
+	char *dir; // where pkl is, "archive/" for torch
+};
+
+bool zip_is(RIO *io, ut64 at);
+PZip *zip_open(RIO *io, ut64 at, const char *member);
+ut8 *zip_read(PZip *z, RIO *io, const PZipEntry *e, ut64 *size);
+const PZipEntry *zip_storage(PZip *z, const char *key);
+const PZipEntry *zip_persid(PZip *z, PyObj *pid);
+bool zip_entry_dump_json(PJ *pj, const char *name, const PZipEntry *e);
+void zip_free(PZip *z);
+#endif